@@ -0,0 +1,157 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "Benchmarks.h"
+#import "BenchmarkSupport.h"
+
+#import "ComparisonRipper.h"
+#import "ImageDrive.h"
+
+#define ADAPTIVE_BENCHMARK_TRACKS		10
+
+// Rips disc images whose damage reads better slowly, with the drive's speed and read size adapted
+// to the errors and with every read made at full speed, on a drive throttled to a real read rate
+int
+AdaptiveReadBenchmark(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool				= [[NSAutoreleasePool alloc] init];
+	double					minutes				= (0 < argc ? strtod(argv[0], NULL) : 5);
+	double					readRate			= (1 < argc ? strtod(argv[1], NULL) : 48 * 75);
+	NSString				*directory			= NSTemporaryDirectory();
+	NSString				*imageFilename		= [directory stringByAppendingPathComponent:@"MaxAdaptiveBenchmark.cdda"];
+	NSString				*ripFilename		= [directory stringByAppendingPathComponent:@"MaxAdaptiveBenchmark.caf"];
+	NSString				*profileFilename	= nil;
+	NSArray					*profiles			= nil;
+	NSDictionary			*profile			= nil;
+	NSArray					*sectors			= nil;
+	ComparisonRipper		*ripper				= nil;
+	ImageDrive				*drive				= nil;
+	BenchmarkRipperTask		*task				= nil;
+	NSException				*exception			= nil;
+	NSUInteger				sectorCount;
+	NSInteger				mismatches;
+	double					startTime, startCPUTime, elapsed, cpuTime, fixedElapsed;
+	unsigned				adaptive;
+	int						status				= 0;
+	
+	if(0 >= minutes)
+		minutes = 5;
+	if(0 >= readRate)
+		readRate = 48 * 75;
+	
+	sectorCount = (NSUInteger)(minutes * 60 * 75);
+	
+	// A clean disc, where adapting should cost nothing, then a single scratch and scattered
+	// blemishes, which read cleanly at 1x
+	profiles = [NSArray arrayWithObjects:
+		[NSDictionary dictionaryWithObjectsAndKeys:@"clean", @"name", [NSArray array], @"errors", nil],
+		[NSDictionary dictionaryWithObjectsAndKeys:@"scratched", @"name",
+			[NSArray arrayWithObject:[NSDictionary dictionaryWithObjectsAndKeys:
+				[NSNumber numberWithUnsignedInteger:(sectorCount / 2)],						@"firstSector",
+				[NSNumber numberWithUnsignedInteger:(sectorCount / 2 + sectorCount / 50)],	@"lastSector",
+				[NSNumber numberWithDouble:0.0005],											@"errorRate",
+				[NSNumber numberWithDouble:0],												@"minimumSpeedErrorRate",
+				nil]], @"errors",
+			nil],
+		[NSDictionary dictionaryWithObjectsAndKeys:@"blemished", @"name",
+			[NSArray arrayWithObjects:
+				[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:(sectorCount / 8)], @"firstSector", [NSNumber numberWithUnsignedInteger:(sectorCount / 8 + 75)], @"lastSector", [NSNumber numberWithDouble:0.0002], @"errorRate", [NSNumber numberWithDouble:0], @"minimumSpeedErrorRate", nil],
+				[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:(sectorCount / 3)], @"firstSector", [NSNumber numberWithUnsignedInteger:(sectorCount / 3 + 75)], @"lastSector", [NSNumber numberWithDouble:0.0002], @"errorRate", [NSNumber numberWithDouble:0], @"minimumSpeedErrorRate", nil],
+				[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:(3 * sectorCount / 4)], @"firstSector", [NSNumber numberWithUnsignedInteger:(3 * sectorCount / 4 + 75)], @"lastSector", [NSNumber numberWithDouble:0.0002], @"errorRate", [NSNumber numberWithDouble:0], @"minimumSpeedErrorRate", nil],
+				nil], @"errors",
+			nil],
+		nil];
+	
+	if(NO == BenchmarkWriteDiscImage(imageFilename, minutes)) {
+		fprintf(stderr, "Unable to write the disc image to %s\n", [imageFilename fileSystemRepresentation]);
+		[pool release];
+		return 1;
+	}
+	
+	BenchmarkOverrideDefaults([NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithInt:2],			@"comparisonRipperRequiredMatches",
+		[NSNumber numberWithInt:50],		@"comparisonRipperMaximumRetries",
+		[NSNumber numberWithBool:YES],		@"comparisonRipperUseHashes",
+		[NSNumber numberWithBool:YES],		@"comparisonRipperUseC2",
+		[NSNumber numberWithInt:0],			@"comparisonRipperDriveOffset",
+		[NSNumber numberWithBool:NO],		@"comparisonRipperUseAccurateRip",
+		nil]);
+	
+	printf("Ripping %.0f minutes with ComparisonRipper, reading at most %.0f sectors/s at full speed\n", minutes, readRate);
+	printf("%-10s %-9s %9s %9s %9s %12s %10s %9s\n", "drive", "reads", "seconds", "commands", "reads", "cpu/sector", "bad", "speedup");
+	
+	for(profile in profiles) {
+		NSAutoreleasePool		*profilePool		= [[NSAutoreleasePool alloc] init];
+		
+		profileFilename		= BenchmarkWriteDriveProfile([directory stringByAppendingPathComponent:@"MaxAdaptiveBenchmark.plist"], imageFilename, ADAPTIVE_BENCHMARK_TRACKS,
+														 [NSDictionary dictionaryWithObjectsAndKeys:[profile objectForKey:@"errors"], @"errors", [NSNumber numberWithDouble:readRate], @"readRate", nil]);
+		sectors				= BenchmarkTrackSectorRanges(profileFilename);
+		fixedElapsed		= 0;
+		
+		// Fixed first, so the adaptive run can be compared with it
+		for(adaptive = 0; adaptive < 2; ++adaptive) {
+			ripper		= [[ComparisonRipper alloc] initWithSectors:sectors deviceName:profileFilename];
+			task		= [BenchmarkRipperTask task];
+			
+			[ripper setUseAdaptiveReads:(BOOL)adaptive];
+			
+			startTime		= BenchmarkSeconds();
+			startCPUTime	= BenchmarkCPUSeconds();
+			
+			exception		= [task ripWithRipper:ripper toFile:ripFilename];
+			
+			elapsed			= BenchmarkSeconds() - startTime;
+			cpuTime			= BenchmarkCPUSeconds() - startCPUTime;
+			
+			// The ripper keeps its drive to itself; its counters survive closing the device
+			drive			= [ripper valueForKey:@"drive"];
+			
+			if(nil != exception) {
+				fprintf(stderr, "The %s rip of the %s drive failed: %s\n", (adaptive ? "adaptive" : "fixed"), [[profile objectForKey:@"name"] UTF8String], [[exception reason] UTF8String]);
+				status = 1;
+			}
+			else {
+				mismatches = BenchmarkCountMismatchedSectors(ripFilename, imageFilename, 0, sectorCount);
+				
+				if(0 == adaptive)
+					fixedElapsed = elapsed;
+				
+				printf("%-10s %-9s %9.2f %9lu %8.2fx %9.2f us %10ld %8.2fx\n",
+					   [[profile objectForKey:@"name"] UTF8String], (adaptive ? "adaptive" : "fixed"), elapsed,
+					   (unsigned long)[drive readCommandCount], (double)[drive sectorReadCount] / sectorCount,
+					   1e6 * cpuTime / sectorCount, (long)mismatches, (0 < fixedElapsed ? fixedElapsed / elapsed : 1.0));
+				
+				// Both must produce the disc exactly, since every error clears up at low speed
+				if(0 != mismatches)
+					status = 1;
+			}
+			
+			[ripper release];
+			[[NSFileManager defaultManager] removeItemAtPath:ripFilename error:nil];
+		}
+		
+		[[NSFileManager defaultManager] removeItemAtPath:profileFilename error:nil];
+		[profilePool release];
+	}
+	
+	[[NSFileManager defaultManager] removeItemAtPath:imageFilename error:nil];
+	
+	[pool release];
+	
+	return status;
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#import "EncoderTaskMethods.h"
+#import "RipperTaskMethods.h"
+
+@class Ripper;
+
+// Helpers for the benchmarks that drive the application's own classes
+
+// Stands in for the task that owns an encoder or ripper, so it can be run to completion
+// on the calling thread
+@interface BenchmarkTask : NSObject <TaskMethods>
+{
+	TaskInfo		*_taskInfo;
+	NSException		*_exception;
+	NSDate			*_startTime;
+	NSDate			*_endTime;
+	BOOL			_started;
+	BOOL			_completed;
+	BOOL			_stopped;
+}
+
+// Clears the results of the last run
+- (void)			reset;
+
+// The exception the last run ended with, or one noting that it never completed
+- (NSException *)	result;
+
+@end
+
+@interface BenchmarkEncoderTask : BenchmarkTask <EncoderTaskMethods>
+{
+	NSDictionary	*_encoderSettings;
+}
+
++ (BenchmarkEncoderTask *) taskWithInputFilename:(NSString *)filename encoderSettings:(NSDictionary *)encoderSettings;
+
+// Runs a new encoderClass encoder and returns its exception, if any
+- (NSException *)	encodeWithClass:(Class)encoderClass toFile:(NSString *)filename;
+
+@end
+
+@interface BenchmarkRipperTask : BenchmarkTask <RipperTaskMethods>
+{
+	NSString		*_phase;
+}
+
++ (BenchmarkRipperTask *) task;
+
+// Runs ripper, which the caller has configured, and returns its exception, if any
+- (NSException *)	ripWithRipper:(Ripper *)ripper toFile:(NSString *)filename;
+
+@end
+
+// Settings matching the defaults of the FLAC settings sheet (compression level 5)
+NSDictionary *	BenchmarkFLACEncoderSettings(void);
+
+// Writes seconds of a deterministic signal, tones over low-level noise, as big-endian PCM in a CAF file
+BOOL			BenchmarkWriteTestSignal(NSString *filename, double seconds, unsigned channels, unsigned bitsPerChannel);
+
+// Writes minutes of the same signal as raw little-endian CD-DA, the layout ImageDrive reads
+BOOL			BenchmarkWriteDiscImage(NSString *filename, double minutes);
+
+// Writes an ImageDrive profile for the image, split into trackCount equal tracks, with the given
+// entries (errors, cacheSize, readRate and so on) added; returns the profile's path, or nil
+NSString *		BenchmarkWriteDriveProfile(NSString *filename, NSString *imageFilename, NSUInteger trackCount, NSDictionary *entries);
+
+// The sectors of each track in an ImageDrive profile, as the rippers are given them
+NSArray *		BenchmarkTrackSectorRanges(NSString *profileFilename);
+
+// Compares the audio in a ripped CAF file with the sectors of the image it was ripped from,
+// returning the number of sectors that differ, or -1 if either file could not be read
+NSInteger		BenchmarkCountMismatchedSectors(NSString *ripFilename, NSString *imageFilename, NSUInteger firstSector, NSUInteger sectorCount);
+
+// Replaces the user's defaults for the given keys until the process exits, without saving them
+void			BenchmarkOverrideDefaults(NSDictionary *defaults);
+
+// Counts the memory allocations made by the calling thread between the two calls
+void			BenchmarkBeginCountingAllocations(void);
+uint64_t		BenchmarkEndCountingAllocations(void);
@@ -0,0 +1,464 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "BenchmarkSupport.h"
+
+#import "AudioMetadata.h"
+#import "Encoder.h"
+#import "Ripper.h"
+#import "SectorRange.h"
+#import "TaskInfo.h"
+#import "TaskStatus.h"
+
+#include <AudioToolbox/AudioFile.h>
+#include <IOKit/storage/IOCDTypes.h>
+#include <libkern/OSByteOrder.h>
+#include <pthread.h>
+
+// libmalloc reports every allocation to this hook, which is how malloc stack logging works
+typedef void (BenchmarkMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t skipFrames);
+extern BenchmarkMallocLogger *malloc_logger;
+
+#define BENCHMARK_MALLOC_LOG_ALLOCATE		2
+
+static pthread_t				sCountingThread		= NULL;
+static uint64_t					sAllocationCount	= 0;
+static BenchmarkMallocLogger	*sPreviousLogger	= NULL;
+
+// Called from inside malloc, so this must not allocate
+static void
+CountAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t skipFrames)
+{
+	if((BENCHMARK_MALLOC_LOG_ALLOCATE & type) && pthread_equal(pthread_self(), sCountingThread))
+		++sAllocationCount;
+	
+	if(NULL != sPreviousLogger)
+		sPreviousLogger(type, arg1, arg2, arg3, result, skipFrames + 1);
+}
+
+// A chord whose notes differ between the channels, at about -10 dBFS, with noise 60 dB down
+static int32_t
+TestSignalSample(SInt64 frame, unsigned channel, unsigned bitsPerChannel, uint64_t *noise)
+{
+	double sample;
+	
+	*noise ^= *noise << 13;
+	*noise ^= *noise >> 7;
+	*noise ^= *noise << 17;
+	
+	sample	= 0.1 * sin(2 * M_PI * (220 + 55 * channel) * frame / 44100.)
+			+ 0.1 * sin(2 * M_PI * 277.18 * frame / 44100.)
+			+ 0.1 * sin(2 * M_PI * 329.63 * frame / 44100.)
+			+ 0.001 * ((double)(*noise >> 11) / (double)(1ULL << 53) - 0.5);
+	
+	return (int32_t)(sample * (double)(1UL << (bitsPerChannel - 1)));
+}
+
+void
+BenchmarkBeginCountingAllocations(void)
+{
+	sCountingThread		= pthread_self();
+	sAllocationCount	= 0;
+	sPreviousLogger		= malloc_logger;
+	malloc_logger		= CountAllocation;
+}
+
+uint64_t
+BenchmarkEndCountingAllocations(void)
+{
+	malloc_logger		= sPreviousLogger;
+	sCountingThread		= NULL;
+	
+	return sAllocationCount;
+}
+
+void
+BenchmarkOverrideDefaults(NSDictionary *defaults)
+{
+	NSUserDefaults			*userDefaults	= [NSUserDefaults standardUserDefaults];
+	NSMutableDictionary		*arguments		= [NSMutableDictionary dictionaryWithDictionary:[userDefaults volatileDomainForName:NSArgumentDomain]];
+	
+	// The argument domain is searched first and is never saved
+	[arguments addEntriesFromDictionary:defaults];
+	[userDefaults removeVolatileDomainForName:NSArgumentDomain];
+	[userDefaults setVolatileDomain:arguments forName:NSArgumentDomain];
+}
+
+NSDictionary *
+BenchmarkFLACEncoderSettings(void)
+{
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithBool:NO],		@"verifyEncoding",
+		[NSNumber numberWithInt:8192],		@"padding",
+		[NSNumber numberWithBool:YES],		@"enableMidSide",
+		[NSNumber numberWithBool:NO],		@"enableLooseMidSide",
+		@"tukey(0.5)",						@"apodization",
+		[NSNumber numberWithInt:8],			@"maxLPCOrder",
+		[NSNumber numberWithInt:0],			@"QLPCoeffPrecision",
+		[NSNumber numberWithBool:NO],		@"enableQLPCoeffPrecisionSearch",
+		[NSNumber numberWithBool:NO],		@"exhaustiveModelSearch",
+		[NSNumber numberWithInt:0],			@"minPartitionOrder",
+		[NSNumber numberWithInt:5],			@"maxPartitionOrder",
+		nil];
+}
+
+BOOL
+BenchmarkWriteTestSignal(NSString *filename, double seconds, unsigned channels, unsigned bitsPerChannel)
+{
+	AudioStreamBasicDescription		asbd;
+	AudioFileID						audioFile			= NULL;
+	OSStatus						err;
+	unsigned						bytesPerSample		= bitsPerChannel / 8;
+	UInt32							bufferFrames		= 4096;
+	UInt32							frameCount;
+	uint8_t							*buffer				= NULL;
+	uint8_t							*p;
+	SInt64							totalFrames			= (SInt64)(seconds * 44100);
+	SInt64							frame;
+	SInt64							byteOffset			= 0;
+	uint64_t						noise				= 0x2545F4914F6CDD1DULL;
+	unsigned						channel, i;
+	int32_t							value;
+	UInt32							bytesWritten;
+	BOOL							result				= NO;
+	
+	memset(&asbd, 0, sizeof(asbd));
+	
+	asbd.mSampleRate			= 44100;
+	asbd.mFormatID				= kAudioFormatLinearPCM;
+	asbd.mFormatFlags			= kAudioFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsBigEndian | kAudioFormatFlagIsPacked;
+	asbd.mBytesPerPacket		= channels * bytesPerSample;
+	asbd.mFramesPerPacket		= 1;
+	asbd.mBytesPerFrame			= channels * bytesPerSample;
+	asbd.mChannelsPerFrame		= channels;
+	asbd.mBitsPerChannel		= bitsPerChannel;
+	
+	buffer = malloc(bufferFrames * asbd.mBytesPerFrame);
+	if(NULL == buffer)
+		return NO;
+	
+	err = AudioFileCreateWithURL((CFURLRef)[NSURL fileURLWithPath:filename], kAudioFileCAFType, &asbd, kAudioFileFlags_EraseFile, &audioFile);
+	if(noErr != err)
+		goto cleanup;
+	
+	for(frame = 0; frame < totalFrames; frame += frameCount) {
+		frameCount		= (UInt32)MIN(bufferFrames, totalFrames - frame);
+		p				= buffer;
+		
+		for(i = 0; i < frameCount; ++i) {
+			for(channel = 0; channel < channels; ++channel) {
+				value = TestSignalSample(frame + i, channel, bitsPerChannel, &noise);
+				
+				switch(bytesPerSample) {
+					case 2:		OSWriteBigInt16(p, 0, (uint16_t)value);												break;
+					case 3:		p[0] = (uint8_t)(value >> 16); p[1] = (uint8_t)(value >> 8); p[2] = (uint8_t)value;	break;
+					case 4:		OSWriteBigInt32(p, 0, (uint32_t)value);												break;
+				}
+				p += bytesPerSample;
+			}
+		}
+		
+		bytesWritten	= frameCount * asbd.mBytesPerFrame;
+		err				= AudioFileWriteBytes(audioFile, NO, byteOffset, &bytesWritten, buffer);
+		if(noErr != err)
+			goto cleanup;
+		
+		byteOffset += bytesWritten;
+	}
+	
+	result = YES;
+	
+cleanup:
+	if(NULL != audioFile && noErr != AudioFileClose(audioFile))
+		result = NO;
+	
+	free(buffer);
+	
+	return result;
+}
+
+BOOL
+BenchmarkWriteDiscImage(NSString *filename, double minutes)
+{
+	FILE			*file				= NULL;
+	uint8_t			sector [kCDSectorSizeCDDA];
+	SInt64			sectorCount			= (SInt64)(minutes * 60 * 75);
+	SInt64			frame				= 0;
+	SInt64			s;
+	uint64_t		noise				= 0x2545F4914F6CDD1DULL;
+	unsigned		i;
+	BOOL			result				= NO;
+	
+	file = fopen([filename fileSystemRepresentation], "wb");
+	if(NULL == file)
+		return NO;
+	
+	for(s = 0; s < sectorCount; ++s) {
+		for(i = 0; i < kCDSectorSizeCDDA / 4; ++i, ++frame) {
+			OSWriteLittleInt16(sector, 4 * i, (uint16_t)TestSignalSample(frame, 0, 16, &noise));
+			OSWriteLittleInt16(sector, 4 * i + 2, (uint16_t)TestSignalSample(frame, 1, 16, &noise));
+		}
+		
+		if(1 != fwrite(sector, sizeof(sector), 1, file))
+			goto cleanup;
+	}
+	
+	result = YES;
+	
+cleanup:
+	if(0 != fclose(file))
+		result = NO;
+	
+	return result;
+}
+
+NSString *
+BenchmarkWriteDriveProfile(NSString *filename, NSString *imageFilename, NSUInteger trackCount, NSDictionary *entries)
+{
+	NSMutableDictionary		*profile		= [NSMutableDictionary dictionary];
+	NSMutableArray			*tracks			= [NSMutableArray array];
+	NSUInteger				sectorCount		= (NSUInteger)([[[[NSFileManager defaultManager] attributesOfItemAtPath:imageFilename error:nil] objectForKey:NSFileSize] unsignedLongLongValue] / kCDSectorSizeCDDA);
+	NSUInteger				i;
+	
+	if(0 == trackCount || sectorCount < trackCount)
+		return nil;
+	
+	for(i = 0; i < trackCount; ++i)
+		[tracks addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedInteger:(i + 1)],						@"number",
+			[NSNumber numberWithUnsignedInteger:(i * sectorCount / trackCount)],	@"firstSector",
+			nil]];
+	
+	[profile setObject:imageFilename forKey:@"image"];
+	[profile setObject:tracks forKey:@"tracks"];
+	[profile setObject:[NSNumber numberWithUnsignedInteger:sectorCount] forKey:@"leadOut"];
+	[profile addEntriesFromDictionary:entries];
+	
+	return ([profile writeToFile:filename atomically:YES] ? filename : nil);
+}
+
+NSArray *
+BenchmarkTrackSectorRanges(NSString *profileFilename)
+{
+	NSDictionary		*profile		= [NSDictionary dictionaryWithContentsOfFile:profileFilename];
+	NSArray				*tracks			= [profile objectForKey:@"tracks"];
+	NSMutableArray		*ranges			= [NSMutableArray array];
+	NSUInteger			firstSector, nextSector;
+	NSUInteger			i;
+	
+	for(i = 0; i < [tracks count]; ++i) {
+		firstSector		= [[[tracks objectAtIndex:i] objectForKey:@"firstSector"] unsignedIntegerValue];
+		nextSector		= (i + 1 < [tracks count] ? [[[tracks objectAtIndex:(i + 1)] objectForKey:@"firstSector"] unsignedIntegerValue] : [[profile objectForKey:@"leadOut"] unsignedIntegerValue]);
+		
+		[ranges addObject:[SectorRange sectorRangeWithFirstSector:firstSector lastSector:(nextSector - 1)]];
+	}
+	
+	return ranges;
+}
+
+NSInteger
+BenchmarkCountMismatchedSectors(NSString *ripFilename, NSString *imageFilename, NSUInteger firstSector, NSUInteger sectorCount)
+{
+	AudioFileID		audioFile			= NULL;
+	FILE			*image				= NULL;
+	uint8_t			ripped [kCDSectorSizeCDDA];
+	uint8_t			expected [kCDSectorSizeCDDA];
+	UInt32			byteCount;
+	NSUInteger		i, j;
+	NSInteger		mismatches			= 0;
+	
+	if(noErr != AudioFileOpenURL((CFURLRef)[NSURL fileURLWithPath:ripFilename], kAudioFileReadPermission, kAudioFileCAFType, &audioFile))
+		return -1;
+	
+	image = fopen([imageFilename fileSystemRepresentation], "rb");
+	if(NULL == image || 0 != fseeko(image, (off_t)firstSector * kCDSectorSizeCDDA, SEEK_SET)) {
+		mismatches = -1;
+		goto cleanup;
+	}
+	
+	for(i = 0; i < sectorCount; ++i) {
+		byteCount = kCDSectorSizeCDDA;
+		if(noErr != AudioFileReadBytes(audioFile, NO, (SInt64)i * kCDSectorSizeCDDA, &byteCount, ripped) || kCDSectorSizeCDDA != byteCount || 1 != fread(expected, sizeof(expected), 1, image)) {
+			mismatches = -1;
+			goto cleanup;
+		}
+		
+		// The rips hold big-endian samples
+		for(j = 0; j < kCDSectorSizeCDDA; j += 2) {
+			if(ripped[j] != expected[j + 1] || ripped[j + 1] != expected[j]) {
+				++mismatches;
+				break;
+			}
+		}
+	}
+	
+cleanup:
+	if(NULL != image)
+		fclose(image);
+	
+	AudioFileClose(audioFile);
+	
+	return mismatches;
+}
+
+@implementation BenchmarkTask
+
+- (void) dealloc
+{
+	[_taskInfo release];			_taskInfo = nil;
+	[_exception release];			_exception = nil;
+	[_startTime release];			_startTime = nil;
+	[_endTime release];				_endTime = nil;
+	
+	[super dealloc];
+}
+
+- (void) reset
+{
+	[self setException:nil];
+	[self setStarted:NO];
+	[self setStopped:NO];
+	[self setCompleted:NO];
+}
+
+- (NSException *) result
+{
+	if(nil == [self exception] && NO == [self completed])
+		return [NSException exceptionWithName:@"BenchmarkException" reason:@"The task did not complete." userInfo:nil];
+	
+	return [self exception];
+}
+
+- (TaskInfo *)		taskInfo											{ return [[_taskInfo retain] autorelease]; }
+- (void)			setTaskInfo:(TaskInfo *)taskInfo					{ [_taskInfo release]; _taskInfo = [taskInfo retain]; }
+
+- (NSDate *)		startTime											{ return [[_startTime retain] autorelease]; }
+- (void)			setStartTime:(NSDate *)startTime					{ [_startTime release]; _startTime = [startTime retain]; }
+
+- (NSDate *)		endTime												{ return [[_endTime retain] autorelease]; }
+- (void)			setEndTime:(NSDate *)endTime						{ [_endTime release]; _endTime = [endTime retain]; }
+
+- (BOOL)			started												{ return _started; }
+- (void)			setStarted:(BOOL)started							{ _started = started; }
+
+- (BOOL)			completed											{ return _completed; }
+- (void)			setCompleted:(BOOL)completed						{ _completed = completed; }
+
+- (BOOL)			stopped												{ return _stopped; }
+- (void)			setStopped:(BOOL)stopped							{ _stopped = stopped; }
+
+- (float)			percentComplete										{ return 0; }
+- (void)			setPercentComplete:(float)percentComplete			{}
+
+- (BOOL)			shouldStop											{ return NO; }
+- (void)			setShouldStop:(BOOL)shouldStop						{}
+
+- (NSUInteger)		secondsRemaining									{ return 0; }
+- (void)			setSecondsRemaining:(NSUInteger)secondsRemaining	{}
+
+- (void)			updateProgress:(float)percentComplete secondsRemaining:(NSUInteger)secondsRemaining {}
+
+- (NSException *)	exception											{ return [[_exception retain] autorelease]; }
+- (void)			setException:(NSException *)exception				{ [_exception release]; _exception = [exception retain]; }
+
+@end
+
+@implementation BenchmarkEncoderTask
+
++ (BenchmarkEncoderTask *) taskWithInputFilename:(NSString *)filename encoderSettings:(NSDictionary *)encoderSettings
+{
+	BenchmarkEncoderTask	*task		= [[BenchmarkEncoderTask alloc] init];
+	TaskInfo				*taskInfo	= [TaskInfo taskInfoWithSettings:[NSDictionary dictionary] metadata:[[[AudioMetadata alloc] init] autorelease]];
+	
+	[taskInfo setInputFilenames:[NSArray arrayWithObject:filename]];
+	
+	[task setTaskInfo:taskInfo];
+	[task setEncoderSettings:encoderSettings];
+	
+	return [task autorelease];
+}
+
+- (void) dealloc
+{
+	[_encoderSettings release];		_encoderSettings = nil;
+	
+	[super dealloc];
+}
+
+- (NSException *) encodeWithClass:(Class)encoderClass toFile:(NSString *)filename
+{
+	Encoder			*encoder		= [[encoderClass alloc] init];
+	TaskStatus		*status			= [[TaskStatus alloc] init];
+	
+	[self reset];
+	
+	[encoder setDelegate:self];
+	[encoder setStatus:status];
+	[encoder encodeToFile:filename];
+	
+	[encoder release];
+	[status release];
+	
+	return [self result];
+}
+
+- (NSDictionary *)	encoderSettings										{ return [[_encoderSettings retain] autorelease]; }
+- (void)			setEncoderSettings:(NSDictionary *)encoderSettings	{ [_encoderSettings release]; _encoderSettings = [encoderSettings retain]; }
+
+- (NSString *)		decoderFanOutIdentifier								{ return nil; }
+- (NSUInteger)		decoderFanOutSinkIndex								{ return 0; }
+
+@end
+
+@implementation BenchmarkRipperTask
+
++ (BenchmarkRipperTask *) task
+{
+	BenchmarkRipperTask		*task		= [[BenchmarkRipperTask alloc] init];
+	
+	[task setTaskInfo:[TaskInfo taskInfoWithSettings:[NSDictionary dictionary] metadata:[[[AudioMetadata alloc] init] autorelease]]];
+	
+	return [task autorelease];
+}
+
+- (void) dealloc
+{
+	[_phase release];				_phase = nil;
+	
+	[super dealloc];
+}
+
+- (NSException *) ripWithRipper:(Ripper *)ripper toFile:(NSString *)filename
+{
+	TaskStatus		*status			= [[TaskStatus alloc] init];
+	
+	[self reset];
+	
+	[ripper setDelegate:self];
+	[ripper setStatus:status];
+	[ripper ripToFile:filename];
+	
+	[status release];
+	
+	return [self result];
+}
+
+- (NSString *)		phase												{ return [[_phase retain] autorelease]; }
+- (void)			setPhase:(NSString *)phase							{ [_phase release]; _phase = [phase retain]; }
+
+@end
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "Benchmarks.h"
+
+#include <mach/mach_time.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <string.h>
+
+struct Benchmark {
+	const char	*name;
+	int			(*run)(int argc, const char *argv[]);
+	const char	*usage;
+};
+
+static const struct Benchmark sBenchmarks [] = {
+	{ "pcm",		PCMConversionBenchmark,			"[megabytes]\tGB/s of each PCM conversion for every kernel set" },
+	{ "encoder",	EncoderBlockBenchmark,			"[seconds]\tencoder throughput and allocations for each block size" },
+	{ "flac",		FLACParallelBenchmark,			"[seconds | files...]\tparallel FLAC speedup, checking the output matches a serial encode" },
+	{ "hash",		SectorHashBenchmark,			"[sectors]\tsectors/s and CPU per sector for each sector hash" },
+	{ "rip",		RipperBenchmark,				"[minutes] [sectors/s]\tthroughput, re-reads and CPU per sector ripping disc images" },
+	{ "adaptive",	AdaptiveReadBenchmark,			"[minutes] [sectors/s]\tdamaged disc rips with adaptive and full speed reads" },
+};
+
+static void
+PrintUsage(void)
+{
+	size_t i;
+	
+	fprintf(stderr, "Usage: MaxBenchmark <name> [arguments...]\n");
+	for(i = 0; i < sizeof(sBenchmarks) / sizeof(sBenchmarks[0]); ++i)
+		fprintf(stderr, "  %-12s %s\n", sBenchmarks[i].name, sBenchmarks[i].usage);
+}
+
+int
+RunBenchmark(int argc, const char *argv[])
+{
+	size_t i;
+	
+	if(2 > argc) {
+		PrintUsage();
+		return 2;
+	}
+	
+	for(i = 0; i < sizeof(sBenchmarks) / sizeof(sBenchmarks[0]); ++i) {
+		if(0 == strcmp(argv[1], sBenchmarks[i].name))
+			return sBenchmarks[i].run(argc - 2, argv + 2);
+	}
+	
+	PrintUsage();
+	return 2;
+}
+
+double
+BenchmarkSeconds(void)
+{
+	static mach_timebase_info_data_t timebase;
+	
+	if(0 == timebase.denom)
+		mach_timebase_info(&timebase);
+	
+	return (double)mach_absolute_time() * timebase.numer / timebase.denom / 1e9;
+}
+
+double
+BenchmarkCPUSeconds(void)
+{
+	struct rusage usage;
+	
+	if(0 != getrusage(RUSAGE_SELF, &usage))
+		return 0;
+	
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Benchmarks are run by the MaxBenchmark tool, which is built with the application's sources
+// but not shipped with it:
+//   MaxBenchmark <name> [arguments...]
+// Each prints its results to standard output and returns a nonzero status if a check fails
+
+int			RunBenchmark(int argc, const char *argv[]);
+
+// Wall clock and process CPU time, in seconds from an arbitrary origin
+double		BenchmarkSeconds(void);
+double		BenchmarkCPUSeconds(void);
+
+// The benchmarks themselves; argv holds the arguments following the benchmark's name
+int			PCMConversionBenchmark(int argc, const char *argv[]);
+int			EncoderBlockBenchmark(int argc, const char *argv[]);
+int			FLACParallelBenchmark(int argc, const char *argv[]);
+int			SectorHashBenchmark(int argc, const char *argv[]);
+int			RipperBenchmark(int argc, const char *argv[]);
+int			AdaptiveReadBenchmark(int argc, const char *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCHMARKS_H */
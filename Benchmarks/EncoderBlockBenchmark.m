@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "Benchmarks.h"
+#import "BenchmarkSupport.h"
+
+#import "FLACEncoder.h"
+#import "MP3Encoder.h"
+
+// The fixed read size the encoders used before it was made tunable, then larger blocks
+static const UInt32 sBlockFrames [] = { 1024, 4096, 16384, 65536 };
+
+// Seconds of decoder read-ahead: none, then the default
+static const double sReadAheadSeconds [] = { 0, 2 };
+
+static NSDictionary *
+MP3EncoderSettings(void)
+{
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithInt:LAME_ENCODING_ENGINE_QUALITY_HIGH],		@"encodingEngineQuality",
+		[NSNumber numberWithInt:LAME_STEREO_MODE_DEFAULT],				@"stereoMode",
+		[NSNumber numberWithInt:LAME_TARGET_QUALITY],					@"target",
+		[NSNumber numberWithInt:80],									@"VBRQuality",
+		[NSNumber numberWithInt:LAME_VARIABLE_BITRATE_MODE_FAST],		@"variableBitrateMode",
+		nil];
+}
+
+// Encodes a test signal with each block size, with and without read-ahead, counting the
+// allocations made by the encoding thread
+int
+EncoderBlockBenchmark(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool				= [[NSAutoreleasePool alloc] init];
+	double					seconds				= (0 < argc ? strtod(argv[0], NULL) : 120);
+	NSString				*directory			= NSTemporaryDirectory();
+	NSString				*inputFilename		= [directory stringByAppendingPathComponent:@"MaxEncoderBenchmark.caf"];
+	NSString				*outputFilename		= nil;
+	NSArray					*encoders			= nil;
+	NSDictionary			*encoder			= nil;
+	BenchmarkEncoderTask	*task				= nil;
+	NSException				*exception			= nil;
+	double					startTime, startCPUTime, elapsed, cpuTime;
+	uint64_t				allocations;
+	unsigned				b, r;
+	int						status				= 0;
+	
+	if(0 >= seconds)
+		seconds = 120;
+	
+	encoders = [NSArray arrayWithObjects:
+		[NSDictionary dictionaryWithObjectsAndKeys:[FLACEncoder class], @"class", @"FLAC", @"name", @"flac", @"extension", BenchmarkFLACEncoderSettings(), @"settings", nil],
+		[NSDictionary dictionaryWithObjectsAndKeys:[MP3Encoder class], @"class", @"MP3", @"name", @"mp3", @"extension", MP3EncoderSettings(), @"settings", nil],
+		nil];
+	
+	if(NO == BenchmarkWriteTestSignal(inputFilename, seconds, 2, 16)) {
+		fprintf(stderr, "Unable to write the test signal to %s\n", [inputFilename fileSystemRepresentation]);
+		[pool release];
+		return 1;
+	}
+	
+	printf("Encoding %.0f s of 16-bit stereo; allocations are those made on the encoding thread\n", seconds);
+	printf("%-6s %8s %10s %9s %9s %9s %12s %12s\n", "format", "block", "read-ahead", "seconds", "cpu", "realtime", "allocations", "per block");
+	
+	for(encoder in encoders) {
+		outputFilename = [directory stringByAppendingPathComponent:[@"MaxEncoderBenchmark" stringByAppendingPathExtension:[encoder objectForKey:@"extension"]]];
+		task = [BenchmarkEncoderTask taskWithInputFilename:inputFilename encoderSettings:[encoder objectForKey:@"settings"]];
+		
+		for(b = 0; b < sizeof(sBlockFrames) / sizeof(sBlockFrames[0]); ++b) {
+			for(r = 0; r < sizeof(sReadAheadSeconds) / sizeof(sReadAheadSeconds[0]); ++r) {
+				NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+				
+				// A single FLAC thread, so the block size is all that changes
+				BenchmarkOverrideDefaults([NSDictionary dictionaryWithObjectsAndKeys:
+					[NSNumber numberWithUnsignedInt:sBlockFrames[b]],	@"encoderBlockFrames",
+					[NSNumber numberWithDouble:sReadAheadSeconds[r]],	@"decoderReadAheadSeconds",
+					[NSNumber numberWithInt:1],							@"flacEncoderThreads",
+					nil]);
+				
+				startTime		= BenchmarkSeconds();
+				startCPUTime	= BenchmarkCPUSeconds();
+				
+				BenchmarkBeginCountingAllocations();
+				exception		= [task encodeWithClass:[encoder objectForKey:@"class"] toFile:outputFilename];
+				allocations		= BenchmarkEndCountingAllocations();
+				
+				elapsed			= BenchmarkSeconds() - startTime;
+				cpuTime			= BenchmarkCPUSeconds() - startCPUTime;
+				
+				if(nil != exception) {
+					fprintf(stderr, "%s encoder failed: %s\n", [[encoder objectForKey:@"name"] UTF8String], [[exception reason] UTF8String]);
+					status = 1;
+				}
+				else
+					printf("%-6s %8u %9.0fs %9.2f %9.2f %8.1fx %12llu %12.2f\n",
+						   [[encoder objectForKey:@"name"] UTF8String], sBlockFrames[b], sReadAheadSeconds[r], elapsed, cpuTime, seconds / elapsed,
+						   allocations, (double)allocations / ceil(seconds * 44100 / sBlockFrames[b]));
+				
+				[runPool release];
+			}
+		}
+		
+		[[NSFileManager defaultManager] removeItemAtPath:outputFilename error:nil];
+	}
+	
+	[[NSFileManager defaultManager] removeItemAtPath:inputFilename error:nil];
+	
+	[pool release];
+	
+	return status;
+}
@@ -0,0 +1,145 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "Benchmarks.h"
+#import "BenchmarkSupport.h"
+
+#import "FLACEncoder.h"
+
+// Sample sizes of the test signal
+static const unsigned sBitsPerChannel [] = { 16, 24 };
+
+// Encodes a test signal, or the files named on the command line, on one thread and then on several,
+// with and without verification, and fails unless every parallel encode is byte-for-byte identical
+// to the serial one
+int
+FLACParallelBenchmark(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool				= [[NSAutoreleasePool alloc] init];
+	NSMutableArray			*files				= [NSMutableArray array];
+	double					seconds				= 0;
+	unsigned				processorCount		= (unsigned)[[NSProcessInfo processInfo] activeProcessorCount];
+	NSString				*directory			= NSTemporaryDirectory();
+	NSString				*signalFilename		= [directory stringByAppendingPathComponent:@"MaxFLACBenchmark.caf"];
+	NSString				*inputFilename		= nil;
+	NSString				*inputName			= nil;
+	NSString				*serialFilename		= [directory stringByAppendingPathComponent:@"MaxFLACBenchmark-serial.flac"];
+	NSString				*parallelFilename	= [directory stringByAppendingPathComponent:@"MaxFLACBenchmark-parallel.flac"];
+	NSMutableDictionary		*settings			= nil;
+	NSData					*serial				= nil;
+	NSData					*parallel			= nil;
+	BenchmarkEncoderTask	*task				= nil;
+	NSException				*exception			= nil;
+	unsigned				threadCounts [3]	= { 1, 2, (2 < processorCount ? processorCount : 4) };
+	double					startTime, elapsed, serialElapsed;
+	unsigned				b, t, verify, inputCount;
+	int						i;
+	int						status				= 0;
+	
+	// Arguments naming files are encoded as they are; otherwise the first is the signal's length
+	for(i = 0; i < argc; ++i) {
+		if([[NSFileManager defaultManager] fileExistsAtPath:[NSString stringWithUTF8String:argv[i]]])
+			[files addObject:[NSString stringWithUTF8String:argv[i]]];
+		else if(0 == i)
+			seconds = strtod(argv[i], NULL);
+	}
+	
+	// Shorter inputs are never split
+	if(60 >= seconds)
+		seconds = 120;
+	
+	if(0 < [files count]) {
+		inputCount = (unsigned)[files count];
+		printf("Encoding %u files on %u processors; every parallel output must match the serial one\n", inputCount, processorCount);
+	}
+	else {
+		inputCount = sizeof(sBitsPerChannel) / sizeof(sBitsPerChannel[0]);
+		printf("Encoding %.0f s of stereo on %u processors; every parallel output must match the serial one\n", seconds, processorCount);
+	}
+	printf("%-24s %7s %8s %9s %9s %8s\n", "input", "verify", "threads", "seconds", "speedup", "output");
+	
+	for(b = 0; b < inputCount; ++b) {
+		if(0 < [files count]) {
+			inputFilename	= [files objectAtIndex:b];
+			inputName		= [inputFilename lastPathComponent];
+		}
+		else {
+			inputFilename	= signalFilename;
+			inputName		= [NSString stringWithFormat:@"%u-bit signal", sBitsPerChannel[b]];
+			
+			if(NO == BenchmarkWriteTestSignal(inputFilename, seconds, 2, sBitsPerChannel[b])) {
+				fprintf(stderr, "Unable to write the test signal to %s\n", [inputFilename fileSystemRepresentation]);
+				status = 1;
+				break;
+			}
+		}
+		
+		for(verify = 0; verify < 2; ++verify) {
+			NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+			
+			settings = [NSMutableDictionary dictionaryWithDictionary:BenchmarkFLACEncoderSettings()];
+			[settings setObject:[NSNumber numberWithBool:(BOOL)verify] forKey:@"verifyEncoding"];
+			
+			task			= [BenchmarkEncoderTask taskWithInputFilename:inputFilename encoderSettings:settings];
+			serial			= nil;
+			serialElapsed	= 0;
+			
+			for(t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+				BenchmarkOverrideDefaults([NSDictionary dictionaryWithObjectsAndKeys:
+					[NSNumber numberWithBool:YES],						@"flacEncoderParallel",
+					[NSNumber numberWithUnsignedInt:threadCounts[t]],	@"flacEncoderThreads",
+					nil]);
+				
+				startTime	= BenchmarkSeconds();
+				exception	= [task encodeWithClass:[FLACEncoder class] toFile:(1 == threadCounts[t] ? serialFilename : parallelFilename)];
+				elapsed		= BenchmarkSeconds() - startTime;
+				
+				if(nil != exception) {
+					fprintf(stderr, "FLAC encoder failed with %u threads: %s\n", threadCounts[t], [[exception reason] UTF8String]);
+					status = 1;
+					break;
+				}
+				
+				if(1 == threadCounts[t]) {
+					serial			= [NSData dataWithContentsOfFile:serialFilename];
+					serialElapsed	= elapsed;
+					printf("%-24s %7s %8u %9.2f %8.2fx %8s\n", [inputName UTF8String], (verify ? "yes" : "no"), threadCounts[t], elapsed, 1.0, "-");
+					continue;
+				}
+				
+				parallel = [NSData dataWithContentsOfFile:parallelFilename];
+				
+				printf("%-24s %7s %8u %9.2f %8.2fx %8s\n", [inputName UTF8String], (verify ? "yes" : "no"), threadCounts[t], elapsed, serialElapsed / elapsed,
+					   ([parallel isEqualToData:serial] ? "same" : "DIFFERS"));
+				
+				if(nil == serial || NO == [parallel isEqualToData:serial])
+					status = 1;
+			}
+			
+			[runPool release];
+		}
+	}
+	
+	[[NSFileManager defaultManager] removeItemAtPath:signalFilename error:nil];
+	[[NSFileManager defaultManager] removeItemAtPath:serialFilename error:nil];
+	[[NSFileManager defaultManager] removeItemAtPath:parallelFilename error:nil];
+	
+	[pool release];
+	
+	return status;
+}
@@ -0,0 +1,319 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "Benchmarks.h"
+#include "PCMConversion.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Each conversion is repeated for at least this long per kernel set
+#define PCM_BENCHMARK_SECONDS		0.25
+#define PCM_BENCHMARK_MAX_CHANNELS	6
+
+// Input in every layout the conversions read, and room for each kind of output
+struct PCMBuffers {
+	size_t		frameCount;
+	
+	uint8_t		*bigEndian			[2];		// Input, output
+	int32_t		*interleaved		[2];
+	int32_t		*planar				[2][PCM_BENCHMARK_MAX_CHANNELS];
+	float		*floats;
+};
+
+enum {
+	kOutputBigEndian,
+	kOutputInterleaved,
+	kOutputPlanar,
+	kOutputFloat,
+};
+
+struct PCMConversionCase {
+	const char	*name;
+	unsigned	channels;
+	unsigned	bitsPerChannel;
+	int			output;
+	bool		bigEndianInput;
+	bool		wideInput;			// Samples use all 32 bits, so packing must drop the high bits
+	bool		(*convert)(struct PCMBuffers *buffers, unsigned channels, unsigned bitsPerChannel);
+};
+
+static bool
+BigEndianToPlanar(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	return PCMDeinterleaveBigEndianToInt32(b->bigEndian[0], b->planar[1], channels, bitsPerChannel, b->frameCount);
+}
+
+static bool
+BigEndianToInterleaved(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	return PCMBigEndianToInt32(b->bigEndian[0], b->interleaved[1], b->frameCount * channels, bitsPerChannel);
+}
+
+static bool
+PlanarToBigEndian(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	return PCMInterleaveInt32ToBigEndian((const int32_t * const *)b->planar[0], b->bigEndian[1], channels, bitsPerChannel, b->frameCount);
+}
+
+static bool
+InterleavedToBigEndian(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	return PCMInt32ToBigEndian(b->interleaved[0], b->bigEndian[1], b->frameCount * channels, bitsPerChannel);
+}
+
+static bool
+InterleavedToPlanar(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	PCMDeinterleaveInt32(b->interleaved[0], b->planar[1], channels, b->frameCount);
+	return true;
+}
+
+static bool
+PlanarToInterleaved(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	PCMInterleaveInt32((const int32_t * const *)b->planar[0], b->interleaved[1], channels, b->frameCount);
+	return true;
+}
+
+static bool
+InterleavedToFloat(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	PCMInt32ToFloat(b->interleaved[0], b->floats, b->frameCount * channels, bitsPerChannel);
+	return true;
+}
+
+// In place, so the output is shifted again on every repetition; only the first pass is compared
+static bool
+InterleavedToFullScale(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel)
+{
+	PCMInt32ToFullScale(b->interleaved[1], b->frameCount * channels, bitsPerChannel);
+	return true;
+}
+
+// The combinations the codecs use
+static const struct PCMConversionCase sCases [] = {
+	{ "big-endian to planar",		2,	16,	kOutputPlanar,		true,	false,	BigEndianToPlanar },
+	{ "big-endian to planar",		2,	24,	kOutputPlanar,		true,	false,	BigEndianToPlanar },
+	{ "big-endian to planar",		2,	32,	kOutputPlanar,		true,	false,	BigEndianToPlanar },
+	{ "big-endian to planar",		1,	16,	kOutputPlanar,		true,	false,	BigEndianToPlanar },
+	{ "big-endian to planar",		6,	16,	kOutputPlanar,		true,	false,	BigEndianToPlanar },
+	{ "big-endian to int32",		2,	16,	kOutputInterleaved,	true,	false,	BigEndianToInterleaved },
+	{ "big-endian to int32",		2,	24,	kOutputInterleaved,	true,	false,	BigEndianToInterleaved },
+	{ "planar to big-endian",		2,	16,	kOutputBigEndian,	false,	false,	PlanarToBigEndian },
+	{ "planar to big-endian",		2,	24,	kOutputBigEndian,	false,	false,	PlanarToBigEndian },
+	{ "int32 to big-endian",		2,	16,	kOutputBigEndian,	false,	false,	InterleavedToBigEndian },
+	{ "int32 to big-endian",		2,	32,	kOutputBigEndian,	false,	false,	InterleavedToBigEndian },
+	{ "deinterleave",				2,	32,	kOutputPlanar,		false,	false,	InterleavedToPlanar },
+	{ "interleave",					2,	32,	kOutputInterleaved,	false,	false,	PlanarToInterleaved },
+	{ "int32 to float",				2,	16,	kOutputFloat,		false,	false,	InterleavedToFloat },
+	{ "int32 to full scale",		2,	16,	kOutputInterleaved,	false,	false,	InterleavedToFullScale },
+	
+	// Samples wider than the output, whose high bits every kernel set must drop the same way
+	{ "wide int32 to big-endian",	2,	16,	kOutputBigEndian,	false,	true,	InterleavedToBigEndian },
+	{ "wide int32 to big-endian",	2,	24,	kOutputBigEndian,	false,	true,	InterleavedToBigEndian },
+	{ "wide planar to big-endian",	2,	16,	kOutputBigEndian,	false,	true,	PlanarToBigEndian },
+};
+
+static uint64_t
+NextRandom(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// Random samples that fit the case's sample size, unless it asks for wide input, in each input layout
+static void
+FillInput(struct PCMBuffers *b, unsigned channels, unsigned bitsPerChannel, bool wideInput)
+{
+	uint64_t		state		= 0x9E3779B97F4A7C15ULL;
+	size_t			frame;
+	unsigned		channel;
+	int32_t			sample;
+	
+	for(frame = 0; frame < b->frameCount; ++frame) {
+		for(channel = 0; channel < channels; ++channel) {
+			sample = (int32_t)NextRandom(&state) >> (wideInput ? 0 : 32 - bitsPerChannel);
+			b->interleaved[0][frame * channels + channel]	= sample;
+			b->planar[0][channel][frame]					= sample;
+		}
+	}
+	
+	PCMInt32ToBigEndian(b->interleaved[0], b->bigEndian[0], b->frameCount * channels, bitsPerChannel);
+	
+	// Full scale conversion works in place on a copy of the input
+	memcpy(b->interleaved[1], b->interleaved[0], b->frameCount * channels * sizeof(int32_t));
+}
+
+// Copies the case's output so other kernel sets can be checked against it
+static void *
+CopyOutput(const struct PCMBuffers *b, const struct PCMConversionCase *c, size_t *byteCount)
+{
+	size_t			sampleCount		= b->frameCount * c->channels;
+	size_t			planeBytes		= b->frameCount * sizeof(int32_t);
+	uint8_t			*copy			= NULL;
+	unsigned		channel;
+	
+	switch(c->output) {
+		case kOutputBigEndian:		*byteCount = sampleCount * (c->bitsPerChannel / 8);		break;
+		case kOutputFloat:			*byteCount = sampleCount * sizeof(float);				break;
+		default:					*byteCount = sampleCount * sizeof(int32_t);				break;
+	}
+	
+	copy = malloc(*byteCount);
+	if(NULL == copy)
+		return NULL;
+	
+	switch(c->output) {
+		case kOutputBigEndian:		memcpy(copy, b->bigEndian[1], *byteCount);				break;
+		case kOutputInterleaved:	memcpy(copy, b->interleaved[1], *byteCount);			break;
+		case kOutputFloat:			memcpy(copy, b->floats, *byteCount);					break;
+		case kOutputPlanar:
+			for(channel = 0; channel < c->channels; ++channel)
+				memcpy(copy + channel * planeBytes, b->planar[1][channel], planeBytes);
+			break;
+	}
+	
+	return copy;
+}
+
+// Returns GB/s of input converted, or a negative value if the conversion failed
+static double
+TimeConversion(struct PCMBuffers *b, const struct PCMConversionCase *c)
+{
+	size_t		inputBytes		= b->frameCount * c->channels * (c->bigEndianInput ? c->bitsPerChannel / 8 : sizeof(int32_t));
+	double		startTime		= BenchmarkSeconds();
+	double		elapsed			= 0;
+	unsigned	repetitions		= 0;
+	
+	do {
+		if(false == c->convert(b, c->channels, c->bitsPerChannel))
+			return -1;
+		++repetitions;
+		elapsed = BenchmarkSeconds() - startTime;
+	} while(elapsed < PCM_BENCHMARK_SECONDS);
+	
+	return (double)inputBytes * repetitions / elapsed / 1e9;
+}
+
+int
+PCMConversionBenchmark(int argc, const char *argv[])
+{
+	struct PCMBuffers	buffers;
+	size_t				megabytes		= (0 < argc ? strtoul(argv[0], NULL, 10) : 16);
+	size_t				kernelCount		= PCMConversionKernelCount();
+	const char			*defaultKernels	= PCMConversionKernelName();
+	size_t				caseCount		= sizeof(sCases) / sizeof(sCases[0]);
+	size_t				i, k, byteCount, referenceByteCount;
+	double				rate, scalarRate;
+	void				*reference, *output;
+	unsigned			channel;
+	int					status			= 0;
+	
+	if(0 == megabytes)
+		megabytes = 16;
+	
+	// Sized so the widest input, interleaved int32, holds the requested amount
+	memset(&buffers, 0, sizeof(buffers));
+	buffers.frameCount		= megabytes * 1024 * 1024 / (PCM_BENCHMARK_MAX_CHANNELS * sizeof(int32_t));
+	
+	for(i = 0; i < 2; ++i) {
+		buffers.bigEndian[i]	= malloc(buffers.frameCount * PCM_BENCHMARK_MAX_CHANNELS * sizeof(int32_t));
+		buffers.interleaved[i]	= malloc(buffers.frameCount * PCM_BENCHMARK_MAX_CHANNELS * sizeof(int32_t));
+		if(NULL == buffers.bigEndian[i] || NULL == buffers.interleaved[i])
+			goto cleanup;
+		
+		for(channel = 0; channel < PCM_BENCHMARK_MAX_CHANNELS; ++channel) {
+			buffers.planar[i][channel] = malloc(buffers.frameCount * sizeof(int32_t));
+			if(NULL == buffers.planar[i][channel])
+				goto cleanup;
+		}
+	}
+	
+	buffers.floats = malloc(buffers.frameCount * PCM_BENCHMARK_MAX_CHANNELS * sizeof(float));
+	if(NULL == buffers.floats)
+		goto cleanup;
+	
+	printf("PCM conversion, %zu MB of int32 per pass; GB/s of input (speedup over scalar)\n", megabytes);
+	printf("%-26s %-3s %-3s", "conversion", "ch", "bit");
+	for(k = 0; k < kernelCount; ++k)
+		printf(" %16s", PCMConversionKernelNameAtIndex(k));
+	printf("\n");
+	
+	for(i = 0; i < caseCount; ++i) {
+		const struct PCMConversionCase *c = &sCases[i];
+		
+		printf("%-26s %-3u %-3u", c->name, c->channels, c->bitsPerChannel);
+		
+		reference	= NULL;
+		scalarRate	= 0;
+		
+		for(k = 0; k < kernelCount; ++k) {
+			PCMConversionUseKernels(PCMConversionKernelNameAtIndex(k));
+			
+			// Check a single pass against the scalar output before timing
+			FillInput(&buffers, c->channels, c->bitsPerChannel, c->wideInput);
+			c->convert(&buffers, c->channels, c->bitsPerChannel);
+			output = CopyOutput(&buffers, c, &byteCount);
+			
+			if(NULL == reference) {
+				reference			= output;
+				referenceByteCount	= byteCount;
+			}
+			else {
+				if(NULL == output || byteCount != referenceByteCount || 0 != memcmp(output, reference, byteCount)) {
+					fprintf(stderr, "%s kernels differ from scalar for %s (%u channels, %u bits)\n", PCMConversionKernelNameAtIndex(k), c->name, c->channels, c->bitsPerChannel);
+					status = 1;
+				}
+				free(output);
+			}
+			
+			rate = TimeConversion(&buffers, c);
+			if(0 == k)
+				scalarRate = rate;
+			
+			if(0 > rate)
+				printf(" %16s", "failed");
+			else if(0 == k)
+				printf(" %16.2f", rate);
+			else
+				printf(" %9.2f (%4.1fx)", rate, rate / scalarRate);
+		}
+		
+		printf("\n");
+		free(reference);
+	}
+	
+	printf("Kernels used by default: %s\n", defaultKernels);
+	PCMConversionUseKernels(defaultKernels);
+	
+cleanup:
+	for(i = 0; i < 2; ++i) {
+		free(buffers.bigEndian[i]);
+		free(buffers.interleaved[i]);
+		for(channel = 0; channel < PCM_BENCHMARK_MAX_CHANNELS; ++channel)
+			free(buffers.planar[i][channel]);
+	}
+	free(buffers.floats);
+	
+	return status;
+}
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "Benchmarks.h"
+#import "BenchmarkSupport.h"
+
+#import "BasicRipper.h"
+#import "ComparisonRipper.h"
+#import "ImageDrive.h"
+
+#define RIPPER_BENCHMARK_TRACKS		10
+
+// Rips a synthetic disc image through ImageDrive with each ripper, for drives of increasing
+// difficulty. ParanoiaRipper reads through libcdparanoia's own device interface rather than
+// Drive, so it cannot be pointed at an image and is not measured.
+int
+RipperBenchmark(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool				= [[NSAutoreleasePool alloc] init];
+	double					minutes				= (0 < argc ? strtod(argv[0], NULL) : 10);
+	double					readRate			= (1 < argc ? strtod(argv[1], NULL) : 0);
+	NSString				*directory			= NSTemporaryDirectory();
+	NSString				*imageFilename		= [directory stringByAppendingPathComponent:@"MaxRipperBenchmark.cdda"];
+	NSString				*ripFilename		= [directory stringByAppendingPathComponent:@"MaxRipperBenchmark.caf"];
+	NSString				*profileFilename	= nil;
+	NSArray					*profiles			= nil;
+	NSDictionary			*profile			= nil;
+	NSArray					*sectors			= nil;
+	NSArray					*ripperClasses		= [NSArray arrayWithObjects:[BasicRipper class], [ComparisonRipper class], nil];
+	Class					ripperClass			= Nil;
+	Ripper					*ripper				= nil;
+	ImageDrive				*drive				= nil;
+	BenchmarkRipperTask		*task				= nil;
+	NSException				*exception			= nil;
+	NSUInteger				sectorCount;
+	NSUInteger				scratchFirst, scratchLast;
+	NSInteger				mismatches;
+	double					startTime, startCPUTime, elapsed, cpuTime;
+	int						status				= 0;
+	
+	if(0 >= minutes)
+		minutes = 10;
+	
+	sectorCount		= (NSUInteger)(minutes * 60 * 75);
+	scratchFirst	= sectorCount / 2;
+	scratchLast		= scratchFirst + sectorCount / 50;
+	
+	// A perfect disc, the same behind a drive cache the rippers must defeat, and a scratch over
+	// 2% of the disc that reads cleanly only at low speed
+	profiles = [NSArray arrayWithObjects:
+		[NSDictionary dictionaryWithObjectsAndKeys:@"clean", @"name", nil],
+		[NSDictionary dictionaryWithObjectsAndKeys:@"cached", @"name", [NSNumber numberWithUnsignedInteger:(2 * 1024 * 1024)], @"cacheSize", nil],
+		[NSDictionary dictionaryWithObjectsAndKeys:@"scratched", @"name",
+			[NSArray arrayWithObject:[NSDictionary dictionaryWithObjectsAndKeys:
+				[NSNumber numberWithUnsignedInteger:scratchFirst],	@"firstSector",
+				[NSNumber numberWithUnsignedInteger:scratchLast],	@"lastSector",
+				[NSNumber numberWithDouble:0.0005],					@"errorRate",
+				[NSNumber numberWithDouble:0],						@"minimumSpeedErrorRate",
+				nil]], @"errors",
+			nil],
+		nil];
+	
+	if(NO == BenchmarkWriteDiscImage(imageFilename, minutes)) {
+		fprintf(stderr, "Unable to write the disc image to %s\n", [imageFilename fileSystemRepresentation]);
+		[pool release];
+		return 1;
+	}
+	
+	// The comparison ripper's own settings, so the user's defaults don't change the results
+	BenchmarkOverrideDefaults([NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithInt:2],			@"comparisonRipperRequiredMatches",
+		[NSNumber numberWithInt:20],		@"comparisonRipperMaximumRetries",
+		[NSNumber numberWithBool:YES],		@"comparisonRipperUseHashes",
+		[NSNumber numberWithBool:YES],		@"comparisonRipperUseC2",
+		[NSNumber numberWithInt:0],			@"comparisonRipperDriveOffset",
+		[NSNumber numberWithBool:NO],		@"comparisonRipperUseAccurateRip",
+		nil]);
+	
+	printf("Ripping %.0f minutes in %u tracks, %s\n", minutes, RIPPER_BENCHMARK_TRACKS,
+		   (0 < readRate ? [[NSString stringWithFormat:@"reading at most %.0f sectors/s", readRate] UTF8String] : "with unthrottled reads"));
+	printf("%-10s %-17s %9s %10s %9s %9s %9s %12s %10s\n", "drive", "ripper", "seconds", "sectors/s", "commands", "reads", "cached", "cpu/sector", "bad");
+	
+	for(profile in profiles) {
+		NSAutoreleasePool		*profilePool		= [[NSAutoreleasePool alloc] init];
+		NSMutableDictionary		*entries			= [NSMutableDictionary dictionaryWithDictionary:profile];
+		
+		[entries removeObjectForKey:@"name"];
+		[entries setObject:[NSNumber numberWithDouble:readRate] forKey:@"readRate"];
+		
+		profileFilename		= BenchmarkWriteDriveProfile([directory stringByAppendingPathComponent:@"MaxRipperBenchmark.plist"], imageFilename, RIPPER_BENCHMARK_TRACKS, entries);
+		sectors				= BenchmarkTrackSectorRanges(profileFilename);
+		
+		for(ripperClass in ripperClasses) {
+			ripper		= [[ripperClass alloc] initWithSectors:sectors deviceName:profileFilename];
+			task		= [BenchmarkRipperTask task];
+			
+			startTime		= BenchmarkSeconds();
+			startCPUTime	= BenchmarkCPUSeconds();
+			
+			exception		= [task ripWithRipper:ripper toFile:ripFilename];
+			
+			elapsed			= BenchmarkSeconds() - startTime;
+			cpuTime			= BenchmarkCPUSeconds() - startCPUTime;
+			
+			// The rippers keep their drive to themselves; its counters survive closing the device
+			drive			= [ripper valueForKey:@"drive"];
+			
+			if(nil != exception) {
+				fprintf(stderr, "%s failed on the %s drive: %s\n", [NSStringFromClass(ripperClass) UTF8String], [[profile objectForKey:@"name"] UTF8String], [[exception reason] UTF8String]);
+				status = 1;
+			}
+			else {
+				mismatches = BenchmarkCountMismatchedSectors(ripFilename, imageFilename, 0, sectorCount);
+				
+				printf("%-10s %-17s %9.2f %10.0f %9lu %8.2fx %9lu %9.2f us %10ld\n",
+					   [[profile objectForKey:@"name"] UTF8String], [NSStringFromClass(ripperClass) UTF8String], elapsed, sectorCount / elapsed,
+					   (unsigned long)[drive readCommandCount], (double)[drive sectorReadCount] / sectorCount, (unsigned long)[drive cacheHitCount],
+					   1e6 * cpuTime / sectorCount, (long)mismatches);
+				
+				// Every ripper must get a perfect disc right
+				if(0 != mismatches && nil == [profile objectForKey:@"errors"])
+					status = 1;
+			}
+			
+			[ripper release];
+			[[NSFileManager defaultManager] removeItemAtPath:ripFilename error:nil];
+		}
+		
+		[[NSFileManager defaultManager] removeItemAtPath:profileFilename error:nil];
+		[profilePool release];
+	}
+	
+	[[NSFileManager defaultManager] removeItemAtPath:imageFilename error:nil];
+	
+	[pool release];
+	
+	return status;
+}
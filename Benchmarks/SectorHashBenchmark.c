@@ -0,0 +1,173 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "Benchmarks.h"
+#include "SectorHash.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_HASH_BENCHMARK_SECONDS	0.5
+
+// The length of a CD-DA sector, and the rate a 1x drive reads them
+#define CDDA_SECTOR_BYTES				2352
+#define CDDA_SECTORS_PER_SECOND			75
+
+static const struct {
+	const char				*name;
+	SectorHashAlgorithm		algorithm;
+} sAlgorithms [] = {
+	{ "SHA-256",	kSectorHashAlgorithmSHA256 },
+	{ "XXH3-128",	kSectorHashAlgorithmXXH3_128 },
+};
+
+// XXH3-128 of the first len bytes of the pattern i * 31 + 7, in canonical (big-endian) form, as the
+// reference xxHash produces them; the lengths cover each of XXH3's input size classes
+static const struct {
+	size_t		len;
+	uint8_t		hash [16];
+} sXXH3KnownVectors [] = {
+	{ 0,	{ 0x99, 0xaa, 0x06, 0xd3, 0x01, 0x47, 0x98, 0xd8, 0x60, 0x01, 0xc3, 0x24, 0x46, 0x8d, 0x49, 0x7f } },
+	{ 3,	{ 0x46, 0xf6, 0x6c, 0xb9, 0x35, 0x38, 0x15, 0x65, 0x15, 0xf7, 0x09, 0x3b, 0x17, 0x3d, 0x00, 0x5c } },
+	{ 16,	{ 0x65, 0x0f, 0xe3, 0x08, 0xc5, 0x66, 0x74, 0x7d, 0xf8, 0x53, 0xdd, 0x94, 0x61, 0x4d, 0xfa, 0x07 } },
+	{ 17,	{ 0x18, 0x21, 0x73, 0x00, 0xb5, 0x13, 0x2d, 0x5a, 0x78, 0xc3, 0x49, 0xfe, 0x81, 0xb2, 0xf2, 0x6c } },
+	{ 128,	{ 0xb4, 0xf8, 0x7b, 0x99, 0xd2, 0xdb, 0x8a, 0x51, 0x1e, 0x04, 0xfa, 0xd9, 0xf0, 0xca, 0xcb, 0x4d } },
+	{ 129,	{ 0x68, 0x81, 0x63, 0x36, 0x50, 0xcd, 0x89, 0x24, 0xc5, 0x1b, 0xc8, 0x87, 0x97, 0x6a, 0xef, 0x63 } },
+	{ 240,	{ 0xde, 0x57, 0xaa, 0xb3, 0x1e, 0x77, 0xa2, 0xff, 0x93, 0xe1, 0x73, 0x83, 0x3f, 0x75, 0xab, 0x66 } },
+	{ 241,	{ 0x92, 0xb9, 0x91, 0xa7, 0x19, 0x2f, 0x3f, 0x08, 0x0b, 0x3b, 0x63, 0x09, 0x48, 0xce, 0x4a, 0x00 } },
+	{ 2352,	{ 0x8d, 0x8a, 0xdd, 0x3a, 0x5a, 0xc0, 0xfb, 0x81, 0x2b, 0x9b, 0x95, 0x81, 0x18, 0x2b, 0x00, 0x61 } },
+};
+
+// Sectors are hashed into rip tables and frame index filenames, so the hash must never change
+static bool
+MatchesKnownVectors(void)
+{
+	uint8_t		input [CDDA_SECTOR_BYTES];
+	uint8_t		hash [kSectorHashMaximumLength];
+	size_t		i;
+	bool		matches		= true;
+	
+	for(i = 0; i < sizeof(input); ++i)
+		input[i] = (uint8_t)(i * 31 + 7);
+	
+	for(i = 0; i < sizeof(sXXH3KnownVectors) / sizeof(sXXH3KnownVectors[0]); ++i) {
+		SectorHash(kSectorHashAlgorithmXXH3_128, input, sXXH3KnownVectors[i].len, hash);
+		if(0 != memcmp(hash, sXXH3KnownVectors[i].hash, sizeof(sXXH3KnownVectors[i].hash))) {
+			fprintf(stderr, "XXH3-128 of %zu bytes differs from the reference\n", sXXH3KnownVectors[i].len);
+			matches = false;
+		}
+	}
+	
+	return matches;
+}
+
+// Every single-bit change to a sector must change its hash, or the rippers would accept a bad read
+static bool
+DetectsBitFlips(SectorHashAlgorithm algorithm, uint8_t *sector)
+{
+	uint8_t		hash [kSectorHashMaximumLength];
+	uint8_t		flipped [kSectorHashMaximumLength];
+	size_t		length		= SectorHashLength(algorithm);
+	size_t		bit;
+	
+	SectorHash(algorithm, sector, CDDA_SECTOR_BYTES, hash);
+	
+	for(bit = 0; bit < 8 * CDDA_SECTOR_BYTES; ++bit) {
+		sector[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+		SectorHash(algorithm, sector, CDDA_SECTOR_BYTES, flipped);
+		sector[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+		
+		if(0 == memcmp(hash, flipped, length))
+			return false;
+	}
+	
+	return true;
+}
+
+// Hashes sectors one at a time, as the rippers do, over a buffer larger than the caches
+int
+SectorHashBenchmark(int argc, const char *argv[])
+{
+	size_t		sectorCount		= (0 < argc ? strtoul(argv[0], NULL, 10) : 0);
+	size_t		algorithmCount	= sizeof(sAlgorithms) / sizeof(sAlgorithms[0]);
+	uint8_t		*sectors		= NULL;
+	uint8_t		hash [kSectorHashMaximumLength];
+	uint64_t	state			= 0x9E3779B97F4A7C15ULL;
+	uint64_t	hashed;
+	double		startTime, startCPUTime, elapsed, cpuTime, rate, sha256Rate;
+	size_t		i, a;
+	int			status			= 0;
+	
+	// A minute of audio by default
+	if(0 == sectorCount)
+		sectorCount = 60 * CDDA_SECTORS_PER_SECOND;
+	
+	sectors = malloc(sectorCount * CDDA_SECTOR_BYTES);
+	if(NULL == sectors) {
+		fprintf(stderr, "Unable to allocate memory.\n");
+		return 1;
+	}
+	
+	for(i = 0; i < sectorCount * CDDA_SECTOR_BYTES / sizeof(uint64_t); ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		memcpy(sectors + i * sizeof(uint64_t), &state, sizeof(uint64_t));
+	}
+	
+	if(false == MatchesKnownVectors())
+		status = 1;
+	
+	printf("Hashing %zu sectors of %d bytes, one at a time\n", sectorCount, CDDA_SECTOR_BYTES);
+	printf("%-8s %12s %9s %10s %12s %10s\n", "hash", "sectors/s", "MB/s", "drive", "cpu/sector", "speedup");
+	
+	sha256Rate = 0;
+	
+	for(a = 0; a < algorithmCount; ++a) {
+		if(false == DetectsBitFlips(sAlgorithms[a].algorithm, sectors)) {
+			fprintf(stderr, "%s missed a single-bit change\n", sAlgorithms[a].name);
+			status = 1;
+		}
+		
+		hashed			= 0;
+		startTime		= BenchmarkSeconds();
+		startCPUTime	= BenchmarkCPUSeconds();
+		
+		do {
+			for(i = 0; i < sectorCount; ++i)
+				SectorHash(sAlgorithms[a].algorithm, sectors + i * CDDA_SECTOR_BYTES, CDDA_SECTOR_BYTES, hash);
+			hashed += sectorCount;
+			elapsed = BenchmarkSeconds() - startTime;
+		} while(elapsed < SECTOR_HASH_BENCHMARK_SECONDS);
+		
+		cpuTime		= BenchmarkCPUSeconds() - startCPUTime;
+		rate		= hashed / elapsed;
+		
+		if(kSectorHashAlgorithmSHA256 == sAlgorithms[a].algorithm)
+			sha256Rate = rate;
+		
+		printf("%-8s %12.0f %9.1f %9.0fx %10.2f us %9.1fx\n", sAlgorithms[a].name, rate, rate * CDDA_SECTOR_BYTES / 1e6,
+			   rate / CDDA_SECTORS_PER_SECOND, 1e6 * cpuTime / hashed, (0 < sha256Rate ? rate / sha256Rate : 1.0));
+	}
+	
+	free(sectors);
+	
+	return status;
+}
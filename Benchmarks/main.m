@@ -0,0 +1,38 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#include "Benchmarks.h"
+
+int main(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool			= [[NSAutoreleasePool alloc] init];
+	NSString				*defaultsPath;
+	int						status;
+	
+	// The application's defaults are copied next to the tool, where +[NSBundle mainBundle] finds them
+	defaultsPath = [[NSBundle mainBundle] pathForResource:@"ApplicationControllerDefaults" ofType:@"plist"];
+	if(nil != defaultsPath)
+		[[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithContentsOfFile:defaultsPath]];
+	
+	status = RunBenchmark(argc, argv);
+	
+	[pool release];
+	return status;
+}
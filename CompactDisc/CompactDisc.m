@@ -41,7 +41,7 @@
 
 		// To avoid keeping an open file descriptor, read the disc's properties from the drive
 		// and store them in our ivars
-		drive = [[Drive alloc] initWithDeviceName:[self deviceName]];
+		drive = [[Drive driveWithDeviceName:[self deviceName]] retain];
 
 		// Is this is a multisession disc?
 		if([drive lastSession] - [drive firstSession] > 0)
@@ -18,7 +18,7 @@
 
 #import <Cocoa/Cocoa.h>
 
-@class AudioMetadata, CompactDiscDocument, EncoderTask;
+@class AudioMetadata, CompactDiscDocument, EncoderTask, TaskScheduler;
 
 // List of the encoder components available in Max
 enum {
@@ -40,6 +40,8 @@ enum {
 	IBOutlet NSArrayController	*_tasksController;
 	
 	NSMutableArray				*_tasks;
+	TaskScheduler				*_scheduler;
+	NSTimer						*_statusTimer;
 	BOOL						_freeze;
 }
 
@@ -52,12 +54,23 @@ enum {
 - (void)			encodeFiles:(NSArray *)filenames metadata:(AudioMetadata *)metadata settings:(NSDictionary *)settings;
 - (void)			encodeFiles:(NSArray *)filenames metadata:(AudioMetadata *)metadata settings:(NSDictionary *)settings inputTracks:(NSArray *)inputTracks;
 
+// Encode several regions of one file, such as the tracks of a cue sheet's image, in one decoding pass
+// Each region has its own metadata and settings, whose framesToConvert selects the region
+- (void)			encodeRegionsOfFile:(NSString *)filename metadata:(NSArray *)metadata settings:(NSArray *)settings;
+
 - (BOOL)			documentHasEncoderTasks:(CompactDiscDocument *)document;
 - (void)			stopEncoderTasksForDocument:(CompactDiscDocument *)document;
 
 - (BOOL)			hasTasks;
 - (NSUInteger)		countOfTasks;
 
+// The worker pool encoders run on, sized by the maximumEncoderThreads default when first used
+- (TaskScheduler *)	scheduler;
+
+// Scheduling metrics for the current batch
+- (NSUInteger)		queueDepth;
+- (double)			utilization;
+
 // Action methods
 - (IBAction)		stopSelectedTasks:(id)sender;
 - (IBAction)		stopAllTasks:(id)sender;
@@ -33,6 +33,10 @@
 
 #import "LogController.h"
 #import "RipperController.h"
+#import "Decoder.h"
+#import "DecoderFanOut.h"
+#import "SectorStream.h"
+#import "TaskScheduler.h"
 
 #include <AudioToolbox/AudioFile.h>
 #include <sndfile/sndfile.h>
@@ -43,9 +47,11 @@
 static EncoderController *sharedController = nil;
 
 @interface EncoderController (Private)
-- (void)	runEncoder:(Class)encoderClass taskInfo:(TaskInfo *)taskInfo encoderSettings:(NSDictionary *)encoderSettings;
+- (void)	runEncoders:(NSArray *)outputFormats taskInfo:(TaskInfo *)taskInfo decoderFanOutIdentifier:(NSString *)identifier firstSinkIndex:(NSUInteger)firstSinkIndex;
+- (void)	runEncoder:(Class)encoderClass taskInfo:(TaskInfo *)taskInfo encoderSettings:(NSDictionary *)encoderSettings decoderFanOutIdentifier:(NSString *)identifier sinkIndex:(NSUInteger)sinkIndex;
 - (void)	addTask:(EncoderTask *)task;
 - (void)	removeTask:(EncoderTask *)task;
+- (void)	sampleTaskStatus:(NSTimer *)timer;
 - (void)	spawnThreads;
 @end
 
@@ -81,6 +87,10 @@ static EncoderController *sharedController = nil;
 {
 	if((self = [super initWithWindowNibName:@"Encoder"])) {		
 		_tasks = [[NSMutableArray alloc] init];
+		
+		// Bound the PCM buffers held by all the decoders the tasks open
+		NSInteger megabytes = [[NSUserDefaults standardUserDefaults] integerForKey:@"maximumDecoderBufferMegabytes"];
+		[Decoder setBufferMemoryLimit:(0 < megabytes ? (NSUInteger)megabytes * 1024 * 1024 : 0)];
 	}
 	
 	return self;
@@ -128,59 +138,66 @@ static EncoderController *sharedController = nil;
 {
 	TaskInfo		*taskInfo			= [TaskInfo taskInfoWithSettings:settings metadata:metadata];
 	NSArray			*outputFormats		= [settings objectForKey:@"encoders"];
-	NSDictionary	*format				= nil;
-	NSUInteger		i					= 0;
+	NSString		*fanOutIdentifier	= nil;
 	
 	[taskInfo setInputFilenames:filenames];
 	[taskInfo setInputTracks:inputTracks];
 	
-	for(i = 0; i < [outputFormats count]; ++i) {
-		format = [outputFormats objectAtIndex:i];
+	// Decode the input once and share it among all the output formats
+	if(1 < [outputFormats count])
+		fanOutIdentifier = [DecoderFanOut registerFanOutWithFilename:[taskInfo inputFilenameAtInputFileIndex] framesToConvert:[settings objectForKey:@"framesToConvert"] sinkCount:[outputFormats count]];
+	
+	// Hold off starting the tasks until all of them exist
+	_freeze = YES;
+	
+	[self runEncoders:outputFormats taskInfo:taskInfo decoderFanOutIdentifier:fanOutIdentifier firstSinkIndex:0];
+	
+	_freeze = NO;
+	[self spawnThreads];
+}
+
+- (void) encodeRegionsOfFile:(NSString *)filename metadata:(NSArray *)metadata settings:(NSArray *)settings
+{
+	NSMutableArray	*regions			= [NSMutableArray array];
+	NSArray			*outputFormats		= nil;
+	NSDictionary	*region				= nil;
+	NSString		*fanOutIdentifier	= nil;
+	TaskInfo		*taskInfo			= nil;
+	NSUInteger		sinkIndex			= 0;
+	NSUInteger		i, j;
+	
+	NSParameterAssert(nil != filename);
+	NSParameterAssert([metadata count] == [settings count]);
+	
+	// One sink for each output format of each region
+	for(i = 0; i < [settings count]; ++i) {
+		outputFormats	= [[settings objectAtIndex:i] objectForKey:@"encoders"];
+		region			= [[settings objectAtIndex:i] objectForKey:@"framesToConvert"];
 		
-		switch([[format objectForKey:@"component"] intValue]) {
-			
-			case kComponentFLAC:
-				[self runEncoder:[FLACEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentOggFLAC:
-				[self runEncoder:[OggFLACEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentWavPack:
-				[self runEncoder:[WavPackEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentMonkeysAudio:
-				[self runEncoder:[MonkeysAudioEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentOggVorbis:
-				[self runEncoder:[OggVorbisEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentMP3:
-				[self runEncoder:[MP3EncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentOggSpeex:
-				[self runEncoder:[OggSpeexEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentCoreAudio:
-				[self runEncoder:[CoreAudioEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			case kComponentLibsndfile:
-				[self runEncoder:[LibsndfileEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"]];
-				break;
-				
-			default:
-				NSLog(@"Unknown component: %@", [format objectForKey:@"component"]);
-				break;
-		}
+		for(j = 0; j < [outputFormats count]; ++j)
+			[regions addObject:(nil != region ? region : [NSDictionary dictionary])];
+	}
+	
+	if(0 == [regions count])
+		return;
+	
+	// A single pass over the file feeds every region's encoders
+	fanOutIdentifier = [DecoderFanOut registerFanOutWithFilename:filename regions:regions];
+	
+	_freeze = YES;
+	
+	for(i = 0; i < [settings count]; ++i) {
+		outputFormats	= [[settings objectAtIndex:i] objectForKey:@"encoders"];
+		taskInfo		= [TaskInfo taskInfoWithSettings:[settings objectAtIndex:i] metadata:[metadata objectAtIndex:i]];
+		
+		[taskInfo setInputFilenames:[NSArray arrayWithObject:filename]];
 		
-	}	
+		[self runEncoders:outputFormats taskInfo:taskInfo decoderFanOutIdentifier:fanOutIdentifier firstSinkIndex:sinkIndex];
+		sinkIndex += [outputFormats count];
+	}
+	
+	_freeze = NO;
+	[self spawnThreads];
 }
 
 - (BOOL) documentHasEncoderTasks:(CompactDiscDocument *)document
@@ -256,6 +273,9 @@ static EncoderController *sharedController = nil;
 
 - (void) encoderTaskDidStart:(EncoderTask *)task notify:(BOOL)notify
 {
+	// A worker took the task from the queue, so there is room for another
+	[self spawnThreads];
+	
 	if(NO == notify)
 		return;
 	
@@ -353,11 +373,88 @@ static EncoderController *sharedController = nil;
 - (NSUInteger)	countOfTasks							{ return [_tasks count]; }
 - (BOOL)		hasTasks								{ return (0 != [_tasks count]); }
 
+- (TaskScheduler *) scheduler
+{
+	NSInteger workerCount;
+	
+	if(nil == _scheduler) {
+		// Extra workers only contend for the same cores
+		workerCount = [[NSUserDefaults standardUserDefaults] integerForKey:@"maximumEncoderThreads"];
+		if(0 >= workerCount || (NSUInteger)workerCount > [[NSProcessInfo processInfo] activeProcessorCount])
+			workerCount = 0;
+		
+		_scheduler = [[TaskScheduler alloc] initWithWorkerCount:(NSUInteger)workerCount];
+	}
+	
+	return _scheduler;
+}
+
+- (NSUInteger)	queueDepth								{ return [[self scheduler] queueDepth]; }
+- (double)		utilization								{ return [[self scheduler] utilization]; }
+
 @end
 
 @implementation EncoderController (Private)
 
-- (void) runEncoder:(Class)encoderClass taskInfo:(TaskInfo *)taskInfo encoderSettings:(NSDictionary *)encoderSettings
+- (void) runEncoders:(NSArray *)outputFormats taskInfo:(TaskInfo *)taskInfo decoderFanOutIdentifier:(NSString *)identifier firstSinkIndex:(NSUInteger)firstSinkIndex
+{
+	NSDictionary	*format				= nil;
+	NSUInteger		i					= 0;
+	
+	for(i = 0; i < [outputFormats count]; ++i) {
+		format = [outputFormats objectAtIndex:i];
+		
+		switch([[format objectForKey:@"component"] intValue]) {
+			
+			case kComponentFLAC:
+				[self runEncoder:[FLACEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentOggFLAC:
+				[self runEncoder:[OggFLACEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentWavPack:
+				[self runEncoder:[WavPackEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentMonkeysAudio:
+				[self runEncoder:[MonkeysAudioEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentOggVorbis:
+				[self runEncoder:[OggVorbisEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentMP3:
+				[self runEncoder:[MP3EncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentOggSpeex:
+				[self runEncoder:[OggSpeexEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentCoreAudio:
+				[self runEncoder:[CoreAudioEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			case kComponentLibsndfile:
+				[self runEncoder:[LibsndfileEncoderTask class] taskInfo:taskInfo encoderSettings:[format objectForKey:@"settings"] decoderFanOutIdentifier:identifier sinkIndex:firstSinkIndex + i];
+				break;
+				
+			default:
+				NSLog(@"Unknown component: %@", [format objectForKey:@"component"]);
+				if(nil != identifier)
+					[DecoderFanOut detachSink:firstSinkIndex + i fromFanOutWithIdentifier:identifier];
+				if([SectorStream isStreamIdentifier:[taskInfo inputFilenameAtInputFileIndex]])
+					[SectorStream releaseStreamWithIdentifier:[taskInfo inputFilenameAtInputFileIndex]];
+				break;
+		}
+		
+	}
+}
+
+- (void) runEncoder:(Class)encoderClass taskInfo:(TaskInfo *)taskInfo encoderSettings:(NSDictionary *)encoderSettings decoderFanOutIdentifier:(NSString *)identifier sinkIndex:(NSUInteger)sinkIndex
 {
 	// Create the task
 	EncoderTask *encoderTask = [[encoderClass alloc] init];
@@ -368,6 +465,10 @@ static EncoderController *sharedController = nil;
 	// Pass the encoding configuration parameters
 	[encoderTask setEncoderSettings:encoderSettings];
 	
+	// Share the decoder with the other output formats
+	if(nil != identifier)
+		[encoderTask setDecoderFanOutIdentifier:identifier sinkIndex:sinkIndex];
+	
 	// Show the encoder window if it is hidden
 	if(NO == [[NSApplication sharedApplication] isHidden] && [[NSUserDefaults standardUserDefaults] boolForKey:@"useDynamicWindows"])
 		[[self window] orderFront:self];
@@ -377,33 +478,83 @@ static EncoderController *sharedController = nil;
 	[self spawnThreads];
 }
 
-- (void)		addTask:(EncoderTask *)task				{ [[self mutableArrayValueForKey:@"tasks"] addObject:task]; }
+- (void) addTask:(EncoderTask *)task
+{
+	// Measure utilization per batch
+	if(NO == [self hasTasks])
+		[[self scheduler] resetStatistics];
+	
+	[[self mutableArrayValueForKey:@"tasks"] addObject:task];
+	
+	// Encoders publish their progress through each task's TaskStatus, which is sampled here
+	if(nil == _statusTimer) {
+		_statusTimer = [[NSTimer timerWithTimeInterval:0.25 target:self selector:@selector(sampleTaskStatus:) userInfo:nil repeats:YES] retain];
+		[[NSRunLoop currentRunLoop] addTimer:_statusTimer forMode:NSRunLoopCommonModes];
+	}
+}
 
 - (void) removeTask:(EncoderTask *)task
 {
 	[[self mutableArrayValueForKey:@"tasks"] removeObject:task];
 	
+	if(NO == [self hasTasks]) {
+		[_statusTimer invalidate];
+		[_statusTimer release];
+		_statusTimer = nil;
+	}
+	
 	// Hide the window if no more tasks
 	if(NO == [self hasTasks] && [[NSUserDefaults standardUserDefaults] boolForKey:@"useDynamicWindows"])
 		[[self window] performClose:self];
 }
 
+- (void) sampleTaskStatus:(NSTimer *)timer
+{
+	EncoderTask		*task;
+	
+	for(task in _tasks) {
+		if([task started] && NO == [task stopped] && NO == [task completed])
+			[task sampleStatus];
+	}
+}
+
 - (void) spawnThreads
 {
-	NSUInteger	maxThreads		= (NSUInteger) [[NSUserDefaults standardUserDefaults] integerForKey:@"maximumEncoderThreads"];
-	NSUInteger	i;
-	NSUInteger	limit;
+	TaskScheduler	*scheduler		= [self scheduler];
+	NSArray			*pending		= nil;
+	NSString		*fanOut			= nil;
+	EncoderTask		*task;
+	EncoderTask		*sibling;
 	
 	if(0 == [_tasks count] || _freeze)
 		return;
 	
-	limit = (maxThreads < [_tasks count] ? maxThreads : [_tasks count]);
+	// Admit the most expensive waiting tasks first, keeping only one queued job per worker
+	// so the rest of the batch is still reordered as tasks arrive and can be stopped cheaply
+	pending = [_tasks sortedArrayUsingDescriptors:[NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:@"estimatedCost" ascending:NO] autorelease]]];
 	
-	// Start encoding the next track(s)
-	for(i = 0; i < limit; ++i) {
-		if(NO == [[_tasks objectAtIndex:i] started])
-			[[_tasks objectAtIndex:i] run];
-	}	
+	for(task in pending) {
+		if([scheduler queueDepth] >= [scheduler workerCount])
+			break;
+		
+		// Once the decoders' buffer budget is spent, wait for running tasks to give some back
+		if(0 != [Decoder bufferMemoryLimit] && [Decoder bufferMemoryInUse] >= [Decoder bufferMemoryLimit] && 0 < [scheduler busyWorkers] + [scheduler queueDepth])
+			break;
+		
+		if([task started] || [task stopped])
+			continue;
+		
+		fanOut = [task decoderFanOutIdentifier];
+		[task run];
+		
+		// Tasks sharing a decoder advance together, so the scheduler runs them as a group
+		if(nil != fanOut) {
+			for(sibling in pending) {
+				if(NO == [sibling started] && NO == [sibling stopped] && [fanOut isEqualToString:[sibling decoderFanOutIdentifier]])
+					[sibling run];
+			}
+		}
+	}
 }
 
 @end
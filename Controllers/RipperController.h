@@ -34,6 +34,7 @@ enum {
 	IBOutlet NSArrayController	*_tasksController;
 	
 	NSMutableArray				*_tasks;
+	NSTimer						*_statusTimer;
 	BOOL						_freeze;
 }
 
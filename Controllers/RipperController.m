@@ -38,6 +38,7 @@ static RipperController *sharedController = nil;
 @interface RipperController (Private)
 - (void)	addTask:(RipperTask *)task;
 - (void)	removeTask:(RipperTask *)task;
+- (void)	sampleTaskStatus:(NSTimer *)timer;
 - (void)	spawnThreads;
 @end
 
@@ -313,7 +314,9 @@ static RipperController *sharedController = nil;
 		[[[task objectInTracksAtIndex:0] document] ejectDisc:self];
 	}
 
-	[[EncoderController sharedController] encodeFile:[task outputFilename] metadata:[[task taskInfo] metadata] settings:[[task taskInfo] settings] inputTracks:[[task taskInfo] inputTracks]];
+	// Streamed rips were handed to the encoders when they started
+	if(NO == [task streaming])
+		[[EncoderController sharedController] encodeFile:[task outputFilename] metadata:[[task taskInfo] metadata] settings:[[task taskInfo] settings] inputTracks:[[task taskInfo] inputTracks]];
 	
 	[task release];
 }
@@ -327,18 +330,43 @@ static RipperController *sharedController = nil;
 
 @implementation RipperController (Private)
 
-- (void)		addTask:(RipperTask *)task				{ [[self mutableArrayValueForKey:@"tasks"] addObject:task]; }
+- (void) addTask:(RipperTask *)task
+{
+	[[self mutableArrayValueForKey:@"tasks"] addObject:task];
+	
+	// Rippers publish their progress through each task's TaskStatus, which is sampled here
+	if(nil == _statusTimer) {
+		_statusTimer = [[NSTimer timerWithTimeInterval:0.25 target:self selector:@selector(sampleTaskStatus:) userInfo:nil repeats:YES] retain];
+		[[NSRunLoop currentRunLoop] addTimer:_statusTimer forMode:NSRunLoopCommonModes];
+	}
+}
 
 - (void) removeTask:(RipperTask *)task
 {
 	[[self mutableArrayValueForKey:@"tasks"] removeObject:task];
 	
+	if(NO == [self hasTasks]) {
+		[_statusTimer invalidate];
+		[_statusTimer release];
+		_statusTimer = nil;
+	}
+	
 	// Hide the window if no more tasks
 	if(NO == [self hasTasks] && [[NSUserDefaults standardUserDefaults] boolForKey:@"useDynamicWindows"]) {
 		[[self window] performClose:self];
 	}
 }
 
+- (void) sampleTaskStatus:(NSTimer *)timer
+{
+	RipperTask		*task;
+	
+	for(task in _tasks) {
+		if([task started] && NO == [task stopped] && NO == [task completed])
+			[task sampleStatus];
+	}
+}
+
 - (void) spawnThreads
 {
 	NSMutableArray	*activeDrives = [NSMutableArray arrayWithCapacity:4];
@@ -552,23 +552,51 @@
 		[settings setValue:albumArt forKey:@"albumArt"];
 	}
 
-	NSArray *selectedTracks = [self selectedTracks];
+	// Group the selected tracks by the file containing them, preserving their order
+	NSArray				*selectedTracks		= [self selectedTracks];
+	NSMutableArray		*filenames			= [NSMutableArray array];
+	NSMutableDictionary	*tracksByFilename	= [NSMutableDictionary dictionary];
+	
 	for(i = 0; i < [selectedTracks count]; ++i) {
-		CueSheetTrack *currentTrack = [selectedTracks objectAtIndex:i];
+		CueSheetTrack	*currentTrack	= [selectedTracks objectAtIndex:i];
+		NSString		*filename		= [currentTrack filename];
 		
-		NSString				*filename			= [currentTrack filename];
-		AudioMetadata			*metadata			= [currentTrack metadata];
-		NSMutableDictionary		*framesToConvert	= [NSMutableDictionary dictionary];
-		NSMutableDictionary		*trackSettings		= [NSMutableDictionary dictionary];
+		if(nil == [tracksByFilename objectForKey:filename]) {
+			[filenames addObject:filename];
+			[tracksByFilename setObject:[NSMutableArray array] forKey:filename];
+		}
 		
-		[framesToConvert setValue:[NSNumber numberWithLongLong:[currentTrack startingFrame]] forKey:@"startingFrame"];
-		[framesToConvert setValue:[NSNumber numberWithUnsignedInt:[currentTrack frameCount]] forKey:@"frameCount"];
+		[[tracksByFilename objectForKey:filename] addObject:currentTrack];
+	}
+	
+	for(i = 0; i < [filenames count]; ++i) {
+		NSString		*filename		= [filenames objectAtIndex:i];
+		NSArray			*tracks			= [tracksByFilename objectForKey:filename];
+		NSMutableArray	*metadata		= [NSMutableArray array];
+		NSMutableArray	*allSettings	= [NSMutableArray array];
+		NSUInteger		j;
 		
-		[trackSettings setValue:framesToConvert forKey:@"framesToConvert"];
-		[trackSettings addEntriesFromDictionary:settings];
+		for(j = 0; j < [tracks count]; ++j) {
+			CueSheetTrack			*currentTrack		= [tracks objectAtIndex:j];
+			NSMutableDictionary		*framesToConvert	= [NSMutableDictionary dictionary];
+			NSMutableDictionary		*trackSettings		= [NSMutableDictionary dictionary];
+			
+			[framesToConvert setValue:[NSNumber numberWithLongLong:[currentTrack startingFrame]] forKey:@"startingFrame"];
+			[framesToConvert setValue:[NSNumber numberWithUnsignedInt:[currentTrack frameCount]] forKey:@"frameCount"];
+			
+			[trackSettings setValue:framesToConvert forKey:@"framesToConvert"];
+			[trackSettings addEntriesFromDictionary:settings];
+			
+			[metadata addObject:[currentTrack metadata]];
+			[allSettings addObject:trackSettings];
+		}
 
 		@try {
-			[[EncoderController sharedController] encodeFile:filename metadata:metadata settings:trackSettings];
+			// Split several tracks out of one image with a single pass over it
+			if(1 < [tracks count])
+				[[EncoderController sharedController] encodeRegionsOfFile:filename metadata:metadata settings:allSettings];
+			else
+				[[EncoderController sharedController] encodeFile:filename metadata:[metadata objectAtIndex:0] settings:[allSettings objectAtIndex:0]];
 		}
 		
 		@catch(NSException *exception) {
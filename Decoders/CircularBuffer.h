@@ -18,14 +18,23 @@
 
 #import <Cocoa/Cocoa.h>
 
-// A simple implementation of a circular (AKA ring) buffer
+// A single-producer/single-consumer circular (AKA ring) buffer:
+//   - The storage is mapped twice in a row in virtual memory, so the readable and writable
+//     regions are always contiguous and never need to be normalized
+//   - One thread may write (putData, exposeBufferForWriting/wroteBytes, resize) while another
+//     reads (getData, exposeBufferForReading/readBytes, reset) without locking
+//   - resize: waits for an in-progress getData to finish; a pointer returned by
+//     exposeBufferForReading is not valid across a resize
 @interface CircularBuffer : NSObject
 {
 	uint8_t			*_buffer;
 	NSUInteger		_bufsize;
 
-	uint8_t			*_readPtr;
-	uint8_t			*_writePtr;
+	NSUInteger		_readIndex;		// Total bytes read; only the consumer stores to it
+	NSUInteger		_writeIndex;	// Total bytes written; only the producer stores to it
+
+	int32_t			_readers;
+	int32_t			_resizing;
 }
 
 - (instancetype)	initWithSize:(NSUInteger)size;
@@ -38,6 +47,9 @@
 - (NSUInteger)		bytesAvailable;
 - (NSUInteger)		freeSpaceAvailable;
 
+// The running count of bytes written, for producers that need to detect progress
+- (NSUInteger)		totalBytesWritten;
+
 - (NSUInteger)		putData:(const void *)data byteCount:(NSUInteger)byteCount;
 - (NSUInteger)		getData:(void *)buffer byteCount:(NSUInteger)byteCount;
 
@@ -18,10 +18,54 @@
 
 #import "CircularBuffer.h"
 
+#include <mach/mach.h>
+#include <sched.h>
+
+// Map size bytes of memory twice, back to back, so the buffer wraps around seamlessly
+static uint8_t *
+AllocateMirroredBuffer(NSUInteger size)
+{
+	kern_return_t	result;
+	vm_address_t	buffer;
+	vm_address_t	mirror;
+	vm_prot_t		currentProtection, maximumProtection;
+	int				attempt;
+	
+	// Another thread may grab the upper half between the calls, so retry a few times
+	for(attempt = 0; attempt < 3; ++attempt) {
+		result = vm_allocate(mach_task_self(), &buffer, 2 * size, VM_FLAGS_ANYWHERE);
+		if(KERN_SUCCESS != result)
+			return NULL;
+		
+		result = vm_deallocate(mach_task_self(), buffer + size, size);
+		if(KERN_SUCCESS != result) {
+			vm_deallocate(mach_task_self(), buffer, size);
+			return NULL;
+		}
+		
+		mirror = buffer + size;
+		result = vm_remap(mach_task_self(), &mirror, size, 0, VM_FLAGS_FIXED, mach_task_self(), buffer, FALSE, &currentProtection, &maximumProtection, VM_INHERIT_DEFAULT);
+		if(KERN_SUCCESS == result && mirror == buffer + size)
+			return (uint8_t *)buffer;
+		
+		if(KERN_SUCCESS == result)
+			vm_deallocate(mach_task_self(), mirror, size);
+		vm_deallocate(mach_task_self(), buffer, size);
+	}
+	
+	return NULL;
+}
+
+static void
+DeallocateMirroredBuffer(uint8_t *buffer, NSUInteger size)
+{
+	if(NULL != buffer)
+		vm_deallocate(mach_task_self(), (vm_address_t)buffer, 2 * size);
+}
+
 @interface CircularBuffer (Private)
-- (void)			normalizeBuffer;
-- (NSUInteger)		contiguousBytesAvailable;
-- (NSUInteger)		contiguousFreeSpaceAvailable;
+- (void)			beginReading;
+- (void)			endReading;
 @end
 
 @implementation CircularBuffer
@@ -36,55 +80,71 @@
 	NSParameterAssert(0 < size);
 	
 	if((self = [super init])) {
-		_bufsize	= size;
-		_buffer		= (uint8_t *)calloc(_bufsize, sizeof(uint8_t));
+		_bufsize	= round_page(size);
+		_buffer		= AllocateMirroredBuffer(_bufsize);
 		
-		NSAssert1(NULL != _buffer, @"Unable to allocate memory: %s", strerror(errno));
+		NSAssert(NULL != _buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 		
-		_readPtr	= _buffer;
-		_writePtr	= _buffer;
-										
 		return self;
 	}
 	return nil;
 }
 
-- (void)			reset							{ _readPtr = _writePtr = _buffer; }
+- (void)			dealloc
+{
+	DeallocateMirroredBuffer(_buffer, _bufsize);
+	_buffer = NULL;
+	
+	[super dealloc];
+}
+
+// Discards everything written so far; called from the consumer
+- (void)			reset							{ __atomic_store_n(&_readIndex, __atomic_load_n(&_writeIndex, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE); }
 - (NSUInteger)		size							{ return _bufsize; }
 
 - (void)			resize:(NSUInteger)size
 {
-	uint8_t		*newbuf;
+	uint8_t			*newbuf;
+	NSUInteger		newsize;
+	NSUInteger		count;
+	
+	newsize = round_page(size);
 	
 	// We can only grow in size, not shrink
-	if(size <= [self size])
+	if(newsize <= [self size])
 		return;
-
-	[self normalizeBuffer];
 	
-	// Allocate a new buffer of the requested size
-	newbuf		= (uint8_t *)calloc(size, sizeof(uint8_t));
-	NSAssert1(NULL != newbuf, @"Unable to allocate memory: %s", strerror(errno));
+	newbuf = AllocateMirroredBuffer(newsize);
+	NSAssert(NULL != newbuf, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 	
-	// Copy the current data into the new buffer
-	memcpy(newbuf, _buffer, [self size]);
+	// Wait for the consumer to get out of the way
+	__atomic_store_n(&_resizing, 1, __ATOMIC_SEQ_CST);
+	while(0 != __atomic_load_n(&_readers, __ATOMIC_SEQ_CST))
+		sched_yield();
 	
-	// Adjust the read and write pointers
-	_readPtr	= newbuf + (_readPtr - _buffer);
-	_writePtr	= newbuf + (_writePtr - _buffer);
-
-	// Free the old buffer and activate new one
-	free(_buffer);
-	_buffer		= newbuf;
-	_bufsize	= size;
+	// Copy the current data into the new buffer; the indices keep counting, so the data
+	// is placed where they will point in the new buffer
+	count = [self bytesAvailable];
+	memcpy(newbuf + (_readIndex % newsize), _buffer + (_readIndex % _bufsize), count);
+	
+	DeallocateMirroredBuffer(_buffer, _bufsize);
+	
+	_buffer			= newbuf;
+	_bufsize		= newsize;
+	
+	__atomic_store_n(&_resizing, 0, __ATOMIC_SEQ_CST);
 }
 
 - (NSUInteger)		bytesAvailable
-{	
-	return (_writePtr >= _readPtr ? (NSUInteger)(_writePtr - _readPtr) : [self size] - (NSUInteger)(_readPtr - _writePtr));
+{
+	NSUInteger		readIndex		= __atomic_load_n(&_readIndex, __ATOMIC_ACQUIRE);
+	NSUInteger		writeIndex		= __atomic_load_n(&_writeIndex, __ATOMIC_ACQUIRE);
+	
+	return writeIndex - readIndex;
 }
 
 - (NSUInteger)		freeSpaceAvailable				{ return _bufsize - [self bytesAvailable]; }
+- (NSUInteger)		totalBytesWritten				{ return __atomic_load_n(&_writeIndex, __ATOMIC_ACQUIRE); }
 
 - (NSUInteger)		putData:(const void *)data byteCount:(NSUInteger)byteCount
 {
@@ -92,24 +152,10 @@
 	NSParameterAssert(0 < byteCount);
 	NSParameterAssert([self freeSpaceAvailable] >= byteCount);
 	
-	if([self contiguousFreeSpaceAvailable] >= byteCount) {
-		memcpy(_writePtr, data, byteCount);
-		_writePtr += byteCount;
+	memcpy([self exposeBufferForWriting], data, byteCount);
+	[self wroteBytes:byteCount];
 
-		return byteCount;
-	}
-	else {
-		NSUInteger	blockSize		= [self contiguousFreeSpaceAvailable];
-		NSUInteger	wrapSize		= byteCount - blockSize;
-		
-		memcpy(_writePtr, data, blockSize);
-		_writePtr = _buffer;
-
-		memcpy(_writePtr, data + blockSize, wrapSize);
-		_writePtr += wrapSize;
-
-		return byteCount;
-	}
+	return byteCount;
 }
 
 - (NSUInteger)		getData:(void *)buffer byteCount:(NSUInteger)byteCount
@@ -121,110 +167,57 @@
 		return 0;
 	}
 	
+	[self beginReading];
+	
 	// Attempt to return some data, if possible
 	if(byteCount > [self bytesAvailable]) {
 		byteCount = [self bytesAvailable];
 	}
-
-	if([self contiguousBytesAvailable] >= byteCount) {
-		memcpy(buffer, _readPtr, byteCount);
-		_readPtr += byteCount;
-	}
-	else {
-		NSUInteger	blockSize		= [self contiguousBytesAvailable];
-		NSUInteger	wrapSize		= byteCount - blockSize;
-		
-		memcpy(buffer, _readPtr, blockSize);
-		_readPtr = _buffer;
-		
-		memcpy(buffer + blockSize, _readPtr, wrapSize);
-		_readPtr += wrapSize;
-	}
+	
+	memcpy(buffer, _buffer + (_readIndex % _bufsize), byteCount);
+	__atomic_store_n(&_readIndex, _readIndex + byteCount, __ATOMIC_RELEASE);
+	
+	[self endReading];
 
 	return byteCount;
 }
 
-- (const void *)	exposeBufferForReading			{ [self normalizeBuffer]; return _readPtr; }
+- (const void *)	exposeBufferForReading			{ return _buffer + (_readIndex % _bufsize); }
 
 - (void)			readBytes:(NSUInteger)byteCount
 {
-	uint8_t			*limit		= _buffer + _bufsize;
+	NSParameterAssert(byteCount <= [self bytesAvailable]);
 	
-	_readPtr += byteCount; 
-
-	if(_readPtr > limit) {
-		_readPtr = _buffer;
-	}
+	__atomic_store_n(&_readIndex, _readIndex + byteCount, __ATOMIC_RELEASE);
 }
 
-- (void *)			exposeBufferForWriting			{ [self normalizeBuffer]; return _writePtr; }
+- (void *)			exposeBufferForWriting			{ return _buffer + (_writeIndex % _bufsize); }
 
 - (void)			wroteBytes:(NSUInteger)byteCount
 {
-	uint8_t			*limit		= _buffer + _bufsize;
-	
-	_writePtr += byteCount;
+	NSParameterAssert(byteCount <= [self freeSpaceAvailable]);
 	
-	if(_writePtr > limit) {
-		_writePtr = _buffer;
-	}
+	__atomic_store_n(&_writeIndex, _writeIndex + byteCount, __ATOMIC_RELEASE);
 }
 
 @end
 
 @implementation CircularBuffer (Private)
 
-- (NSUInteger)		contiguousBytesAvailable
+- (void)			beginReading
 {
-	uint8_t			*limit		= _buffer + _bufsize;
-	
-	return (_writePtr >= _readPtr ? _writePtr - _readPtr : limit - _readPtr);
-}
-
-- (NSUInteger)		contiguousFreeSpaceAvailable
-{
-	uint8_t			*limit		= _buffer + _bufsize;
-	
-	return (_writePtr >= _readPtr ? limit - _writePtr : _readPtr - _writePtr);
-}
-
-- (void)			normalizeBuffer
-{
-	if(_writePtr == _readPtr) {		
-		_writePtr = _readPtr = _buffer;
-	}
-	else if(_writePtr > _readPtr) {
-		NSUInteger	count		= _writePtr - _readPtr;
-		NSUInteger	delta		= _readPtr - _buffer;
+	for(;;) {
+		__atomic_add_fetch(&_readers, 1, __ATOMIC_SEQ_CST);
+		if(0 == __atomic_load_n(&_resizing, __ATOMIC_SEQ_CST))
+			return;
 		
-		memmove(_buffer, _readPtr, count);
-		
-		_readPtr	= _buffer;
-		_writePtr	-= delta;
+		// A resize is in progress
+		__atomic_sub_fetch(&_readers, 1, __ATOMIC_SEQ_CST);
+		while(0 != __atomic_load_n(&_resizing, __ATOMIC_SEQ_CST))
+			sched_yield();
 	}
-	else {
-		NSUInteger		chunkASize	= [self contiguousBytesAvailable];
-		NSUInteger		chunkBSize	= [self bytesAvailable] - [self contiguousBytesAvailable];
-		uint8_t			*chunkA		= NULL;
-		uint8_t			*chunkB		= NULL;
-		
-		chunkA = (uint8_t *)calloc(chunkASize, sizeof(uint8_t));
-		NSAssert1(NULL != chunkA, @"Unable to allocate memory: %s", strerror(errno));
-		memcpy(chunkA, _readPtr, chunkASize);
-		
-		if(0 < chunkBSize) {
-			chunkB = (uint8_t *)calloc(chunkBSize, sizeof(uint8_t));
-			NSAssert1(NULL != chunkA, @"Unable to allocate memory: %s", strerror(errno));
-			memcpy(chunkB, _buffer, chunkBSize);
-		}
-		
-		memcpy(_buffer, chunkA, chunkASize);
-		memcpy(_buffer + chunkASize, chunkB, chunkBSize);
-		
-		_readPtr	= _buffer;
-		_writePtr	= _buffer + chunkASize + chunkBSize;
-	}
-	
 }
 
+- (void)			endReading						{ __atomic_sub_fetch(&_readers, 1, __ATOMIC_SEQ_CST); }
+
 @end
@@ -80,6 +80,8 @@
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	OSStatus result = ExtAudioFileDispose(_extAudioFile);
 	NSAssert1(noErr == result, @"ExtAudioFileDispose failed: %@", UTCreateStringForOSType(result));
 	
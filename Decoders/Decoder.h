@@ -21,18 +21,42 @@
 
 #import "DecoderMethods.h"
 
+#include <pthread.h>
+
 @class CircularBuffer;
+@class MappedFile;
 
 // A decoder reads audio data in some format and provides it as PCM:
 //   - The audio stream is converted to PCM and placed in _pcmBuffer
+//   - Native decoders fill _pcmBuffer with interleaved host-endian int32 samples instead,
+//     which the planar read methods can hand out without byte swapping
+//   - In read-ahead mode -fillPCMBuffer runs on a separate thread, which keeps
+//     _pcmBuffer topped up while the caller of -readAudio:frameCount: works
 @interface Decoder : NSObject <DecoderMethods>
 {
 	NSString						*_filename;		// The filename of the source
+	MappedFile						*_mappedFile;	// The source's contents, for subclasses that read through a mapping
 
 	AudioStreamBasicDescription		_pcmFormat;		// The type of PCM data provided by this source
 	CircularBuffer					*_pcmBuffer;	// The buffer which holds the PCM audio data
+	NSUInteger						_bufferMemory;	// The size of _pcmBuffer, as charged to the process-wide budget
 	
 	SInt64							_currentFrame;	// The first frame that will be returned from -readAudio:frameCount:
+	
+	BOOL							_nativeSamples;	// Set by subclasses which buffer int32 samples
+	void							*_conversionBuffer;
+	NSUInteger						_conversionBufferSize;
+	
+	// Read-ahead
+	double							_readAheadSeconds;
+	pthread_t						_readAheadThread;
+	NSCondition						*_readAheadCondition;
+	BOOL							_readAheadStop;
+	BOOL							_readAheadSuspended;
+	BOOL							_readAheadFilling;
+	BOOL							_endOfStream;
+	int32_t							_readAheadWaiting;
+	NSException						*_readAheadException;
 }
 
 // Create a Decoder of the correct type for the given file
@@ -40,13 +64,46 @@
 
 - (instancetype) initWithFilename:(NSString *)filename;
 
+// Adopt a file that is already mapped (by +decoderWithFilename:, while probing it) instead of opening it again
+- (instancetype) initWithMappedFile:(MappedFile *)mappedFile;
+
+// Whether the subclass reads its input through -mappedFile; defaults to NO
++ (BOOL) readsMappedFile;
+
 // The source of the raw audio stream
 - (NSString *) filename;
 
+// The source mapped into memory; the file is mapped on first use if it wasn't handed over
+- (MappedFile *) mappedFile;
+
 // The buffer which holds the PCM data
 - (CircularBuffer *) pcmBuffer;
 
+// The size of one frame in _pcmBuffer
+- (UInt32) bufferBytesPerFrame;
+
+// _pcmBuffer never grows while decoding; subclasses that need room for a whole codec
+// block reserve it here while opening the source
+- (void) reservePCMBufferCapacity:(NSUInteger)byteCount;
+
+// A cap on the memory all decoders in the process may hold in PCM buffers; 0 means no cap.
+// Read-ahead buffers are trimmed to what is left, and EncoderController holds back new
+// tasks while the budget is spent
++ (NSUInteger) bufferMemoryLimit;
++ (void) setBufferMemoryLimit:(NSUInteger)bufferMemoryLimit;
++ (NSUInteger) bufferMemoryInUse;
+
 // Subclasses must implement this method!
 - (void) fillPCMBuffer;
 
+// Read-ahead mode, which keeps the given number of seconds of audio decoded; 0 disables it
+- (double) readAheadSeconds;
+- (void) setReadAheadSeconds:(double)readAheadSeconds;
+
+// The read-ahead thread must be suspended around seeks, and stopped before
+// a subclass tears down its decoding state in -dealloc
+- (void) suspendReadAhead;
+- (void) resumeReadAhead;
+- (void) stopReadAhead;
+
 @end
@@ -19,73 +19,78 @@
 #import "Decoder.h"
 #import "UtilityFunctions.h"
 #import "CoreAudioUtilities.h"
-#import "CoreAudioDecoder.h"
 #import "CircularBuffer.h"
-#import "FLACDecoder.h"
-#import "LibsndfileDecoder.h"
-#import "MonkeysAudioDecoder.h"
-#import "MPEGDecoder.h"
-#import "MusepackDecoder.h"
-#import "OggFLACDecoder.h"
-#import "OggSpeexDecoder.h"
-#import "OggVorbisDecoder.h"
-#import "WavPackDecoder.h"
-#import "ShortenDecoder.h"
+#import "DecoderProbe.h"
+#import "MappedFile.h"
+#import "SectorStreamDecoder.h"
+#import "SectorStream.h"
 #import "FileFormatNotSupportedException.h"
+#import "PCMConversion.h"
 
 #include <AudioToolbox/AudioFormat.h>
 
+@interface Decoder (Private)
+- (void)	readAheadLoop;
+- (void)	waitForBytes:(NSUInteger)byteCount;
+- (UInt32)	readBufferedFrames:(void *)buffer frameCount:(UInt32)frameCount;
+- (void *)	conversionBufferForFrameCount:(UInt32)frameCount;
+- (void)	updateBufferMemory;
+@end
+
+static NSUInteger		sBufferMemoryLimit		= 0;
+static NSUInteger		sBufferMemoryInUse		= 0;
+
+static void *
+ReadAheadThreadEntry(void *arg)
+{
+	NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+	
+	[(Decoder *)arg readAheadLoop];
+	
+	[pool release];
+	return NULL;
+}
+
 @implementation Decoder
 
 + (id) decoderWithFilename:(NSString *)filename
 {
-	Decoder *result = nil;
-		
-	// Create the source based on the file's extension
-	NSArray			*coreAudioExtensions	= GetCoreAudioExtensions();
-	NSArray			*libsndfileExtensions	= GetLibsndfileExtensions();
-	NSString		*extension				= [[filename pathExtension] lowercaseString];
-
-	// Determine which type of converter to use and create it
-	if([extension isEqualToString:@"ogg"] || [extension isEqualToString:@"oga"]) {
-		// Determine the content type of the ogg stream
-		OggStreamType type = GetOggStreamType(filename);
-		NSAssert(kOggStreamTypeInvalid != type, @"The file does not appear to be an Ogg file.");
-		NSAssert(kOggStreamTypeUnknown != type, @"The Ogg file's data format was not recognized.");
-		
-		switch(type) {
-			case kOggStreamTypeVorbis:		result = [[OggVorbisDecoder alloc] initWithFilename:filename];		break;
-			case kOggStreamTypeFLAC:		result = [[OggFLACDecoder alloc] initWithFilename:filename];		break;
-			case kOggStreamTypeSpeex:		result = [[OggSpeexDecoder alloc] initWithFilename:filename];		break;
-			default:																							break;
-		}
-	}
-	else if([extension isEqualToString:@"flac"])
-		result = [[FLACDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"oggflac"])
-		result = [[OggFLACDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"ape"])
-		result = [[MonkeysAudioDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"spx"])
-		result = [[OggSpeexDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"wv"])
-		result = [[WavPackDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"mpc"])
-		result = [[MusepackDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"shn"])
-		result = [[ShortenDecoder alloc] initWithFilename:filename];
-	else if([extension isEqualToString:@"mp3"])
-		result = [[MPEGDecoder alloc] initWithFilename:filename];
-	else if([coreAudioExtensions containsObject:extension])
-		result = [[CoreAudioDecoder alloc] initWithFilename:filename];
-	else if([libsndfileExtensions containsObject:extension])
-		result = [[LibsndfileDecoder alloc] initWithFilename:filename];
-	else
+	Decoder			*result			= nil;
+	MappedFile		*mappedFile		= nil;
+	Class			decoderClass	= Nil;
+	
+	// Sector streams live in memory, not on disk
+	if([SectorStream isStreamIdentifier:filename])
+		return [[[SectorStreamDecoder alloc] initWithFilename:filename] autorelease];
+	
+	// A file probed before is not mapped unless its decoder reads the mapping
+	decoderClass = [DecoderProbe cachedDecoderClassForFilename:filename];
+	if(Nil != decoderClass && NO == [decoderClass readsMappedFile])
+		return [[[decoderClass alloc] initWithFilename:filename] autorelease];
+	
+	// The file is opened once: the probe sniffs the start of the mapping and the decoder reads the rest
+	mappedFile = [MappedFile mappedFileWithFilename:filename];
+	NSAssert1(nil != mappedFile, @"Unable to open the input file (%s).", strerror(errno));
+	
+	if(Nil == decoderClass)
+		decoderClass = [DecoderProbe decoderClassForMappedFile:mappedFile];
+	if(Nil == decoderClass)
 		@throw [FileFormatNotSupportedException exceptionWithReason:NSLocalizedStringFromTable(@"The file's format was not recognized.", @"Exceptions", @"") userInfo:nil];
+	
+	if([decoderClass readsMappedFile])
+		result = [[decoderClass alloc] initWithMappedFile:mappedFile];
+	else
+		result = [[decoderClass alloc] initWithFilename:filename];
 
 	return [result autorelease];
 }
 
++ (BOOL) readsMappedFile							{ return NO; }
+
++ (NSUInteger)	bufferMemoryLimit								{ return __atomic_load_n(&sBufferMemoryLimit, __ATOMIC_RELAXED); }
++ (void)		setBufferMemoryLimit:(NSUInteger)bufferMemoryLimit	{ __atomic_store_n(&sBufferMemoryLimit, bufferMemoryLimit, __ATOMIC_RELAXED); }
++ (NSUInteger)	bufferMemoryInUse								{ return __atomic_load_n(&sBufferMemoryInUse, __ATOMIC_RELAXED); }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	NSParameterAssert(nil != filename);
@@ -93,14 +98,37 @@
 	if((self = [super init])) {
 		_pcmBuffer = [[CircularBuffer alloc] init];
 		_filename = [filename retain];
+		
+		[self updateBufferMemory];
 	}
 	return self;
 }
 
+- (id) initWithMappedFile:(MappedFile *)mappedFile
+{
+	NSParameterAssert(nil != mappedFile);
+	
+	// Subclasses only override -initWithFilename:, so the mapping is adopted before their initializer runs
+	_mappedFile = [mappedFile retain];
+	
+	return [self initWithFilename:[mappedFile filename]];
+}
+
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
+	[_readAheadCondition release];
+	_readAheadCondition = nil;
+	[_readAheadException release];
+	_readAheadException = nil;
+	free(_conversionBuffer);
+	_conversionBuffer = NULL;
+	__atomic_sub_fetch(&sBufferMemoryInUse, _bufferMemory, __ATOMIC_RELAXED);
 	[_pcmBuffer release];
 	_pcmBuffer = nil;
+	[_mappedFile release];
+	_mappedFile = nil;
 	[_filename release];
 	_filename = nil;
 	
@@ -109,9 +137,30 @@
 
 - (NSString *)						filename			{ return [[_filename retain] autorelease]; }
 
+- (MappedFile *) mappedFile
+{
+	if(nil == _mappedFile) {
+		_mappedFile = [[MappedFile alloc] initWithFilename:[self filename]];
+		NSAssert1(nil != _mappedFile, @"Unable to open the input file (%s).", strerror(errno));
+	}
+	
+	return _mappedFile;
+}
+
 - (AudioStreamBasicDescription)		pcmFormat			{ return _pcmFormat; }
 - (CircularBuffer *)				pcmBuffer			{ return [[_pcmBuffer retain] autorelease]; }
 
+- (UInt32) bufferBytesPerFrame
+{
+	return (_nativeSamples ? [self pcmFormat].mChannelsPerFrame * (UInt32)sizeof(int32_t) : [self pcmFormat].mBytesPerFrame);
+}
+
+- (void) reservePCMBufferCapacity:(NSUInteger)byteCount
+{
+	[[self pcmBuffer] resize:byteCount];
+	[self updateBufferMemory];
+}
+
 - (NSString *) pcmFormatDescription
 {
 	OSStatus						result;
@@ -132,28 +181,51 @@
 	NSParameterAssert(NULL != bufferList);
 	NSParameterAssert(0 < bufferList->mNumberBuffers);
 	NSParameterAssert(0 < frameCount);
+	NSParameterAssert(bufferList->mBuffers[0].mDataByteSize >= frameCount * [self pcmFormat].mBytesPerPacket);
 	
-	UInt32		framesRead		= 0;	
-	UInt32		byteCount		= frameCount * [self pcmFormat].mBytesPerPacket;
-	UInt32		bytesRead		= 0;
+	UInt32		framesRead		= 0;
+	int32_t		*samples		= NULL;
+	
+	if(_nativeSamples) {
+		samples		= [self conversionBufferForFrameCount:frameCount];
+		framesRead	= [self readBufferedFrames:samples frameCount:frameCount];
+		
+		if(NO == PCMInt32ToBigEndian(samples, bufferList->mBuffers[0].mData, framesRead * [self pcmFormat].mChannelsPerFrame, [self pcmFormat].mBitsPerChannel))
+			@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil];
+	}
+	else
+		framesRead = [self readBufferedFrames:bufferList->mBuffers[0].mData frameCount:frameCount];
 
-	NSParameterAssert(bufferList->mBuffers[0].mDataByteSize >= byteCount);
+	bufferList->mBuffers[0].mNumberChannels	= [self pcmFormat].mChannelsPerFrame;
+	bufferList->mBuffers[0].mDataByteSize	= framesRead * [self pcmFormat].mBytesPerFrame;
 	
-	// If there aren't enough bytes in the buffer, fill it as much as possible
-	if([[self pcmBuffer] bytesAvailable] < byteCount)
-		[self fillPCMBuffer];
+	return framesRead;
+}
+
+- (UInt32) readInt32Channels:(int32_t **)channels frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != channels);
+	NSParameterAssert(0 < frameCount);
 	
-	// If there still aren't enough bytes available, return what we have
-	if([[self pcmBuffer] bytesAvailable] < byteCount)
-		byteCount = (UInt32)[[self pcmBuffer] bytesAvailable];
-			
-	bytesRead								= (UInt32)[[self pcmBuffer] getData:bufferList->mBuffers[0].mData byteCount:byteCount];
-	bufferList->mBuffers[0].mNumberChannels	= [self pcmFormat].mChannelsPerFrame;
-	bufferList->mBuffers[0].mDataByteSize	= bytesRead;
-	framesRead								= bytesRead / [self pcmFormat].mBytesPerFrame;
+	void		*buffer			= [self conversionBufferForFrameCount:frameCount];
+	UInt32		framesRead		= [self readBufferedFrames:buffer frameCount:frameCount];
 	
-	// Update internal state
-	_currentFrame += framesRead;
+	if(_nativeSamples)
+		PCMDeinterleaveInt32(buffer, channels, [self pcmFormat].mChannelsPerFrame, framesRead);
+	else if(NO == PCMDeinterleaveBigEndianToInt32(buffer, channels, [self pcmFormat].mChannelsPerFrame, [self pcmFormat].mBitsPerChannel, framesRead))
+		@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil];
+	
+	return framesRead;
+}
+
+- (UInt32) readFloatChannels:(float **)channels frameCount:(UInt32)frameCount
+{
+	UInt32		framesRead		= [self readInt32Channels:(int32_t **)channels frameCount:frameCount];
+	UInt32		channel;
+	
+	// The samples are converted in place
+	for(channel = 0; channel < [self pcmFormat].mChannelsPerFrame; ++channel)
+		PCMInt32ToFloat((const int32_t *)channels[channel], channels[channel], framesRead, [self pcmFormat].mBitsPerChannel);
 	
 	return framesRead;
 }
@@ -170,4 +242,234 @@
 // Subclass implementation is responsible for completely filling in _pcmFormat
 - (void)			fillPCMBuffer						{}
 
+#pragma mark Read-ahead
+
+- (double)			readAheadSeconds					{ return _readAheadSeconds; }
+
+- (void) setReadAheadSeconds:(double)readAheadSeconds
+{
+	NSParameterAssert(0 <= readAheadSeconds);
+	
+	[self stopReadAhead];
+	
+	if(0 == readAheadSeconds)
+		return;
+
+	// Size the buffer to hold the requested amount of audio, or as much of it as the budget allows
+	NSUInteger		byteCount		= (NSUInteger)(readAheadSeconds * [self pcmFormat].mSampleRate) * [self bufferBytesPerFrame];
+	NSUInteger		limit			= [Decoder bufferMemoryLimit];
+	NSUInteger		inUse			= [Decoder bufferMemoryInUse];
+	
+	if(0 != limit && byteCount > [[self pcmBuffer] size] + (limit > inUse ? limit - inUse : 0))
+		byteCount = [[self pcmBuffer] size] + (limit > inUse ? limit - inUse : 0);
+	
+	[self reservePCMBufferCapacity:byteCount];
+	
+	if(nil == _readAheadCondition)
+		_readAheadCondition = [[NSCondition alloc] init];
+	
+	_readAheadStop			= NO;
+	_readAheadSuspended		= NO;
+	_readAheadFilling		= NO;
+	_endOfStream			= NO;
+	_readAheadSeconds		= readAheadSeconds;
+	
+	int result = pthread_create(&_readAheadThread, NULL, ReadAheadThreadEntry, self);
+	if(0 != result)
+		_readAheadSeconds = 0;
+}
+
+- (void) suspendReadAhead
+{
+	if(0 == _readAheadSeconds)
+		return;
+	
+	[_readAheadCondition lock];
+	_readAheadSuspended = YES;
+	while(_readAheadFilling)
+		[_readAheadCondition wait];
+	[_readAheadCondition unlock];
+}
+
+- (void) resumeReadAhead
+{
+	if(0 == _readAheadSeconds)
+		return;
+	
+	[_readAheadCondition lock];
+	_readAheadSuspended		= NO;
+	_endOfStream			= NO;
+	[_readAheadException release];
+	_readAheadException		= nil;
+	[_readAheadCondition broadcast];
+	[_readAheadCondition unlock];
+}
+
+- (void) stopReadAhead
+{
+	if(0 == _readAheadSeconds)
+		return;
+	
+	[_readAheadCondition lock];
+	_readAheadStop = YES;
+	[_readAheadCondition broadcast];
+	[_readAheadCondition unlock];
+	
+	pthread_join(_readAheadThread, NULL);
+	
+	_readAheadSeconds = 0;
+}
+
+@end
+
+@implementation Decoder (Private)
+
+- (void) readAheadLoop
+{
+	CircularBuffer		*buffer			= [self pcmBuffer];
+	NSUInteger			threshold		= [buffer size] / 2;
+	NSUInteger			bytesWritten;
+	NSException			*exception;
+	
+	for(;;) {
+		
+		// Wait until there is room for a worthwhile amount of audio
+		[_readAheadCondition lock];
+		for(;;) {
+			if(_readAheadStop || (NO == _readAheadSuspended && NO == _endOfStream && [buffer freeSpaceAvailable] >= threshold))
+				break;
+			
+			// The consumer checks this flag after reading, so recheck once it is visible
+			__atomic_store_n(&_readAheadWaiting, 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if(NO == _readAheadSuspended && NO == _endOfStream && [buffer freeSpaceAvailable] >= threshold) {
+				__atomic_store_n(&_readAheadWaiting, 0, __ATOMIC_RELAXED);
+				break;
+			}
+			
+			[_readAheadCondition wait];
+			__atomic_store_n(&_readAheadWaiting, 0, __ATOMIC_RELAXED);
+		}
+		
+		if(_readAheadStop) {
+			[_readAheadCondition unlock];
+			break;
+		}
+		
+		_readAheadFilling = YES;
+		[_readAheadCondition unlock];
+		
+		bytesWritten	= [buffer totalBytesWritten];
+		exception		= nil;
+		
+		@try {
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			[self fillPCMBuffer];
+			[pool release];
+		}
+		
+		@catch(NSException *e) {
+			exception = e;
+		}
+		
+		[_readAheadCondition lock];
+		_readAheadFilling = NO;
+		
+		// A fill that produces nothing means the stream is exhausted
+		if(nil != exception) {
+			_readAheadException		= [exception retain];
+			_endOfStream			= YES;
+		}
+		else if(bytesWritten == [buffer totalBytesWritten])
+			_endOfStream = YES;
+		
+		[_readAheadCondition broadcast];
+		[_readAheadCondition unlock];
+	}
+}
+
+- (void) waitForBytes:(NSUInteger)byteCount
+{
+	NSException		*exception		= nil;
+	
+	// The read-ahead thread only fills once half the buffer is free, so don't wait for more than that
+	if(byteCount > [[self pcmBuffer] size] / 2)
+		byteCount = [[self pcmBuffer] size] / 2;
+	
+	if([[self pcmBuffer] bytesAvailable] >= byteCount)
+		return;
+	
+	[_readAheadCondition lock];
+	while([[self pcmBuffer] bytesAvailable] < byteCount && NO == _endOfStream)
+		[_readAheadCondition wait];
+	
+	if([[self pcmBuffer] bytesAvailable] < byteCount)
+		exception = [[_readAheadException retain] autorelease];
+	[_readAheadCondition unlock];
+	
+	if(nil != exception)
+		@throw exception;
+}
+
+- (UInt32) readBufferedFrames:(void *)buffer frameCount:(UInt32)frameCount
+{
+	UInt32		bytesPerFrame	= [self bufferBytesPerFrame];
+	UInt32		byteCount		= frameCount * bytesPerFrame;
+	UInt32		bytesRead		= 0;
+	UInt32		framesRead		= 0;
+	
+	// If there aren't enough bytes in the buffer, fill it as much as possible
+	if(0 < _readAheadSeconds)
+		[self waitForBytes:byteCount];
+	else if([[self pcmBuffer] bytesAvailable] < byteCount)
+		[self fillPCMBuffer];
+	
+	// If there still aren't enough bytes available, return what we have
+	if([[self pcmBuffer] bytesAvailable] < byteCount)
+		byteCount = (UInt32)[[self pcmBuffer] bytesAvailable];
+	
+	bytesRead		= (UInt32)[[self pcmBuffer] getData:buffer byteCount:byteCount];
+	framesRead		= bytesRead / bytesPerFrame;
+	
+	// Update internal state
+	_currentFrame += framesRead;
+	
+	// Wake the read-ahead thread if it is waiting for space
+	if(0 < _readAheadSeconds) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&_readAheadWaiting, __ATOMIC_RELAXED)) {
+			[_readAheadCondition lock];
+			[_readAheadCondition broadcast];
+			[_readAheadCondition unlock];
+		}
+	}
+	
+	return framesRead;
+}
+
+- (void *) conversionBufferForFrameCount:(UInt32)frameCount
+{
+	NSUInteger	size	= frameCount * [self pcmFormat].mChannelsPerFrame * sizeof(int32_t);
+	
+	if(_conversionBufferSize < size) {
+		void *buffer = realloc(_conversionBuffer, size);
+		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		_conversionBuffer		= buffer;
+		_conversionBufferSize	= size;
+	}
+	
+	return _conversionBuffer;
+}
+
+- (void) updateBufferMemory
+{
+	NSUInteger size = [[self pcmBuffer] size];
+	
+	if(size != _bufferMemory) {
+		__atomic_add_fetch(&sBufferMemoryInUse, size - _bufferMemory, __ATOMIC_RELAXED);
+		_bufferMemory = size;
+	}
+}
+
 @end
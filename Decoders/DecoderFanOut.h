@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "DecoderMethods.h"
+
+#include <AudioToolbox/AudioToolbox.h>
+
+// A DecoderFanOut decodes an input once and shares the PCM with one FanOutDecoder per output format:
+//   - Decoded blocks are recycled once every attached sink has read them, so the fastest
+//     encoder can run at most one window ahead of the slowest
+//   - Each sink may read its own region of the input, such as one track of a cue sheet's image;
+//     the input is then decoded in a single pass over all the regions, and a sink waits
+//     until the decode reaches its region
+//   - Fan-outs are registered by identifier since encoders reach their tasks over Distributed Objects
+@interface DecoderFanOut : NSObject
+{
+	NSString						*_identifier;
+	NSString						*_filename;
+	SInt64							_startingFrame;
+	UInt32							_frameCount;		// 0 to decode the entire file
+
+	SInt64							*_sinkStartingFrames;	// Relative to _startingFrame
+	UInt32							*_sinkFrameCounts;		// 0 to read to the end
+
+	id <DecoderMethods>				_decoder;
+	AudioStreamBasicDescription		_pcmFormat;
+
+	NSCondition						*_condition;
+
+	NSUInteger						_sinkCount;
+	SInt64							*_sinkBlocks;		// The block each sink will read next
+	NSUInteger						_detachedSinkCount;
+
+	NSUInteger						_windowSize;
+	UInt32							_framesPerBlock;
+	int32_t							**_blocks;
+	UInt32							*_blockFrameCounts;
+	int32_t							**_fillChannels;
+
+	SInt64							_blocksDecoded;
+	BOOL							_decoding;
+	BOOL							_endOfStream;
+	NSException						*_exception;
+}
+
+// ========================================
+// Registration
+// ========================================
++ (NSString *) registerFanOutWithFilename:(NSString *)filename framesToConvert:(NSDictionary *)framesToConvert sinkCount:(NSUInteger)sinkCount;
+
+// One sink per region; each region is a framesToConvert dictionary, or an empty one for the whole file
++ (NSString *) registerFanOutWithFilename:(NSString *)filename regions:(NSArray *)regions;
++ (DecoderFanOut *) fanOutWithIdentifier:(NSString *)identifier;
++ (void) detachSink:(NSUInteger)sinkIndex fromFanOutWithIdentifier:(NSString *)identifier;
+
+// ========================================
+// Properties
+// ========================================
+- (NSString *) identifier;
+- (NSString *) filename;
+- (NSUInteger) sinkCount;
+- (UInt32) framesPerBlock;
+
+// The shared source; opened by the first sink to need it
+- (id <DecoderMethods>) decoder;
+
+// A new, unshared decoder for the same input and region
+- (id <DecoderMethods>) createPrivateDecoder;
+- (id <DecoderMethods>) createPrivateDecoderForSink:(NSUInteger)sinkIndex;
+
+// A sink's region, with the starting frame relative to the start of the shared decode
+- (SInt64) startingFrameForSink:(NSUInteger)sinkIndex;
+- (UInt32) frameCountForSink:(NSUInteger)sinkIndex;
+
+// ========================================
+// Sink access
+// ========================================
+// Returns NO if the sink started too late to read from the shared window
+// An attached sink reads from the block holding the start of its region
+- (BOOL) attachSink:(NSUInteger)sinkIndex;
+- (void) detachSink:(NSUInteger)sinkIndex;
+
+// Blocks until the requested block is available, releasing all earlier blocks for this sink
+// Blocks hold framesPerBlock host-endian int32 samples for each channel in turn
+// Returns the number of frames in the block, or 0 at the end of the stream
+- (UInt32) readBlock:(SInt64)block forSink:(NSUInteger)sinkIndex samples:(const int32_t **)samples;
+
+@end
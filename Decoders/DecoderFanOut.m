@@ -0,0 +1,468 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "DecoderFanOut.h"
+#import "Decoder.h"
+#import "RegionDecoder.h"
+
+// The amount of decoded audio held for the sinks
+#define FANOUT_FRAMES_PER_BLOCK		4096
+#define FANOUT_WINDOW_SIZE			16
+
+// Sinks reading different regions are far apart in the stream, so their window is widened
+// until it holds this much audio and the encoders for several tracks can run at once
+#define FANOUT_REGION_WINDOW_BYTES	(64 * 1024 * 1024)
+
+// A sink that has not read its first block yet holds the window at that block, but only
+// for this long; after that it is left behind and falls back to a private decoder
+#define FANOUT_ATTACH_TIMEOUT		5.0
+
+// Sink states other than a block number
+#define kFanOutSinkPending			((SInt64)-1)
+#define kFanOutSinkDetached			INT64_MAX
+
+static NSMutableDictionary *sFanOuts = nil;
+
+@interface DecoderFanOut (Private)
+- (id)			initWithIdentifier:(NSString *)identifier filename:(NSString *)filename regions:(NSArray *)regions;
+- (id <DecoderMethods>) createDecoderWithStartingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount;
+- (void)		openDecoder;
+- (SInt64)		oldestBlockInUse;
+- (BOOL)		demotePendingSinks;
+- (void)		decodeNextBlock;
+- (UInt32)		fillBlock:(int32_t *)block;
+@end
+
+@implementation DecoderFanOut
+
+#pragma mark Registration
+
++ (NSString *) registerFanOutWithFilename:(NSString *)filename framesToConvert:(NSDictionary *)framesToConvert sinkCount:(NSUInteger)sinkCount
+{
+	NSMutableArray	*regions		= [NSMutableArray arrayWithCapacity:sinkCount];
+	NSUInteger		i;
+	
+	// Every output format reads the same region
+	for(i = 0; i < sinkCount; ++i)
+		[regions addObject:(nil != framesToConvert ? framesToConvert : [NSDictionary dictionary])];
+	
+	return [self registerFanOutWithFilename:filename regions:regions];
+}
+
++ (NSString *) registerFanOutWithFilename:(NSString *)filename regions:(NSArray *)regions
+{
+	NSString		*identifier		= [[NSProcessInfo processInfo] globallyUniqueString];
+	DecoderFanOut	*fanOut			= [[DecoderFanOut alloc] initWithIdentifier:identifier filename:filename regions:regions];
+
+	@synchronized(self) {
+		if(nil == sFanOuts)
+			sFanOuts = [[NSMutableDictionary alloc] init];
+		
+		[sFanOuts setObject:fanOut forKey:identifier];
+	}
+	
+	[fanOut release];
+	
+	return identifier;
+}
+
++ (DecoderFanOut *) fanOutWithIdentifier:(NSString *)identifier
+{
+	DecoderFanOut	*fanOut		= nil;
+	
+	@synchronized(self) {
+		fanOut = [[sFanOuts objectForKey:identifier] retain];
+	}
+	
+	return [fanOut autorelease];
+}
+
++ (void) detachSink:(NSUInteger)sinkIndex fromFanOutWithIdentifier:(NSString *)identifier
+{
+	[[self fanOutWithIdentifier:identifier] detachSink:sinkIndex];
+}
+
+- (void) dealloc
+{
+	NSUInteger		i;
+	
+	if(NULL != _blocks) {
+		for(i = 0; i < _windowSize; ++i)
+			free(_blocks[i]);
+		free(_blocks);
+		_blocks = NULL;
+	}
+	
+	free(_blockFrameCounts);		_blockFrameCounts = NULL;
+	free(_fillChannels);			_fillChannels = NULL;
+	free(_sinkBlocks);				_sinkBlocks = NULL;
+	free(_sinkStartingFrames);		_sinkStartingFrames = NULL;
+	free(_sinkFrameCounts);			_sinkFrameCounts = NULL;
+	
+	[(NSObject *)_decoder release];	_decoder = nil;
+	[_exception release];			_exception = nil;
+	[_condition release];			_condition = nil;
+	[_filename release];			_filename = nil;
+	[_identifier release];			_identifier = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+- (NSString *)			identifier						{ return [[_identifier retain] autorelease]; }
+- (NSString *)			filename						{ return [[_filename retain] autorelease]; }
+- (NSUInteger)			sinkCount						{ return _sinkCount; }
+- (UInt32)				framesPerBlock					{ return _framesPerBlock; }
+
+- (id <DecoderMethods>) decoder
+{
+	[_condition lock];
+	@try {
+		[self openDecoder];
+	}
+	
+	@finally {
+		[_condition unlock];
+	}
+	
+	return [[(NSObject *)_decoder retain] autorelease];
+}
+
+- (id <DecoderMethods>) createPrivateDecoder
+{
+	return [self createDecoderWithStartingFrame:_startingFrame frameCount:_frameCount];
+}
+
+- (id <DecoderMethods>) createPrivateDecoderForSink:(NSUInteger)sinkIndex
+{
+	NSParameterAssert(sinkIndex < _sinkCount);
+	
+	return [self createDecoderWithStartingFrame:_startingFrame + _sinkStartingFrames[sinkIndex] frameCount:_sinkFrameCounts[sinkIndex]];
+}
+
+- (SInt64) startingFrameForSink:(NSUInteger)sinkIndex
+{
+	NSParameterAssert(sinkIndex < _sinkCount);
+	return _sinkStartingFrames[sinkIndex];
+}
+
+- (UInt32) frameCountForSink:(NSUInteger)sinkIndex
+{
+	NSParameterAssert(sinkIndex < _sinkCount);
+	return _sinkFrameCounts[sinkIndex];
+}
+
+#pragma mark Sink access
+
+- (BOOL) attachSink:(NSUInteger)sinkIndex
+{
+	BOOL	attached	= NO;
+	
+	NSParameterAssert(sinkIndex < _sinkCount);
+	
+	[_condition lock];
+	if(kFanOutSinkPending == _sinkBlocks[sinkIndex]) {
+		_sinkBlocks[sinkIndex]	= _sinkStartingFrames[sinkIndex] / _framesPerBlock;
+		attached				= YES;
+	}
+	[_condition unlock];
+	
+	return attached;
+}
+
+- (void) detachSink:(NSUInteger)sinkIndex
+{
+	BOOL	finished	= NO;
+	
+	NSParameterAssert(sinkIndex < _sinkCount);
+	
+	[_condition lock];
+	if(kFanOutSinkDetached != _sinkBlocks[sinkIndex]) {
+		_sinkBlocks[sinkIndex] = kFanOutSinkDetached;
+		++_detachedSinkCount;
+		[_condition broadcast];
+	}
+	finished = (_detachedSinkCount == _sinkCount);
+	[_condition unlock];
+	
+	// Once every sink is gone the fan-out is no longer needed
+	if(finished) {
+		@synchronized([DecoderFanOut class]) {
+			[sFanOuts removeObjectForKey:[self identifier]];
+		}
+	}
+}
+
+- (UInt32) readBlock:(SInt64)block forSink:(NSUInteger)sinkIndex samples:(const int32_t **)samples
+{
+	UInt32		frameCount		= 0;
+	
+	NSParameterAssert(sinkIndex < _sinkCount);
+	NSParameterAssert(0 <= block);
+	NSParameterAssert(NULL != samples);
+	
+	[_condition lock];
+	
+	@try {
+		NSAssert(kFanOutSinkDetached != _sinkBlocks[sinkIndex] && kFanOutSinkPending != _sinkBlocks[sinkIndex], @"The sink is not attached.");
+		NSAssert(block >= _sinkBlocks[sinkIndex], @"Blocks must be read in order.");
+
+		// Moving to this block releases the earlier ones
+		if(block != _sinkBlocks[sinkIndex]) {
+			_sinkBlocks[sinkIndex] = block;
+			[_condition broadcast];
+		}
+
+		[self openDecoder];
+
+		for(;;) {
+			if(nil != _exception)
+				@throw _exception;
+			
+			if(block < _blocksDecoded) {
+				*samples	= _blocks[block % _windowSize];
+				frameCount	= _blockFrameCounts[block % _windowSize];
+				break;
+			}
+			
+			if(_endOfStream)
+				break;
+			
+			// Decode on behalf of all sinks if nobody else is and a slot is free
+			if(NO == _decoding && _blocksDecoded < [self oldestBlockInUse] + (SInt64)_windowSize) {
+				[self decodeNextBlock];
+				continue;
+			}
+			
+			if(NO == [_condition waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:FANOUT_ATTACH_TIMEOUT]])
+				[self demotePendingSinks];
+		}
+	}
+	
+	@finally {
+		[_condition unlock];
+	}
+	
+	return frameCount;
+}
+
+@end
+
+@implementation DecoderFanOut (Private)
+
+- (id) initWithIdentifier:(NSString *)identifier filename:(NSString *)filename regions:(NSArray *)regions
+{
+	NSDictionary	*region;
+	SInt64			startingFrame, endingFrame;
+	UInt32			frameCount;
+	BOOL			toEnd;
+	NSUInteger		i;
+	
+	NSParameterAssert(nil != identifier);
+	NSParameterAssert(nil != filename);
+	NSParameterAssert(0 < [regions count]);
+	
+	if((self = [super init])) {
+		_identifier			= [identifier retain];
+		_filename			= [filename retain];
+		
+		_condition			= [[NSCondition alloc] init];
+		
+		_sinkCount			= [regions count];
+		_sinkBlocks			= calloc(_sinkCount, sizeof(SInt64));
+		_sinkStartingFrames	= calloc(_sinkCount, sizeof(SInt64));
+		_sinkFrameCounts	= calloc(_sinkCount, sizeof(UInt32));
+		NSAssert(NULL != _sinkBlocks && NULL != _sinkStartingFrames && NULL != _sinkFrameCounts, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		// The shared decode spans every region
+		_startingFrame		= INT64_MAX;
+		endingFrame			= 0;
+		toEnd				= NO;
+		
+		for(i = 0; i < _sinkCount; ++i) {
+			region			= [regions objectAtIndex:i];
+			startingFrame	= [[region valueForKey:@"startingFrame"] longLongValue];
+			frameCount		= [[region valueForKey:@"frameCount"] unsignedIntValue];
+			
+			_sinkBlocks[i]			= kFanOutSinkPending;
+			_sinkStartingFrames[i]	= startingFrame;
+			_sinkFrameCounts[i]		= frameCount;
+			
+			_startingFrame	= MIN(_startingFrame, startingFrame);
+			endingFrame		= MAX(endingFrame, startingFrame + frameCount);
+			toEnd			= toEnd || 0 == frameCount;
+		}
+		
+		_frameCount			= (toEnd ? 0 : (UInt32)(endingFrame - _startingFrame));
+		
+		for(i = 0; i < _sinkCount; ++i)
+			_sinkStartingFrames[i] -= _startingFrame;
+		
+		_windowSize			= FANOUT_WINDOW_SIZE;
+		_framesPerBlock		= FANOUT_FRAMES_PER_BLOCK;
+	}
+	return self;
+}
+
+- (id <DecoderMethods>) createDecoderWithStartingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount
+{
+	id <DecoderMethods>		decoder				= nil;
+	double					readAheadSeconds	= [[NSUserDefaults standardUserDefaults] doubleForKey:@"decoderReadAheadSeconds"];
+	
+	if(0 != frameCount)
+		decoder = [RegionDecoder decoderWithFilename:[self filename] startingFrame:startingFrame frameCount:frameCount];
+	else if(0 != startingFrame)
+		decoder = [RegionDecoder decoderWithFilename:[self filename] startingFrame:startingFrame];
+	else
+		decoder = [Decoder decoderWithFilename:[self filename]];
+	
+	if(0 < readAheadSeconds)
+		[(Decoder *)decoder setReadAheadSeconds:readAheadSeconds];
+	
+	return decoder;
+}
+
+// Called with the lock held
+- (void) openDecoder
+{
+	NSUInteger		blockBytes;
+	NSUInteger		i;
+	
+	if(nil != _decoder)
+		return;
+	
+	_decoder	= [(NSObject *)[self createPrivateDecoder] retain];
+	_pcmFormat	= [_decoder pcmFormat];
+	
+	// Widen the window for sinks that start at different points
+	for(i = 1; i < _sinkCount; ++i) {
+		if(_sinkStartingFrames[i] != _sinkStartingFrames[0]) {
+			blockBytes	= _framesPerBlock * _pcmFormat.mChannelsPerFrame * sizeof(int32_t);
+			_windowSize	= MAX(_windowSize, FANOUT_REGION_WINDOW_BYTES / blockBytes);
+			
+			if(0 != [Decoder bufferMemoryLimit])
+				_windowSize = MAX(FANOUT_WINDOW_SIZE, MIN(_windowSize, [Decoder bufferMemoryLimit] / 2 / blockBytes));
+			break;
+		}
+	}
+	
+	_blocks				= calloc(_windowSize, sizeof(int32_t *));
+	_blockFrameCounts	= calloc(_windowSize, sizeof(UInt32));
+	_fillChannels		= calloc(_pcmFormat.mChannelsPerFrame, sizeof(int32_t *));
+	NSAssert(NULL != _blocks && NULL != _blockFrameCounts && NULL != _fillChannels, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+}
+
+// Called with the lock held
+- (SInt64) oldestBlockInUse
+{
+	SInt64			oldest		= kFanOutSinkDetached;
+	NSUInteger		i;
+	
+	// A sink that hasn't attached yet will start at the block holding the start of its region
+	for(i = 0; i < _sinkCount; ++i) {
+		SInt64 block = (kFanOutSinkPending == _sinkBlocks[i] ? _sinkStartingFrames[i] / _framesPerBlock : _sinkBlocks[i]);
+		if(block < oldest)
+			oldest = block;
+	}
+	
+	return oldest;
+}
+
+// Called with the lock held
+- (BOOL) demotePendingSinks
+{
+	BOOL			demoted		= NO;
+	NSUInteger		i;
+	
+	// Only sinks holding the window back are left behind; the others can still attach later
+	for(i = 0; i < _sinkCount; ++i) {
+		if(kFanOutSinkPending == _sinkBlocks[i] && _sinkStartingFrames[i] / _framesPerBlock + (SInt64)_windowSize <= _blocksDecoded) {
+			_sinkBlocks[i] = kFanOutSinkDetached;
+			++_detachedSinkCount;
+			demoted = YES;
+		}
+	}
+	
+	return demoted;
+}
+
+// Called with the lock held; the lock is dropped while decoding
+- (void) decodeNextBlock
+{
+	SInt64			block			= _blocksDecoded;
+	int32_t			*buffer			= NULL;
+	UInt32			frameCount		= 0;
+	NSException		*exception		= nil;
+	
+	// Blocks are allocated as the window first fills, since a wide window may never be used in full
+	if(NULL == _blocks[block % _windowSize]) {
+		_blocks[block % _windowSize] = calloc(_framesPerBlock * _pcmFormat.mChannelsPerFrame, sizeof(int32_t));
+		NSAssert(NULL != _blocks[block % _windowSize], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	buffer = _blocks[block % _windowSize];
+	
+	_decoding = YES;
+	[_condition unlock];
+	
+	@try {
+		frameCount = [self fillBlock:buffer];
+	}
+	
+	@catch(NSException *e) {
+		exception = [e retain];
+	}
+	
+	[_condition lock];
+	_decoding = NO;
+	
+	if(nil != exception)
+		_exception = exception;
+	else if(0 == frameCount)
+		_endOfStream = YES;
+	else {
+		_blockFrameCounts[block % _windowSize] = frameCount;
+		++_blocksDecoded;
+	}
+	
+	[_condition broadcast];
+}
+
+- (UInt32) fillBlock:(int32_t *)block
+{
+	UInt32		framesRead		= 0;
+	UInt32		frameCount;
+	UInt32		channel;
+	
+	// Decoders may return short reads before the end of the stream
+	while(framesRead < _framesPerBlock) {
+		for(channel = 0; channel < _pcmFormat.mChannelsPerFrame; ++channel)
+			_fillChannels[channel] = block + (channel * _framesPerBlock) + framesRead;
+
+		frameCount = [_decoder readInt32Channels:_fillChannels frameCount:(_framesPerBlock - framesRead)];
+		if(0 == frameCount)
+			break;
+		
+		framesRead += frameCount;
+	}
+	
+	return framesRead;
+}
+
+@end
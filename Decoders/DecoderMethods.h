@@ -30,6 +30,11 @@
 // Attempt to read frameCount frames of audio, returning the actual number of frames read
 - (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount;
 
+// Attempt to read frameCount frames of host-endian audio with one buffer per channel, returning the actual number of frames read
+// Integer samples are right-justified to the format's bits per channel, and floats are scaled to [-1, 1)
+- (UInt32) readInt32Channels:(int32_t **)channels frameCount:(UInt32)frameCount;
+- (UInt32) readFloatChannels:(float **)channels frameCount:(UInt32)frameCount;
+
 // The format of audio data provided by the source
 - (NSString *) sourceFormatDescription;
 
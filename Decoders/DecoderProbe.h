@@ -0,0 +1,43 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+@class MappedFile;
+
+// DecoderProbe chooses the Decoder subclass for a file:
+//   - The file's leading bytes are matched against the magic numbers of the supported
+//     formats, so a file with the wrong extension still gets the right decoder
+//   - Files whose contents are not recognized fall back to their extension
+//   - Results are cached by path, size and modification time, and the cache is checked
+//     with stat() before the file is mapped, so importing a directory does not map and sniff
+//     each file once per decoder it creates
+@interface DecoderProbe : NSObject
+{
+}
+
+// The class found the last time filename was probed; Nil if it has not been probed
+// or has changed since
++ (Class)		cachedDecoderClassForFilename:(NSString *)filename;
+
+// Sniffs the mapping and caches the result; returns Nil if neither the contents nor the extension are recognized
++ (Class)		decoderClassForMappedFile:(MappedFile *)mappedFile;
+
++ (void)		clearCache;
+
+@end
@@ -0,0 +1,245 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "DecoderProbe.h"
+#import "MappedFile.h"
+#import "UtilityFunctions.h"
+#import "CoreAudioUtilities.h"
+#import "CoreAudioDecoder.h"
+#import "FLACDecoder.h"
+#import "LibsndfileDecoder.h"
+#import "MonkeysAudioDecoder.h"
+#import "MPEGDecoder.h"
+#import "MusepackDecoder.h"
+#import "OggFLACDecoder.h"
+#import "OggSpeexDecoder.h"
+#import "OggVorbisDecoder.h"
+#import "WavPackDecoder.h"
+#import "ShortenDecoder.h"
+
+#include <sys/stat.h>
+
+#define PROBE_CACHE_CAPACITY		4096
+
+static NSMutableDictionary		*sProbeCache				= nil;
+static NSDictionary				*sBuiltinDecoderClasses		= nil;
+static NSSet					*sCoreAudioExtensions		= nil;
+static NSSet					*sLibsndfileExtensions		= nil;
+
+@interface DecoderProbe (Private)
++ (void)		loadExtensions;
++ (Class)		decoderClassForExtension:(NSString *)extension;
+@end
+
+// The Ogg codecs are identified by the first packet of the first page
+static Class
+DecoderClassForOggPage(const uint8_t	*bytes,
+					   size_t			length)
+{
+	size_t		segmentCount, packetLength, i;
+	
+	if(27 > length || 0 != memcmp(bytes, "OggS", 4))
+		return Nil;
+	
+	segmentCount = bytes[26];
+	if(27 + segmentCount > length)
+		return Nil;
+	
+	// The lacing values add up to the packet's length, which ends at the first value under 255
+	packetLength = 0;
+	for(i = 0; i < segmentCount; ++i) {
+		packetLength += bytes[27 + i];
+		if(255 > bytes[27 + i])
+			break;
+	}
+	
+	bytes	+= 27 + segmentCount;
+	length	-= 27 + segmentCount;
+	if(packetLength > length)
+		packetLength = length;
+	
+	if(7 <= packetLength && 0 == memcmp(bytes, "\x01vorbis", 7))
+		return [OggVorbisDecoder class];
+	else if(8 <= packetLength && 0 == memcmp(bytes, "Speex   ", 8))
+		return [OggSpeexDecoder class];
+	else if(5 <= packetLength && 0 == memcmp(bytes, "\x7f" "FLAC", 5))
+		return [OggFLACDecoder class];
+	
+	return Nil;
+}
+
+static Class
+DecoderClassForContents(const uint8_t	*bytes,
+						size_t			length)
+{
+	// Skip an ID3v2 tag; they are usually found in front of MP3s, but occasionally FLAC too
+	if(10 <= length && 0 == memcmp(bytes, "ID3", 3)) {
+		size_t tagLength = 10 + (((bytes[6] & 0x7f) << 21) | ((bytes[7] & 0x7f) << 14) | ((bytes[8] & 0x7f) << 7) | (bytes[9] & 0x7f));
+		
+		// Footer present
+		if(0x10 & bytes[5])
+			tagLength += 10;
+		
+		if(tagLength >= length)
+			return Nil;
+		
+		bytes	+= tagLength;
+		length	-= tagLength;
+	}
+	
+	if(4 > length)
+		return Nil;
+	
+	if(0 == memcmp(bytes, "fLaC", 4))
+		return [FLACDecoder class];
+	else if(0 == memcmp(bytes, "OggS", 4))
+		return DecoderClassForOggPage(bytes, length);
+	else if(0 == memcmp(bytes, "MAC ", 4))
+		return [MonkeysAudioDecoder class];
+	else if(0 == memcmp(bytes, "wvpk", 4))
+		return [WavPackDecoder class];
+	else if(0 == memcmp(bytes, "MPCK", 4) || 0 == memcmp(bytes, "MP+", 3))
+		return [MusepackDecoder class];
+	else if(0 == memcmp(bytes, "ajkg", 4))
+		return [ShortenDecoder class];
+	else if(0 == memcmp(bytes, "RIFF", 4) || 0 == memcmp(bytes, "FORM", 4) || 0 == memcmp(bytes, "caff", 4) || (8 <= length && 0 == memcmp(bytes + 4, "ftyp", 4)))
+		return [CoreAudioDecoder class];
+	
+	// An MPEG audio frame header: 11 sync bits, a valid layer, bitrate and sample rate
+	// ADTS (layer 0) is AAC and is left to the extension
+	if(0xff == bytes[0] && 0xe0 == (bytes[1] & 0xe0) && 0 != (bytes[1] & 0x06) && 0xf0 != (bytes[2] & 0xf0) && 0x0c != (bytes[2] & 0x0c))
+		return [MPEGDecoder class];
+	
+	return Nil;
+}
+
+@implementation DecoderProbe
+
++ (Class) cachedDecoderClassForFilename:(NSString *)filename
+{
+	NSParameterAssert(nil != filename);
+	
+	struct stat		sourceStat;
+	NSDictionary	*entry				= nil;
+	
+	@synchronized(self) {
+		entry = [[[sProbeCache objectForKey:filename] retain] autorelease];
+	}
+	
+	if(nil == entry || -1 == stat([filename fileSystemRepresentation], &sourceStat))
+		return Nil;
+	
+	// A cached result only stands if the file hasn't changed since it was probed
+	if((unsigned long long)sourceStat.st_size != [[entry objectForKey:@"length"] unsignedLongLongValue] || (long long)sourceStat.st_mtime != [[entry objectForKey:@"modificationTime"] longLongValue])
+		return Nil;
+	
+	return NSClassFromString([entry objectForKey:@"decoderClass"]);
+}
+
++ (Class) decoderClassForMappedFile:(MappedFile *)mappedFile
+{
+	NSParameterAssert(nil != mappedFile);
+	
+	NSString		*filename			= [mappedFile filename];
+	NSString		*extension			= [[filename pathExtension] lowercaseString];
+	NSNumber		*length				= [NSNumber numberWithUnsignedLongLong:[mappedFile length]];
+	NSNumber		*modificationTime	= [NSNumber numberWithLongLong:[mappedFile modificationTime]];
+	NSDictionary	*entry				= nil;
+	Class			decoderClass		= Nil;
+	
+	[self loadExtensions];
+	
+	decoderClass = DecoderClassForContents([mappedFile bytes], [mappedFile length]);
+	
+	// Core Audio's containers may hold formats that only libsndfile reads
+	if([CoreAudioDecoder class] == decoderClass && NO == [sCoreAudioExtensions containsObject:extension] && [sLibsndfileExtensions containsObject:extension])
+		decoderClass = [LibsndfileDecoder class];
+	
+	if(Nil == decoderClass)
+		decoderClass = [self decoderClassForExtension:extension];
+	
+	if(Nil == decoderClass)
+		return Nil;
+	
+	entry = [NSDictionary dictionaryWithObjectsAndKeys:
+		NSStringFromClass(decoderClass), @"decoderClass",
+		length, @"length",
+		modificationTime, @"modificationTime",
+		nil];
+	
+	@synchronized(self) {
+		if(nil == sProbeCache)
+			sProbeCache = [[NSMutableDictionary alloc] init];
+		
+		// Imports can touch any number of files, so start over rather than grow without bound
+		if(PROBE_CACHE_CAPACITY <= [sProbeCache count])
+			[sProbeCache removeAllObjects];
+		
+		[sProbeCache setObject:entry forKey:filename];
+	}
+	
+	return decoderClass;
+}
+
++ (void) clearCache
+{
+	@synchronized(self) {
+		[sProbeCache removeAllObjects];
+	}
+}
+
+@end
+
+@implementation DecoderProbe (Private)
+
++ (void) loadExtensions
+{
+	@synchronized(self) {
+		if(nil == sBuiltinDecoderClasses) {
+			sBuiltinDecoderClasses = [[NSDictionary alloc] initWithObjectsAndKeys:
+				[FLACDecoder class], @"flac",
+				[OggFLACDecoder class], @"oggflac",
+				[MonkeysAudioDecoder class], @"ape",
+				[OggSpeexDecoder class], @"spx",
+				[WavPackDecoder class], @"wv",
+				[MusepackDecoder class], @"mpc",
+				[ShortenDecoder class], @"shn",
+				[MPEGDecoder class], @"mp3",
+				nil];
+			
+			sCoreAudioExtensions	= [[NSSet alloc] initWithArray:GetCoreAudioExtensions()];
+			sLibsndfileExtensions	= [[NSSet alloc] initWithArray:GetLibsndfileExtensions()];
+		}
+	}
+}
+
++ (Class) decoderClassForExtension:(NSString *)extension
+{
+	Class decoderClass = [sBuiltinDecoderClasses objectForKey:extension];
+	
+	if(Nil != decoderClass)
+		return decoderClass;
+	else if([sCoreAudioExtensions containsObject:extension])
+		return [CoreAudioDecoder class];
+	else if([sLibsndfileExtensions containsObject:extension])
+		return [LibsndfileDecoder class];
+	
+	return Nil;
+}
+
+@end
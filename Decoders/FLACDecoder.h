@@ -25,6 +25,8 @@
 {
 	FLAC__StreamDecoder			*_flac;
 	FLAC__uint64				_totalSamples;
+	unsigned					_maxBlocksize;
+	BOOL						_seeking;
 }
 
 @end
@@ -18,10 +18,14 @@
 
 #import "FLACDecoder.h"
 #import "CircularBuffer.h"
+#import "PCMConversion.h"
+#import "MappedFile.h"
 
 @interface FLACDecoder (Private)
 
 - (void) setTotalSamples:(FLAC__uint64)totalSamples;
+- (void)	setMaxBlocksize:(unsigned)maxBlocksize;
+- (BOOL)	isSeeking;
 
 - (void) setSampleRate:(Float64)sampleRate;
 - (void) setBitsPerChannel:(UInt32)bitsPerChannel;
@@ -29,94 +33,72 @@
 
 @end
 
+// The stream is read from a mapping of the file instead of through stdio
+static FLAC__StreamDecoderReadStatus
+readCallback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	MappedFile		*file		= [(FLACDecoder *)client_data mappedFile];
+	
+	if(0 == *bytes)
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+	
+	*bytes = [file readBytes:buffer length:*bytes];
+	return (0 == *bytes ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE);
+}
+
+static FLAC__StreamDecoderSeekStatus
+seekCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	MappedFile		*file		= [(FLACDecoder *)client_data mappedFile];
+	return ([file seekToOffset:(off_t)absolute_byte_offset] ? FLAC__STREAM_DECODER_SEEK_STATUS_OK : FLAC__STREAM_DECODER_SEEK_STATUS_ERROR);
+}
+
+static FLAC__StreamDecoderTellStatus
+tellCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	*absolute_byte_offset = [[(FLACDecoder *)client_data mappedFile] offset];
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus
+lengthCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
+{
+	*stream_length = [[(FLACDecoder *)client_data mappedFile] length];
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool
+eofCallback(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	return [[(FLACDecoder *)client_data mappedFile] atEnd];
+}
+
 static FLAC__StreamDecoderWriteStatus 
 writeCallback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	FLACDecoder			*source					= (FLACDecoder *)client_data;
 
-	int8_t				*alias8					= NULL;
-	int16_t				*alias16				= NULL;
 	int32_t				*alias32				= NULL;
-	
-	unsigned			sample, channel;
-	int32_t				audioSample;
 		
-	// Calculate the number of audio data points contained in the frame (should be one for each channel)
-	unsigned spaceRequired = frame->header.blocksize * frame->header.channels * (frame->header.bits_per_sample / 8);
-
-	// Increase buffer size as required
-	if([[source pcmBuffer] freeSpaceAvailable] < spaceRequired)
-		[[source pcmBuffer] resize:([[source pcmBuffer] size] + spaceRequired)];
-
-	switch(frame->header.bits_per_sample) {
-		
-		case 8:
+	// The buffer holds host-endian int32 samples, which encoders can use without byte swapping
+	unsigned spaceRequired = frame->header.blocksize * frame->header.channels * sizeof(int32_t);
+
+	// -fillPCMBuffer only decodes a frame when the largest block in the stream will fit,
+	// so a frame that doesn't fit is larger than STREAMINFO claims and the stream is damaged.
+	// The frame decoded by a seek can't be put off, though; the buffer is empty then, so grow it
+	if([[source pcmBuffer] freeSpaceAvailable] < spaceRequired) {
+		if(NO == [source isSeeking])
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		[[source pcmBuffer] resize:spaceRequired];
+	}
 
-			// Interleave the audio (no need for byte swapping)
-			alias8 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					*alias8++ = (int8_t)buffer[channel][sample];
-				}
-			}
+	// Interleave the audio
+	alias32 = [[source pcmBuffer] exposeBufferForWriting];
+	PCMInterleaveInt32((const int32_t * const *)buffer, alias32, frame->header.channels, frame->header.blocksize);
 
-			[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		case 16:
-			
-			// Interleave the audio, converting to big endian byte order 
-			alias16 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					*alias16++ = (int16_t)OSSwapHostToBigInt16((int16_t)buffer[channel][sample]);
-				}
-			}
-				
-			[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		case 24:				
-			
-			// Interleave the audio, converting to big endian byte order
-			alias8 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					audioSample	= buffer[channel][sample];
-					
-					// Skip the highest byte
-					*alias8++	= (int8_t)((audioSample & 0x00ff0000) >> 16);
-					*alias8++	= (int8_t)((audioSample & 0x0000ff00) >> 8);
-					*alias8++	= (int8_t)((audioSample & 0x000000ff) /*>> 0*/);					
-				}
-			}
-			
-			[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		case 32:
-			
-			// Interleave the audio, converting to big endian byte order 
-			alias32 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					*alias32++ = OSSwapHostToBigInt32(buffer[channel][sample]);
-				}
-			}
-				
-			[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		default:
-			@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-			break;				
-	}
+	[[source pcmBuffer] wroteBytes:spaceRequired];
 	
-	// Always return continue; an exception will be thrown if this isn't the case
+	// Otherwise return continue; an exception will be thrown if this isn't the case
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -132,6 +114,7 @@ metadataCallback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata
 	switch(metadata->type) {
 		case FLAC__METADATA_TYPE_STREAMINFO:
 			[source setTotalSamples:metadata->data.stream_info.total_samples];
+			[source setMaxBlocksize:metadata->data.stream_info.max_blocksize];
 			[source setSampleRate:metadata->data.stream_info.sample_rate];			
 			[source setBitsPerChannel:metadata->data.stream_info.bits_per_sample];
 			[source setChannelsPerFrame:metadata->data.stream_info.channels];
@@ -168,6 +151,8 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 
 @implementation FLACDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {
@@ -176,13 +161,17 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 		NSAssert(NULL != _flac, NSLocalizedStringFromTable(@"Unable to create the FLAC decoder.", @"Exceptions", @""));
 		
 		// Initialize decoder
-		FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_file(_flac, 
-																			  [[self filename] fileSystemRepresentation],
+		FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_stream(_flac, 
+																			  readCallback, 
+																			  seekCallback, 
+																			  tellCallback, 
+																			  lengthCallback, 
+																			  eofCallback, 
 																			  writeCallback, 
 																			  metadataCallback, 
 																			  errorCallback,
 																			  self);
-		NSAssert1(FLAC__STREAM_DECODER_INIT_STATUS_OK == status, @"FLAC__stream_decoder_init_file failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
+		NSAssert1(FLAC__STREAM_DECODER_INIT_STATUS_OK == status, @"FLAC__stream_decoder_init_stream failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 		
 		/*
 		 // Process cue sheets
@@ -206,9 +195,16 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 		_pcmFormat.mFramesPerPacket		= 1;
 		_pcmFormat.mBytesPerFrame		= _pcmFormat.mBytesPerPacket * _pcmFormat.mFramesPerPacket;
 		
+		_nativeSamples					= YES;
+		
 		// We only handle a subset of the legal bitsPerChannel for FLAC
 		NSAssert(8 == _pcmFormat.mBitsPerChannel || 16 == _pcmFormat.mBitsPerChannel || 24 == _pcmFormat.mBitsPerChannel || 32 == _pcmFormat.mBitsPerChannel, @"Sample size not supported");
 		
+		// Reserve room for the largest block once, so the buffer never grows while decoding
+		if(0 == _maxBlocksize)
+			_maxBlocksize = FLAC__MAX_BLOCK_SIZE;
+		[self reservePCMBufferCapacity:_maxBlocksize * _pcmFormat.mChannelsPerFrame * sizeof(int32_t)];
+		
 	}
 	return self;
 }
@@ -217,6 +213,8 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 {
 	FLAC__bool					result;
 	
+	[self stopReadAhead];
+	
 	result = FLAC__stream_decoder_finish(_flac);
 	NSAssert1(YES == result, @"FLAC__stream_decoder_finish failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 
@@ -236,58 +234,33 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 {
 	NSParameterAssert(0 <= frame && frame <= [self totalFrames]);
 	
-	if(FLAC__stream_decoder_seek_absolute(_flac, frame)) {
-		[[self pcmBuffer] reset];
+	// Discard read-ahead first; libFLAC writes the frame containing the target sample during the seek
+	[[self pcmBuffer] reset];
+
+	_seeking = YES;
+	if(FLAC__stream_decoder_seek_absolute(_flac, frame))
 		_currentFrame = frame;
-	}
+	_seeking = NO;
 	
 	return [self currentFrame];
 }
 
 - (void) fillPCMBuffer
 {
-	CircularBuffer				*buffer				= [self pcmBuffer];
-
-	FLAC__bool					result;
+	CircularBuffer		*buffer				= [self pcmBuffer];
+	NSUInteger			blockByteSize		= _maxBlocksize * [self pcmFormat].mChannelsPerFrame * sizeof(int32_t);
+	FLAC__bool			result;
 	
-	unsigned					blockSize;
-	unsigned					channels;
-	unsigned					bitsPerSample;
-	unsigned					blockByteSize;
-
-	
-	for(;;) {
+	// Decode while the buffer can take a block of the largest size in the stream; once it can't,
+	// decoding is suspended until the consumer has read enough to make room
+	while([buffer freeSpaceAvailable] >= blockByteSize) {
 
 		// EOS?
-		if(FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(_flac)) {
+		if(FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(_flac))
 			break;
-		}
-				
-		// A problem I've run into is calculating how many times to call process_single, since
-		// there is no good way to know in advance the bytes which will be required to hold a FLAC frame.
-		// I'll handle it here by checking to see if there is enough space for the block
-		// that was just read.  For files with varying block sizes, channels or sample depths
-		// this could blow up!
-		// It's not feasible to use the maximum possible values, because
-		// maxBlocksize(65535) * maxBitsPerSample(32) * maxChannels(8) = 16,776,960 (No 16 MB buffers here!)
-		blockSize			= FLAC__stream_decoder_get_blocksize(_flac);
-		channels			= FLAC__stream_decoder_get_channels(_flac);
-		bitsPerSample		= FLAC__stream_decoder_get_bits_per_sample(_flac); 
 		
-		blockByteSize		= blockSize * channels * (bitsPerSample / 8);
-
-		// Ensure the buffer is large enough to hold one block
-		if([buffer size] < blockByteSize)
-			[buffer resize:blockByteSize];
-
-		// Ensure sufficient space remains in the buffer
-		if([buffer freeSpaceAvailable] >= blockByteSize) {
-			result	= FLAC__stream_decoder_process_single(_flac);
-			NSAssert1(YES == result, @"FLAC__stream_decoder_process_single failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
-		}
-		else {
-			break;
-		}
+		result	= FLAC__stream_decoder_process_single(_flac);
+		NSAssert1(YES == result, @"FLAC__stream_decoder_process_single failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 	}
 }
 
@@ -296,6 +269,8 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 @implementation FLACDecoder (Private)
 
 - (void)	setTotalSamples:(FLAC__uint64)totalSamples 		{ _totalSamples = totalSamples; }
+- (void)	setMaxBlocksize:(unsigned)maxBlocksize			{ _maxBlocksize = maxBlocksize; }
+- (BOOL)	isSeeking										{ return _seeking; }
 
 - (void)	setSampleRate:(Float64)sampleRate				{ _pcmFormat.mSampleRate = sampleRate; }
 - (void)	setBitsPerChannel:(UInt32)bitsPerChannel		{ _pcmFormat.mBitsPerChannel = bitsPerChannel; }
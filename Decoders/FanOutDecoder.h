@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "DecoderMethods.h"
+
+#include <AudioToolbox/AudioToolbox.h>
+
+@class DecoderFanOut;
+
+// A FanOutDecoder reads the PCM shared by a DecoderFanOut on behalf of a single output format,
+// limited to its sink's region of the input
+@interface FanOutDecoder : NSObject <DecoderMethods>
+{
+	DecoderFanOut					*_fanOut;
+	NSUInteger						_sinkIndex;
+	id <DecoderMethods>				_privateDecoder;	// Used if this sink started too late to share
+
+	AudioStreamBasicDescription		_pcmFormat;
+	SInt64							_totalFrames;
+	
+	SInt64							_regionStart;		// Frames relative to the start of the shared decode
+	SInt64							_regionEnd;			// INT64_MAX to read to the end
+	
+	SInt64							_block;
+	const int32_t					*_blockSamples;
+	UInt32							_framesPerBlock;
+	UInt32							_blockFrameCount;
+	UInt32							_blockFramesRead;
+	const int32_t					**_channelSamples;
+	
+	SInt64							_currentFrame;
+	BOOL							_endOfStream;
+}
+
+// ========================================
+// Creation
+// ========================================
+// Returns nil if the fan-out no longer exists
++ (instancetype) decoderWithFanOutIdentifier:(NSString *)identifier sinkIndex:(NSUInteger)sinkIndex;
+
+- (instancetype) initWithFanOut:(DecoderFanOut *)fanOut sinkIndex:(NSUInteger)sinkIndex;
+
+// ========================================
+// Properties
+// ========================================
+- (DecoderFanOut *) fanOut;
+- (NSUInteger) sinkIndex;
+
+@end
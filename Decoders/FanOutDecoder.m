@@ -0,0 +1,264 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "FanOutDecoder.h"
+#import "DecoderFanOut.h"
+#import "PCMConversion.h"
+
+@interface FanOutDecoder (Private)
+- (UInt32) framesAvailableInBlock;
+@end
+
+@implementation FanOutDecoder
+
+#pragma mark Creation
+
++ (id) decoderWithFanOutIdentifier:(NSString *)identifier sinkIndex:(NSUInteger)sinkIndex
+{
+	DecoderFanOut *fanOut = [DecoderFanOut fanOutWithIdentifier:identifier];
+	if(nil == fanOut)
+		return nil;
+	
+	return [[[FanOutDecoder alloc] initWithFanOut:fanOut sinkIndex:sinkIndex] autorelease];
+}
+
+- (id) initWithFanOut:(DecoderFanOut *)fanOut sinkIndex:(NSUInteger)sinkIndex
+{
+	NSParameterAssert(nil != fanOut);
+	NSParameterAssert(sinkIndex < [fanOut sinkCount]);
+	
+	if((self = [super init])) {
+		_fanOut		= [fanOut retain];
+		_sinkIndex	= sinkIndex;
+		_block		= -1;
+		
+		if(NO == [_fanOut attachSink:_sinkIndex]) {
+			_privateDecoder = [(NSObject *)[_fanOut createPrivateDecoderForSink:_sinkIndex] retain];
+			_pcmFormat		= [_privateDecoder pcmFormat];
+			_totalFrames	= [_privateDecoder totalFrames];
+		}
+		else {
+			_pcmFormat		= [[_fanOut decoder] pcmFormat];
+			_framesPerBlock	= [_fanOut framesPerBlock];
+			
+			_regionStart	= [_fanOut startingFrameForSink:_sinkIndex];
+			_block			= (_regionStart / _framesPerBlock) - 1;
+			
+			if(0 != [_fanOut frameCountForSink:_sinkIndex]) {
+				_regionEnd		= _regionStart + [_fanOut frameCountForSink:_sinkIndex];
+				_totalFrames	= [_fanOut frameCountForSink:_sinkIndex];
+			}
+			else {
+				_regionEnd		= INT64_MAX;
+				_totalFrames	= (-1 == [[_fanOut decoder] totalFrames] ? -1 : [[_fanOut decoder] totalFrames] - _regionStart);
+			}
+			
+			_channelSamples	= calloc(_pcmFormat.mChannelsPerFrame, sizeof(int32_t *));
+			NSAssert(NULL != _channelSamples, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		}
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_fanOut detachSink:_sinkIndex];
+	[_fanOut release];							_fanOut = nil;
+	[(NSObject *)_privateDecoder release];		_privateDecoder = nil;
+	free(_channelSamples);						_channelSamples = NULL;
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+- (DecoderFanOut *)	fanOut								{ return [[_fanOut retain] autorelease]; }
+- (NSUInteger)		sinkIndex							{ return _sinkIndex; }
+
+#pragma mark Audio Access
+
+- (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != bufferList);
+	NSParameterAssert(0 < bufferList->mNumberBuffers);
+	NSParameterAssert(0 < frameCount);
+	NSParameterAssert(bufferList->mBuffers[0].mDataByteSize >= frameCount * _pcmFormat.mBytesPerFrame);
+	
+	UInt32		framesRead		= 0;
+	UInt32		framesToCopy;
+	UInt32		channel;
+	
+	if(nil != _privateDecoder) {
+		framesRead		= [_privateDecoder readAudio:bufferList frameCount:frameCount];
+		_currentFrame	+= framesRead;
+		return framesRead;
+	}
+	
+	while(framesRead < frameCount) {
+		framesToCopy = [self framesAvailableInBlock];
+		if(0 == framesToCopy)
+			break;
+		
+		if(framesToCopy > frameCount - framesRead)
+			framesToCopy = frameCount - framesRead;
+		
+		for(channel = 0; channel < _pcmFormat.mChannelsPerFrame; ++channel)
+			_channelSamples[channel] = _blockSamples + (channel * _framesPerBlock) + _blockFramesRead;
+		
+		if(NO == PCMInterleaveInt32ToBigEndian(_channelSamples, (uint8_t *)bufferList->mBuffers[0].mData + (framesRead * _pcmFormat.mBytesPerFrame), _pcmFormat.mChannelsPerFrame, _pcmFormat.mBitsPerChannel, framesToCopy))
+			@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil];
+		
+		_blockFramesRead	+= framesToCopy;
+		framesRead			+= framesToCopy;
+	}
+	
+	bufferList->mBuffers[0].mNumberChannels	= _pcmFormat.mChannelsPerFrame;
+	bufferList->mBuffers[0].mDataByteSize	= framesRead * _pcmFormat.mBytesPerFrame;
+	
+	_currentFrame += framesRead;
+	
+	return framesRead;
+}
+
+- (UInt32) readInt32Channels:(int32_t **)channels frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != channels);
+	NSParameterAssert(0 < frameCount);
+	
+	UInt32		framesRead		= 0;
+	UInt32		framesToCopy;
+	UInt32		channel;
+	
+	if(nil != _privateDecoder) {
+		framesRead		= [_privateDecoder readInt32Channels:channels frameCount:frameCount];
+		_currentFrame	+= framesRead;
+		return framesRead;
+	}
+	
+	while(framesRead < frameCount) {
+		framesToCopy = [self framesAvailableInBlock];
+		if(0 == framesToCopy)
+			break;
+		
+		if(framesToCopy > frameCount - framesRead)
+			framesToCopy = frameCount - framesRead;
+		
+		for(channel = 0; channel < _pcmFormat.mChannelsPerFrame; ++channel)
+			memcpy(channels[channel] + framesRead, _blockSamples + (channel * _framesPerBlock) + _blockFramesRead, framesToCopy * sizeof(int32_t));
+		
+		_blockFramesRead	+= framesToCopy;
+		framesRead			+= framesToCopy;
+	}
+	
+	_currentFrame += framesRead;
+	
+	return framesRead;
+}
+
+- (UInt32) readFloatChannels:(float **)channels frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != channels);
+	NSParameterAssert(0 < frameCount);
+	
+	UInt32		framesRead		= 0;
+	UInt32		framesToCopy;
+	UInt32		channel;
+	
+	if(nil != _privateDecoder) {
+		framesRead		= [_privateDecoder readFloatChannels:channels frameCount:frameCount];
+		_currentFrame	+= framesRead;
+		return framesRead;
+	}
+	
+	while(framesRead < frameCount) {
+		framesToCopy = [self framesAvailableInBlock];
+		if(0 == framesToCopy)
+			break;
+		
+		if(framesToCopy > frameCount - framesRead)
+			framesToCopy = frameCount - framesRead;
+		
+		for(channel = 0; channel < _pcmFormat.mChannelsPerFrame; ++channel)
+			PCMInt32ToFloat(_blockSamples + (channel * _framesPerBlock) + _blockFramesRead, channels[channel] + framesRead, framesToCopy, _pcmFormat.mBitsPerChannel);
+		
+		_blockFramesRead	+= framesToCopy;
+		framesRead			+= framesToCopy;
+	}
+	
+	_currentFrame += framesRead;
+	
+	return framesRead;
+}
+
+- (AudioStreamBasicDescription) pcmFormat				{ return _pcmFormat; }
+
+- (NSString *) pcmFormatDescription
+{
+	return (nil != _privateDecoder ? [_privateDecoder pcmFormatDescription] : [[_fanOut decoder] pcmFormatDescription]);
+}
+
+- (NSString *) sourceFormatDescription
+{
+	return (nil != _privateDecoder ? [_privateDecoder sourceFormatDescription] : [[_fanOut decoder] sourceFormatDescription]);
+}
+
+- (SInt64)			totalFrames							{ return _totalFrames; }
+- (SInt64)			currentFrame						{ return _currentFrame; }
+
+// Sinks share a single read position, so seeking is not possible
+- (BOOL)			supportsSeeking						{ return NO; }
+- (SInt64)			seekToFrame:(SInt64)frame			{ return -1; }
+
+@end
+
+@implementation FanOutDecoder (Private)
+
+// Moves to the next block once this one is used up; returns 0 at the end of the stream or region
+- (UInt32) framesAvailableInBlock
+{
+	SInt64		position;
+	
+	if(_endOfStream)
+		return 0;
+	
+	if(_blockFramesRead == _blockFrameCount) {
+		_blockFrameCount	= [_fanOut readBlock:_block + 1 forSink:_sinkIndex samples:&_blockSamples];
+		++_block;
+		
+		// The region may start partway into its first block
+		position			= _regionStart - (_block * _framesPerBlock);
+		_blockFramesRead	= (UInt32)(0 < position ? MIN(position, (SInt64)_blockFrameCount) : 0);
+		
+		if(0 == _blockFrameCount) {
+			_endOfStream = YES;
+			return 0;
+		}
+	}
+	
+	// Let the rest of the stream go as soon as the region is done with it
+	position = (_block * _framesPerBlock) + _blockFramesRead;
+	if(position >= _regionEnd) {
+		_endOfStream = YES;
+		[_fanOut detachSink:_sinkIndex];
+		return 0;
+	}
+	
+	return (UInt32)MIN((SInt64)(_blockFrameCount - _blockFramesRead), _regionEnd - position);
+}
+
+@end
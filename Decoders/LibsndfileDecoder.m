@@ -63,6 +63,8 @@
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	int result = sf_close(_sf);
 	NSAssert1(0 == result, @"sf_close failed: %s", sf_error_number(result));
 	
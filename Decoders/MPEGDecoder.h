@@ -18,12 +18,12 @@
 
 #import <Cocoa/Cocoa.h>
 #import "Decoder.h"
+#import "MPEGFrameIndex.h"
 
 #include <mad/mad.h>
 
 @interface MPEGDecoder : Decoder
 {
-	FILE				*_file;
 	unsigned char		*_inputBuffer;
 	
 	AudioBufferList		*_bufferList;
@@ -44,10 +44,14 @@
 	
 	BOOL				_foundXingHeader;
 	BOOL				_foundLAMEHeader;
+	BOOL				_foundVBRIHeader;
 	
 	off_t				_fileBytes;
 	uint8_t				_xingTOC [100];
 	
+	MPEGFrameIndex		*_frameIndex;
+	NSUInteger			_primingFrames;
+	
 	struct mad_stream	_mad_stream;
 	struct mad_frame	_mad_frame;
 	struct mad_synth	_mad_synth;
@@ -18,6 +18,7 @@
 
 #import "MPEGDecoder.h"
 #import "CircularBuffer.h"
+#import "MappedFile.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -28,6 +29,13 @@
 
 #define BIT_RESOLUTION		16
 
+// Seeks through the frame index land this many MPEG frames early, so the bit reservoir
+// and the synthesis filter are filled before the requested frame is decoded
+#define SEEK_PREROLL_FRAMES	10
+
+// libmad reports errors found in a frame's audio data, after its header decoded, as 0x02xx
+#define MAD_FRAME_DATA_ERROR(error)	(0x0200 == ((error) & 0xff00))
+
 // From vbrheadersdk:
 // ========================================
 // A Xing header may be present in the ancillary
@@ -79,21 +87,22 @@ audio_linear_round(unsigned int bits,
 
 @interface MPEGDecoder (Private)
 - (BOOL) scanFile;
+- (BOOL) feedStream:(struct mad_stream *)stream;
+- (BOOL) foundInfoFrame;
 - (SInt64) seekToFrameApproximately:(SInt64)frame;
 - (SInt64) seekToFrameAccurately:(SInt64)frame;
 @end
 
 @implementation MPEGDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {
 		_inputBuffer = (unsigned char *)calloc(INPUT_BUFFER_SIZE + MAD_BUFFER_GUARD, sizeof(unsigned char));
 		NSAssert(NULL != _inputBuffer, @"Unable to allocate memory");
 		
-		_file = fopen([[self filename] fileSystemRepresentation], "r");
-		NSAssert(NULL != _file, NSLocalizedStringFromTable(@"Unable to create the MPEG decoder.", @"Exceptions", @""));
-		
 		mad_stream_init(&_mad_stream);
 		mad_frame_init(&_mad_frame);
 		mad_synth_init(&_mad_synth);
@@ -104,6 +113,17 @@ audio_linear_round(unsigned int bits,
 			return nil;
 		}
 		
+		// Without a header giving the length, a saved index is exact; otherwise build one in the background
+		_frameIndex = [[MPEGFrameIndex indexForFile:[self filename]] retain];
+		if(0 == _totalMPEGFrames && nil != _frameIndex) {
+			if([_frameIndex complete]) {
+				_totalFrames = ([_frameIndex countOfFrames] - ([self foundInfoFrame] ? 1 : 0)) * _samplesPerMPEGFrame;
+			}
+			else {
+				[_frameIndex completeInBackground];
+			}
+		}
+		
 		// Setup input format descriptor
 		_pcmFormat.mFormatID			= kAudioFormatLinearPCM;
 		// Unfortunately Max requires the output to be in Big Endian format
@@ -130,14 +150,16 @@ audio_linear_round(unsigned int bits,
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	mad_synth_finish(&_mad_synth);
 	mad_frame_finish(&_mad_frame);
 	mad_stream_finish(&_mad_stream);
 	
 	free(_inputBuffer);
 	_inputBuffer = NULL;
-	fclose(_file);
-	_file = NULL;
+	[_frameIndex release];
+	_frameIndex = nil;
 	
 	if(_bufferList) {
 		unsigned i;
@@ -161,7 +183,7 @@ audio_linear_round(unsigned int bits,
 
 - (SInt64) seekToFrame:(SInt64)frame
 {
-	if(_foundLAMEHeader)
+	if(_foundLAMEHeader || nil != _frameIndex)
 		return [self seekToFrameAccurately:frame];
 	else
 		return [self seekToFrameApproximately:frame];
@@ -172,10 +194,6 @@ audio_linear_round(unsigned int bits,
 	CircularBuffer		*buffer				= [self pcmBuffer];
 	NSUInteger			frameCount			= [buffer freeSpaceAvailable] / (_pcmFormat.mChannelsPerFrame * sizeof(int16_t));
 				
-	NSUInteger		bytesToRead;
-	NSUInteger		bytesRemaining;
-	unsigned char	*readStartPointer;
-	
 	BOOL			readEOF					= NO;
 	
 	NSUInteger		framesRead				= 0;
@@ -205,9 +223,9 @@ audio_linear_round(unsigned int bits,
 		if(framesRead == frameCount)
 			break;
 		
-		// If the file contains a Xing header but not LAME gapless information,
-		// decode the number of MPEG frames specified by the Xing header
-		if(_foundXingHeader && NO == _foundLAMEHeader && 1 + _mpegFramesDecoded == _totalMPEGFrames)
+		// If the file contains a Xing or VBRI header but not LAME gapless information,
+		// decode the number of MPEG frames specified by the header
+		if([self foundInfoFrame] && NO == _foundLAMEHeader && 1 + _mpegFramesDecoded == _totalMPEGFrames)
 			break;
 		
 		// The LAME header indicates how many samples are in the file
@@ -215,44 +233,21 @@ audio_linear_round(unsigned int bits,
 			break;
 		
 		// Feed the input buffer if necessary
-		if(NULL == _mad_stream.buffer || MAD_ERROR_BUFLEN == _mad_stream.error) {
-			if(NULL != _mad_stream.next_frame) {
-				bytesRemaining = _mad_stream.bufend - _mad_stream.next_frame;
-				memmove(_inputBuffer, _mad_stream.next_frame, bytesRemaining);
-				
-				readStartPointer	= _inputBuffer + bytesRemaining;
-				bytesToRead			= INPUT_BUFFER_SIZE - bytesRemaining;
-			}
-			else {
-				bytesToRead			= INPUT_BUFFER_SIZE;
-				readStartPointer	= _inputBuffer;
-				bytesRemaining		= 0;
-			}
-			
-			// Read raw bytes from the MP3 file
-			size_t bytesRead = fread(readStartPointer, 1, bytesToRead, _file);
-			if(ferror(_file)) {
-#if DEBUG
-				NSLog(@"Read error: %s.", strerror(errno));
-#endif
-				break;
-			}
-			
-			// MAD_BUFFER_GUARD zeroes are required to decode the last frame of the file
-			if(feof(_file)) {
-				memset(readStartPointer + bytesRead, 0, MAD_BUFFER_GUARD);
-				bytesRead	+= MAD_BUFFER_GUARD;
-				readEOF		= YES;
-			}
-			
-			mad_stream_buffer(&_mad_stream, _inputBuffer, bytesRead + bytesRemaining);
-			_mad_stream.error = MAD_ERROR_NONE;
-		}
+		if(NULL == _mad_stream.buffer || MAD_ERROR_BUFLEN == _mad_stream.error)
+			readEOF = [self feedStream:&_mad_stream];
 		
 		// Decode the MPEG frame
 		int result = mad_frame_decode(&_mad_frame, &_mad_stream);
 		if(-1 == result) {
-			if(MAD_RECOVERABLE(_mad_stream.error)) {
+			// A damaged frame (a bad CRC, for example) still takes its place in the stream, as silence,
+			// so frames are counted the same way the frame index counts them
+			if(MAD_FRAME_DATA_ERROR(_mad_stream.error)) {
+#if DEBUG
+				NSLog(@"Recoverable frame level error (%s)", mad_stream_errorstr(&_mad_stream));
+#endif
+				mad_frame_mute(&_mad_frame);
+			}
+			else if(MAD_RECOVERABLE(_mad_stream.error)) {
 				// Prevent ID3 tags from reporting recoverable frame errors
 				const uint8_t	*buffer			= _mad_stream.this_frame;
 				NSUInteger		buflen			= _mad_stream.bufend - _mad_stream.this_frame;
@@ -297,8 +292,8 @@ audio_linear_round(unsigned int bits,
 		// This can happen if the encoder delay is greater than the number of samples in a frame
 		NSUInteger startingSample = _samplesToSkipInNextFrame;
 		
-		// Skip the Xing header (it contains empty audio)
-		if(_foundXingHeader && 1 == _mpegFramesDecoded)
+		// Skip the Xing or VBRI header (it contains empty audio)
+		if([self foundInfoFrame] && 1 == _mpegFramesDecoded)
 			continue;
 		// Adjust the first real audio frame for gapless playback
 		else if(_foundLAMEHeader && 2 == _mpegFramesDecoded)
@@ -342,16 +337,12 @@ audio_linear_round(unsigned int bits,
 - (BOOL) scanFile
 {
 	uint32_t			framesDecoded = 0;
-	NSUInteger			bytesToRead, bytesRemaining;
-	size_t				bytesRead;
-	unsigned char		*readStartPointer;
 	BOOL				readEOF;
 	
 	struct mad_stream	stream;
 	struct mad_frame	frame;
 	
 	int					result;
-	struct stat			stat;
 	uint32_t			id3_length		= 0;
 	
 	// Set up	
@@ -360,46 +351,11 @@ audio_linear_round(unsigned int bits,
 	
 	readEOF = NO;
 	
-	result = fstat(fileno(_file), &stat);
-	if(-1 == result)
-		return NO;
-	
-	_fileBytes = stat.st_size;
+	_fileBytes = [[self mappedFile] length];
 	
 	for(;;) {
-		if(NULL == stream.buffer || MAD_ERROR_BUFLEN == stream.error) {
-			if(stream.next_frame) {
-				bytesRemaining = stream.bufend - stream.next_frame;
-				memmove(_inputBuffer, stream.next_frame, bytesRemaining);
-				
-				readStartPointer	= _inputBuffer + bytesRemaining;
-				bytesToRead			= INPUT_BUFFER_SIZE - bytesRemaining;
-			}
-			else {
-				bytesToRead			= INPUT_BUFFER_SIZE;
-				readStartPointer	= _inputBuffer;
-				bytesRemaining		= 0;
-			}
-			
-			// Read raw bytes from the MP3 file
-			bytesRead = fread(readStartPointer, 1, bytesToRead, _file);
-			if(ferror(_file)) {
-#if DEBUG
-				NSLog(@"Read error: %s.", strerror(errno));
-#endif
-				break;
-			}
-			
-			// MAD_BUFFER_GUARD zeroes are required to decode the last frame of the file
-			if(feof(_file)) {
-				memset(readStartPointer + bytesRead, 0, MAD_BUFFER_GUARD);
-				bytesRead	+= MAD_BUFFER_GUARD;
-				readEOF		= YES;
-			}
-			
-			mad_stream_buffer(&stream, _inputBuffer, bytesRead + bytesRemaining);
-			stream.error = MAD_ERROR_NONE;
-		}
+		if(NULL == stream.buffer || MAD_ERROR_BUFLEN == stream.error)
+			readEOF = [self feedStream:&stream];
 		
 		result = mad_frame_decode(&frame, &stream);
 		if(-1 == result) {
@@ -449,6 +405,16 @@ audio_linear_round(unsigned int bits,
 //			_channelLayout.mChannelLayoutTag	= (1 == MAD_NCHANNELS(&frame.header) ? kAudioChannelLayoutTag_Mono : kAudioChannelLayoutTag_Stereo);
 			_samplesPerMPEGFrame				= 32 * MAD_NSBSAMPLES(&frame.header);
 			
+			// A VBRI header starts 32 bytes after the first frame's header
+			// Reference http://www.codeproject.com/audio/MPEGAudioInfo.asp
+			const uint8_t *vbri = stream.this_frame + 4 + 32;
+			if(vbri + 26 <= stream.bufend && 'V' == vbri[0] && 'B' == vbri[1] && 'R' == vbri[2] && 'I' == vbri[3]) {
+				_totalMPEGFrames	= OSReadBigInt32(vbri, 14);
+				_totalFrames		= _totalMPEGFrames * _samplesPerMPEGFrame;
+				_foundVBRIHeader	= YES;
+				break;
+			}
+			
 			unsigned ancillaryBitsRemaining = stream.anc_bitlen;
 			if(32 > ancillaryBitsRemaining)
 				continue;
@@ -576,8 +542,9 @@ audio_linear_round(unsigned int bits,
 			}
 		}
 		else {
-			// Just estimate the number of frames based on the file's size
-			_totalFrames = (double)frame.header.samplerate * ((_fileBytes - id3_length) / (frame.header.bitrate / 8.0));
+			// Just estimate the number of frames based on the file's size, unless the Xing header gave it
+			if(0 == _totalMPEGFrames)
+				_totalFrames = (double)frame.header.samplerate * ((_fileBytes - id3_length) / (frame.header.bitrate / 8.0));
 			
 			// For now, quit after second frame
 			break;
@@ -589,12 +556,52 @@ audio_linear_round(unsigned int bits,
 	mad_stream_finish(&stream);
 	
 	// Rewind to the beginning of file
-	if(-1 == fseek(_file, 0, SEEK_SET))
+	if(NO == [[self mappedFile] seekToOffset:0])
 		return NO;
 	
 	return YES;
 }
 
+// Returns YES once the end of the file has been passed to libmad
+- (BOOL) feedStream:(struct mad_stream *)stream
+{
+	MappedFile				*mappedFile		= [self mappedFile];
+	const unsigned char		*bytes			= [mappedFile bytes];
+	const unsigned char		*end			= bytes + [mappedFile length];
+	const unsigned char		*start;
+	size_t					tailLength;
+	
+	// The padded tail has already been fed, so there is nothing left to decode
+	if(_inputBuffer == stream->buffer)
+		return YES;
+	
+	// After a seek, hand libmad the rest of the file straight from the mapping
+	if(NULL == stream->buffer) {
+		start = bytes + MIN([mappedFile offset], [mappedFile length]);
+		mad_stream_buffer(stream, start, end - start);
+		stream->error = MAD_ERROR_NONE;
+		return NO;
+	}
+	
+	// libmad only runs out of a buffer holding the rest of the file at its end, and needs
+	// MAD_BUFFER_GUARD zeroes past the last frame to decode it, so only the tail is copied
+	start		= stream->next_frame;
+	tailLength	= MIN((size_t)(end - start), INPUT_BUFFER_SIZE);
+	
+	memcpy(_inputBuffer, end - tailLength, tailLength);
+	memset(_inputBuffer + tailLength, 0, MAD_BUFFER_GUARD);
+	
+	mad_stream_buffer(stream, _inputBuffer, tailLength + MAD_BUFFER_GUARD);
+	stream->error = MAD_ERROR_NONE;
+	
+	return YES;
+}
+
+- (BOOL) foundInfoFrame
+{
+	return (_foundXingHeader || _foundVBRIHeader);
+}
+
 - (SInt64) seekToFrameApproximately:(SInt64)frame
 {
 	double	fraction	= (double)frame / [self totalFrames];
@@ -620,8 +627,8 @@ audio_linear_round(unsigned int bits,
 	else
 		seekPoint = (long)_fileBytes * fraction;
 	
-	int result = fseek(_file, seekPoint, SEEK_SET);
-	if(0 == result) {
+	BOOL result = [[self mappedFile] seekToOffset:seekPoint];
+	if(result) {
 		mad_stream_buffer(&_mad_stream, NULL, 0);
 		
 		// Reset frame count to prevent early termination of playback
@@ -637,7 +644,7 @@ audio_linear_round(unsigned int bits,
 	}
 	
 	// Right now it's only possible to return an approximation of the audio frame
-	return (-1 == result ? -1 : frame);
+	return (result ? frame : -1);
 }
 
 - (SInt64) seekToFrameAccurately:(SInt64)frame
@@ -646,15 +653,36 @@ audio_linear_round(unsigned int bits,
 	
 	// Brute force seeking is necessary since frame-accurate seeking is required
 	
-	NSUInteger		bytesToRead;
-	NSUInteger		bytesRemaining;
-	unsigned char	*readStartPointer;
-	
 	BOOL			readEOF					= NO;
 	
+	// The MPEG frame holding the requested audio frame, counting any Xing or VBRI frame
+	NSUInteger		firstAudioFrame			= ([self foundInfoFrame] ? 1 : 0);
+	SInt64			delay					= (_foundLAMEHeader ? _encoderDelay : 0);
+	NSUInteger		targetFrame				= firstAudioFrame + (NSUInteger)((frame + delay) / _samplesPerMPEGFrame);
+	NSUInteger		jumpFrame				= (SEEK_PREROLL_FRAMES < targetFrame ? targetFrame - SEEK_PREROLL_FRAMES : 0);
+	off_t			jumpOffset				= -1;
+	
+	// Jump through the index unless the decoder is already about to reach the requested frame;
+	// the encoder delay must lie entirely before the jump
+	if(nil != _frameIndex && firstAudioFrame < jumpFrame && (SInt64)((jumpFrame - firstAudioFrame) * _samplesPerMPEGFrame) >= delay
+	   && ([self currentFrame] > frame || _mpegFramesDecoded + SEEK_PREROLL_FRAMES < jumpFrame))
+		jumpOffset = [_frameIndex offsetOfFrame:jumpFrame];
+	
+	if(-1 != jumpOffset && [[self mappedFile] seekToOffset:jumpOffset]) {
+		// Decoding resumes as if every earlier frame had been read
+		_mpegFramesDecoded			= (uint32_t)jumpFrame;
+		_samplesDecoded				= ((jumpFrame - firstAudioFrame) * _samplesPerMPEGFrame) - delay;
+		_myCurrentFrame				= _samplesDecoded;
+		_samplesToSkipInNextFrame	= 0;
+		_primingFrames				= SEEK_PREROLL_FRAMES;
+		
+		mad_stream_buffer(&_mad_stream, NULL, 0);
+		mad_frame_mute(&_mad_frame);
+		mad_synth_mute(&_mad_synth);
+	}
 	// To seek to a frame earlier in the file, rewind to the beginning
-	if([self currentFrame] > frame) {
-		if(-1 == fseek(_file, 0, SEEK_SET))
+	else if([self currentFrame] > frame) {
+		if(NO == [[self mappedFile] seekToOffset:0])
 			return -1;
 		
 		// Reset decoder parameters
@@ -679,9 +707,9 @@ audio_linear_round(unsigned int bits,
 		if(_samplesDecoded >= frame)
 			break;
 
-		// If the file contains a Xing header but not LAME gapless information,
-		// decode the number of MPEG frames specified by the Xing header
-		if(_foundXingHeader && NO == _foundLAMEHeader && 1 + _mpegFramesDecoded == _totalMPEGFrames)
+		// If the file contains a Xing or VBRI header but not LAME gapless information,
+		// decode the number of MPEG frames specified by the header
+		if([self foundInfoFrame] && NO == _foundLAMEHeader && 1 + _mpegFramesDecoded == _totalMPEGFrames)
 			break;
 		
 		// The LAME header indicates how many samples are in the file
@@ -689,44 +717,25 @@ audio_linear_round(unsigned int bits,
 			break;
 		
 		// Feed the input buffer if necessary
-		if(NULL == _mad_stream.buffer || MAD_ERROR_BUFLEN == _mad_stream.error) {
-			if(NULL != _mad_stream.next_frame) {
-				bytesRemaining = _mad_stream.bufend - _mad_stream.next_frame;
-				memmove(_inputBuffer, _mad_stream.next_frame, bytesRemaining);
-				
-				readStartPointer	= _inputBuffer + bytesRemaining;
-				bytesToRead			= INPUT_BUFFER_SIZE - bytesRemaining;
-			}
-			else {
-				bytesToRead			= INPUT_BUFFER_SIZE;
-				readStartPointer	= _inputBuffer;
-				bytesRemaining		= 0;
-			}
-			
-			// Read raw bytes from the MP3 file
-			size_t bytesRead = fread(readStartPointer, 1, bytesToRead, _file);
-			if(ferror(_file)) {
-#if DEBUG
-				NSLog(@"Read error: %s.", strerror(errno));
-#endif
-				break;
-			}
-			
-			// MAD_BUFFER_GUARD zeroes are required to decode the last frame of the file
-			if(feof(_file)) {
-				memset(readStartPointer + bytesRead, 0, MAD_BUFFER_GUARD);
-				bytesRead	+= MAD_BUFFER_GUARD;
-				readEOF		= YES;
-			}
-			
-			mad_stream_buffer(&_mad_stream, _inputBuffer, bytesRead + bytesRemaining);
-			_mad_stream.error = MAD_ERROR_NONE;
-		}
+		if(NULL == _mad_stream.buffer || MAD_ERROR_BUFLEN == _mad_stream.error)
+			readEOF = [self feedStream:&_mad_stream];
 		
 		// Decode the MPEG frame
 		int result = mad_frame_decode(&_mad_frame, &_mad_stream);
 		if(-1 == result) {
-			if(MAD_RECOVERABLE(_mad_stream.error)) {
+			// Frames just after a jump may refer to bit reservoir data that was never read;
+			// they still take their place in the stream
+			if(0 < _primingFrames && MAD_ERROR_BADDATAPTR == _mad_stream.error) {
+				--_primingFrames;
+				++_mpegFramesDecoded;
+				_samplesDecoded		+= _samplesPerMPEGFrame;
+				_myCurrentFrame		+= _samplesPerMPEGFrame;
+				continue;
+			}
+			// A damaged frame still takes its place in the stream, as in fillPCMBuffer
+			else if(MAD_FRAME_DATA_ERROR(_mad_stream.error))
+				mad_frame_mute(&_mad_frame);
+			else if(MAD_RECOVERABLE(_mad_stream.error)) {
 				// Prevent ID3 tags from reporting recoverable frame errors
 				const uint8_t	*buffer			= _mad_stream.this_frame;
 				NSUInteger		buflen			= _mad_stream.bufend - _mad_stream.this_frame;
@@ -768,8 +777,8 @@ audio_linear_round(unsigned int bits,
 		// This can happen if the encoder delay is greater than the number of samples in a frame
 		NSUInteger startingSample = _samplesToSkipInNextFrame;
 		
-		// Skip the Xing header (it contains empty audio)
-		if(_foundXingHeader && 1 == _mpegFramesDecoded)
+		// Skip the Xing or VBRI header (it contains empty audio)
+		if([self foundInfoFrame] && 1 == _mpegFramesDecoded)
 			continue;
 		// Adjust the first real audio frame for gapless playback
 		else if(_foundLAMEHeader && 2 == _mpegFramesDecoded)
@@ -815,11 +824,19 @@ audio_linear_round(unsigned int bits,
 		}
 		// The entire frame was skipped
 		else {
+			// Run the frames after a jump through the synthesis filter, to fill its history
+			if(0 < _primingFrames) {
+				mad_synth_frame(&_mad_synth, &_mad_frame);
+				--_primingFrames;
+			}
+			
 			_samplesDecoded		+= (sampleCount - startingSample);
 			_myCurrentFrame		+= (sampleCount - startingSample);
 		}
 	}
 	
+	_primingFrames = 0;
+	
 	[[self pcmBuffer] reset];
 	_currentFrame = _myCurrentFrame;
 
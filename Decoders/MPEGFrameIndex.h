@@ -0,0 +1,60 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#include <sys/types.h>
+
+@class MappedFile;
+
+// An MPEGFrameIndex holds the byte offset of every MPEG frame in a file, so a decoder can jump to any frame:
+//   - Frames are found by decoding headers only, so indexing is far cheaper than decoding
+//   - The index grows on demand as seeks move forward, or is completed by a single low-priority
+//     background pass that runs alongside decoding
+//   - Completed indexes are saved in the application data directory, keyed by path, size and modification time
+@interface MPEGFrameIndex : NSObject
+{
+	NSString		*_filename;
+	off_t			_fileSize;
+	time_t			_modificationTime;
+	MappedFile		*_mappedFile;
+
+	off_t			*_offsets;
+	NSUInteger		_count;
+	NSUInteger		_capacity;
+	BOOL			_complete;
+	BOOL			_indexingInBackground;
+}
+
+// The index for filename; a saved index is loaded if the file has not changed since it was built
++ (MPEGFrameIndex *)	indexForFile:(NSString *)filename;
+
+- (NSString *)			filename;
+
+// YES once the whole file has been indexed
+- (BOOL)				complete;
+- (NSUInteger)			countOfFrames;
+
+// The offset of the MPEG frame with the given index, counting from the first frame after any ID3v2 tag,
+// indexing forward as far as needed; -1 if the file does not have that many frames
+- (off_t)				offsetOfFrame:(NSUInteger)frameIndex;
+
+// Index the rest of the file in one pass on a low-priority background queue, then save the result
+- (void)				completeInBackground;
+
+@end
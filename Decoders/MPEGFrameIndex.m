@@ -0,0 +1,381 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "MPEGFrameIndex.h"
+#import "UtilityFunctions.h"
+#import "MappedFile.h"
+
+#include "SectorHash.h"
+
+#include <mad/mad.h>
+#include <sys/stat.h>
+#include <libkern/OSByteOrder.h>
+
+#define INDEX_INITIAL_CAPACITY		1024
+
+// How many frames the background pass indexes each time it takes the lock
+#define INDEX_FRAMES_PER_PASS		4096
+
+#define INDEX_FILE_MAGIC			0x5846494D		// "MFIX"
+#define INDEX_FILE_VERSION			1
+
+// Indexes being completed in the background, so every decoder opening the file shares them
+static NSMutableDictionary *sIndexesInProgress = nil;
+
+@interface MPEGFrameIndex (Private)
+- (id)			initWithFilename:(NSString *)filename fileSize:(off_t)fileSize modificationTime:(time_t)modificationTime;
+- (BOOL)		describesFileSize:(off_t)fileSize modificationTime:(time_t)modificationTime;
+- (NSString *)	storePath;
+- (BOOL)		load;
+- (void)		save;
+- (void)		addOffset:(off_t)offset;
+- (BOOL)		indexThroughFrame:(NSUInteger)frameIndex;
+@end
+
+@implementation MPEGFrameIndex
+
++ (MPEGFrameIndex *) indexForFile:(NSString *)filename
+{
+	MPEGFrameIndex		*index		= nil;
+	struct stat			sourceStat;
+	
+	NSParameterAssert(nil != filename);
+	
+	if(-1 == stat([filename fileSystemRepresentation], &sourceStat))
+		return nil;
+	
+	// An index still being built is shared, as long as the file hasn't changed since it was started
+	@synchronized(self) {
+		index = [sIndexesInProgress objectForKey:filename];
+		if(nil != index && [index describesFileSize:sourceStat.st_size modificationTime:sourceStat.st_mtime])
+			return [[index retain] autorelease];
+	}
+	
+	index = [[[MPEGFrameIndex alloc] initWithFilename:filename fileSize:sourceStat.st_size modificationTime:sourceStat.st_mtime] autorelease];
+	[index load];
+	
+	return index;
+}
+
+- (void) dealloc
+{
+	[_filename release];		_filename = nil;
+	[_mappedFile release];		_mappedFile = nil;
+	free(_offsets);				_offsets = NULL;
+	
+	[super dealloc];
+}
+
+- (NSString *)		filename						{ return [[_filename retain] autorelease]; }
+
+- (BOOL)			complete
+{
+	@synchronized(self) {
+		return _complete;
+	}
+	return NO;
+}
+
+- (NSUInteger)		countOfFrames
+{
+	@synchronized(self) {
+		return _count;
+	}
+	return 0;
+}
+
+- (off_t) offsetOfFrame:(NSUInteger)frameIndex
+{
+	@synchronized(self) {
+		[self indexThroughFrame:frameIndex];
+		return (frameIndex < _count ? _offsets[frameIndex] : -1);
+	}
+	return -1;
+}
+
+- (void) completeInBackground
+{
+	@synchronized(self) {
+		if(_complete || _indexingInBackground)
+			return;
+		_indexingInBackground = YES;
+	}
+	
+	@synchronized([MPEGFrameIndex class]) {
+		if(nil == sIndexesInProgress)
+			sIndexesInProgress = [[NSMutableDictionary alloc] init];
+		[sIndexesInProgress setObject:self forKey:[self filename]];
+	}
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+		NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+		BOOL				indexed		= YES;
+		BOOL				done		= NO;
+		
+		// Take the lock a pass at a time so decoders seeking in the same file are not held up
+		while(indexed && NO == done) {
+			@synchronized(self) {
+				indexed		= [self indexThroughFrame:_count + INDEX_FRAMES_PER_PASS];
+				done		= _complete;
+			}
+		}
+		
+		if(indexed)
+			[self save];
+		
+		// A newer index for the same file, started after it changed, may have taken this one's place
+		@synchronized([MPEGFrameIndex class]) {
+			if(self == [sIndexesInProgress objectForKey:[self filename]])
+				[sIndexesInProgress removeObjectForKey:[self filename]];
+		}
+		
+		@synchronized(self) {
+			_indexingInBackground = NO;
+		}
+		
+		[pool release];
+	});
+}
+
+@end
+
+@implementation MPEGFrameIndex (Private)
+
+- (id) initWithFilename:(NSString *)filename fileSize:(off_t)fileSize modificationTime:(time_t)modificationTime
+{
+	if((self = [super init])) {
+		_filename			= [filename retain];
+		_fileSize			= fileSize;
+		_modificationTime	= modificationTime;
+	}
+	return self;
+}
+
+- (BOOL) describesFileSize:(off_t)fileSize modificationTime:(time_t)modificationTime
+{
+	return (_fileSize == fileSize && _modificationTime == modificationTime);
+}
+
+- (NSString *) storePath
+{
+	const char		*path		= [[self filename] fileSystemRepresentation];
+	uint8_t			hash		[16];
+	
+	SectorHash(kSectorHashAlgorithmXXH3_128, path, strlen(path), hash);
+	
+	return [NSString stringWithFormat:@"%@/MPEG Frame Indexes/%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x.mfi", GetApplicationDataDirectory(),
+		hash[0], hash[1], hash[2], hash[3], hash[4], hash[5], hash[6], hash[7], hash[8], hash[9], hash[10], hash[11], hash[12], hash[13], hash[14], hash[15]];
+}
+
+// The layout, all little-endian: magic, version, file size, modification time, path length, path,
+// frame count, offset of the first frame, then the distance from each frame to the next as 32 bits
+- (BOOL) load
+{
+	NSData			*data		= [NSData dataWithContentsOfFile:[self storePath] options:NSDataReadingMappedIfSafe error:nil];
+	const uint8_t	*bytes		= [data bytes];
+	const char		*path		= [[self filename] fileSystemRepresentation];
+	size_t			pathLength	= strlen(path);
+	size_t			headerSize	= 4 + 4 + 8 + 8 + 4 + pathLength + 4 + 8;
+	uint32_t		count;
+	NSUInteger		i;
+	
+	if(nil == data || [data length] < headerSize)
+		return NO;
+	
+	if(INDEX_FILE_MAGIC != OSReadLittleInt32(bytes, 0) || INDEX_FILE_VERSION != OSReadLittleInt32(bytes, 4))
+		return NO;
+	
+	// The file must not have changed since it was indexed
+	if((uint64_t)_fileSize != OSReadLittleInt64(bytes, 8) || (int64_t)_modificationTime != (int64_t)OSReadLittleInt64(bytes, 16))
+		return NO;
+	
+	// Different paths may hash alike
+	if(pathLength != OSReadLittleInt32(bytes, 24) || 0 != memcmp(bytes + 28, path, pathLength))
+		return NO;
+	
+	count = OSReadLittleInt32(bytes, 28 + pathLength);
+	if(0 == count || [data length] != headerSize + (4 * (count - 1)))
+		return NO;
+	
+	@synchronized(self) {
+		free(_offsets);
+		_offsets = calloc(count, sizeof(off_t));
+		NSAssert(NULL != _offsets, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		_offsets[0] = OSReadLittleInt64(bytes, 32 + pathLength);
+		for(i = 1; i < count; ++i) {
+			_offsets[i] = _offsets[i - 1] + OSReadLittleInt32(bytes, headerSize + (4 * (i - 1)));
+		}
+		
+		_count		= count;
+		_capacity	= count;
+		_complete	= YES;
+	}
+	
+	return YES;
+}
+
+- (void) save
+{
+	NSMutableData	*data;
+	const char		*path		= [[self filename] fileSystemRepresentation];
+	uint32_t		pathLength	= (uint32_t)strlen(path);
+	uint32_t		u32;
+	uint64_t		u64;
+	NSUInteger		i;
+	
+	@synchronized(self) {
+		if(NO == _complete || 0 == _count)
+			return;
+		
+		// Frames are never 4 GB apart, but an index that cannot be stored faithfully is not stored at all
+		for(i = 1; i < _count; ++i) {
+			if(UINT32_MAX < _offsets[i] - _offsets[i - 1])
+				return;
+		}
+		
+		data = [NSMutableData dataWithCapacity:4 + 4 + 8 + 8 + 4 + pathLength + 4 + 8 + (4 * _count)];
+		
+		u32 = OSSwapHostToLittleInt32(INDEX_FILE_MAGIC);			[data appendBytes:&u32 length:4];
+		u32 = OSSwapHostToLittleInt32(INDEX_FILE_VERSION);			[data appendBytes:&u32 length:4];
+		u64 = OSSwapHostToLittleInt64(_fileSize);					[data appendBytes:&u64 length:8];
+		u64 = OSSwapHostToLittleInt64(_modificationTime);			[data appendBytes:&u64 length:8];
+		u32 = OSSwapHostToLittleInt32(pathLength);					[data appendBytes:&u32 length:4];
+		[data appendBytes:path length:pathLength];
+		u32 = OSSwapHostToLittleInt32((uint32_t)_count);			[data appendBytes:&u32 length:4];
+		u64 = OSSwapHostToLittleInt64(_offsets[0]);					[data appendBytes:&u64 length:8];
+		
+		for(i = 1; i < _count; ++i) {
+			u32 = OSSwapHostToLittleInt32((uint32_t)(_offsets[i] - _offsets[i - 1]));
+			[data appendBytes:&u32 length:4];
+		}
+	}
+	
+	// The index is only a cache, so failing to save it is not an error
+	[[NSFileManager defaultManager] createDirectoryAtPath:[[self storePath] stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+	[data writeToFile:[self storePath] atomically:YES];
+}
+
+- (void) addOffset:(off_t)offset
+{
+	if(_count == _capacity) {
+		_capacity	= (0 == _capacity ? INDEX_INITIAL_CAPACITY : 2 * _capacity);
+		_offsets	= realloc(_offsets, _capacity * sizeof(off_t));
+		NSAssert(NULL != _offsets, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	_offsets[_count++] = offset;
+}
+
+// Must be called with the lock held; returns NO if the file could not be read
+- (BOOL) indexThroughFrame:(NSUInteger)frameIndex
+{
+	struct mad_stream		stream;
+	struct mad_header		header;
+	unsigned char			*tail			= NULL;
+	const unsigned char		*base;
+	off_t					baseOffset;
+	size_t					tailLength;
+	BOOL					skipFirst;
+	
+	if(_complete || frameIndex < _count)
+		return YES;
+	
+	// The file is mapped once and kept until the index is complete
+	if(nil == _mappedFile) {
+		_mappedFile = [[MappedFile alloc] initWithFilename:[self filename]];
+		if(nil == _mappedFile)
+			return NO;
+	}
+	
+	// The file was truncated after it was opened
+	if((off_t)[_mappedFile length] < (0 < _count ? _offsets[_count - 1] : 0)) {
+		[_mappedFile release];		_mappedFile = nil;
+		_complete = YES;
+		return YES;
+	}
+	
+	mad_stream_init(&stream);
+	mad_header_init(&header);
+	
+	// Resume at the last frame found; its header is decoded again but not recorded twice
+	baseOffset		= (0 < _count ? _offsets[_count - 1] : 0);
+	base			= [_mappedFile bytes] + baseOffset;
+	skipFirst		= (0 < _count);
+	
+	mad_stream_buffer(&stream, base, [_mappedFile length] - baseOffset);
+	
+	while(frameIndex >= _count) {
+		if(-1 == mad_header_decode(&header, &stream)) {
+			// Running out of the mapping means the end of the file, where libmad needs
+			// MAD_BUFFER_GUARD zeroes past the last frame; running out of those means it is indexed
+			if(MAD_ERROR_BUFLEN == stream.error && NULL == tail) {
+				tailLength	= [_mappedFile length] - (baseOffset + (stream.next_frame - base));
+				tail		= calloc(tailLength + MAD_BUFFER_GUARD, sizeof(unsigned char));
+				NSAssert(NULL != tail, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+				
+				memcpy(tail, stream.next_frame, tailLength);
+				
+				baseOffset	+= stream.next_frame - base;
+				base		= tail;
+				
+				mad_stream_buffer(&stream, tail, tailLength + MAD_BUFFER_GUARD);
+				continue;
+			}
+			else if(MAD_ERROR_BUFLEN == stream.error) {
+				_complete = YES;
+				break;
+			}
+			else if(MAD_RECOVERABLE(stream.error)) {
+				// Skip ID3 tags the same way the decoder does, so both count the same frames
+				const uint8_t	*tag		= stream.this_frame;
+				NSUInteger		taglen		= stream.bufend - stream.this_frame;
+				
+				if(10 <= taglen && 0x49 == tag[0] && 0x44 == tag[1] && 0x33 == tag[2]) {
+					mad_stream_skip(&stream, 10 + (((tag[6] & 0x7F) << (3 * 7)) | ((tag[7] & 0x7F) << (2 * 7)) |
+												   ((tag[8] & 0x7F) << (1 * 7)) | ((tag[9] & 0x7F) << (0 * 7))));
+				}
+				continue;
+			}
+			
+			// Nothing past an unrecoverable error can be decoded, so the index ends here
+			_complete = YES;
+			break;
+		}
+		
+		if(skipFirst) {
+			skipFirst = NO;
+			continue;
+		}
+		
+		[self addOffset:baseOffset + (stream.this_frame - base)];
+	}
+	
+	mad_header_finish(&header);
+	mad_stream_finish(&stream);
+	
+	free(tail);
+	
+	if(_complete) {
+		[_mappedFile release];		_mappedFile = nil;
+	}
+	
+	return YES;
+}
+
+@end
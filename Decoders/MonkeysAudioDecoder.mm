@@ -59,6 +59,8 @@
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	delete SELF_DECOMPRESSOR;
 	
 	[super dealloc];
@@ -18,13 +18,52 @@
 
 #import "MusepackDecoder.h"
 #import "CircularBuffer.h"
+#import "MappedFile.h"
+
+static mpc_int32_t
+readCallback(mpc_reader *p_reader, void *ptr, mpc_int32_t size)
+{
+	return (mpc_int32_t)[(MappedFile *)p_reader->data readBytes:ptr length:(size_t)size];
+}
+
+static mpc_bool_t
+seekCallback(mpc_reader *p_reader, mpc_int32_t offset)
+{
+	return [(MappedFile *)p_reader->data seekToOffset:offset];
+}
+
+static mpc_int32_t
+tellCallback(mpc_reader *p_reader)
+{
+	return (mpc_int32_t)[(MappedFile *)p_reader->data offset];
+}
+
+static mpc_int32_t
+getSizeCallback(mpc_reader *p_reader)
+{
+	return (mpc_int32_t)[(MappedFile *)p_reader->data length];
+}
+
+static mpc_bool_t
+canSeekCallback(mpc_reader *p_reader)
+{
+	return YES;
+}
 
 @implementation MusepackDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {		
-		mpc_reader_init_stdio(&_reader, [[self filename] fileSystemRepresentation]);
+		// Read through the mapping rather than stdio
+		_reader.read		= readCallback;
+		_reader.seek		= seekCallback;
+		_reader.tell		= tellCallback;
+		_reader.get_size	= getSizeCallback;
+		_reader.canseek		= canSeekCallback;
+		_reader.data		= [self mappedFile];
 
 		_demux = mpc_demux_init(&_reader);
 		NSAssert(NULL != _demux, NSLocalizedStringFromTable(@"The file does not appear to be a valid Musepack file.", @"Exceptions", @""));
@@ -49,9 +88,10 @@
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	mpc_demux_exit(_demux);
 	_demux = NULL;
-	mpc_reader_exit_stdio(&_reader);
 	
 	[super dealloc];
 }
@@ -25,6 +25,7 @@
 {
 	FLAC__StreamDecoder			*_flac;
 	FLAC__uint64				_totalSamples;
+	unsigned					_maxBlocksize;
 }
 
 @end
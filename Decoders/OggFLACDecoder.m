@@ -18,10 +18,13 @@
 
 #import "OggFLACDecoder.h"
 #import "CircularBuffer.h"
+#import "PCMConversion.h"
+#import "MappedFile.h"
 
 @interface OggFLACDecoder (Private)
 
 - (void)	setTotalSamples:(FLAC__uint64)totalSamples;
+- (void)	setMaxBlocksize:(unsigned)maxBlocksize;
 
 - (void)	setSampleRate:(Float64)sampleRate;
 - (void)	setBitsPerChannel:(UInt32)bitsPerChannel;
@@ -29,96 +32,67 @@
 
 @end
 
+// Input callbacks reading from the mapped file (see FLACDecoder)
+static FLAC__StreamDecoderReadStatus
+readCallback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	MappedFile		*file		= [(OggFLACDecoder *)client_data mappedFile];
+	
+	if(0 == *bytes)
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+	
+	*bytes = [file readBytes:buffer length:*bytes];
+	return (0 == *bytes ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE);
+}
+
+static FLAC__StreamDecoderSeekStatus
+seekCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	MappedFile		*file		= [(OggFLACDecoder *)client_data mappedFile];
+	return ([file seekToOffset:(off_t)absolute_byte_offset] ? FLAC__STREAM_DECODER_SEEK_STATUS_OK : FLAC__STREAM_DECODER_SEEK_STATUS_ERROR);
+}
+
+static FLAC__StreamDecoderTellStatus
+tellCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	*absolute_byte_offset = [[(OggFLACDecoder *)client_data mappedFile] offset];
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus
+lengthCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
+{
+	*stream_length = [[(OggFLACDecoder *)client_data mappedFile] length];
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool
+eofCallback(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	return [[(OggFLACDecoder *)client_data mappedFile] atEnd];
+}
+
 static FLAC__StreamDecoderWriteStatus 
 writeCallback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	OggFLACDecoder		*source					= (OggFLACDecoder *)client_data;
-	
-	unsigned			spaceRequired			= 0;
-	
-	int8_t				*alias8					= NULL;
-	int16_t				*alias16				= NULL;
+
 	int32_t				*alias32				= NULL;
-	
-	unsigned			sample, channel;
-	int32_t				audioSample;
-	
-	// Calculate the number of audio data points contained in the frame (should be one for each channel)
-	spaceRequired		= frame->header.blocksize * frame->header.channels * (frame->header.bits_per_sample / 8);
-	
-	// Increase buffer size as required
-	if([[source pcmBuffer] freeSpaceAvailable] < spaceRequired)
-		[[source pcmBuffer] resize:([[source pcmBuffer] size] + spaceRequired)];
-	
-	switch(frame->header.bits_per_sample) {
 		
-		case 8:
-			
-			// Interleave the audio (no need for byte swapping)
-			alias8 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					*alias8++ = (int8_t)buffer[channel][sample];
-				}
-			}
-				
-				[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		case 16:
-			
-			// Interleave the audio, converting to big endian byte order 
-			alias16 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					*alias16++ = (int16_t)OSSwapHostToBigInt16((int16_t)buffer[channel][sample]);
-				}
-			}
-				
-				[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		case 24:				
-			
-			// Interleave the audio, converting to big endian byte order
-			alias8 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					audioSample	= buffer[channel][sample];
-					
-					// Skip the highest byte
-					*alias8++	= (int8_t)((audioSample & 0x00ff0000) >> 16);
-					*alias8++	= (int8_t)((audioSample & 0x0000ff00) >> 8);
-					*alias8++	= (int8_t)((audioSample & 0x000000ff) /*>> 0*/);					
-				}
-			}
-			
-			[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		case 32:
-			
-			// Interleave the audio, converting to big endian byte order 
-			alias32 = [[source pcmBuffer] exposeBufferForWriting];
-			for(sample = 0; sample < frame->header.blocksize; ++sample) {
-				for(channel = 0; channel < frame->header.channels; ++channel) {
-					*alias32++ = OSSwapHostToBigInt32(buffer[channel][sample]);
-				}
-			}
-				
-				[[source pcmBuffer] wroteBytes:spaceRequired];
-			
-			break;
-			
-		default:
-			@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-			break;				
-	}
+	// Samples are buffered as host-endian int32 (see FLACDecoder)
+	unsigned spaceRequired = frame->header.blocksize * frame->header.channels * sizeof(int32_t);
+
+	// The buffer's capacity is fixed; see FLACDecoder
+	if([[source pcmBuffer] freeSpaceAvailable] < spaceRequired)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+	// Interleave the audio
+	alias32 = [[source pcmBuffer] exposeBufferForWriting];
+	PCMInterleaveInt32((const int32_t * const *)buffer, alias32, frame->header.channels, frame->header.blocksize);
+
+	[[source pcmBuffer] wroteBytes:spaceRequired];
 	
-	// Always return continue; an exception will be thrown if this isn't the case
+	// Otherwise return continue; an exception will be thrown if this isn't the case
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -134,6 +108,7 @@ metadataCallback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata
 	switch(metadata->type) {
 		case FLAC__METADATA_TYPE_STREAMINFO:
 			[source setTotalSamples:metadata->data.stream_info.total_samples];
+			[source setMaxBlocksize:metadata->data.stream_info.max_blocksize];
 			[source setSampleRate:metadata->data.stream_info.sample_rate];			
 			[source setBitsPerChannel:metadata->data.stream_info.bits_per_sample];
 			[source setChannelsPerFrame:metadata->data.stream_info.channels];
@@ -169,6 +144,8 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 
 @implementation OggFLACDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {
@@ -177,13 +154,17 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 		NSAssert(NULL != _flac, NSLocalizedStringFromTable(@"Unable to create the FLAC decoder.", @"Exceptions", @""));
 		
 		// Initialize decoder
-		FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_ogg_file(_flac, 
-																				  [[self filename] fileSystemRepresentation],
+		FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_ogg_stream(_flac, 
+																				  readCallback, 
+																				  seekCallback, 
+																				  tellCallback, 
+																				  lengthCallback, 
+																				  eofCallback, 
 																				  writeCallback, 
 																				  metadataCallback, 
 																				  errorCallback,
 																				  self);
-		NSAssert1(FLAC__STREAM_DECODER_INIT_STATUS_OK == status, @"FLAC__stream_decoder_init_file failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
+		NSAssert1(FLAC__STREAM_DECODER_INIT_STATUS_OK == status, @"FLAC__stream_decoder_init_ogg_stream failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 		
 		/*
 		 // Process cue sheets
@@ -207,15 +188,24 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 		_pcmFormat.mFramesPerPacket		= 1;
 		_pcmFormat.mBytesPerFrame		= _pcmFormat.mBytesPerPacket * _pcmFormat.mFramesPerPacket;
 		
+		_nativeSamples					= YES;
+		
 		// We only handle a subset of the legal bitsPerChannel for FLAC
 		NSAssert(8 == _pcmFormat.mBitsPerChannel || 16 == _pcmFormat.mBitsPerChannel || 24 == _pcmFormat.mBitsPerChannel || 32 == _pcmFormat.mBitsPerChannel, @"Sample size not supported");
 		
+		// The buffer holds at least one block of the largest size and does not grow after this
+		if(0 == _maxBlocksize)
+			_maxBlocksize = FLAC__MAX_BLOCK_SIZE;
+		[self reservePCMBufferCapacity:_maxBlocksize * _pcmFormat.mChannelsPerFrame * sizeof(int32_t)];
+		
 	}
 	return self;
 }
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	FLAC__bool result = FLAC__stream_decoder_finish(_flac);
 	NSAssert1(YES == result, @"FLAC__stream_decoder_finish failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 	
@@ -231,44 +221,20 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 
 - (void) fillPCMBuffer
 {
-	CircularBuffer				*buffer				= [self pcmBuffer];
-	
-	FLAC__bool					result;
+	CircularBuffer		*buffer				= [self pcmBuffer];
+	NSUInteger			blockByteSize		= _maxBlocksize * [self pcmFormat].mChannelsPerFrame * sizeof(int32_t);
+	FLAC__bool			result;
 	
-	unsigned					blockSize;
-	unsigned					channels;
-	unsigned					bitsPerSample;
-	unsigned					blockByteSize;
-	
-	
-	for(;;) {
-		
+	// Decode while the buffer can take a block of the largest size in the stream; once it can't,
+	// decoding is suspended until the consumer has read enough to make room
+	while([buffer freeSpaceAvailable] >= blockByteSize) {
+
 		// EOS?
-		if(FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(_flac)) {
+		if(FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(_flac))
 			break;
-		}
 		
-		// A problem I've run into is calculating how many times to call process_single, since
-		// there is no good way to know in advance the bytes which will be required to hold a FLAC frame.
-		// I'll handle it here by checking to see if there is enough space for the block
-		// that was just read.  For files with varying block sizes, channels or sample depths
-		// this could blow up!
-		// It's not feasible to use the maximum possible values, because
-		// maxBlocksize(65535) * maxBitsPerSample(32) * maxChannels(8) = 16,776,960 (No 16 MB buffers here!)
-		blockSize			= FLAC__stream_decoder_get_blocksize(_flac);
-		channels			= FLAC__stream_decoder_get_channels(_flac);
-		bitsPerSample		= FLAC__stream_decoder_get_bits_per_sample(_flac); 
-		
-		blockByteSize		= blockSize * channels * (bitsPerSample / 8);
-		
-		//Ensure ssufficient space remains in the buffer
-		if([buffer freeSpaceAvailable] >= blockByteSize) {
-			result	= FLAC__stream_decoder_process_single(_flac);
-			NSAssert1(YES == result, @"FLAC__stream_decoder_process_single failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
-		}
-		else {
-			break;
-		}
+		result	= FLAC__stream_decoder_process_single(_flac);
+		NSAssert1(YES == result, @"FLAC__stream_decoder_process_single failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 	}
 }
 
@@ -277,6 +243,7 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 @implementation OggFLACDecoder (Private)
 
 - (void)	setTotalSamples:(FLAC__uint64)totalSamples 		{ _totalSamples = totalSamples; }
+- (void)	setMaxBlocksize:(unsigned)maxBlocksize			{ _maxBlocksize = maxBlocksize; }
 
 - (void)	setSampleRate:(Float64)sampleRate				{ _pcmFormat.mSampleRate = sampleRate; }
 - (void)	setBitsPerChannel:(UInt32)bitsPerChannel		{ _pcmFormat.mBitsPerChannel = bitsPerChannel; }
@@ -25,7 +25,6 @@
 
 @interface OggSpeexDecoder : Decoder
 {
-	int						_fd;
 	
 	ogg_sync_state			_oy;
 	ogg_page				_og;
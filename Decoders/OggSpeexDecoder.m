@@ -18,6 +18,7 @@
 
 #import "OggSpeexDecoder.h"
 #import "CircularBuffer.h"
+#import "MappedFile.h"
 
 #include <speex/speex.h>
 #include <speex/speex_header.h>
@@ -32,25 +33,22 @@
 
 @implementation OggSpeexDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {
 		ogg_packet				op;
 		SpeexStereoState		stereo					= SPEEX_STEREO_STATE_INIT;
 		
-		// Open the input file
-		_fd = open([[self filename] fileSystemRepresentation], O_RDONLY);
-		NSAssert1(-1 != _fd, @"Unable to open the input file (%s).", strerror(errno));
-		
 		// Initialize Ogg data struct
 		ogg_sync_init(&_oy);
 		
 		// Get the ogg buffer for writing
 		char *data = ogg_sync_buffer(&_oy, 4096);
 		
-		// Read bitstream from input file
-		ssize_t bytesRead = read(_fd, data, 4096);
-		NSAssert1(-1 != bytesRead, @"Unable to read from the input file (%s).", strerror(errno));
+		// Copy the bitstream straight from the mapped input file
+		size_t bytesRead = [[self mappedFile] readBytes:data length:4096];
 		
 		// Tell the sync layer how many bytes were written to its internal buffer
 		int result = ogg_sync_wrote(&_oy, bytesRead);
@@ -119,7 +117,7 @@
 
 - (void) dealloc
 {
-	int			result;
+	[self stopReadAhead];
 	
 	// Speex cleanup
 	speex_decoder_destroy(_st);
@@ -128,10 +126,6 @@
 	// Ogg cleanup
 	ogg_stream_clear(&_os);
 	ogg_sync_clear(&_oy);
-	
-	// Close input file
-	result = close(_fd);
-	NSAssert1(-1 != result, @"Unable to close the input file (%s).", strerror(errno));
 
 	[super dealloc];
 }
@@ -223,14 +217,13 @@
 		if(NO == ogg_stream_eos(&_os) && 0 < packetsDesired) {
 			while(1 != ogg_sync_pageout(&_oy, &_og)) {
 				char			*data		= NULL;
-				ssize_t			bytesRead;
+				size_t			bytesRead;
 				
 				// Get the ogg buffer for writing
 				data		= ogg_sync_buffer(&_oy, 4196);
 				
 				// Read bitstream from input file
-				bytesRead	= read(_fd, data, 4196);
-				NSAssert1(-1 != bytesRead, @"Unable to read from the input file (%s).", strerror(errno));
+				bytesRead	= [[self mappedFile] readBytes:data length:4196];
 								
 				ogg_sync_wrote(&_oy, bytesRead);
 
@@ -18,16 +18,40 @@
 
 #import "OggVorbisDecoder.h"
 #import "CircularBuffer.h"
+#import "MappedFile.h"
+
+static size_t
+readCallback(void *ptr, size_t size, size_t nmemb, void *datasource)
+{
+	if(0 == size)
+		return 0;
+	
+	return [(MappedFile *)datasource readBytes:ptr length:size * nmemb] / size;
+}
+
+static int
+seekCallback(void *datasource, ogg_int64_t offset, int whence)
+{
+	return ([(MappedFile *)datasource seekToOffset:(off_t)offset whence:whence] ? 0 : -1);
+}
+
+static long
+tellCallback(void *datasource)
+{
+	return (long)[(MappedFile *)datasource offset];
+}
 
 @implementation OggVorbisDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {		
-		FILE *file = fopen([[self filename] fileSystemRepresentation], "r");
-		NSAssert1(NULL != file, @"Unable to open the input file (%s).", strerror(errno));	
+		// No close callback; the mapping is released along with the decoder
+		ov_callbacks callbacks = { readCallback, seekCallback, NULL, tellCallback };
 		
-		int result = ov_test(file, &_vf, NULL, 0);
+		int result = ov_test_callbacks([self mappedFile], &_vf, NULL, 0, callbacks);
 		NSAssert(0 == result, NSLocalizedStringFromTable(@"The file does not appear to be a valid Ogg Vorbis file.", @"Exceptions", @""));
 		
 		result = ov_test_open(&_vf);
@@ -55,6 +79,8 @@
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	int result = ov_clear(&_vf); 
 	
 	if(0 != result)
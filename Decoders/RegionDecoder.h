@@ -63,4 +63,8 @@
 - (void) reset;
 - (NSUInteger) completedLoops;
 
+// Read-ahead mode for the underlying decoder
+- (double) readAheadSeconds;
+- (void) setReadAheadSeconds:(double)readAheadSeconds;
+
 @end
@@ -19,6 +19,12 @@
 #import "RegionDecoder.h"
 #import "Decoder.h"
 
+@interface RegionDecoder (Private)
+- (void) seekDecoderToFrame:(SInt64)frame;
+- (UInt32) framesToReadForRequest:(UInt32)frameCount;
+- (void) didReadFrames:(UInt32)framesRead ofRequested:(UInt32)framesToRead;
+@end
+
 @implementation RegionDecoder
 
 #pragma mark Creation
@@ -152,7 +158,7 @@
 
 - (void) reset
 {
-	[[self decoder] seekToFrame:[self startingFrame]];
+	[self seekDecoderToFrame:[self startingFrame]];
 	
 	_framesReadInCurrentLoop	= 0;
 	_totalFramesRead			= 0;
@@ -167,23 +173,51 @@
 	if([self loopCount] < [self completedLoops])
 		return 0;
 	
-	UInt32	framesRemaining		= (UInt32)([self startingFrame] + [self frameCount] - [[self decoder] currentFrame]);
-	UInt32	framesToRead		= (frameCount < framesRemaining ? frameCount : framesRemaining);
+	UInt32	framesToRead		= [self framesToReadForRequest:frameCount];
 	UInt32	framesRead			= 0;
 	
 	if(0 < framesToRead)
 		framesRead = [[self decoder] readAudio:bufferList frameCount:framesToRead];
 	
-	_framesReadInCurrentLoop	+= framesRead;
-	_totalFramesRead			+= framesRead;
+	[self didReadFrames:framesRead ofRequested:framesToRead];
 	
-	if([self frameCount] == _framesReadInCurrentLoop || (0 == framesRead && 0 != framesToRead)) {
-		++_completedLoops;
-		_framesReadInCurrentLoop = 0;
-		
-		if([self loopCount] > [self completedLoops])
-			[[self decoder] seekToFrame:[self startingFrame]];
-	}
+	return framesRead;	
+}
+
+- (UInt32) readInt32Channels:(int32_t **)channels frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != channels);
+	NSParameterAssert(0 < frameCount);
+	
+	if([self loopCount] < [self completedLoops])
+		return 0;
+	
+	UInt32	framesToRead		= [self framesToReadForRequest:frameCount];
+	UInt32	framesRead			= 0;
+	
+	if(0 < framesToRead)
+		framesRead = [[self decoder] readInt32Channels:channels frameCount:framesToRead];
+	
+	[self didReadFrames:framesRead ofRequested:framesToRead];
+	
+	return framesRead;	
+}
+
+- (UInt32) readFloatChannels:(float **)channels frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != channels);
+	NSParameterAssert(0 < frameCount);
+	
+	if([self loopCount] < [self completedLoops])
+		return 0;
+	
+	UInt32	framesToRead		= [self framesToReadForRequest:frameCount];
+	UInt32	framesRead			= 0;
+	
+	if(0 < framesToRead)
+		framesRead = [[self decoder] readFloatChannels:channels frameCount:framesToRead];
+	
+	[self didReadFrames:framesRead ofRequested:framesToRead];
 	
 	return framesRead;	
 }
@@ -208,9 +242,45 @@
 	_framesReadInCurrentLoop	= frame % [self frameCount];
 	_totalFramesRead			= frame;
 
-	[[self decoder] seekToFrame:[self startingFrame] + _framesReadInCurrentLoop];
+	[self seekDecoderToFrame:[self startingFrame] + _framesReadInCurrentLoop];
 	
 	return [self currentFrame];
 }
 
+- (double)			readAheadSeconds						{ return [[self decoder] readAheadSeconds]; }
+- (void)			setReadAheadSeconds:(double)readAheadSeconds	{ [[self decoder] setReadAheadSeconds:readAheadSeconds]; }
+
+@end
+
+@implementation RegionDecoder (Private)
+
+- (void) seekDecoderToFrame:(SInt64)frame
+{
+	// Anything decoded ahead of the old position is discarded by the seek
+	[[self decoder] suspendReadAhead];
+	[[self decoder] seekToFrame:frame];
+	[[self decoder] resumeReadAhead];
+}
+
+- (UInt32) framesToReadForRequest:(UInt32)frameCount
+{
+	UInt32	framesRemaining		= (UInt32)([self startingFrame] + [self frameCount] - [[self decoder] currentFrame]);
+	
+	return (frameCount < framesRemaining ? frameCount : framesRemaining);
+}
+
+- (void) didReadFrames:(UInt32)framesRead ofRequested:(UInt32)framesToRead
+{
+	_framesReadInCurrentLoop	+= framesRead;
+	_totalFramesRead			+= framesRead;
+	
+	if([self frameCount] == _framesReadInCurrentLoop || (0 == framesRead && 0 != framesToRead)) {
+		++_completedLoops;
+		_framesReadInCurrentLoop = 0;
+		
+		if([self loopCount] > [self completedLoops])
+			[self seekDecoderToFrame:[self startingFrame]];
+	}
+}
+
 @end
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "SectorStreamDecoder.h"
+#import "SectorStream.h"
+#import "CircularBuffer.h"
+
+@implementation SectorStreamDecoder
+
+- (id) initWithFilename:(NSString *)filename
+{
+	if((self = [super initWithFilename:filename])) {
+		
+		_stream = [[SectorStream streamWithIdentifier:filename] retain];
+		NSAssert(nil != _stream, @"The rip is no longer available.");
+		
+		_streamFrame					= 0;
+		
+		// CD-DA, swapped to big-endian as it is buffered
+		_pcmFormat.mFormatID			= kAudioFormatLinearPCM;
+		_pcmFormat.mFormatFlags			= kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsBigEndian | kAudioFormatFlagIsPacked;
+		
+		_pcmFormat.mSampleRate			= 44100;
+		_pcmFormat.mChannelsPerFrame	= 2;
+		_pcmFormat.mBitsPerChannel		= 16;
+		
+		_pcmFormat.mBytesPerPacket		= (_pcmFormat.mBitsPerChannel / 8) * _pcmFormat.mChannelsPerFrame;
+		_pcmFormat.mFramesPerPacket		= 1;
+		_pcmFormat.mBytesPerFrame		= _pcmFormat.mBytesPerPacket * _pcmFormat.mFramesPerPacket;
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[self stopReadAhead];
+	
+	[_stream release];		_stream = nil;
+	
+	[super dealloc];
+}
+
+- (NSString *)		sourceFormatDescription			{ return [NSString stringWithFormat:@"%@, %u channels, %u Hz", NSLocalizedStringFromTable(@"CD-DA", @"General", @""), [self pcmFormat].mChannelsPerFrame, (unsigned)[self pcmFormat].mSampleRate]; }
+
+- (SInt64)			totalFrames						{ return [_stream totalFrames]; }
+
+// Audio already read has been given back to the system, so only seeks forward succeed
+- (BOOL)			supportsSeeking					{ return YES; }
+
+- (SInt64) seekToFrame:(SInt64)frame
+{
+	_streamFrame	= (frame < [self totalFrames] ? frame : [self totalFrames]);
+	_currentFrame	= _streamFrame;
+	[[self pcmBuffer] reset];
+	return [self currentFrame];
+}
+
+- (void) fillPCMBuffer
+{
+	CircularBuffer		*buffer				= [self pcmBuffer];
+	NSUInteger			frameCount			= [buffer freeSpaceAvailable] / 4;
+	NSUInteger			framesAvailable;
+
+	if(0 == frameCount)
+		return;
+	
+	// Wait for the ripper only as long as it takes to verify the next sector
+	framesAvailable		= [_stream waitForFramesAtFrame:_streamFrame];
+	frameCount			= (frameCount < framesAvailable ? frameCount : framesAvailable);
+	
+	if(0 == frameCount)
+		return;
+	
+	// CD-DA is little-endian regardless of the host
+	swab([_stream bytesAtFrame:_streamFrame], [buffer exposeBufferForWriting], frameCount * 4);
+	[buffer wroteBytes:frameCount * 4];
+	
+	_streamFrame += frameCount;
+	
+	// The PCM buffer holds its own copy, so the stream need not keep the audio
+	[_stream discardFramesBeforeFrame:_streamFrame];
+}
+
+@end
@@ -67,6 +67,8 @@
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	shn_cleanup_decoder(_shn);
 	shn_unload(_shn);
 	_shn = NULL;
@@ -21,9 +21,12 @@
 
 #include <wavpack/wavpack.h>
 
+@class MappedFile;
+
 @interface WavPackDecoder : Decoder
 {
     WavpackContext					*_wpc;
+	MappedFile						*_correctionFile;
 }
 
 @end
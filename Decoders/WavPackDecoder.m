@@ -18,18 +18,74 @@
 
 #import "WavPackDecoder.h"
 #import "CircularBuffer.h"
+#import "MappedFile.h"
 
 #define WP_INPUT_BUFFER_LEN		1024
 
+// WavPack reads the file (and the correction file, if present) through these, with the MappedFile as the id
+static int32_t
+readBytes(void *id, void *data, int32_t bcount)
+{
+	return (int32_t)[(MappedFile *)id readBytes:data length:(size_t)bcount];
+}
+
+static uint32_t
+getPosition(void *id)
+{
+	return (uint32_t)[(MappedFile *)id offset];
+}
+
+static int
+setPositionAbsolute(void *id, uint32_t pos)
+{
+	return ([(MappedFile *)id seekToOffset:pos] ? 0 : -1);
+}
+
+static int
+setPositionRelative(void *id, int32_t delta, int mode)
+{
+	return ([(MappedFile *)id seekToOffset:delta whence:mode] ? 0 : -1);
+}
+
+static int
+pushBackByte(void *id, int c)
+{
+	MappedFile *file = (MappedFile *)id;
+	return ([file seekToOffset:-1 whence:SEEK_CUR] ? c : EOF);
+}
+
+static uint32_t
+getLength(void *id)
+{
+	return (uint32_t)[(MappedFile *)id length];
+}
+
+static int
+canSeek(void *id)
+{
+	return 1;
+}
+
+static WavpackStreamReader sMappedFileReader = {
+	readBytes, getPosition, setPositionAbsolute, setPositionRelative, pushBackByte, getLength, canSeek, NULL
+};
+
 @implementation WavPackDecoder
 
++ (BOOL) readsMappedFile							{ return YES; }
+
 - (id) initWithFilename:(NSString *)filename
 {
 	if((self = [super initWithFilename:filename])) {
 		char error [80];
 		
+		// The correction file is optional
+		NSString *correctionFilename = [[self filename] stringByAppendingString:@"c"];
+		if([[NSFileManager defaultManager] fileExistsAtPath:correctionFilename])
+			_correctionFile = [[MappedFile alloc] initWithFilename:correctionFilename];
+		
 		// Setup converter
-		_wpc = WavpackOpenFileInput([[self filename] fileSystemRepresentation], error, OPEN_WVC, 0);
+		_wpc = WavpackOpenFileInputEx(&sMappedFileReader, [self mappedFile], _correctionFile, error, OPEN_WVC, 0);
 		NSAssert1(NULL != _wpc, @"Unable to open the input file (%s).", error);
 		
 		// Setup input format descriptor
@@ -43,15 +99,22 @@
 		_pcmFormat.mBytesPerPacket		= (_pcmFormat.mBitsPerChannel / 8) * _pcmFormat.mChannelsPerFrame;
 		_pcmFormat.mFramesPerPacket		= 1;
 		_pcmFormat.mBytesPerFrame		= _pcmFormat.mBytesPerPacket * _pcmFormat.mFramesPerPacket;
+		
+		_nativeSamples					= YES;
 	}
 	return self;
 }
 
 - (void) dealloc
 {
+	[self stopReadAhead];
+	
 	WavpackCloseFile(_wpc);
 	_wpc = NULL;
 	
+	[_correctionFile release];
+	_correctionFile = nil;
+	
 	[super dealloc];
 }
 
@@ -72,82 +135,16 @@
 - (void) fillPCMBuffer
 {
 	CircularBuffer		*buffer				= [self pcmBuffer];
-	unsigned			spaceRequired		= 0;
-	
-	// Calculate how many bytes will be required to hold WP_INPUT_BUFFER_LEN "complete" samples
-	spaceRequired		= WP_INPUT_BUFFER_LEN /* * [self pcmFormat].mChannelsPerFrame*/ * ([self pcmFormat].mBitsPerChannel / 8);
+	uint32_t			framesToRead		= WP_INPUT_BUFFER_LEN / [self pcmFormat].mChannelsPerFrame;
+	uint32_t			framesRead			= 0;
 	
-	if([buffer freeSpaceAvailable] >= spaceRequired) {
-		int32_t				inputBuffer			[WP_INPUT_BUFFER_LEN];
-		uint32_t			samplesRead			= 0;
-		uint32_t			sample				= 0;
-		int32_t				audioSample			= 0;
-		int8_t				*alias8				= NULL;
-		int16_t				*alias16			= NULL;
-		int32_t				*alias32			= NULL;
+	if([buffer freeSpaceAvailable] >= framesToRead * [self bufferBytesPerFrame]) {
 		
-		// Wavpack uses "complete" samples (one sample across all channels), i.e. a Core Audio frame
-		samplesRead		= WavpackUnpackSamples(_wpc, inputBuffer, WP_INPUT_BUFFER_LEN / [self pcmFormat].mChannelsPerFrame);
+		// Wavpack uses "complete" samples (one sample across all channels), i.e. a Core Audio frame,
+		// and unpacks them as interleaved host-endian int32 which can go straight into the buffer
+		framesRead		= WavpackUnpackSamples(_wpc, [buffer exposeBufferForWriting], framesToRead);
 		
-		switch([self pcmFormat].mBitsPerChannel) {
-			
-			case 8:
-				
-				// No need for byte swapping
-				alias8 = [buffer exposeBufferForWriting];
-				for(sample = 0; sample < samplesRead * [self pcmFormat].mChannelsPerFrame; ++sample) {
-					*alias8++ = (int8_t)inputBuffer[sample];
-				}
-
-				[buffer wroteBytes:samplesRead * [self pcmFormat].mChannelsPerFrame * sizeof(int8_t)];
-				
-				break;
-				
-			case 16:
-				
-				// Convert to big endian byte order 
-				alias16 = [buffer exposeBufferForWriting];
-				for(sample = 0; sample < samplesRead * [self pcmFormat].mChannelsPerFrame; ++sample) {
-					*alias16++ = (int16_t)OSSwapHostToBigInt16((int16_t)inputBuffer[sample]);
-				}
-					
-				[buffer wroteBytes:samplesRead * [self pcmFormat].mChannelsPerFrame * sizeof(int16_t)];
-				
-				break;
-				
-			case 24:
-				
-				// Convert to big endian byte order 
-				alias8 = [buffer exposeBufferForWriting];
-				for(sample = 0; sample < samplesRead * [self pcmFormat].mChannelsPerFrame; ++sample) {
-					audioSample	= inputBuffer[sample];
-					
-					// Skip the highest byte
-					*alias8++	= (int8_t)((audioSample & 0x00ff0000) >> 16);
-					*alias8++	= (int8_t)((audioSample & 0x0000ff00) >> 8);
-					*alias8++	= (int8_t)((audioSample & 0x000000ff) /*>> 0*/);					
-				}
-					
-				[buffer wroteBytes:samplesRead * [self pcmFormat].mChannelsPerFrame * 3 * sizeof(int8_t)];
-				
-				break;
-				
-			case 32:
-				
-				// Convert to big endian byte order 
-				alias32 = [buffer exposeBufferForWriting];
-				for(sample = 0; sample < samplesRead * [self pcmFormat].mChannelsPerFrame; ++sample) {
-					*alias32++ = OSSwapHostToBigInt32(inputBuffer[sample]);
-				}
-					
-				[buffer wroteBytes:samplesRead * [self pcmFormat].mChannelsPerFrame * sizeof(int32_t)];
-				
-				break;
-				
-			default:
-				@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-			break;	
-		}
+		[buffer wroteBytes:framesRead * [self bufferBytesPerFrame]];
 	}
 }
 
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#import "Drive.h"
+#import "SectorRange.h"
+
+struct ReadRegion;
+
+// Chooses the drive speed and read size for each region of a rip from what has been seen there so far:
+//   - Every region starts at full speed, with reads as large as the drive allows
+//   - C2 errors and mismatched readings slow a region and its neighbours down and shorten the
+//     reads there, so the rest of the disc is still read at full speed
+//   - Decisions may be made on a DriveReader's thread while the ripper records results
+@interface AdaptiveReadController : NSObject
+{
+	SectorRange				*_sectorRange;
+	NSUInteger				_maximumSectorsPerRead;
+
+	NSUInteger				_regionCount;
+	struct ReadRegion		*_regions;
+
+	uint16_t				_driveSpeed;		// The speed last requested, or 0 before the first read
+	NSUInteger				_level;				// The level last used, for logging changes
+	BOOL					_logDecisions;
+}
+
+- (instancetype)	initWithSectorRange:(SectorRange *)range maximumSectorsPerRead:(NSUInteger)maximumSectorsPerRead;
+
+- (SectorRange *)	sectorRange;
+- (NSUInteger)		maximumSectorsPerRead;
+
+- (BOOL)			logDecisions;
+- (void)			setLogDecisions:(BOOL)logDecisions;
+
+// Results, reported as the sectors are processed
+- (void)			recordReadOfSectorRange:(SectorRange *)range;
+- (void)			recordErrorForSector:(NSUInteger)sector;
+- (void)			recordMismatchForSector:(NSUInteger)sector;
+
+// Decisions for the region containing sector
+- (uint16_t)		speedForSector:(NSUInteger)sector;
+- (NSUInteger)		sectorsPerReadForSector:(NSUInteger)sector;
+
+// Set the drive's speed for a read starting at sector, returning the number of sectors to read
+- (NSUInteger)		prepareDrive:(Drive *)drive forReadAtSector:(NSUInteger)sector;
+
+@end
@@ -0,0 +1,227 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AdaptiveReadController.h"
+#import "LogController.h"
+
+#include <IOKit/storage/IOCDTypes.h>
+
+// About 1.7 seconds of audio, so a scratch slows down little more than itself
+#define READ_REGION_SIZE			128
+
+// Even badly damaged regions are read more than a few sectors at a time
+#define MINIMUM_SECTORS_PER_READ	8
+
+struct ReadRegion {
+	NSUInteger		reads;			// Sectors read
+	NSUInteger		errors;			// Sectors read with C2 errors
+	NSUInteger		mismatches;		// Readings that disagreed with an earlier one
+};
+
+// Problems per sector read at which each level starts, and what it does
+static const struct {
+	double			density;
+	uint16_t		speed;
+	NSUInteger		readDivisor;
+} sReadLevels [] = {
+	{ 0,		kCDSpeedMax,			1 },
+	{ 0.002,	16 * kCDSpeedMin,		2 },
+	{ 0.01,		8 * kCDSpeedMin,		4 },
+	{ 0.05,		4 * kCDSpeedMin,		16 },
+	{ 0.2,		kCDSpeedMin,			64 }
+};
+
+#define READ_LEVEL_COUNT			(sizeof(sReadLevels) / sizeof(sReadLevels[0]))
+
+@interface AdaptiveReadController (Private)
+- (NSUInteger)		regionForSector:(NSUInteger)sector;
+- (double)			densityForRegion:(NSUInteger)region;
+- (NSUInteger)		levelForSector:(NSUInteger)sector density:(double *)density;
+- (void)			logMessage:(NSString *)message;
+@end
+
+@implementation AdaptiveReadController
+
+- (id) initWithSectorRange:(SectorRange *)range maximumSectorsPerRead:(NSUInteger)maximumSectorsPerRead
+{
+	NSParameterAssert(nil != range);
+	NSParameterAssert(0 < maximumSectorsPerRead);
+	
+	if((self = [super init])) {
+		_sectorRange			= [range retain];
+		_maximumSectorsPerRead	= maximumSectorsPerRead;
+		
+		_regionCount			= ([range length] + READ_REGION_SIZE - 1) / READ_REGION_SIZE;
+		_regions				= calloc(_regionCount, sizeof(struct ReadRegion));
+		NSAssert(NULL != _regions, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	free(_regions);				_regions = NULL;
+	
+	[_sectorRange release];		_sectorRange = nil;
+	
+	[super dealloc];
+}
+
+- (SectorRange *)	sectorRange								{ return [[_sectorRange retain] autorelease]; }
+- (NSUInteger)		maximumSectorsPerRead					{ return _maximumSectorsPerRead; }
+
+- (BOOL)			logDecisions							{ return _logDecisions; }
+- (void)			setLogDecisions:(BOOL)logDecisions		{ _logDecisions = logDecisions; }
+
+- (void) recordReadOfSectorRange:(SectorRange *)range
+{
+	NSUInteger		sector;
+	
+	@synchronized(self) {
+		for(sector = [range firstSector]; sector <= [range lastSector]; ++sector) {
+			if([_sectorRange containsSector:sector]) {
+				++_regions[[self regionForSector:sector]].reads;
+			}
+		}
+	}
+}
+
+- (void) recordErrorForSector:(NSUInteger)sector
+{
+	@synchronized(self) {
+		if([_sectorRange containsSector:sector]) {
+			++_regions[[self regionForSector:sector]].errors;
+		}
+	}
+}
+
+- (void) recordMismatchForSector:(NSUInteger)sector
+{
+	@synchronized(self) {
+		if([_sectorRange containsSector:sector]) {
+			++_regions[[self regionForSector:sector]].mismatches;
+		}
+	}
+}
+
+- (uint16_t) speedForSector:(NSUInteger)sector
+{
+	return sReadLevels[[self levelForSector:sector density:NULL]].speed;
+}
+
+- (NSUInteger) sectorsPerReadForSector:(NSUInteger)sector
+{
+	NSUInteger		level			= [self levelForSector:sector density:NULL];
+	NSUInteger		sectorCount		= _maximumSectorsPerRead / sReadLevels[level].readDivisor;
+	NSUInteger		regionEnd;
+	
+	sectorCount		= MAX(sectorCount, MIN(_maximumSectorsPerRead, MINIMUM_SECTORS_PER_READ));
+	
+	// Stop at the end of the region, since the next one may call for something else
+	if([_sectorRange containsSector:sector]) {
+		regionEnd		= [_sectorRange firstSector] + (([self regionForSector:sector] + 1) * READ_REGION_SIZE);
+		sectorCount		= MIN(sectorCount, regionEnd - sector);
+	}
+	
+	return sectorCount;
+}
+
+- (NSUInteger) prepareDrive:(Drive *)drive forReadAtSector:(NSUInteger)sector
+{
+	NSUInteger		level;
+	NSUInteger		sectorCount;
+	double			density;
+	uint16_t		speed;
+	
+	NSParameterAssert(nil != drive);
+	
+	level			= [self levelForSector:sector density:&density];
+	speed			= sReadLevels[level].speed;
+	sectorCount		= [self sectorsPerReadForSector:sector];
+	
+	if(speed != _driveSpeed) {
+		[drive setSpeed:speed];
+		_driveSpeed = speed;
+	}
+	
+	if(level != _level) {
+		[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Sector %lu: %.2f%% of reads had problems, reading at %@ speed, %lu sectors at a time", @"Log", @""),
+						  (unsigned long)sector,
+						  density * 100,
+						  (kCDSpeedMax == speed ? NSLocalizedStringFromTable(@"maximum", @"Log", @"") : [NSString stringWithFormat:@"%ux", speed / kCDSpeedMin]),
+						  (unsigned long)sectorCount]];
+		_level = level;
+	}
+	
+	return sectorCount;
+}
+
+@end
+
+@implementation AdaptiveReadController (Private)
+
+- (NSUInteger)		regionForSector:(NSUInteger)sector		{ return [_sectorRange indexForSector:sector] / READ_REGION_SIZE; }
+
+- (double) densityForRegion:(NSUInteger)region
+{
+	struct ReadRegion *r = _regions + region;
+	
+	return (0 == r->reads ? 0 : (double)(r->errors + r->mismatches) / r->reads);
+}
+
+- (NSUInteger) levelForSector:(NSUInteger)sector density:(double *)density
+{
+	NSUInteger		region;
+	NSUInteger		level		= 0;
+	double			worst		= 0;
+	
+	@synchronized(self) {
+		if([_sectorRange containsSector:sector]) {
+			region	= [self regionForSector:sector];
+			
+			// Slow down a little ahead of a bad region and a little after it
+			worst	= [self densityForRegion:region];
+			if(0 < region) {
+				worst = MAX(worst, [self densityForRegion:region - 1]);
+			}
+			if(region + 1 < _regionCount) {
+				worst = MAX(worst, [self densityForRegion:region + 1]);
+			}
+		}
+	}
+	
+	while(level + 1 < READ_LEVEL_COUNT && sReadLevels[level + 1].density <= worst) {
+		++level;
+	}
+	
+	if(NULL != density) {
+		*density = worst;
+	}
+	
+	return level;
+}
+
+- (void) logMessage:(NSString *)message
+{
+	if([self logDecisions]) {
+		[[LogController sharedController] performSelectorOnMainThread:@selector(logMessage:) withObject:message waitUntilDone:NO];
+	}
+}
+
+@end
@@ -41,6 +41,9 @@ enum {
 	NSUInteger		_lastSession;
 }
 
+// Returns a drive for deviceName, which may name a disc image description (see ImageDrive)
++ (id)					driveWithDeviceName:(NSString *)deviceName;
+
 // Set up to read the drive corresponding to deviceName (will open the device and read the CDTOC)
 - (instancetype)		initWithDeviceName:(NSString *)deviceName;
 
@@ -86,6 +89,9 @@ enum {
 - (uint16_t)			speed;
 - (void)				setSpeed:(uint16_t)speed;
 
+// The largest read the device accepts in one command, in bytes, or 0 if unknown
+- (NSUInteger)			maximumReadSize;
+
 // Clear the drive's cache by filling with sectors outside of range
 - (void)				clearCache:(SectorRange *)range;
 
@@ -20,9 +20,11 @@
 
 #include <IOKit/storage/IOCDTypes.h>
 #include <IOKit/storage/IOCDMediaBSDClient.h>
+#include <sys/disk.h>
 #include <util.h> // opendev
 
 #import "LogController.h"
+#import "ImageDrive.h"
 
 @interface Drive (Private)
 - (void)				logMessage:(NSString *)message;
@@ -44,6 +46,13 @@
 
 @implementation Drive
 
++ (id) driveWithDeviceName:(NSString *)deviceName
+{
+	Class driveClass = ([ImageDrive isImageDeviceName:deviceName] ? [ImageDrive class] : [Drive class]);
+	
+	return [[[driveClass alloc] initWithDeviceName:deviceName] autorelease];
+}
+
 - (id) initWithDeviceName:(NSString *)deviceName
 {
 	NSParameterAssert(nil != deviceName);
@@ -207,6 +216,16 @@
 		[self logMessage:NSLocalizedStringFromTable(@"Unable to set the drive's speed", @"Exceptions", @"")];
 }
 
+- (NSUInteger)		maximumReadSize
+{
+	uint64_t	byteCount	= 0;
+	
+	if(-1 == ioctl([self fileDescriptor], DKIOCGETMAXBYTECOUNTREAD, &byteCount))
+		return 0;
+	
+	return (NSUInteger)byteCount;
+}
+
 - (void)			clearCache:(SectorRange *)range
 {
 	int16_t			*buffer											= NULL;
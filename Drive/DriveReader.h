@@ -0,0 +1,69 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#include <pthread.h>
+
+#import "Drive.h"
+#import "SectorRange.h"
+
+@class AdaptiveReadController;
+
+// Reads a sector range from a drive on a background thread, up to a fixed number of sectors at a time,
+// so the next read is already in progress while the caller processes the previous one.
+// Each chunk holds audio followed by error flags for every sector, as from -readAudioAndErrorFlags:sectorRange:
+// An AdaptiveReadController, if given, sets the drive's speed and the size of each read
+@interface DriveReader : NSObject
+{
+	Drive				*_drive;
+	SectorRange			*_sectorRange;
+	NSUInteger			_sectorsPerRead;
+	AdaptiveReadController	*_controller;
+	
+	NSUInteger			_depth;				// The number of chunk buffers
+	int8_t				**_buffers;
+	SectorRange			**_ranges;			// The sectors held in each buffer
+	NSUInteger			*_sectorsRead;		// The sectors actually read into each buffer
+	NSUInteger			_readIndex;			// The next buffer the reader will fill
+	NSUInteger			_consumeIndex;		// The next buffer the caller will receive
+	NSUInteger			_readyCount;		// Buffers filled and not yet handed out
+	BOOL				_holding;			// Whether the caller holds a buffer
+	
+	pthread_t			_thread;
+	BOOL				_threadRunning;
+	NSCondition			*_condition;
+	BOOL				_stop;
+	BOOL				_finished;
+	NSException			*_exception;
+}
+
+- (instancetype)		initWithDrive:(Drive *)drive sectorRange:(SectorRange *)range sectorsPerRead:(NSUInteger)sectorsPerRead;
+- (instancetype)		initWithDrive:(Drive *)drive sectorRange:(SectorRange *)range sectorsPerRead:(NSUInteger)sectorsPerRead controller:(AdaptiveReadController *)controller;
+
+// Start reading; at most two reads are completed ahead of the caller
+- (void)				start;
+
+// Wait for the next chunk and return it, or NULL once the range has been read
+// The chunk remains valid until the next call; errors on the reading thread are rethrown here
+- (const int8_t *)		nextChunk:(SectorRange **)range sectorsRead:(NSUInteger *)sectorsRead;
+
+// Stop reading and wait for the reading thread to exit
+- (void)				stop;
+
+@end
@@ -0,0 +1,261 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "DriveReader.h"
+#import "AdaptiveReadController.h"
+
+#include <IOKit/storage/IOCDTypes.h>
+
+// One buffer for the caller, one complete and waiting, and one being read
+#define DRIVE_READER_DEPTH		3
+
+@interface DriveReader (Private)
+- (void)	readLoop;
+@end
+
+static void *
+DriveReaderThreadEntry(void *arg)
+{
+	NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+	
+	[(DriveReader *)arg readLoop];
+	
+	[pool release];
+	return NULL;
+}
+
+@implementation DriveReader
+
+- (id) initWithDrive:(Drive *)drive sectorRange:(SectorRange *)range sectorsPerRead:(NSUInteger)sectorsPerRead
+{
+	return [self initWithDrive:drive sectorRange:range sectorsPerRead:sectorsPerRead controller:nil];
+}
+
+- (id) initWithDrive:(Drive *)drive sectorRange:(SectorRange *)range sectorsPerRead:(NSUInteger)sectorsPerRead controller:(AdaptiveReadController *)controller
+{
+	NSUInteger i;
+	
+	NSParameterAssert(nil != drive);
+	NSParameterAssert(nil != range);
+	NSParameterAssert(0 < sectorsPerRead);
+	
+	if((self = [super init])) {
+		_drive				= [drive retain];
+		_sectorRange		= [range retain];
+		_sectorsPerRead		= sectorsPerRead;
+		_controller			= [controller retain];
+		_condition			= [[NSCondition alloc] init];
+		
+		_depth				= DRIVE_READER_DEPTH;
+		_buffers			= calloc(_depth, sizeof(int8_t *));
+		_ranges				= calloc(_depth, sizeof(SectorRange *));
+		_sectorsRead		= calloc(_depth, sizeof(NSUInteger));
+		NSAssert(NULL != _buffers && NULL != _ranges && NULL != _sectorsRead, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		for(i = 0; i < _depth; ++i) {
+			_buffers[i] = calloc(_sectorsPerRead, kCDSectorSizeCDDA + kCDSectorSizeErrorFlags);
+			NSAssert(NULL != _buffers[i], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		}
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	NSUInteger i;
+	
+	[self stop];
+	
+	for(i = 0; i < _depth; ++i) {
+		if(NULL != _buffers) {
+			free(_buffers[i]);
+		}
+		if(NULL != _ranges) {
+			[_ranges[i] release];
+		}
+	}
+	
+	free(_buffers);					_buffers = NULL;
+	free(_ranges);					_ranges = NULL;
+	free(_sectorsRead);				_sectorsRead = NULL;
+	
+	[_exception release];			_exception = nil;
+	[_condition release];			_condition = nil;
+	[_sectorRange release];			_sectorRange = nil;
+	[_controller release];			_controller = nil;
+	[_drive release];				_drive = nil;
+	
+	[super dealloc];
+}
+
+- (void) start
+{
+	int result;
+	
+	NSAssert(NO == _threadRunning, @"The reader has already been started.");
+	
+	_stop		= NO;
+	_finished	= NO;
+
+	result = pthread_create(&_thread, NULL, DriveReaderThreadEntry, self);
+	NSAssert1(0 == result, NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"pthread_create");
+	
+	_threadRunning = YES;
+}
+
+- (const int8_t *) nextChunk:(SectorRange **)range sectorsRead:(NSUInteger *)sectorsRead
+{
+	const int8_t	*chunk		= NULL;
+	NSException		*exception	= nil;
+	
+	[_condition lock];
+	
+	// The caller is done with the previous chunk, so the reader may refill it
+	if(_holding) {
+		_consumeIndex	= (_consumeIndex + 1) % _depth;
+		_holding		= NO;
+		[_condition broadcast];
+	}
+	
+	while(0 == _readyCount && NO == _finished) {
+		[_condition wait];
+	}
+	
+	if(0 < _readyCount) {
+		chunk			= _buffers[_consumeIndex];
+		_holding		= YES;
+		--_readyCount;
+
+		if(NULL != range) {
+			*range = [[_ranges[_consumeIndex] retain] autorelease];
+		}
+		if(NULL != sectorsRead) {
+			*sectorsRead = _sectorsRead[_consumeIndex];
+		}
+	}
+	else if(nil != _exception) {
+		exception = [[_exception retain] autorelease];
+	}
+	
+	[_condition unlock];
+	
+	if(nil != exception) {
+		@throw exception;
+	}
+	
+	return chunk;
+}
+
+- (void) stop
+{
+	if(NO == _threadRunning) {
+		return;
+	}
+	
+	[_condition lock];
+	_stop = YES;
+	[_condition broadcast];
+	[_condition unlock];
+	
+	pthread_join(_thread, NULL);
+	_threadRunning = NO;
+}
+
+@end
+
+@implementation DriveReader (Private)
+
+- (void) readLoop
+{
+	NSUInteger			sector		= [_sectorRange firstSector];
+	NSUInteger			sectorCount;
+	NSUInteger			sectorsRead;
+	NSUInteger			index;
+	SectorRange			*readRange;
+	NSException			*exception	= nil;
+	NSAutoreleasePool	*pool;
+	
+	while(sector <= [_sectorRange lastSector]) {
+		
+		// A rip runs thousands of reads on this thread, so release each one's objects as it completes
+		pool = [[NSAutoreleasePool alloc] init];
+		
+		// Wait for a free buffer; the caller's buffer and completed ones are off limits
+		[_condition lock];
+		while(NO == _stop && _readyCount + (_holding ? 1 : 0) + 1 > _depth) {
+			[_condition wait];
+		}
+		
+		if(_stop) {
+			[_condition unlock];
+			[pool release];
+			break;
+		}
+		
+		index = _readIndex;
+		[_condition unlock];
+		
+		sectorCount		= [_sectorRange lastSector] - sector + 1;
+		if(sectorCount > _sectorsPerRead) {
+			sectorCount = _sectorsPerRead;
+		}
+		
+		@try {
+			if(nil != _controller) {
+				sectorCount = MIN(sectorCount, [_controller prepareDrive:_drive forReadAtSector:sector]);
+			}
+			
+			readRange		= [SectorRange sectorRangeWithFirstSector:sector sectorCount:sectorCount];
+			sectorsRead		= [_drive readAudioAndErrorFlags:_buffers[index] sectorRange:readRange];
+		}
+		
+		@catch(NSException *e) {
+			exception = e;
+		}
+		
+		[_condition lock];
+		
+		if(nil != exception) {
+			_exception = [exception retain];
+			[_condition unlock];
+			[pool release];
+			break;
+		}
+		
+		[_ranges[index] release];
+		_ranges[index]			= [readRange retain];
+		_sectorsRead[index]		= sectorsRead;
+		_readIndex				= (_readIndex + 1) % _depth;
+		++_readyCount;
+		
+		[_condition broadcast];
+		[_condition unlock];
+		
+		sector += sectorCount;
+		
+		[pool release];
+	}
+	
+	[_condition lock];
+	_finished = YES;
+	[_condition broadcast];
+	[_condition unlock];
+}
+
+@end
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#import "Drive.h"
+
+// A Drive that plays back a disc image instead of talking to hardware, for profiling
+// and exercising the rippers reproducibly.
+//
+// The device name is the path of a property list describing the disc:
+//   image				Raw little-endian CD-DA, 2352 bytes per sector starting at LBA 0 (relative to the property list)
+//   tracks				Array of { number, firstSector, [session], [dataTrack], [preEmphasis], [copyPermitted], [isrc] }
+//   leadOut			LBA of the lead-out
+//   mcn				Media catalog number (optional)
+//   errors				Array of { firstSector, lastSector, [errorRate], [minimumSpeedErrorRate], [reportC2], [unreadable] }:
+//						in these sectors each byte is corrupted with probability errorRate (default 0.001) on every
+//						physical read at full speed, easing towards minimumSpeedErrorRate (default errorRate) at 1x
+//   jitter				Maximum read offset error in frames, applied per read (default 0)
+//   cacheSize			Drive cache in bytes; cached sectors are returned as last read (default 0)
+//   readLatency		Seconds added to every read command (default 0)
+//   readRate			Maximum sectors per second at full speed, or 0 for unlimited (default 0)
+//   maxReadSize		Largest read in bytes the drive reports accepting, or 0 if unknown (default 0)
+//   seed				Seed for the error and jitter generator (default 1)
+@interface ImageDrive : Drive
+{
+	NSDictionary	*_profile;
+	int				_imageFD;
+	off_t			_imageSize;
+	
+	NSArray			*_errorRegions;
+	NSUInteger		_jitter;
+	double			_readLatency;
+	double			_readRate;
+	NSUInteger		_maximumReadSize;
+	uint16_t		_speed;
+	uint64_t		_randomState;
+	
+	uint8_t			*_cache;				// Audio and error flags for each cache line
+	NSUInteger		*_cacheTags;			// The sector held in each cache line, plus one (0 for none)
+	NSUInteger		_cacheLines;
+	
+	NSUInteger		_readCommandCount;
+	NSUInteger		_sectorReadCount;
+	NSUInteger		_cacheHitCount;
+}
+
+// Returns YES if deviceName names a disc image description rather than a device
++ (BOOL)			isImageDeviceName:(NSString *)deviceName;
+
+// Statistics since the drive was opened
+- (NSUInteger)		readCommandCount;
+- (NSUInteger)		sectorReadCount;
+- (NSUInteger)		cacheHitCount;
+
+@end
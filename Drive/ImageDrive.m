@@ -0,0 +1,457 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ImageDrive.h"
+
+#include <IOKit/storage/IOCDTypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <unistd.h>
+
+#define kImageDriveBlockSize	(kCDSectorSizeCDDA + kCDSectorSizeErrorFlags)
+
+@interface ImageDrive (Private)
+- (void)				readTOC;
+- (NSUInteger)			readCD:(void *)buffer sectorAreas:(uint8_t)sectorAreas startSector:(NSUInteger)startSector sectorCount:(NSUInteger)sectorCount;
+
+- (uint64_t)			nextRandom;
+- (double)				nextUniform;
+
+- (NSDictionary *)		errorRegionForSector:(NSUInteger)sector;
+- (void)				readPhysicalSector:(NSUInteger)sector frameOffset:(NSInteger)frameOffset into:(uint8_t *)block;
+- (void)				getQSubchannel:(uint8_t *)q forSector:(NSUInteger)sector;
+- (void)				throttleRead:(NSUInteger)sectorCount;
+@end
+
+static inline uint8_t
+BCD(NSUInteger value)
+{
+	return (uint8_t)(((value / 10) << 4) | (value % 10));
+}
+
+static void
+SetMSF(uint8_t *msf, NSUInteger frames)
+{
+	msf[0] = BCD(frames / (60 * 75));
+	msf[1] = BCD((frames / 75) % 60);
+	msf[2] = BCD(frames % 75);
+}
+
+// CRC-16/CCITT over the first 10 bytes of the Q sub-channel, stored inverted
+static uint16_t
+QSubchannelCRC(const uint8_t *q)
+{
+	uint16_t	crc		= 0;
+	unsigned	i, j;
+	
+	for(i = 0; i < 10; ++i) {
+		crc ^= (uint16_t)(q[i] << 8);
+		for(j = 0; j < 8; ++j) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	
+	return (uint16_t)~crc;
+}
+
+@implementation ImageDrive
+
++ (BOOL) isImageDeviceName:(NSString *)deviceName
+{
+	return ([[[deviceName pathExtension] lowercaseString] isEqualToString:@"plist"] && [[NSFileManager defaultManager] fileExistsAtPath:deviceName]);
+}
+
+- (void) dealloc
+{
+	[self closeDevice];
+	
+	[_errorRegions release];		_errorRegions = nil;
+	free(_cache);					_cache = NULL;
+	free(_cacheTags);				_cacheTags = NULL;
+	
+	[super dealloc];
+}
+
+#pragma mark Device management
+
+- (BOOL)				deviceOpen									{ return nil != _profile; }
+
+- (void) openDevice
+{
+	NSString		*imagePath;
+	NSDictionary	*profile;
+	struct stat		sourceStat;
+	
+	if([self deviceOpen]) {
+		return;
+	}
+	
+	profile = [NSDictionary dictionaryWithContentsOfFile:[self deviceName]];
+	NSAssert(nil != profile, NSLocalizedStringFromTable(@"Unable to open the drive for reading.", @"Exceptions", @""));
+	
+	imagePath = [profile objectForKey:@"image"];
+	NSAssert(nil != imagePath, NSLocalizedStringFromTable(@"Unable to open the drive for reading.", @"Exceptions", @""));
+	if(NO == [imagePath isAbsolutePath]) {
+		imagePath = [[[self deviceName] stringByDeletingLastPathComponent] stringByAppendingPathComponent:imagePath];
+	}
+	
+	_imageFD = open([imagePath fileSystemRepresentation], O_RDONLY);
+	NSAssert(-1 != _imageFD, NSLocalizedStringFromTable(@"Unable to open the drive for reading.", @"Exceptions", @""));
+	
+	_imageSize			= (0 == fstat(_imageFD, &sourceStat) ? sourceStat.st_size : 0);
+	_profile			= [profile retain];
+
+	[_errorRegions release];
+	_errorRegions		= [[profile objectForKey:@"errors"] retain];
+	_jitter				= [[profile objectForKey:@"jitter"] unsignedIntegerValue];
+	_readLatency		= [[profile objectForKey:@"readLatency"] doubleValue];
+	_readRate			= [[profile objectForKey:@"readRate"] doubleValue];
+	_maximumReadSize	= [[profile objectForKey:@"maxReadSize"] unsignedIntegerValue];
+	_speed				= kCDSpeedMax;
+	_randomState		= (nil != [profile objectForKey:@"seed"] ? [[profile objectForKey:@"seed"] unsignedLongLongValue] : 1);
+	if(0 == _randomState) {
+		_randomState = 1;
+	}
+	
+	[self setCacheSize:[[profile objectForKey:@"cacheSize"] unsignedIntegerValue]];
+	
+	free(_cache);				_cache = NULL;
+	free(_cacheTags);			_cacheTags = NULL;
+	_cacheLines = ([self cacheSize] + kCDSectorSizeCDDA - 1) / kCDSectorSizeCDDA;
+	if(0 < _cacheLines) {
+		_cache		= calloc(_cacheLines, kImageDriveBlockSize);
+		_cacheTags	= calloc(_cacheLines, sizeof(NSUInteger));
+		NSAssert(NULL != _cache && NULL != _cacheTags, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	_readCommandCount	= 0;
+	_sectorReadCount	= 0;
+	_cacheHitCount		= 0;
+}
+
+- (void) closeDevice
+{
+	if(NO == [self deviceOpen]) {
+		return;
+	}
+	
+	close(_imageFD);
+	_imageFD = -1;
+	
+	[_profile release];			_profile = nil;
+}
+
+#pragma mark Drive speed
+
+- (uint16_t)			speed										{ return _speed; }
+- (void)				setSpeed:(uint16_t)speed					{ _speed = speed; }
+- (NSUInteger)			maximumReadSize								{ return _maximumReadSize; }
+
+#pragma mark Identification
+
+- (NSString *)			readMCN										{ return [_profile objectForKey:@"mcn"]; }
+
+- (NSString *) readISRC:(NSUInteger)track
+{
+	NSEnumerator	*enumerator;
+	NSDictionary	*trackInfo;
+	
+	enumerator = [[_profile objectForKey:@"tracks"] objectEnumerator];
+	while((trackInfo = [enumerator nextObject])) {
+		if([[trackInfo objectForKey:@"number"] unsignedIntegerValue] == track) {
+			return [trackInfo objectForKey:@"isrc"];
+		}
+	}
+	
+	return nil;
+}
+
+#pragma mark Statistics
+
+- (NSUInteger)			readCommandCount							{ return _readCommandCount; }
+- (NSUInteger)			sectorReadCount								{ return _sectorReadCount; }
+- (NSUInteger)			cacheHitCount								{ return _cacheHitCount; }
+
+- (NSString *)			description
+{
+	return [NSString stringWithFormat:@"{\n\tImage: %@\n\tFirst Session: %lu\n\tLast Session: %lu\n}", [self deviceName], (unsigned long)[self firstSession], (unsigned long)[self lastSession]];
+}
+
+@end
+
+@implementation ImageDrive (Private)
+
+- (void) readTOC
+{
+	NSArray				*tracks;
+	NSDictionary		*trackInfo;
+	TrackDescriptor		*track;
+	SessionDescriptor	*session;
+	NSUInteger			i, sessionNumber;
+	
+	tracks = [[_profile objectForKey:@"tracks"] sortedArrayUsingDescriptors:[NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:@"number" ascending:YES] autorelease]]];
+	NSAssert(0 < [tracks count], NSLocalizedStringFromTable(@"Unable to read the disc's table of contents.", @"Exceptions", @""));
+	
+	[_tracks removeAllObjects];
+	[_sessions removeAllObjects];
+	
+	_firstSession	= NSNotFound;
+	_lastSession	= 0;
+	
+	for(i = 0; i < [tracks count]; ++i) {
+		trackInfo		= [tracks objectAtIndex:i];
+		sessionNumber	= (nil != [trackInfo objectForKey:@"session"] ? [[trackInfo objectForKey:@"session"] unsignedIntegerValue] : 1);
+		
+		track = [[TrackDescriptor alloc] init];
+
+		[track setSession:(unsigned)sessionNumber];
+		[track setNumber:[[trackInfo objectForKey:@"number"] unsignedIntValue]];
+		[track setFirstSector:[[trackInfo objectForKey:@"firstSector"] unsignedIntValue]];
+		[track setDataTrack:[[trackInfo objectForKey:@"dataTrack"] boolValue]];
+		[track setChannels:([track dataTrack] ? 0 : 2)];
+		[track setPreEmphasis:[[trackInfo objectForKey:@"preEmphasis"] boolValue]];
+		[track setCopyPermitted:[[trackInfo objectForKey:@"copyPermitted"] boolValue]];
+
+		[_tracks addObject:[track autorelease]];
+		
+		// Tracks are sorted, so each session's tracks are contiguous
+		session = [self sessionNumber:sessionNumber];
+		if(nil == session) {
+			session = [[SessionDescriptor alloc] init];
+			[session setNumber:sessionNumber];
+			[session setFirstTrack:[track number]];
+			[_sessions addObject:[session autorelease]];
+			
+			// The previous session ends where this one begins
+			if(0 < i) {
+				[[self sessionNumber:_lastSession] setLeadOut:[track firstSector]];
+			}
+		}
+		[session setLastTrack:[track number]];
+		
+		_firstSession	= MIN(_firstSession, sessionNumber);
+		_lastSession	= MAX(_lastSession, sessionNumber);
+	}
+	
+	[[self sessionNumber:_lastSession] setLeadOut:[[_profile objectForKey:@"leadOut"] unsignedIntegerValue]];
+}
+
+- (NSUInteger) readCD:(void *)buffer sectorAreas:(uint8_t)sectorAreas startSector:(NSUInteger)startSector sectorCount:(NSUInteger)sectorCount
+{
+	uint8_t			block			[ kImageDriveBlockSize ];
+	uint8_t			*out			= buffer;
+	NSDictionary	*region;
+	NSInteger		frameOffset		= 0;
+	NSUInteger		sector, line, i;
+	
+	NSAssert([self deviceOpen], NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Exceptions", @""));
+	
+	++_readCommandCount;
+	
+	// The whole command is misaligned by the same amount, as on a drive without accurate stream
+	if(0 < _jitter) {
+		frameOffset = (NSInteger)([self nextRandom] % (2 * _jitter + 1)) - (NSInteger)_jitter;
+	}
+	
+	for(i = 0; i < sectorCount; ++i) {
+		sector	= startSector + i;
+		region	= [self errorRegionForSector:sector];
+		
+		NSAssert(NO == [[region objectForKey:@"unreadable"] boolValue], NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Exceptions", @""));
+		
+		line = (0 < _cacheLines ? sector % _cacheLines : 0);
+		if(0 < _cacheLines && sector + 1 == _cacheTags[line]) {
+			memcpy(block, _cache + (line * kImageDriveBlockSize), kImageDriveBlockSize);
+			++_cacheHitCount;
+		}
+		else {
+			[self readPhysicalSector:sector frameOffset:frameOffset into:block];
+			++_sectorReadCount;
+			
+			if(0 < _cacheLines) {
+				memcpy(_cache + (line * kImageDriveBlockSize), block, kImageDriveBlockSize);
+				_cacheTags[line] = sector + 1;
+			}
+		}
+		
+		if(kCDSectorAreaUser & sectorAreas) {
+			memcpy(out, block, kCDSectorSizeCDDA);
+			out += kCDSectorSizeCDDA;
+		}
+		if(kCDSectorAreaErrorFlags & sectorAreas) {
+			memcpy(out, block + kCDSectorSizeCDDA, kCDSectorSizeErrorFlags);
+			out += kCDSectorSizeErrorFlags;
+		}
+		if(kCDSectorAreaSubChannelQ & sectorAreas) {
+			[self getQSubchannel:out forSector:sector];
+			out += kCDSectorSizeQSubchannel;
+		}
+	}
+	
+	[self throttleRead:sectorCount];
+	
+	return sectorCount;
+}
+
+// xorshift64*, so a profile's seed reproduces the same errors run after run
+- (uint64_t) nextRandom
+{
+	_randomState ^= _randomState >> 12;
+	_randomState ^= _randomState << 25;
+	_randomState ^= _randomState >> 27;
+	return _randomState * 0x2545F4914F6CDD1DULL;
+}
+
+- (double)				nextUniform							{ return (double)([self nextRandom] >> 11) / 9007199254740992.0; }
+
+- (NSDictionary *) errorRegionForSector:(NSUInteger)sector
+{
+	NSEnumerator	*enumerator;
+	NSDictionary	*region;
+	
+	enumerator = [_errorRegions objectEnumerator];
+	while((region = [enumerator nextObject])) {
+		if([[region objectForKey:@"firstSector"] unsignedIntegerValue] <= sector && sector <= [[region objectForKey:@"lastSector"] unsignedIntegerValue]) {
+			return region;
+		}
+	}
+	
+	return nil;
+}
+
+- (void) readPhysicalSector:(NSUInteger)sector frameOffset:(NSInteger)frameOffset into:(uint8_t *)block
+{
+	NSDictionary	*region;
+	off_t			location;
+	off_t			skip			= 0;
+	ssize_t			bytesRead;
+	double			errorRate;
+	double			slowness;
+	BOOL			reportC2;
+	NSUInteger		i;
+	
+	bzero(block, kImageDriveBlockSize);
+
+	// Sectors before the start or past the end of the image read as silence
+	location = (off_t)sector * kCDSectorSizeCDDA + (off_t)frameOffset * 4;
+	if(0 > location) {
+		skip		= -location;
+		location	= 0;
+	}
+	
+	if(skip < kCDSectorSizeCDDA && location < _imageSize) {
+		bytesRead = pread(_imageFD, block + skip, (size_t)(kCDSectorSizeCDDA - skip), location);
+		NSAssert(-1 != bytesRead, NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Exceptions", @""));
+	}
+	
+	region = [self errorRegionForSector:sector];
+	if(nil == region) {
+		return;
+	}
+	
+	errorRate	= (nil != [region objectForKey:@"errorRate"] ? [[region objectForKey:@"errorRate"] doubleValue] : 0.001);
+	reportC2	= (nil != [region objectForKey:@"reportC2"] ? [[region objectForKey:@"reportC2"] boolValue] : YES);
+	
+	// Damaged areas read better slowly; full speed is taken to be 48x
+	if(nil != [region objectForKey:@"minimumSpeedErrorRate"] && kCDSpeedMax != _speed && 0 < _speed) {
+		slowness	= 1 - MIN(1.0, MAX(0.0, ((double)_speed - kCDSpeedMin) / (47 * kCDSpeedMin)));
+		errorRate	+= slowness * ([[region objectForKey:@"minimumSpeedErrorRate"] doubleValue] - errorRate);
+	}
+	
+	if(0 >= errorRate) {
+		return;
+	}
+	
+	// Corrupt bytes independently with the given probability, skipping ahead geometrically
+	i = 0;
+	for(;;) {
+		if(1 > errorRate) {
+			i += (NSUInteger)floor(log(1 - [self nextUniform]) / log(1 - errorRate));
+		}
+		if(kCDSectorSizeCDDA <= i) {
+			break;
+		}
+		
+		block[i] ^= (uint8_t)(1 + ([self nextRandom] % 255));
+		if(reportC2) {
+			block[kCDSectorSizeCDDA + (i / 8)] |= (uint8_t)(0x80 >> (i % 8));
+		}
+		
+		++i;
+	}
+}
+
+- (void) getQSubchannel:(uint8_t *)q forSector:(NSUInteger)sector
+{
+	TrackDescriptor		*track		= nil;
+	TrackDescriptor		*candidate;
+	NSUInteger			i;
+	uint16_t			crc;
+	uint8_t				control		= 0;
+	
+	bzero(q, kCDSectorSizeQSubchannel);
+	
+	for(i = 0; i < [_tracks count]; ++i) {
+		candidate = [_tracks objectAtIndex:i];
+		if([candidate firstSector] <= sector) {
+			track = candidate;
+		}
+	}
+	
+	if(nil == track) {
+		return;
+	}
+	
+	if([track dataTrack])		{ control |= 0x4; }
+	if([track copyPermitted])	{ control |= 0x2; }
+	if([track preEmphasis])		{ control |= 0x1; }
+	
+	// Mode 1 Q: position within the track and on the disc
+	q[0] = (uint8_t)((control << 4) | 0x1);
+	q[1] = BCD([track number]);
+	q[2] = BCD(1);
+	SetMSF(q + 3, sector - [track firstSector]);
+	q[6] = 0;
+	SetMSF(q + 7, sector + 150);
+	
+	crc		= QSubchannelCRC(q);
+	q[10]	= (uint8_t)(crc >> 8);
+	q[11]	= (uint8_t)crc;
+}
+
+- (void) throttleRead:(NSUInteger)sectorCount
+{
+	double		rate		= _readRate;
+	double		seconds		= _readLatency;
+	
+	// Drive speeds are in kB/s, where 1x (176 kB/s) is 75 sectors per second
+	if(0 < rate && kCDSpeedMax != _speed && 0 < _speed) {
+		rate = MIN(rate, (_speed * 1000.0) / kCDSectorSizeCDDA);
+	}
+	
+	if(0 < rate) {
+		seconds += sectorCount / rate;
+	}
+	
+	if(0 < seconds) {
+		usleep((useconds_t)(seconds * 1000000));
+	}
+}
+
+@end
@@ -29,7 +29,6 @@
 #import "StopException.h"
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "GaplessUtilities.h"
 
@@ -56,10 +55,6 @@
 	AudioStreamBasicDescription		asbd;
 	AudioConverterRef				converter							= NULL;
 	CFArrayRef						converterPropertySettings			= NULL;
-	unsigned long					iterations							= 0;
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;
 				
 	@try {
 		bufferList.mBuffers[0].mData = NULL;
@@ -69,17 +64,7 @@
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		// Parse the encoder settings
 		settings				= [[self delegate] encoderSettings];
@@ -161,13 +146,13 @@
 		}					
 		
 		// Allocate buffer
-		bufferLen						= 10 * 1024;
+		bufferLen						= [self blockFrames] * [decoder pcmFormat].mBytesPerFrame;
 		bufferList.mNumberBuffers		= 1;
-		bufferList.mBuffers[0].mData	= calloc(bufferLen, sizeof(uint8_t));
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		bufferList.mBuffers[0].mData	= [self scratchBuffer:kEncoderInterleavedScratch byteCount:bufferLen];
 
 		totalFrames						= [decoder totalFrames];
 		framesToRead					= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
 		// Iteratively get the data and save it to the file
 		for(;;) {
@@ -190,24 +175,11 @@
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		}
 		
 		// Write gapless info and accurate bitrate for AAC files
@@ -248,8 +220,6 @@
 				NSLog(@"%@", exception);
 			}
 		}
-
-		free(bufferList.mBuffers[0].mData);
 	}
 
 	[[self delegate] setEndTime:[NSDate date]];
@@ -20,12 +20,44 @@
 
 #import "EncoderMethods.h"
 #import "EncoderTaskMethods.h"
+#import "DecoderMethods.h"
+#import "TaskStatus.h"
+
+// Scratch buffers owned by each encoder
+enum {
+	kEncoderChannelScratch			= 0,
+	kEncoderInterleavedScratch		= 1,
+	kEncoderOutputScratch			= 2,
+	
+	kEncoderScratchBufferCount		= 3
+};
 
 // An Encoder is responsible for taking audio input from a Decoder and turning it into a different format
 @interface Encoder : NSObject <EncoderMethods>
 {
 	id <EncoderTaskMethods>			_delegate;
 	NSString						*_sourceFilename;
+	TaskStatus						*_status;
+	
+	void							*_scratch				[kEncoderScratchBufferCount];
+	size_t							_scratchSize			[kEncoderScratchBufferCount];
 }
 
+// Progress and cancellation for the delegate, shared without messaging
+- (TaskStatus *)		status;
+- (void)				setStatus:(TaskStatus *)status;
+
+// The decoder for the delegate's input, shared with the other output formats when possible
+- (id <DecoderMethods>) sourceDecoder;
+
+// The number of frames to request from the decoder at a time
+- (UInt32)				blockFrames;
+
+// Scratch memory is kept for the life of the encoder and only grows, so the encode loop does not allocate;
+// the contents are undefined after a call that grows the buffer
+- (void *)				scratchBuffer:(unsigned)index byteCount:(size_t)byteCount;
+
+// One buffer of frameCount samples per channel, carved from kEncoderChannelScratch
+- (int32_t **)			scratchChannels:(UInt32)channelCount frameCount:(UInt32)frameCount;
+
 @end
@@ -18,6 +18,8 @@
 
 #import "Encoder.h"
 #import "EncoderTask.h"
+#import "Decoder.h"
+#import "FanOutDecoder.h"
 
 @implementation Encoder
 
@@ -32,9 +34,17 @@
 		pool			= [[NSAutoreleasePool alloc] init];
 		connection		= [NSConnection connectionWithReceivePort:[portArray objectAtIndex:0] sendPort:[portArray objectAtIndex:1]];
 		owner			= (EncoderTask *)[connection rootProxy];
+		
+		// The task may have been stopped while it was waiting for a worker
+		if([[portArray objectAtIndex:2] shouldStop]) {
+			[owner setStopped:YES];
+			return;
+		}
+		
 		encoder			= [[self alloc] init];
 				
 		[encoder setDelegate:owner];
+		[encoder setStatus:[portArray objectAtIndex:2]];
 		[owner encoderReady:encoder];		
 	}	
 	
@@ -49,11 +59,106 @@
 	}
 }
 
+- (void) dealloc
+{
+	unsigned i;
+	
+	for(i = 0; i < kEncoderScratchBufferCount; ++i)
+		free(_scratch[i]);
+	
+	[_status release];			_status = nil;
+	
+	[super dealloc];
+}
+
 - (id <EncoderTaskMethods>)	delegate									{ return _delegate; }
 - (void)				setDelegate:(id <EncoderTaskMethods>)delegate	{ _delegate = delegate; }
 
+- (TaskStatus *)		status											{ return [[_status retain] autorelease]; }
+- (void)				setStatus:(TaskStatus *)status					{ [_status release]; _status = [status retain]; }
+
 - (oneway void)			encodeToFile:(NSString *)filename				{}
 
+- (id <DecoderMethods>) sourceDecoder
+{
+	id <DecoderMethods>		decoder				= nil;
+	TaskInfo				*taskInfo			= [[self delegate] taskInfo];
+	NSString				*identifier			= [[self delegate] decoderFanOutIdentifier];
+	NSDictionary			*framesToConvert	= [[taskInfo settings] valueForKey:@"framesToConvert"];
+	NSString				*sourceFilename		= [taskInfo inputFilenameAtInputFileIndex];
+	double					readAheadSeconds	= [[NSUserDefaults standardUserDefaults] doubleForKey:@"decoderReadAheadSeconds"];
+	
+	// Read from the decoder shared with the other output formats, if one exists
+	if(nil != identifier)
+		decoder = [FanOutDecoder decoderWithFanOutIdentifier:identifier sinkIndex:[[self delegate] decoderFanOutSinkIndex]];
+
+	if(nil != decoder)
+		return decoder;
+	
+	// Create the appropriate kind of decoder
+	if(nil != framesToConvert) {
+		SInt64 startingFrame = [[framesToConvert valueForKey:@"startingFrame"] longLongValue];
+		UInt32 frameCount = [[framesToConvert valueForKey:@"frameCount"] unsignedIntValue];
+		decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
+	}
+	else
+		decoder = [Decoder decoderWithFilename:sourceFilename];
+	
+	// Decode on a separate thread so decoding and encoding overlap
+	if(0 < readAheadSeconds)
+		[(Decoder *)decoder setReadAheadSeconds:readAheadSeconds];
+	
+	return decoder;
+}
+
+- (UInt32) blockFrames
+{
+	NSInteger blockFrames = [[NSUserDefaults standardUserDefaults] integerForKey:@"encoderBlockFrames"];
+	
+	// Anything smaller than the old fixed size just costs more calls
+	if(1024 > blockFrames)
+		return 1024;
+	else if(1048576 < blockFrames)
+		return 1048576;
+	
+	return (UInt32)blockFrames;
+}
+
+- (void *) scratchBuffer:(unsigned)index byteCount:(size_t)byteCount
+{
+	void *buffer;
+	
+	NSParameterAssert(kEncoderScratchBufferCount > index);
+	
+	if(_scratchSize[index] < byteCount) {
+		buffer = realloc(_scratch[index], byteCount);
+		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		_scratch[index]		= buffer;
+		_scratchSize[index]	= byteCount;
+	}
+	
+	return _scratch[index];
+}
+
+- (int32_t **) scratchChannels:(UInt32)channelCount frameCount:(UInt32)frameCount
+{
+	int32_t		**channels;
+	int32_t		*samples;
+	size_t		pointerBytes;
+	UInt32		channel;
+	
+	// Keep the sample storage 16-byte aligned for the vectorized conversions
+	pointerBytes	= (channelCount * sizeof(int32_t *) + 15) & ~(size_t)15;
+	channels		= [self scratchBuffer:kEncoderChannelScratch byteCount:(pointerBytes + (size_t)channelCount * frameCount * sizeof(int32_t))];
+	samples			= (int32_t *)((uint8_t *)channels + pointerBytes);
+	
+	for(channel = 0; channel < channelCount; ++channel)
+		channels[channel] = samples + (size_t)channel * frameCount;
+	
+	return channels;
+}
+
 - (NSString *)			settingsString									{ return nil; }
 
 @end
@@ -25,8 +25,6 @@
 {
 	FLAC__StreamEncoder		*_flac;
 	
-	UInt32					_sourceBitsPerChannel;
-	
 	BOOL					_exhaustiveModelSearch;
 	BOOL					_enableMidSide;
 	BOOL					_enableLooseMidSide;
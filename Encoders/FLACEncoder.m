@@ -24,18 +24,240 @@
 #include <AudioToolbox/AudioFile.h>
 #include <AudioToolbox/ExtendedAudioFile.h>
 
+#include <FLAC/metadata.h>
+#include <CommonCrypto/CommonDigest.h>
+
+#include <pthread.h>
+
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
 #import "UtilityFunctions.h"
 
+// Parallel encoding hands each thread runs of this many FLAC blocks
+#define FLAC_PARALLEL_BLOCKS_PER_CHUNK		64
+
+// Inputs shorter than this are encoded on a single thread
+#define FLAC_PARALLEL_MINIMUM_SECONDS		60
+
+// A run of blocks encoded independently of the rest of the stream
+struct FLACChunk {
+	int32_t					**channels;
+	UInt32					frameCount;
+	uint32_t				firstFrameNumber;
+	
+	FLAC__byte				*output;				// Renumbered FLAC frames
+	size_t					outputSize;
+	size_t					outputCapacity;
+	uint32_t				*frameSizes;
+	unsigned				frameSizeCount;
+	
+	NSException				*exception;
+	dispatch_semaphore_t	done;
+	BOOL					pending;
+};
+
+// What libFLAC would have tracked while writing the frames itself
+struct FLACStreamState {
+	FILE					*file;
+	unsigned				blocksize;
+	FLAC__StreamMetadata	*seektable;
+	unsigned				firstSeekpointToCheck;
+	FLAC__uint64			samplesWritten;
+	FLAC__uint64			audioBytesWritten;
+	uint32_t				minFrameSize;
+	uint32_t				maxFrameSize;
+};
+
 @interface FLACEncoder (Private)
-- (void)	parseSettings;
-- (void)	encodeChunk:(const AudioBufferList *)chunk frameCount:(UInt32)frameCount;
+- (void)		parseSettings;
+- (void)		configureEncoder:(FLAC__StreamEncoder *)encoder format:(AudioStreamBasicDescription)format;
+- (void)		encodeChunk:(const int32_t * const *)channels frameCount:(UInt32)frameCount;
+
+- (unsigned)	parallelThreadCount;
+- (void)		encodeInParallelFromDecoder:(id <DecoderMethods>)decoder toFile:(NSString *)filename seektable:(FLAC__StreamMetadata *)seektable threadCount:(unsigned)threadCount;
+- (void)		encodeFLACChunk:(struct FLACChunk *)chunk format:(AudioStreamBasicDescription)format blocksize:(unsigned)blocksize;
+- (void)		writeFLACChunk:(struct FLACChunk *)chunk stream:(struct FLACStreamState *)stream;
 @end
 
+static uint8_t			sCRC8Table [256];
+static uint16_t			sCRC16Table [256];
+static pthread_once_t	sCRCTablesOnce			= PTHREAD_ONCE_INIT;
+
+static void
+InitializeCRCTables()
+{
+	unsigned	i, bit;
+	uint8_t		crc8;
+	uint16_t	crc16;
+	
+	for(i = 0; i < 256; ++i) {
+		crc8	= (uint8_t)i;
+		crc16	= (uint16_t)(i << 8);
+		for(bit = 0; bit < 8; ++bit) {
+			crc8	= (uint8_t)((crc8 & 0x80) ? (crc8 << 1) ^ 0x07 : (crc8 << 1));
+			crc16	= (uint16_t)((crc16 & 0x8000) ? (crc16 << 1) ^ 0x8005 : (crc16 << 1));
+		}
+		sCRC8Table[i]	= crc8;
+		sCRC16Table[i]	= crc16;
+	}
+}
+
+// Copies a fixed-blocksize frame to output with a new frame number, updating both CRCs
+// Returns the size of the new frame, which may grow by up to five bytes, or 0 if the header is not recognized
+static size_t
+RenumberFLACFrame(const FLAC__byte *frame, size_t bytes, uint32_t frameNumber, FLAC__byte *output)
+{
+	size_t		numberLength, newNumberLength, headerLength, i;
+	unsigned	blockSizeCode, sampleRateCode;
+	uint8_t		crc8;
+	uint16_t	crc16;
+	
+	pthread_once(&sCRCTablesOnce, InitializeCRCTables);
+	
+	// Sync code and fixed blocksize, with room for the fixed part of the header and both CRCs
+	if(8 > bytes || 0xFF != frame[0] || 0xF8 != frame[1])
+		return 0;
+	
+	// The frame number is UTF-8 coded
+	if(0x00 == (frame[4] & 0x80))			numberLength = 1;
+	else if(0xC0 == (frame[4] & 0xE0))		numberLength = 2;
+	else if(0xE0 == (frame[4] & 0xF0))		numberLength = 3;
+	else if(0xF0 == (frame[4] & 0xF8))		numberLength = 4;
+	else if(0xF8 == (frame[4] & 0xFC))		numberLength = 5;
+	else if(0xFC == (frame[4] & 0xFE))		numberLength = 6;
+	else									return 0;
+	
+	// and may be followed by an uncommon block size or sample rate
+	headerLength	= 4 + numberLength;
+	blockSizeCode	= frame[2] >> 4;
+	sampleRateCode	= frame[2] & 0x0F;
+	
+	if(6 == blockSizeCode)									headerLength += 1;
+	else if(7 == blockSizeCode)								headerLength += 2;
+	
+	if(12 == sampleRateCode)								headerLength += 1;
+	else if(13 == sampleRateCode || 14 == sampleRateCode)	headerLength += 2;
+	
+	if(headerLength + 1 + 2 > bytes)
+		return 0;
+	
+	memcpy(output, frame, 4);
+	
+	if(0x80 > frameNumber) {
+		output[4]		= (FLAC__byte)frameNumber;
+		newNumberLength	= 1;
+	}
+	else {
+		if(0x800 > frameNumber)				{ newNumberLength = 2;	output[4] = (FLAC__byte)(0xC0 | (frameNumber >> 6)); }
+		else if(0x10000 > frameNumber)		{ newNumberLength = 3;	output[4] = (FLAC__byte)(0xE0 | (frameNumber >> 12)); }
+		else if(0x200000 > frameNumber)		{ newNumberLength = 4;	output[4] = (FLAC__byte)(0xF0 | (frameNumber >> 18)); }
+		else if(0x4000000 > frameNumber)	{ newNumberLength = 5;	output[4] = (FLAC__byte)(0xF8 | (frameNumber >> 24)); }
+		else								{ newNumberLength = 6;	output[4] = (FLAC__byte)(0xFC | (frameNumber >> 30)); }
+		
+		for(i = 1; i < newNumberLength; ++i)
+			output[4 + i] = (FLAC__byte)(0x80 | ((frameNumber >> (6 * (newNumberLength - 1 - i))) & 0x3F));
+	}
+	
+	// Everything else is unchanged apart from the CRCs
+	memcpy(output + 4 + newNumberLength, frame + 4 + numberLength, bytes - 2 - (4 + numberLength));
+	
+	headerLength	= headerLength - numberLength + newNumberLength;
+	bytes			= bytes - numberLength + newNumberLength;
+	
+	crc8 = 0;
+	for(i = 0; i < headerLength; ++i)
+		crc8 = sCRC8Table[crc8 ^ output[i]];
+	output[headerLength] = crc8;
+	
+	crc16 = 0;
+	for(i = 0; i < bytes - 2; ++i)
+		crc16 = (uint16_t)((crc16 << 8) ^ sCRC16Table[(crc16 >> 8) ^ output[i]]);
+	output[bytes - 2] = (FLAC__byte)(crc16 >> 8);
+	output[bytes - 1] = (FLAC__byte)crc16;
+	
+	return bytes;
+}
+
+// libFLAC hashes the samples interleaved, little-endian and packed to the bytes needed for the sample size
+static void
+AccumulateFLACMD5(CC_MD5_CTX *md5, const int32_t * const *channels, unsigned channelCount, UInt32 frameCount, unsigned bytesPerSample, FLAC__byte *buffer)
+{
+	FLAC__byte		*p			= buffer;
+	UInt32			frame;
+	unsigned		channel;
+	int32_t			sample;
+	
+	switch(bytesPerSample) {
+		case 1:
+			for(frame = 0; frame < frameCount; ++frame)
+				for(channel = 0; channel < channelCount; ++channel)
+					*p++ = (FLAC__byte)channels[channel][frame];
+			break;
+			
+		case 2:
+			for(frame = 0; frame < frameCount; ++frame)
+				for(channel = 0; channel < channelCount; ++channel) {
+					sample	= channels[channel][frame];
+					*p++	= (FLAC__byte)sample;
+					*p++	= (FLAC__byte)(sample >> 8);
+				}
+			break;
+			
+		case 3:
+			for(frame = 0; frame < frameCount; ++frame)
+				for(channel = 0; channel < channelCount; ++channel) {
+					sample	= channels[channel][frame];
+					*p++	= (FLAC__byte)sample;
+					*p++	= (FLAC__byte)(sample >> 8);
+					*p++	= (FLAC__byte)(sample >> 16);
+				}
+			break;
+	}
+	
+	CC_MD5_Update(md5, buffer, (CC_LONG)(p - buffer));
+}
+
+static FLAC__StreamEncoderWriteStatus
+WriteHeaderCallback(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	return (bytes == fwrite(buffer, 1, bytes, (FILE *)client_data) ? FLAC__STREAM_ENCODER_WRITE_STATUS_OK : FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR);
+}
+
+static FLAC__StreamEncoderWriteStatus
+WriteChunkCallback(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	struct FLACChunk	*chunk		= (struct FLACChunk *)client_data;
+	FLAC__byte			*output;
+	size_t				size;
+	
+	// Only the encoder writing the file contributes the stream header
+	if(0 == samples)
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	
+	if(FLAC_PARALLEL_BLOCKS_PER_CHUNK == chunk->frameSizeCount)
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+	
+	if(chunk->outputCapacity < chunk->outputSize + bytes + 5) {
+		output = realloc(chunk->output, 2 * (chunk->outputSize + bytes + 5));
+		if(NULL == output)
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		
+		chunk->output			= output;
+		chunk->outputCapacity	= 2 * (chunk->outputSize + bytes + 5);
+	}
+	
+	size = RenumberFLACFrame(buffer, bytes, chunk->firstFrameNumber + current_frame, chunk->output + chunk->outputSize);
+	if(0 == size)
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+	
+	chunk->outputSize							+= size;
+	chunk->frameSizes[chunk->frameSizeCount++]	= (uint32_t)size;
+	
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
 @implementation FLACEncoder
 
 - (id) init
@@ -60,10 +282,10 @@
 - (oneway void) encodeToFile:(NSString *)filename
 {
 	NSDate							*startTime					= [NSDate date];
-	unsigned long					iterations					= 0;
-	AudioBufferList					bufferList;
-	ssize_t							bufferLen					= 0;
-	UInt32							bufferByteSize				= 0;
+	int32_t							**buffer					= NULL;
+	UInt32							bufferLen					= 0;
+	UInt32							channelCount				= 0;
+	unsigned						threadCount					= 0;
 	FLAC__bool						result;
 	FLAC__StreamEncoderInitStatus	encoderStatus;
 	FLAC__StreamMetadata			*seektable					= NULL;
@@ -71,13 +293,8 @@
 	FLAC__StreamMetadata			*metadata [2];
 	SInt64							totalFrames, framesToRead;
 	UInt32							frameCount;
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;
 	
 	@try {
-		bufferList.mBuffers[0].mData = NULL;
-
 		// Parse the encoder settings
 		[self parseSettings];
 
@@ -86,101 +303,31 @@
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 
-		_sourceBitsPerChannel	= [decoder pcmFormat].mBitsPerChannel;
 		totalFrames				= [decoder totalFrames];
 		framesToRead			= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
-		// Set up the AudioBufferList
-		bufferList.mNumberBuffers					= 1;
-		bufferList.mBuffers[0].mData				= NULL;
-		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
-		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen = 1024;
+		// 32-bit sample size not yet supported by FLAC
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
-				// 32-bit sample size not yet supported by FLAC
-				/*
-			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
+			case 24:
 				break;
-				*/
 				
 			default:
 				@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
 				break;				
 		}
 
-		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-		
 		// Create the FLAC encoder
 		_flac = FLAC__stream_encoder_new();
 		NSAssert(NULL != _flac, NSLocalizedStringFromTable(@"Unable to create the FLAC encoder.", @"Exceptions", @""));
 
 		// Setup FLAC encoder
-		
-		// Input information
-		result = FLAC__stream_encoder_set_sample_rate(_flac, [decoder pcmFormat].mSampleRate);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_sample_rate failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-
-		result = FLAC__stream_encoder_set_bits_per_sample(_flac, [decoder pcmFormat].mBitsPerChannel);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_bits_per_sample failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-
-		result = FLAC__stream_encoder_set_channels(_flac, [decoder pcmFormat].mChannelsPerFrame);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_channels failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-			
-		// Encoder parameters
-		result = FLAC__stream_encoder_set_do_mid_side_stereo(_flac, _enableMidSide);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_do_mid_side_stereo failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-		
-		result = FLAC__stream_encoder_set_loose_mid_side_stereo(_flac, _enableLooseMidSide);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_loose_mid_side_stereo failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-		
-		result = FLAC__stream_encoder_set_apodization(_flac, [_apodization cStringUsingEncoding:NSASCIIStringEncoding]);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_apodization failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-		
-		result = FLAC__stream_encoder_set_max_lpc_order(_flac, _maxLPCOrder);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_max_lpc_order failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-		
-		result = FLAC__stream_encoder_set_qlp_coeff_precision(_flac, _QLPCoeffPrecision);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_qlp_coeff_precision failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-		
-		result = FLAC__stream_encoder_set_do_qlp_coeff_prec_search(_flac, _enableQLPCoeffPrecisionSearch);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_do_qlp_coeff_prec_search failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-		
-		result = FLAC__stream_encoder_set_do_exhaustive_model_search(_flac, _exhaustiveModelSearch);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_do_exhaustive_model_search failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-
-		result = FLAC__stream_encoder_set_min_residual_partition_order(_flac, _minPartitionOrder);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_min_residual_partition_order failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-
-		result = FLAC__stream_encoder_set_max_residual_partition_order(_flac, _maxPartitionOrder);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_max_residual_partition_order failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+		[self configureEncoder:_flac format:[decoder pcmFormat]];
 
 		// Create a seektable
 		seektable = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE);
@@ -212,61 +359,54 @@
 			NSAssert1(YES == result, @"FLAC__stream_encoder_set_metadata failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
 		}
 
-		result = FLAC__stream_encoder_set_verify(_flac, _verifyEncoding);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_set_verify failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-
-		// Initialize the FLAC encoder
 		result = FLAC__stream_encoder_set_total_samples_estimate(_flac, totalFrames);
 		NSAssert1(YES == result, @"FLAC__stream_encoder_set_total_samples_estimate failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
 
-		encoderStatus = FLAC__stream_encoder_init_file(_flac, 
-													   [filename fileSystemRepresentation],
-													   NULL, 
-													   self);
-		NSAssert1(FLAC__STREAM_ENCODER_INIT_STATUS_OK == encoderStatus, @"FLAC__stream_encoder_init_file failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-
-		// Iteratively get the PCM data and encode it
-		for(;;) {
-			
-			// Set up the buffer parameters
-			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
-			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
-			
-			// Read a chunk of PCM input
-			frameCount = [decoder readAudio:&bufferList frameCount:frameCount];
-			
-			// We're finished if no frames were returned
-			if(0 == frameCount)
-				break;
-			
-			// Encode the PCM data
-			[self encodeChunk:&bufferList frameCount:frameCount];
-			
-			// Update status
-			framesToRead -= frameCount;
+		// When flacEncoderParallel is set, long inputs are encoded on several threads, unless loose mid-side
+		// stereo is enabled since it carries its choice of channel assignment from one frame to the next
+		threadCount = [self parallelThreadCount];
+		if(1 < threadCount && NO == _enableLooseMidSide && totalFrames >= FLAC_PARALLEL_MINIMUM_SECONDS * [decoder pcmFormat].mSampleRate) {
+			[self encodeInParallelFromDecoder:decoder toFile:filename seektable:seektable threadCount:threadCount];
+		}
+		else {
+			// Allocate the buffers that will hold the audio data for each channel, which FLAC accepts as-is
+			bufferLen		= [self blockFrames];
+			channelCount	= [decoder pcmFormat].mChannelsPerFrame;
+			buffer			= [self scratchChannels:channelCount frameCount:bufferLen];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
+			// Initialize the FLAC encoder
+			encoderStatus = FLAC__stream_encoder_init_file(_flac, 
+														   [filename fileSystemRepresentation],
+														   NULL, 
+														   self);
+			NSAssert1(FLAC__STREAM_ENCODER_INIT_STATUS_OK == encoderStatus, @"FLAC__stream_encoder_init_file failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+
+			// Iteratively get the PCM data and encode it
+			for(;;) {
 				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop])
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+				// Read a chunk of PCM input
+				frameCount = [decoder readInt32Channels:buffer frameCount:bufferLen];
 				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
+				// We're finished if no frames were returned
+				if(0 == frameCount)
+					break;
 				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
+				// Encode the PCM data
+				[self encodeChunk:(const int32_t * const *)buffer frameCount:frameCount];
+				
+				// Update status
+				framesToRead -= frameCount;
+				[_status setCompletedUnits:(totalFrames - framesToRead)];
+				
+				// Check if we should stop, and if so throw an exception
+				if([_status shouldStop])
+					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 			}
 			
-			++iterations;
+			// Finish up the encoding process
+			result = FLAC__stream_encoder_finish(_flac);
+			NSAssert1(YES == result, @"FLAC__stream_encoder_finish failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
 		}
-		
-		// Finish up the encoding process
-		result = FLAC__stream_encoder_finish(_flac);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_finish failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
 	}
 	
 	
@@ -291,8 +431,6 @@
 		if(NULL != padding) {
 			FLAC__metadata_object_delete(padding);
 		}
-				
-		free(bufferList.mBuffers[0].mData);
 	}	
 
 	[[self delegate] setEndTime:[NSDate date]];
@@ -323,98 +461,389 @@
 	_exhaustiveModelSearch	= [[settings objectForKey:@"exhaustiveModelSearch"] boolValue];
 	_minPartitionOrder		= [[settings objectForKey:@"minPartitionOrder"] intValue];
 	_maxPartitionOrder		= [[settings objectForKey:@"maxPartitionOrder"] intValue];
+	_verifyEncoding			= [[settings objectForKey:@"verifyEncoding"] boolValue];
+}
+
+- (void) configureEncoder:(FLAC__StreamEncoder *)encoder format:(AudioStreamBasicDescription)format
+{
+	FLAC__bool		result;
+	
+	// Input information
+	result = FLAC__stream_encoder_set_sample_rate(encoder, format.mSampleRate);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_sample_rate failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+
+	result = FLAC__stream_encoder_set_bits_per_sample(encoder, format.mBitsPerChannel);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_bits_per_sample failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+
+	result = FLAC__stream_encoder_set_channels(encoder, format.mChannelsPerFrame);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_channels failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+		
+	// Encoder parameters
+	result = FLAC__stream_encoder_set_do_mid_side_stereo(encoder, _enableMidSide);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_do_mid_side_stereo failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+	
+	result = FLAC__stream_encoder_set_loose_mid_side_stereo(encoder, _enableLooseMidSide);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_loose_mid_side_stereo failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+	
+	result = FLAC__stream_encoder_set_apodization(encoder, [_apodization cStringUsingEncoding:NSASCIIStringEncoding]);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_apodization failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+	
+	result = FLAC__stream_encoder_set_max_lpc_order(encoder, _maxLPCOrder);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_max_lpc_order failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+	
+	result = FLAC__stream_encoder_set_qlp_coeff_precision(encoder, _QLPCoeffPrecision);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_qlp_coeff_precision failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+	
+	result = FLAC__stream_encoder_set_do_qlp_coeff_prec_search(encoder, _enableQLPCoeffPrecisionSearch);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_do_qlp_coeff_prec_search failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+	
+	result = FLAC__stream_encoder_set_do_exhaustive_model_search(encoder, _exhaustiveModelSearch);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_do_exhaustive_model_search failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+
+	result = FLAC__stream_encoder_set_min_residual_partition_order(encoder, _minPartitionOrder);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_min_residual_partition_order failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+
+	result = FLAC__stream_encoder_set_max_residual_partition_order(encoder, _maxPartitionOrder);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_max_residual_partition_order failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
+
+	// Set here so the encoders for parallel chunks verify their frames too
+	result = FLAC__stream_encoder_set_verify(encoder, _verifyEncoding);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_set_verify failed: %s", FLAC__stream_encoder_get_resolved_state_string(encoder));
 }
 
-- (void) encodeChunk:(const AudioBufferList *)chunk frameCount:(UInt32)frameCount
+- (void) encodeChunk:(const int32_t * const *)channels frameCount:(UInt32)frameCount
 {
 	FLAC__bool		result;
 	
-	int32_t			**buffer				= NULL;
+	result = FLAC__stream_encoder_process(_flac, (const FLAC__int32 * const *)channels, frameCount);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_process failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+}	
+
+- (unsigned) parallelThreadCount
+{
+	NSInteger	threadCount		= [[NSUserDefaults standardUserDefaults] integerForKey:@"flacEncoderThreads"];
+	NSInteger	processorCount	= [[NSProcessInfo processInfo] activeProcessorCount];
+	NSInteger	encoderCount;
+	
+	// Off by default until the flac benchmark has shown parallel output matches serial libFLAC on real input
+	if(NO == [[NSUserDefaults standardUserDefaults] boolForKey:@"flacEncoderParallel"])
+		return 1;
+	
+	// By default the cores are shared with the other encoders the scheduler may be running
+	if(0 >= threadCount) {
+		encoderCount = [[NSUserDefaults standardUserDefaults] integerForKey:@"maximumEncoderThreads"];
+		if(0 >= encoderCount || encoderCount > processorCount)
+			encoderCount = processorCount;
+		
+		threadCount = processorCount / encoderCount;
+	}
 	
-	int8_t			*buffer8				= NULL;
-	int16_t			*buffer16				= NULL;
-	int32_t			*buffer32				= NULL;
+	if(1 > threadCount)
+		threadCount = 1;
 	
-	int32_t			constructedSample;
+	return (unsigned)(64 < threadCount ? 64 : threadCount);
+}
+
+// FLAC frames do not depend on one another, so runs of blocks are encoded by separate encoders
+// with identical settings, and their frames are renumbered and written in order. _flac writes
+// the stream header; STREAMINFO and the seektable are filled in afterwards with the values
+// libFLAC would have tracked had it written the frames itself.
+- (void) encodeInParallelFromDecoder:(id <DecoderMethods>)decoder toFile:(NSString *)filename seektable:(FLAC__StreamMetadata *)seektable threadCount:(unsigned)threadCount
+{
+	AudioStreamBasicDescription		format					= [decoder pcmFormat];
+	unsigned						channelCount			= format.mChannelsPerFrame;
+	unsigned						bytesPerSample			= (format.mBitsPerChannel + 7) / 8;
+	unsigned						chunkCount				= 2 * threadCount;
+	struct FLACChunk				*chunks					= NULL;
+	struct FLACChunk				*chunk					= NULL;
+	struct FLACStreamState			stream;
+	int32_t							*cursor [FLAC__MAX_CHANNELS];
+	FLAC__byte						*md5Buffer				= NULL;
+	CC_MD5_CTX						md5;
+	dispatch_semaphore_t			workers					= NULL;
+	dispatch_queue_t				queue					= dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	FLAC__Metadata_SimpleIterator	*iterator				= NULL;
+	FLAC__StreamMetadata			*streaminfo				= NULL;
+	FLAC__StreamEncoderInitStatus	encoderStatus;
+	FLAC__bool						result;
+	SInt64							totalFrames				= [decoder totalFrames];
+	SInt64							framesToRead			= totalFrames;
+	unsigned						blocksize;
+	UInt32							chunkFrames;
+	UInt32							frameCount;
+	UInt32							framesRead;
+	uint32_t						chunkIndex;
+	unsigned						i, channel;
+	BOOL							endOfStream				= NO;
 	
-	unsigned		wideSample;
-	unsigned		sample, channel;
+	memset(&stream, 0, sizeof(stream));
 	
 	@try {
-		// Allocate the FLAC buffer
-		buffer = calloc(chunk->mBuffers[0].mNumberChannels, sizeof(int32_t *));
-		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		NSAssert(FLAC__MAX_CHANNELS >= channelCount, @"Too many channels for FLAC.");
 		
-		// Initialize each channel buffer to zero
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			buffer[channel] = NULL;
-		}
+		stream.file = fopen([filename fileSystemRepresentation], "wb");
+		NSAssert(NULL != stream.file, NSLocalizedStringFromTable(@"Unable to create the output file.", @"Exceptions", @""));
+		
+		encoderStatus = FLAC__stream_encoder_init_stream(_flac, WriteHeaderCallback, NULL, NULL, NULL, stream.file);
+		NSAssert1(FLAC__STREAM_ENCODER_INIT_STATUS_OK == encoderStatus, @"FLAC__stream_encoder_init_stream failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+		
+		blocksize				= FLAC__stream_encoder_get_blocksize(_flac);
+		chunkFrames				= blocksize * FLAC_PARALLEL_BLOCKS_PER_CHUNK;
+		
+		stream.blocksize		= blocksize;
+		stream.seektable		= seektable;
+		stream.minFrameSize		= UINT32_MAX;
+		
+		// No audio was passed and there is no seek callback, so finishing writes nothing more
+		result = FLAC__stream_encoder_finish(_flac);
+		NSAssert1(YES == result, @"FLAC__stream_encoder_finish failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+		
+		// Twice as many chunks as threads, so the next ones are read while the others encode
+		chunks = calloc(chunkCount, sizeof(struct FLACChunk));
+		NSAssert(NULL != chunks, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 		
-		// Allocate channel buffers
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			buffer[channel] = calloc(frameCount, sizeof(int32_t));
-			NSAssert(NULL != buffer[channel], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		for(i = 0; i < chunkCount; ++i) {
+			chunk					= &chunks[i];
+			chunk->channels			= calloc(channelCount, sizeof(int32_t *));
+			chunk->frameSizes		= calloc(FLAC_PARALLEL_BLOCKS_PER_CHUNK, sizeof(uint32_t));
+			chunk->outputCapacity	= (size_t)chunkFrames * channelCount * bytesPerSample;
+			chunk->output			= malloc(chunk->outputCapacity);
+			chunk->done				= dispatch_semaphore_create(0);
+			NSAssert(NULL != chunk->channels && NULL != chunk->frameSizes && NULL != chunk->output && NULL != chunk->done, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+			
+			chunk->channels[0]		= calloc((size_t)channelCount * chunkFrames, sizeof(int32_t));
+			NSAssert(NULL != chunk->channels[0], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+			
+			for(channel = 1; channel < channelCount; ++channel)
+				chunk->channels[channel] = chunk->channels[0] + (size_t)channel * chunkFrames;
 		}
 		
-		// Split PCM data into channels and convert to 32-bit sample size for FLAC
-		switch(_sourceBitsPerChannel) {
-
-			case 8:
-				buffer8 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						buffer[channel][wideSample] = (int32_t)buffer8[sample];
-					}
-				}
-				break;
+		md5Buffer = [self scratchBuffer:kEncoderOutputScratch byteCount:(size_t)chunkFrames * channelCount * bytesPerSample];
+		CC_MD5_Init(&md5);
+		
+		workers = dispatch_semaphore_create(threadCount);
+		NSAssert(NULL != workers, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		for(chunkIndex = 0; NO == endOfStream; ++chunkIndex) {
+			chunk = &chunks[chunkIndex % chunkCount];
 			
-			case 16:
-				buffer16 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						buffer[channel][wideSample] = (int32_t)(int16_t)OSSwapBigToHostInt16(buffer16[sample]);
-					}
-				}
-				break;
+			// Write the frames of the chunk that last used this slot
+			if(chunk->pending)
+				[self writeFLACChunk:chunk stream:&stream];
 			
-			case 24:
-				buffer8 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-						constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++;
-						
-						buffer[channel][wideSample] = constructedSample;
-					}
-				}
-				break;
+			// Fill the chunk, since only the final one may be short
+			for(frameCount = 0; frameCount < chunkFrames; frameCount += framesRead) {
+				for(channel = 0; channel < channelCount; ++channel)
+					cursor[channel] = chunk->channels[channel] + frameCount;
 				
-			case 32:
-				buffer32 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						buffer[channel][wideSample] = (int32_t)OSSwapBigToHostInt32(buffer32[sample]);
-					}
-				}
+				framesRead = [decoder readInt32Channels:cursor frameCount:(chunkFrames - frameCount)];
+				if(0 == framesRead)
+					break;
+			}
+			
+			if(0 == frameCount)
 				break;
+			
+			endOfStream = (frameCount < chunkFrames);
+			
+			// The hash covers the stream in order, so it is computed here rather than by the workers
+			AccumulateFLACMD5(&md5, (const int32_t * const *)chunk->channels, channelCount, frameCount, bytesPerSample, md5Buffer);
+			
+			chunk->frameCount			= frameCount;
+			chunk->firstFrameNumber		= chunkIndex * FLAC_PARALLEL_BLOCKS_PER_CHUNK;
+			chunk->outputSize			= 0;
+			chunk->frameSizeCount		= 0;
+			chunk->pending				= YES;
+			
+			// Wait for a free worker before submitting, so no more than threadCount blocks are
+			// ever queued and GCD has no reason to start threads beyond them
+			dispatch_semaphore_wait(workers, DISPATCH_TIME_FOREVER);
+			dispatch_async(queue, ^{
+				[self encodeFLACChunk:chunk format:format blocksize:blocksize];
+				dispatch_semaphore_signal(workers);
+				dispatch_semaphore_signal(chunk->done);
+			});
+			
+			// Update status
+			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
+			
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+		}
+		
+		// Write the chunks still in flight, oldest first
+		for(i = 0; i < chunkCount; ++i) {
+			chunk = &chunks[(chunkIndex + i) % chunkCount];
+			if(chunk->pending)
+				[self writeFLACChunk:chunk stream:&stream];
+		}
+		
+		result = (0 == fclose(stream.file));
+		stream.file = NULL;
+		NSAssert(YES == result, NSLocalizedStringFromTable(@"Unable to close the output file.", @"Exceptions", @""));
+		
+		// Fill in STREAMINFO and the seektable in place, as FLAC__stream_encoder_finish would have
+		iterator = FLAC__metadata_simple_iterator_new();
+		NSAssert(NULL != iterator, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		result = FLAC__metadata_simple_iterator_init(iterator, [filename fileSystemRepresentation], NO, NO);
+		NSAssert1(YES == result, @"FLAC__metadata_simple_iterator_init failed: %s", FLAC__Metadata_SimpleIteratorStatusString[FLAC__metadata_simple_iterator_status(iterator)]);
+		
+		do {
+			switch(FLAC__metadata_simple_iterator_get_block_type(iterator)) {
+				case FLAC__METADATA_TYPE_STREAMINFO:
+					streaminfo = FLAC__metadata_simple_iterator_get_block(iterator);
+					NSAssert(NULL != streaminfo, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+					
+					streaminfo->data.stream_info.min_framesize	= (UINT32_MAX == stream.minFrameSize ? 0 : stream.minFrameSize);
+					streaminfo->data.stream_info.max_framesize	= stream.maxFrameSize;
+					streaminfo->data.stream_info.total_samples	= stream.samplesWritten;
+					CC_MD5_Final(streaminfo->data.stream_info.md5sum, &md5);
+					
+					result = FLAC__metadata_simple_iterator_set_block(iterator, streaminfo, NO);
+					NSAssert1(YES == result, @"FLAC__metadata_simple_iterator_set_block failed: %s", FLAC__Metadata_SimpleIteratorStatusString[FLAC__metadata_simple_iterator_status(iterator)]);
+					break;
+					
+				case FLAC__METADATA_TYPE_SEEKTABLE:
+					FLAC__format_seektable_sort(&seektable->data.seek_table);
+					
+					result = FLAC__metadata_simple_iterator_set_block(iterator, seektable, NO);
+					NSAssert1(YES == result, @"FLAC__metadata_simple_iterator_set_block failed: %s", FLAC__Metadata_SimpleIteratorStatusString[FLAC__metadata_simple_iterator_status(iterator)]);
+					break;
+					
+				default:
+					break;
+			}
+		} while(FLAC__metadata_simple_iterator_next(iterator));
+	}
+	
+	@finally {
+		// Outstanding chunks still refer to the buffers
+		if(NULL != chunks) {
+			for(i = 0; i < chunkCount; ++i) {
+				chunk = &chunks[i];
 				
-			default:
-				@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-				break;
+				if(chunk->pending)
+					dispatch_semaphore_wait(chunk->done, DISPATCH_TIME_FOREVER);
+				
+				[chunk->exception release];
+				
+				if(NULL != chunk->done)
+					dispatch_release(chunk->done);
+				
+				if(NULL != chunk->channels)
+					free(chunk->channels[0]);
+				
+				free(chunk->channels);
+				free(chunk->frameSizes);
+				free(chunk->output);
+			}
+			
+			free(chunks);
 		}
 		
-		// Encode the chunk
-		result = FLAC__stream_encoder_process(_flac, (const FLAC__int32 * const *)buffer, frameCount);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_process failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+		if(NULL != workers)
+			dispatch_release(workers);
+		
+		if(NULL != stream.file)
+			fclose(stream.file);
+		
+		if(NULL != streaminfo)
+			FLAC__metadata_object_delete(streaminfo);
+		
+		if(NULL != iterator)
+			FLAC__metadata_simple_iterator_delete(iterator);
 	}
+}
+
+// Called on a worker thread, so failures are handed back through the chunk
+- (void) encodeFLACChunk:(struct FLACChunk *)chunk format:(AudioStreamBasicDescription)format blocksize:(unsigned)blocksize
+{
+	NSAutoreleasePool				*pool				= [[NSAutoreleasePool alloc] init];
+	FLAC__StreamEncoder				*flac				= NULL;
+	FLAC__StreamEncoderInitStatus	encoderStatus;
+	FLAC__bool						result;
+	
+	@try {
+		flac = FLAC__stream_encoder_new();
+		NSAssert(NULL != flac, NSLocalizedStringFromTable(@"Unable to create the FLAC encoder.", @"Exceptions", @""));
+		
+		[self configureEncoder:flac format:format];
+		
+		result = FLAC__stream_encoder_set_blocksize(flac, blocksize);
+		NSAssert1(YES == result, @"FLAC__stream_encoder_set_blocksize failed: %s", FLAC__stream_encoder_get_resolved_state_string(flac));
+		
+		encoderStatus = FLAC__stream_encoder_init_stream(flac, WriteChunkCallback, NULL, NULL, NULL, chunk);
+		NSAssert1(FLAC__STREAM_ENCODER_INIT_STATUS_OK == encoderStatus, @"FLAC__stream_encoder_init_stream failed: %s", FLAC__stream_encoder_get_resolved_state_string(flac));
 		
+		result = FLAC__stream_encoder_process(flac, (const FLAC__int32 * const *)chunk->channels, chunk->frameCount);
+		NSAssert1(YES == result, @"FLAC__stream_encoder_process failed: %s", FLAC__stream_encoder_get_resolved_state_string(flac));
+		
+		result = FLAC__stream_encoder_finish(flac);
+		NSAssert1(YES == result, @"FLAC__stream_encoder_finish failed: %s", FLAC__stream_encoder_get_resolved_state_string(flac));
+	}
+	
+	@catch(NSException *exception) {
+		chunk->exception = [exception retain];
+	}
+	
 	@finally {
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			free(buffer[channel]);
+		if(NULL != flac)
+			FLAC__stream_encoder_delete(flac);
+		
+		[pool release];
+	}
+}
+
+- (void) writeFLACChunk:(struct FLACChunk *)chunk stream:(struct FLACStreamState *)stream
+{
+	FLAC__StreamMetadata_SeekPoint	*points;
+	NSException						*exception;
+	FLAC__uint64					firstSample, lastSample, testSample;
+	unsigned						frameSamples;
+	unsigned						i, j;
+	size_t							bytesWritten;
+	
+	dispatch_semaphore_wait(chunk->done, DISPATCH_TIME_FOREVER);
+	chunk->pending = NO;
+	
+	if(nil != chunk->exception) {
+		exception			= [chunk->exception autorelease];
+		chunk->exception	= nil;
+		@throw exception;
+	}
+	
+	bytesWritten = fwrite(chunk->output, 1, chunk->outputSize, stream->file);
+	NSAssert(bytesWritten == chunk->outputSize, NSLocalizedStringFromTable(@"Unable to write to the output file.", @"Exceptions", @""));
+	
+	points = stream->seektable->data.seek_table.points;
+	
+	for(i = 0; i < chunk->frameSizeCount; ++i) {
+		frameSamples	= MIN(stream->blocksize, chunk->frameCount - i * stream->blocksize);
+		firstSample		= stream->samplesWritten;
+		lastSample		= firstSample + frameSamples - 1;
+		
+		// Several template points may fall in the same frame
+		for(j = stream->firstSeekpointToCheck; j < stream->seektable->data.seek_table.num_points; ++j) {
+			testSample = points[j].sample_number;
+			if(testSample > lastSample)
+				break;
+			else if(testSample >= firstSample) {
+				points[j].sample_number		= firstSample;
+				points[j].stream_offset		= stream->audioBytesWritten;
+				points[j].frame_samples		= frameSamples;
+			}
+			else
+				++stream->firstSeekpointToCheck;
 		}
-		free(buffer);
+		
+		stream->minFrameSize			= MIN(stream->minFrameSize, chunk->frameSizes[i]);
+		stream->maxFrameSize			= MAX(stream->maxFrameSize, chunk->frameSizes[i]);
+		stream->samplesWritten			+= frameSamples;
+		stream->audioBytesWritten		+= chunk->frameSizes[i];
 	}
-}	
+}
 
 @end
@@ -21,11 +21,11 @@
 #include <sndfile/sndfile.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
 #import "UtilityFunctions.h"
+#import "PCMConversion.h"
 
 @implementation LibsndfileEncoder
 
@@ -35,27 +35,16 @@
 	SNDFILE							*sf									= NULL;
 	SF_INFO							info;
 	int								format								= 0;
-	AudioBufferList					bufferList;
-	ssize_t							bufferLen							= 0;
-	UInt32							bufferByteSize						= 0;
+	int32_t							**buffer							= NULL;
+	UInt32							bufferLen							= 0;
+	UInt32							channelCount						= 0;
 
 	SInt64							totalFrames, framesToRead;
 	UInt32							frameCount;
 	
-	int8_t							*buffer8							= NULL;
-	int16_t							*buffer16							= NULL;
-	int32_t							*buffer32							= NULL;
 	int32_t							*buf								= NULL;
 	
-	unsigned long					iterations							= 0;
 
-	int32_t							constructedSample;
-	
-	unsigned						wideSample, sample, channel;
-	
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;
 	
 	@try {
 		// This will never work if these sizes aren't the same
@@ -66,47 +55,21 @@
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		// Parse settings
 		format = [[[[self delegate] encoderSettings] objectForKey:@"majorFormat"] intValue] | [[[[self delegate] encoderSettings] objectForKey:@"subtypeFormat"] intValue];
 		
 		totalFrames			= [decoder totalFrames];
 		framesToRead		= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
-		// Set up the AudioBufferList
-		bufferList.mNumberBuffers					= 1;
-		bufferList.mBuffers[0].mData				= NULL;
-		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
-		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 1024;
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -114,11 +77,13 @@
 				break;				
 		}
 		
-		bufferByteSize		= bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// Allocate the buffers that will hold the audio data for each channel
+		bufferLen			= [self blockFrames];
+		channelCount		= [decoder pcmFormat].mChannelsPerFrame;
+		buffer				= [self scratchChannels:channelCount frameCount:bufferLen];
 
-		buf					= (int32_t *)calloc(bufferLen, sizeof(int32_t));
-		NSAssert(NULL != buf, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// Allocate the buffer that will hold the interleaved audio data
+		buf					= [self scratchBuffer:kEncoderInterleavedScratch byteCount:(bufferLen * channelCount * sizeof(int32_t))];
 
 		// Setup output file
 		memset(&info, 0, sizeof(info));
@@ -131,94 +96,30 @@
 		// Iteratively get the PCM data and encode it
 		for(;;) {
 			
-			// Set up the buffer parameters
-			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
-			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
-			
 			// Read a chunk of PCM input
-			frameCount		= [decoder readAudio:&bufferList frameCount:frameCount];
+			frameCount		= [decoder readInt32Channels:buffer frameCount:bufferLen];
 			
 			// We're finished if no frames were returned
 			if(0 == frameCount) {
 				break;
 			}
 			
-			// Fill buf buffer, converting to host endian byte order
+			// Fill buf buffer, interleaving the channels
 			// Libsndfile expects the most significant byte to be the most significant byte, regardless of
 			// sample size
-			switch([decoder pcmFormat].mBitsPerChannel) {
-				
-				case 8:
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							buf[sample] = (int32_t)buffer8[sample];
-							buf[sample] <<= 24;
-						}
-					}
-					break;
-					
-				case 16:
-					buffer16 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							buf[sample] = (int32_t)(int16_t)OSSwapBigToHostInt16(buffer16[sample]);
-							buf[sample] <<= 16;
-						}
-					}
-					break;
-					
-				case 24:
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel) {
-							constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-							constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-							constructedSample |= (uint8_t)*buffer8++;
-							
-							buf[(bufferList.mBuffers[0].mNumberChannels * wideSample) + channel] = constructedSample << 8;
-						}
-					}
-					break;
-					
-				case 32:
-					buffer32 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							buf[sample] = (int32_t)OSSwapBigToHostInt32(buffer32[sample]);
-						}
-					}
-					break;
-					
-				default:
-					@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-					break;				
-			}
+			PCMInterleaveInt32((const int32_t * const *)buffer, buf, channelCount, frameCount);
+			PCMInt32ToFullScale(buf, frameCount * channelCount, [decoder pcmFormat].mBitsPerChannel);
 			
 			// Write the data
 			sf_writef_int(sf, buf, frameCount);
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		}
 	}
 
@@ -232,9 +133,6 @@
 	}
 	
 	@finally {
-		free(bufferList.mBuffers[0].mData);
-		free(buf);
-				
 		if(0 != sf_close(sf)) {
 			NSException *exception =[NSException exceptionWithName:@"IOException"
 															reason:NSLocalizedStringFromTable(@"Unable to close the output file.", @"Exceptions", @"") 
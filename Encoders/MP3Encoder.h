@@ -50,6 +50,7 @@ enum {
 	FILE					*_out;
 	lame_global_flags		*_gfp;
 	UInt32					_sourceBitsPerChannel;
+	UInt32					_channelCount;
 }
 
 @end
@@ -28,11 +28,11 @@
 #include <lame/lame.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
 #import "UtilityFunctions.h"
+#import "PCMConversion.h"
 
 #include <fcntl.h>		// open, write
 #include <stdio.h>		// fopen, fclose
@@ -43,7 +43,7 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 
 @interface MP3Encoder (Private)
 - (void)	parseSettings;
-- (void)	encodeChunk:(const AudioBufferList *)chunk frameCount:(UInt32)frameCount;
+- (void)	encodeChunk:(int32_t **)channels frameCount:(UInt32)frameCount;
 - (void)	finishEncode;
 @end
 
@@ -74,19 +74,13 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 	NSDate							*startTime						= [NSDate date];
 	FILE							*file							= NULL;
 	int								result;
-	AudioBufferList					bufferList;
-	ssize_t							bufferLen						= 0;
-	UInt32							bufferByteSize					= 0;
+	int32_t							**buffer						= NULL;
+	UInt32							bufferLen						= 0;
+	UInt32							channelCount					= 0;
 	SInt64							totalFrames, framesToRead;
 	UInt32							frameCount;
-	unsigned long					iterations						= 0;
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;	
 	
 	@try {
-		bufferList.mBuffers[0].mData = NULL;
-
 		// Parse the encoder settings
 		[self parseSettings];
 
@@ -95,47 +89,22 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		NSAssert(1 == [decoder pcmFormat].mChannelsPerFrame || 2 == [decoder pcmFormat].mChannelsPerFrame, NSLocalizedStringFromTable(@"LAME only supports one or two channel input.", @"Exceptions", @""));
 
 		_sourceBitsPerChannel	= [decoder pcmFormat].mBitsPerChannel;
+		_channelCount			= [decoder pcmFormat].mChannelsPerFrame;
 		totalFrames				= [decoder totalFrames];
 		framesToRead			= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
-		// Set up the AudioBufferList
-		bufferList.mNumberBuffers					= 1;
-		bufferList.mBuffers[0].mData				= NULL;
-		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
-		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 1024;
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -143,8 +112,10 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 				break;				
 		}
 		
-		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// Allocate the buffers that will hold the audio data for each channel
+		bufferLen		= [self blockFrames];
+		channelCount	= [decoder pcmFormat].mChannelsPerFrame;
+		buffer			= [self scratchChannels:channelCount frameCount:bufferLen];
 		
 		// Initialize the LAME encoder
 		lame_set_num_channels(_gfp, [decoder pcmFormat].mChannelsPerFrame);
@@ -160,13 +131,8 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 		// Iteratively get the PCM data and encode it
 		for(;;) {
 			
-			// Set up the buffer parameters
-			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
-			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
-			
 			// Read a chunk of PCM input
-			frameCount		= [decoder readAudio:&bufferList frameCount:frameCount];
+			frameCount		= [decoder readInt32Channels:buffer frameCount:bufferLen];
 			
 			// We're finished if no frames were returned
 			if(0 == frameCount) {
@@ -174,28 +140,15 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 			}
 			
 			// Encode the PCM data
-			[self encodeChunk:&bufferList frameCount:frameCount];
+			[self encodeChunk:buffer frameCount:frameCount];
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		}
 		
 		// Flush the last MP3 frames (maybe)
@@ -241,7 +194,6 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 			NSLog(@"%@", exception);
 		}		
 
-		free(bufferList.mBuffers[0].mData);
 	}
 
 	[[self delegate] setEndTime:[NSDate date]];
@@ -326,152 +278,30 @@ static int sLAMEBitrates [14] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192
 	}
 }
 
-- (void) encodeChunk:(const AudioBufferList *)chunk frameCount:(UInt32)frameCount;
+- (void) encodeChunk:(int32_t **)channels frameCount:(UInt32)frameCount;
 {
 	unsigned char	*buffer					= NULL;
 	unsigned		bufferLen				= 0;
 	
-	void			**channelBuffers		= NULL;
-	short			**channelBuffers16		= NULL;
-	long			**channelBuffers32		= NULL;
-	
-	int8_t			*buffer8				= NULL;
-	int16_t			*buffer16				= NULL;
-	int32_t			*buffer32				= NULL;
-	
-	int32_t			constructedSample;
+	unsigned		channel;
 	
 	int				result;
 	size_t			numWritten;
 	
-	unsigned		wideSample;
-	unsigned		sample, channel;
+	// Size the MP3 buffer using LAME guide for size
+	bufferLen	= 1.25 * (_channelCount * frameCount) + 7200;
+	buffer		= [self scratchBuffer:kEncoderOutputScratch byteCount:bufferLen];
 	
-	@try {
-		// Allocate the MP3 buffer using LAME guide for size
-		bufferLen	= 1.25 * (chunk->mBuffers[0].mNumberChannels * frameCount) + 7200;
-		buffer		= (unsigned char *) calloc(bufferLen, sizeof(unsigned char));
-		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-		
-		// Allocate channel buffers for sample de-interleaving
-		channelBuffers = calloc(chunk->mBuffers[0].mNumberChannels, sizeof(void *));
-		NSAssert(NULL != channelBuffers, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-		
-		// Initialize each channel buffer to zero
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			channelBuffers[channel] = NULL;
-		}
-
-		unsigned long max_long_value_for_lame = 1UL << (8 * sizeof(long) - 1);
-
-		// Split PCM data into channels and convert to appropriate sample size for LAME
-		switch(_sourceBitsPerChannel) {
-			
-			case 8:				
-				channelBuffers16 = (short **)channelBuffers;
-				
-				for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-					channelBuffers16[channel] = calloc(frameCount, sizeof(short));
-					NSAssert(NULL != channelBuffers16[channel], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-				}
-					
-				buffer8 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						// Rescale values to short
-						channelBuffers16[channel][wideSample] = (short)((buffer8[sample] / 128.f) * 32768);
-					}
-				}
-					
-				result = lame_encode_buffer(_gfp, channelBuffers16[0], channelBuffers16[1], frameCount, buffer, bufferLen);
-				
-				break;
-				
-			case 16:
-				channelBuffers16 = (short **)channelBuffers;
-				
-				for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-					channelBuffers16[channel] = calloc(frameCount, sizeof(short));
-					NSAssert(NULL != channelBuffers16[channel], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-				}
-					
-				buffer16 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						channelBuffers16[channel][wideSample] = (short)OSSwapBigToHostInt16(buffer16[sample]);
-					}
-				}
-					
-				result = lame_encode_buffer(_gfp, channelBuffers16[0], channelBuffers16[1], frameCount, buffer, bufferLen);
-				
-				break;
-				
-			case 24:
-				channelBuffers32 = (long **)channelBuffers;
-				
-				for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-					channelBuffers32[channel] = calloc(frameCount, sizeof(long));
-					NSAssert(NULL != channelBuffers32[channel], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-				}
-
-				// Packed 24-bit data is 3 bytes, while unpacked is 24 bits in an int32_t
-				buffer8 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-						constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++;
-
-						// lame_encode_buffer_long2() expects the values to be scaled to fit the size of long, not a particular bit width
-						// Specifically in the range 2^(8*sizeof(long)-1)
-						// Which for 32-bit longs = 2147483648 (0x80000000), for 64-bit longs = 9223372036854775808 (0x8000000000000000)
-						channelBuffers32[channel][wideSample] = (long)((constructedSample / 8388608.f) * max_long_value_for_lame);
-					}
-				}
-					
-				result = lame_encode_buffer_long2(_gfp, channelBuffers32[0], channelBuffers32[1], frameCount, buffer, bufferLen);
-				
-				break;
-				
-			case 32:
-				channelBuffers32 = (long **)channelBuffers;
-				
-				for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-					channelBuffers32[channel] = calloc(frameCount, sizeof(long));
-					NSAssert(NULL != channelBuffers32[channel], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-				}
-
-				buffer32 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						// See comment above about expected scaling for lame_encode_buffer_long2()
-						channelBuffers32[channel][wideSample] = (long)((OSSwapBigToHostInt32(buffer32[sample]) / 2147483648.f) * max_long_value_for_lame);
-					}
-				}
-					
-				result = lame_encode_buffer_long2(_gfp, channelBuffers32[0], channelBuffers32[1], frameCount, buffer, bufferLen);
-				
-				break;
-				
-			default:
-				@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-				break;
-		}
-		
-		NSAssert(0 <= result, NSLocalizedStringFromTable(@"LAME encoding error.", @"Exceptions", @""));
-		
-		numWritten = fwrite(buffer, sizeof(unsigned char), result, _out);
-		NSAssert(numWritten == result, NSLocalizedStringFromTable(@"Unable to write to the output file.", @"Exceptions", @""));
-	}
+	// lame_encode_buffer_int() expects the samples to be scaled to the full range of int
+	for(channel = 0; channel < _channelCount; ++channel)
+		PCMInt32ToFullScale(channels[channel], frameCount, _sourceBitsPerChannel);
 	
-	@finally {
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			free(channelBuffers[channel]);
-		}
-		free(channelBuffers);
-		
-		free(buffer);
-	}
+	// The right channel is ignored for mono input
+	result = lame_encode_buffer_int(_gfp, channels[0], channels[1 < _channelCount ? 1 : 0], frameCount, buffer, bufferLen);
+	NSAssert(0 <= result, NSLocalizedStringFromTable(@"LAME encoding error.", @"Exceptions", @""));
+	
+	numWritten = fwrite(buffer, sizeof(unsigned char), result, _out);
+	NSAssert(numWritten == result, NSLocalizedStringFromTable(@"Unable to write to the output file.", @"Exceptions", @""));
 }
 
 - (void) finishEncode
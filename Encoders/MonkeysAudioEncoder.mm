@@ -30,7 +30,6 @@
 #include <AudioToolbox/ExtendedAudioFile.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
@@ -55,7 +54,6 @@
 - (oneway void) encodeToFile:(NSString *)filename
 {
 	NSDate							*startTime					= [NSDate date];
-	unsigned long					iterations					= 0;
 	AudioBufferList					bufferList;
 	ssize_t							bufferLen					= 0;
 	UInt32							bufferByteSize				= 0;
@@ -64,9 +62,6 @@
 	int								result;
 	SInt64							totalFrames, framesToRead;
 	UInt32							frameCount;
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;
 	
 	@try {
 		bufferList.mBuffers[0].mData = NULL;
@@ -79,45 +74,24 @@
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		_sourceBitsPerChannel	= [decoder pcmFormat].mBitsPerChannel;
 		_sourceBytesPerFrame	= [decoder pcmFormat].mBytesPerFrame;
 		totalFrames				= [decoder totalFrames];
 		framesToRead			= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
 		// Set up the AudioBufferList
 		bufferList.mNumberBuffers					= 1;
 		bufferList.mBuffers[0].mData				= NULL;
 		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
 		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 1024;
 		switch([decoder pcmFormat].mBitsPerChannel) {			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -125,8 +99,12 @@
 				break;				
 		}
 		
+		// Use the encoder's scratch memory for the interleaved audio data
+		bufferLen									= [self blockFrames] * [decoder pcmFormat].mBytesPerFrame;
+		bufferList.mBuffers[0].mData				= [self scratchBuffer:kEncoderInterleavedScratch byteCount:bufferLen];
+		bufferList.mBuffers[0].mDataByteSize		= (UInt32)bufferLen;
+		
 		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 
 		// Create the MAC compressor
 		_compressor = CreateIAPECompress();
@@ -164,24 +142,12 @@
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop]) {
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 			}
-			
-			++iterations;
 		}
 		
 		// Finish up the compression process
@@ -203,7 +169,6 @@
 			delete _compressor;
 		}
 				
-		free(bufferList.mBuffers[0].mData);
 		free(chars);
 	}	
 
@@ -25,7 +25,6 @@
 #include <AudioToolbox/ExtendedAudioFile.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
@@ -33,7 +32,7 @@
 
 @interface OggFLACEncoder (Private)
 - (void)	parseSettings;
-- (void)	encodeChunk:(const AudioBufferList *)chunk frameCount:(UInt32)frameCount;
+- (void)	encodeChunk:(const int32_t * const *)channels frameCount:(UInt32)frameCount;
 @end
 
 @implementation OggFLACEncoder
@@ -57,37 +56,19 @@
 - (oneway void) encodeToFile:(NSString *) filename
 {
 	NSDate							*startTime					= [NSDate date];
-	unsigned long					iterations					= 0;
-	AudioBufferList					bufferList;
-	ssize_t							bufferLen					= 0;
-	UInt32							bufferByteSize				= 0;
+	int32_t							**buffer					= NULL;
+	UInt32							bufferLen					= 0;
+	UInt32							channelCount				= 0;
 	FLAC__bool						result;
 	FLAC__StreamEncoderInitStatus	encoderStatus;
 	FLAC__StreamMetadata			padding;
 	FLAC__StreamMetadata			*metadata					[1];
 	SInt64							totalFrames, framesToRead;
 	UInt32							frameCount;
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;
 	
 	@try {
-		bufferList.mBuffers[0].mData = NULL;
-
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
-		
-		_sourceBitsPerChannel = [decoder pcmFormat].mBitsPerChannel;
+		id <DecoderMethods> decoder = [self sourceDecoder];
 
 		// Tell our owner we are starting
 		[[self delegate] setStartTime:startTime];	
@@ -98,30 +79,14 @@
 		
 		totalFrames			= [decoder totalFrames];
 		framesToRead		= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
-		// Set up the AudioBufferList
-		bufferList.mNumberBuffers					= 1;
-		bufferList.mBuffers[0].mData				= NULL;
-		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
-		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 1024;
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -129,8 +94,10 @@
 				break;				
 		}
 		
-		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// Allocate the buffers that will hold the audio data for each channel
+		bufferLen		= [self blockFrames];
+		channelCount	= [decoder pcmFormat].mChannelsPerFrame;
+		buffer			= [self scratchChannels:channelCount frameCount:bufferLen];
 		
 		// Create the Ogg FLAC encoder
 		_flac = FLAC__stream_encoder_new();
@@ -198,13 +165,8 @@
 		// Iteratively get the PCM data and encode it
 		for(;;) {
 			
-			// Set up the buffer parameters
-			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
-			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
-			
 			// Read a chunk of PCM input
-			frameCount		= [decoder readAudio:&bufferList frameCount:frameCount];
+			frameCount		= [decoder readInt32Channels:buffer frameCount:bufferLen];
 			
 			// We're finished if no frames were returned
 			if(0 == frameCount) {
@@ -212,28 +174,15 @@
 			}
 			
 			// Encode the PCM data
-			[self encodeChunk:&bufferList frameCount:frameCount];
+			[self encodeChunk:(const int32_t * const *)buffer frameCount:frameCount];
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		}
 		
 		// Finish up the encoding process
@@ -253,8 +202,6 @@
 		if(NULL != _flac) {
 			FLAC__stream_encoder_delete(_flac);
 		}
-		
-		free(bufferList.mBuffers[0].mData);
 	}	
 
 	[[self delegate] setEndTime:[NSDate date]];
@@ -285,97 +232,12 @@
 	_padding				= [[settings objectForKey:@"padding"] unsignedIntValue];
 }
 
-- (void) encodeChunk:(const AudioBufferList *)chunk frameCount:(UInt32)frameCount
+- (void) encodeChunk:(const int32_t * const *)channels frameCount:(UInt32)frameCount
 {
 	FLAC__bool		result;
 	
-	int32_t			**buffer				= NULL;
-	
-	int8_t			*buffer8				= NULL;
-	int16_t			*buffer16				= NULL;
-	int32_t			*buffer32				= NULL;
-	
-	int32_t			constructedSample;
-	
-	unsigned		wideSample;
-	unsigned		sample, channel;
-	
-	@try {
-		// Allocate the FLAC buffer
-		buffer = calloc(chunk->mBuffers[0].mNumberChannels, sizeof(int32_t *));
-		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-		
-		// Initialize each channel buffer to zero
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			buffer[channel] = NULL;
-		}
-		
-		// Allocate channel buffers
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			buffer[channel] = calloc(frameCount, sizeof(int32_t));
-			NSAssert(NULL != buffer[channel], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-		}
-		
-		// Split PCM data into channels and convert to 32-bit sample size for FLAC
-		switch(_sourceBitsPerChannel) {
-			
-			case 8:
-				buffer8 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						buffer[channel][wideSample] = (int32_t)buffer8[sample];
-					}
-				}
-				break;
-				
-			case 16:
-				buffer16 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						buffer[channel][wideSample] = (int32_t)(int16_t)OSSwapBigToHostInt16(buffer16[sample]);
-					}
-				}
-				break;
-				
-			case 24:
-				buffer8 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {						
-						constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++;
-						
-						buffer[channel][wideSample] = constructedSample;
-					}
-				}
-				break;
-
-			case 32:
-				buffer32 = chunk->mBuffers[0].mData;
-				for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-					for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel, ++sample) {
-						buffer[channel][wideSample] = (int32_t)OSSwapBigToHostInt32(buffer32[sample]);
-					}
-				}
-				break;
-				
-			default:
-				@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-				break;
-		}
-		
-		// Encode the chunk
-		result = FLAC__stream_encoder_process(_flac, (const FLAC__int32 * const *)buffer, frameCount);
-		NSAssert1(YES == result, @"FLAC__stream_encoder_process failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
-	}
-	
-	@finally {
-		for(channel = 0; channel < chunk->mBuffers[0].mNumberChannels; ++channel) {
-			free(buffer[channel]);
-		}
-		free(buffer);
-	}
-	
-}	
+	result = FLAC__stream_encoder_process(_flac, (const FLAC__int32 * const *)channels, frameCount);
+	NSAssert1(YES == result, @"FLAC__stream_encoder_process failed: %s", FLAC__stream_encoder_get_resolved_state_string(_flac));
+}
 
 @end
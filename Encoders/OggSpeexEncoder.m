@@ -32,11 +32,11 @@
 #include <ogg/ogg.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
 #import "UtilityFunctions.h"
+#import "PCMConversion.h"
 
 #include <fcntl.h>		// open, write
 #include <stdio.h>		// fopen, fclose
@@ -157,29 +157,15 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 	ssize_t						currentBytesWritten							= 0;
 	ssize_t						bytesWritten								= 0;
 
-	unsigned long				iterations									= 0;
-
 	AudioBufferList				bufferList;
 	ssize_t						bufferLen									= 0;
 	UInt32						bufferByteSize								= 0;
 	SInt64						totalFileFrames, framesToRead;
 	UInt32						frameCount;
 
-	int8_t						*buffer8									= NULL;
-	int16_t						*buffer16									= NULL;
-	int32_t						*buffer32									= NULL;
+	int32_t						*samples									= NULL;
 	float						*floatBuffer								= NULL;
-
-//	int8_t						byteOne, byteTwo, byteThree;
-	int32_t						constructedSample;
-//	float						normalizedSample;
-
-	unsigned					sample, wideSample;
-
-	double						percentComplete;
-	NSTimeInterval				interval;
-	unsigned					secondsRemaining;	
-	
+	UInt32						sampleCount;
 	
 	@try {
 		bufferList.mBuffers[0].mData = NULL;
@@ -192,22 +178,14 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		NSAssert(1 == [decoder pcmFormat].mChannelsPerFrame || 2 == [decoder pcmFormat].mChannelsPerFrame, NSLocalizedStringFromTable(@"Speex only supports one or two channel input.", @"Exceptions", @""));
 		
 		totalFrames			= [decoder totalFrames];
 		framesToRead		= totalFrames;
+		totalFileFrames		= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
 		// Resample input if requested
 /*		if(_resampleInput) {
@@ -235,9 +213,8 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 		NSAssert(-1 != fd, NSLocalizedStringFromTable(@"Unable to create the output file.", @"Exceptions", @""));
 		
 		// Check if we should stop, and if so throw an exception
-		if([[self delegate] shouldStop]) {
+		if([_status shouldStop])
 			@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-		}
 		
 		// Initialize ogg stream- use the current time as the stream id
 		result = ogg_stream_init(&os, (int)arc4random());
@@ -338,24 +315,12 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 		bufferList.mBuffers[0].mData				= NULL;
 		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
 		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 2 * frameSize;
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -363,8 +328,15 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 				break;				
 		}
 		
+		// Allocate the buffers that will hold one Speex frame of interleaved audio data
+		bufferLen									= frameSize * [decoder pcmFormat].mChannelsPerFrame;
+		bufferList.mBuffers[0].mData				= calloc(frameSize, [decoder pcmFormat].mBytesPerFrame);
+		bufferList.mBuffers[0].mDataByteSize		= frameSize * [decoder pcmFormat].mBytesPerFrame;
+		samples										= calloc(bufferLen, sizeof(int32_t));
+		floatBuffer									= calloc(bufferLen, sizeof(float));
+		
 		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		NSAssert(NULL != bufferList.mBuffers[0].mData && NULL != samples && NULL != floatBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 		
 		speex_bits_init(&bits);
 		
@@ -377,93 +349,32 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 			// Set up the buffer parameters
 			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
 			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
 			
 			// Read a chunk of PCM input
-			frameCount		= [decoder readAudio:&bufferList frameCount:frameCount];
+			frameCount		= [decoder readAudio:&bufferList frameCount:frameSize];
 
 			// We're finished if no frames were returned
 			if(0 == frameCount) {
 				eos = YES;
 			}
 			
-			// Fill Speex buffer, converting to host endian byte order
-			// Speex only supports 16-bit or floating point samples, so renormalize accordingly
-			switch([decoder pcmFormat].mBitsPerChannel) {
-				
-				case 8:
-					floatBuffer = calloc(frameCount, sizeof(float));
-					NSAssert(NULL != floatBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-						
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(sample = 0; sample < frameCount; ++sample) {
-						floatBuffer[sample] = (float)(buffer8[sample] / 128.f);
-					}
-					break;
-					
-				case 16:
-					buffer16 = bufferList.mBuffers[0].mData;
-					for(sample = 0; sample < frameCount; ++sample) {
-						buffer16[sample] = (int16_t)OSSwapBigToHostInt16(buffer16[sample]);
-					}
-					break;
-					
-				case 24:
-					floatBuffer = calloc(frameCount, sizeof(float));
-					NSAssert(NULL != floatBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-						
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount && sample < bufferList.mBuffers[0].mDataByteSize; ++wideSample, ++sample) {
-						constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-						constructedSample |= (uint8_t)*buffer8++;
-						
-						floatBuffer[wideSample] = (constructedSample / 8388608.);
-					}
-					break;
-
-				case 32:
-					floatBuffer = calloc(frameCount, sizeof(float));
-					NSAssert(NULL != floatBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-
-					buffer32 = bufferList.mBuffers[0].mData;
-					for(sample = 0; sample < frameCount; ++sample) {
-						floatBuffer[sample] = (float)(OSSwapBigToHostInt32(buffer32[sample]) / 2147483648.f);
-					}
-					break;
-					
-				default:
-					@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-					break;				
-			}
+			// Convert to host byte order, padding a short final frame with silence
+			sampleCount		= frameCount * [decoder pcmFormat].mChannelsPerFrame;
+			PCMBigEndianToInt32(bufferList.mBuffers[0].mData, samples, sampleCount, [decoder pcmFormat].mBitsPerChannel);
+			memset(samples + sampleCount, 0, (bufferLen - sampleCount) * sizeof(int32_t));
+			
+			// Speex expects floating point samples with the range of 16-bit integers
+			PCMInt32ToFloatWithScale(samples, floatBuffer, bufferLen, 32768.f / (float)(1UL << ([decoder pcmFormat].mBitsPerChannel - 1)));
 
 			totalFrames += frameCount;			
 			++frameID;
 			
-			switch([decoder pcmFormat].mBitsPerChannel) {
-
-				case 8:
-				case 24:
-				case 32:
-					if(2 == [decoder pcmFormat].mChannelsPerFrame) {
-						speex_encode_stereo(floatBuffer, frameSize, &bits);
-					}
-
-					speex_encode(speexState, floatBuffer, &bits);
-
-					free(floatBuffer);
-					floatBuffer = NULL;
-					break;
-							
-				case 16:
-					if(2 == [decoder pcmFormat].mChannelsPerFrame) {
-						speex_encode_stereo_int(bufferList.mBuffers[0].mData, frameSize, &bits);
-					}
-					
-					speex_encode_int(speexState, bufferList.mBuffers[0].mData, &bits);
-					break;
+			if(2 == [decoder pcmFormat].mChannelsPerFrame) {
+				speex_encode_stereo(floatBuffer, frameSize, &bits);
 			}
 			
+			speex_encode(speexState, floatBuffer, &bits);
+			
 			
 			framesEncoded	+= frameSize;
 			
@@ -504,24 +415,11 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFileFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFileFrames - framesToRead)/(double) totalFileFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= interval / ((double)(totalFileFrames - framesToRead)/(double) totalFileFrames) - interval;
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		}
 		
 		// Finish up
@@ -584,6 +482,7 @@ static void comment_add(char **comments, int *length, const char *tag, const cha
 		// Clean up
 		free(comments);
 		free(bufferList.mBuffers[0].mData);
+		free(samples);
 		free(floatBuffer);
 		
 		speex_encoder_destroy(speexState);
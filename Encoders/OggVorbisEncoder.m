@@ -26,7 +26,6 @@
 #include <AudioToolbox/ExtendedAudioFile.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "StopException.h"
 
@@ -60,34 +59,18 @@ static int sVorbisBitrates [14] = { 48, 56, 64, 80, 96, 112, 128, 160, 192, 224,
 		
 	float						**buffer;
 	
-	int8_t						*buffer8							= NULL;
-	int16_t						*buffer16							= NULL;
-	int32_t						*buffer32							= NULL;
-	unsigned					wideSample;
-	unsigned					sample, channel;
-	
-	int32_t						constructedSample;
-
 	BOOL						eos									= NO;
 
-	AudioBufferList				bufferList;
-	ssize_t						bufferLen							= 0;
-	UInt32						bufferByteSize						= 0;
+	UInt32						bufferLen							= 0;
 	SInt64						totalFrames, framesToRead;
 	UInt32						frameCount;
 	
 	int							result;
 	size_t						numWritten;
 	
-	unsigned long				iterations							= 0;
 	
-	double						percentComplete;
-	NSTimeInterval				interval;
-	unsigned					secondsRemaining;
 	
 	@try {
-		bufferList.mBuffers[0].mData = NULL;
-
 		// Parse the encoder settings
 		[self parseSettings];
 
@@ -96,44 +79,18 @@ static int sVorbisBitrates [14] = { 48, 56, 64, 80, 96, 112, 128, 160, 192, 224,
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		totalFrames			= [decoder totalFrames];
 		framesToRead		= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
-		// Set up the AudioBufferList
-		bufferList.mNumberBuffers					= 1;
-		bufferList.mBuffers[0].mData				= NULL;
-		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
-		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 1024;
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -141,15 +98,15 @@ static int sVorbisBitrates [14] = { 48, 56, 64, 80, 96, 112, 128, 160, 192, 224,
 				break;				
 		}
 		
-		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// The decoder fills the encoder's buffers directly
+		bufferLen			= [self blockFrames];
 		
 		// Open the output file
 		_out = fopen([filename fileSystemRepresentation], "w");
 		NSAssert(NULL != _out, NSLocalizedStringFromTable(@"Unable to create the output file.", @"Exceptions", @""));
 		
 		// Check if we should stop, and if so throw an exception
-		if([[self delegate] shouldStop])
+		if([_status shouldStop])
 			@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		
 		// Setup the encoder
@@ -196,84 +153,22 @@ static int sVorbisBitrates [14] = { 48, 56, 64, 80, 96, 112, 128, 160, 192, 224,
 		// Iteratively get the PCM data and encode it
 		while(NO == eos) {
 			
-			// Set up the buffer parameters
-			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
-			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
-			
-			// Read a chunk of PCM input
-			frameCount = [decoder readAudio:&bufferList frameCount:frameCount];
-			
 			// Expose the buffer to submit data
-			buffer = vorbis_analysis_buffer(&vd, frameCount);
+			buffer = vorbis_analysis_buffer(&vd, bufferLen);
 			
-			// Split PCM data into channels and convert to 32-bit float samples for Vorbis
-			switch([decoder pcmFormat].mBitsPerChannel) {
-				
-				case 8:
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample)
-							buffer[channel][wideSample] = buffer8[sample] / 128.f;
-					}
-					break;
-					
-				case 16:
-					buffer16 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample)
-							buffer[channel][wideSample] = ((int16_t)OSSwapBigToHostInt16(buffer16[sample])) / 32768.f;
-					}
-					break;
-					
-				case 24:
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel) {
-							constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-							constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-							constructedSample |= (uint8_t)*buffer8++;
-							
-							buffer[channel][wideSample] = (constructedSample / 8388608.);
-						}
-					}
-					break;
-
-				case 32:
-					buffer32 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample)
-							buffer[channel][wideSample] = ((int32_t)OSSwapBigToHostInt32(buffer32[sample])) / 2147483648.f;
-					}
-					break;
-					
-				default:
-					@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-					break;
-			}
+			// Read a chunk of PCM input as 32-bit float samples for Vorbis
+			frameCount = [decoder readFloatChannels:buffer frameCount:bufferLen];
 			
 			// Tell the library how much data we actually submitted
 			vorbis_analysis_wrote(&vd, frameCount);
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop])
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 			
 			while(1 == vorbis_analysis_blockout(&vd, &vb)){
 				
@@ -330,8 +225,6 @@ static int sVorbisBitrates [14] = { 48, 56, 64, 80, 96, 112, 128, 160, 192, 224,
 		vorbis_dsp_clear(&vd);
 		vorbis_comment_clear(&vc);
 		vorbis_info_clear(&vi);
-
-		free(bufferList.mBuffers[0].mData);
 	}	
 
 	[[self delegate] setEndTime:[NSDate date]];
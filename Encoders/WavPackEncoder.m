@@ -27,10 +27,10 @@
 #include <wavpack/wavpack.h>
 
 #import "Decoder.h"
-#import "RegionDecoder.h"
 
 #import "UtilityFunctions.h"
 #import "StopException.h"
+#import "PCMConversion.h"
 
 // WavPack IO wrapper
 static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)			
@@ -48,13 +48,9 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 {
 	NSDate							*startTime							= [NSDate date];
 
-	AudioBufferList					bufferList;
-	ssize_t							bufferLen							= 0;
-	UInt32							bufferByteSize						= 0;
-
-	int8_t							*buffer8							= NULL;
-	int16_t							*buffer16							= NULL;
-	int32_t							*buffer32							= NULL;
+	int32_t							**buffer							= NULL;
+	UInt32							bufferLen							= 0;
+	UInt32							channelCount						= 0;
 	int32_t							*wpBuf								= NULL;
 	
 	SInt64							totalFrames, framesToRead;
@@ -66,20 +62,11 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 	WavpackContext					*wpc								= NULL;
 	WavpackConfig					config;
 	
-	unsigned long					iterations							= 0;
-
-	int32_t							constructedSample;
 
-	unsigned						wideSample, sample, channel;
 
-	double							percentComplete;
-	NSTimeInterval					interval;
-	unsigned						secondsRemaining;
 	
 	
 	@try {
-		bufferList.mBuffers[0].mData = NULL;
-
 		// Parse the encoder settings
 		[self parseSettings];
 
@@ -88,44 +75,18 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 		[[self delegate] setStarted:YES];
 		
 		// Setup the decoder
-		id <DecoderMethods> decoder = nil;
-		NSString *sourceFilename = [[[self delegate] taskInfo] inputFilenameAtInputFileIndex];
-		
-		// Create the appropriate kind of decoder
-		if(nil != [[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"]) {
-			SInt64 startingFrame = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"startingFrame"] longLongValue];
-			UInt32 frameCount = [[[[[[self delegate] taskInfo] settings] valueForKey:@"framesToConvert"] valueForKey:@"frameCount"] unsignedIntValue];
-			decoder = [RegionDecoder decoderWithFilename:sourceFilename startingFrame:startingFrame frameCount:frameCount];
-		}
-		else
-			decoder = [Decoder decoderWithFilename:sourceFilename];
+		id <DecoderMethods> decoder = [self sourceDecoder];
 		
 		totalFrames			= [decoder totalFrames];
 		framesToRead		= totalFrames;
+		[_status beginPhase:kTaskPhaseNone totalUnits:totalFrames];
 		
-		// Set up the AudioBufferList
-		bufferList.mNumberBuffers					= 1;
-		bufferList.mBuffers[0].mData				= NULL;
-		bufferList.mBuffers[0].mNumberChannels		= [decoder pcmFormat].mChannelsPerFrame;
-		
-		// Allocate the buffer that will hold the interleaved audio data
-		bufferLen									= 1024;
 		switch([decoder pcmFormat].mBitsPerChannel) {
 			
 			case 8:				
-			case 24:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int8_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int8_t);
-				break;
-				
 			case 16:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int16_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int16_t);
-				break;
-				
+			case 24:
 			case 32:
-				bufferList.mBuffers[0].mData			= calloc(bufferLen, sizeof(int32_t));
-				bufferList.mBuffers[0].mDataByteSize	= (UInt32)bufferLen * sizeof(int32_t);
 				break;
 				
 			default:
@@ -133,11 +94,13 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 				break;				
 		}
 		
-		bufferByteSize = bufferList.mBuffers[0].mDataByteSize;
-		NSAssert(NULL != bufferList.mBuffers[0].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// Allocate the buffers that will hold the audio data for each channel
+		bufferLen		= [self blockFrames];
+		channelCount	= [decoder pcmFormat].mChannelsPerFrame;
+		buffer			= [self scratchChannels:channelCount frameCount:bufferLen];
 		
-		wpBuf = (int32_t *)calloc(bufferLen, sizeof(int32_t));
-		NSAssert(NULL != wpBuf, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		// WavPack takes interleaved samples
+		wpBuf = [self scratchBuffer:kEncoderInterleavedScratch byteCount:(bufferLen * channelCount * sizeof(int32_t))];
 		
 		// Open the output file
 		fd = open([filename fileSystemRepresentation], O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
@@ -180,66 +143,16 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 		// Iteratively get the PCM data and encode it
 		for(;;) {
 			
-			// Set up the buffer parameters
-			bufferList.mBuffers[0].mNumberChannels	= [decoder pcmFormat].mChannelsPerFrame;
-			bufferList.mBuffers[0].mDataByteSize	= bufferByteSize;
-			frameCount								= bufferList.mBuffers[0].mDataByteSize / [decoder pcmFormat].mBytesPerFrame;
-			
 			// Read a chunk of PCM input
-			frameCount		= [decoder readAudio:&bufferList frameCount:frameCount];
+			frameCount		= [decoder readInt32Channels:buffer frameCount:bufferLen];
 			
 			// We're finished if no frames were returned
 			if(0 == frameCount) {
 				break;
 			}
 			
-			// Fill WavPack buffer, converting to host endian byte order
-			switch([decoder pcmFormat].mBitsPerChannel) {
-				
-				case 8:
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							wpBuf[sample] = (int32_t)buffer8[sample];
-						}
-					}
-					break;
-					
-				case 16:
-					buffer16 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							wpBuf[sample] = (int32_t)(int16_t)OSSwapBigToHostInt16(buffer16[sample]);
-						}
-					}
-					break;
-					
-				case 24:
-					buffer8 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							constructedSample = (int8_t)*buffer8++; constructedSample <<= 8;
-							constructedSample |= (uint8_t)*buffer8++; constructedSample <<= 8;
-							constructedSample |= (uint8_t)*buffer8++;
-							
-							wpBuf[(bufferList.mBuffers[0].mNumberChannels * wideSample) + channel] = constructedSample;
-						}
-					}
-					break;
-					
-				case 32:
-					buffer32 = bufferList.mBuffers[0].mData;
-					for(wideSample = sample = 0; wideSample < frameCount; ++wideSample) {
-						for(channel = 0; channel < bufferList.mBuffers[0].mNumberChannels; ++channel, ++sample) {
-							wpBuf[sample] = (int32_t)OSSwapBigToHostInt32(buffer32[sample]);
-						}
-					}
-					break;
-					
-				default:
-					@throw [NSException exceptionWithName:@"IllegalInputException" reason:@"Sample size not supported" userInfo:nil]; 
-					break;				
-			}
+			// Fill WavPack buffer; the samples are already in host byte order
+			PCMInterleaveInt32((const int32_t * const *)buffer, wpBuf, channelCount, frameCount);
 
 			// Write the data
 			result = WavpackPackSamples(wpc, wpBuf, frameCount);
@@ -247,24 +160,11 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 			
 			// Update status
 			framesToRead -= frameCount;
+			[_status setCompletedUnits:(totalFrames - framesToRead)];
 			
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(totalFrames - framesToRead)/(double) totalFrames) * 100.0;
-				interval			= -1.0 * [startTime timeIntervalSinceNow];
-				secondsRemaining	= (unsigned) (interval / ((double)(totalFrames - framesToRead)/(double) totalFrames) - interval);
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
-			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop])
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
 		}
 		
 		// Flush any remaining samples
@@ -288,9 +188,6 @@ static int writeWavPackBlock(void *wv_id, void *data, int32_t bcount)
 		}
 		close(fd);
 		close(cfd);
-		
-		free(bufferList.mBuffers[0].mData);
-		free(wpBuf);
 	}	
 
 	[[self delegate] setEndTime:[NSDate date]];
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "SectorRange.h"
+
+@class Drive;
+
+struct AccurateRipTrack;
+
+// Accumulates the AccurateRip v1 and v2 checksums of the audio tracks lying wholly within a sector range:
+//   - The drive's read offset (in frames) is applied, so a few sectors outside the range
+//     may be needed; see -requiredSectorRange
+//   - Each frame's contribution depends only on its position, so sectors may be added in any order
+@interface AccurateRipChecksum : NSObject
+{
+	SectorRange					*_sectorRange;
+	SectorRange					*_requiredSectorRange;
+	int							_driveOffset;
+	
+	NSUInteger					_trackCount;		// The tracks being checksummed
+	struct AccurateRipTrack		*_tracks;
+	BOOL						_coversSectorRange;
+}
+
+- (instancetype)	initWithDrive:(Drive *)drive sectorRange:(SectorRange *)range driveOffset:(int)driveOffset;
+
+- (SectorRange *)	sectorRange;
+- (int)				driveOffset;
+
+// The sectors whose audio falls in the checksummed tracks once the offset is applied
+- (SectorRange *)	requiredSectorRange;
+
+// YES if every sector of the range belongs to a track being checksummed
+- (BOOL)			coversSectorRange;
+
+// The sectors of the range whose audio, as read, is entirely covered by the checksums; the offset
+// shifts the checked audio off one end of the range, and AccurateRip skips the edges of the disc,
+// so a match says nothing about the sectors outside this. Returns nil if there are none.
+- (SectorRange *)	checkedSectorRange;
+
+// Add one sector of little-endian CD-DA; sectors outside -requiredSectorRange are ignored
+- (void)			addSector:(NSUInteger)sector bytes:(const void *)bytes;
+
+- (NSUInteger)		countOfTracks;
+- (NSUInteger)		trackNumberAtIndex:(NSUInteger)index;
+- (uint32_t)		checksumV1AtIndex:(NSUInteger)index;
+- (uint32_t)		checksumV2AtIndex:(NSUInteger)index;
+
+@end
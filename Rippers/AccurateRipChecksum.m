@@ -0,0 +1,218 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AccurateRipChecksum.h"
+#import "Drive.h"
+
+#include <IOKit/storage/IOCDTypes.h>
+#include <libkern/OSByteOrder.h>
+
+#define FRAMES_PER_SECTOR		(kCDSectorSizeCDDA / 4)
+
+// AccurateRip skips the audio nearest the start and end of the disc, which many drives can't read
+#define SKIPPED_FRAMES			(5 * FRAMES_PER_SECTOR)
+
+struct AccurateRipTrack {
+	NSUInteger		number;			// Counting only the audio tracks in the first session
+	NSUInteger		firstSector;
+	NSUInteger		lastSector;
+	int64_t			firstFrame;		// The raw frame that becomes the track's first frame once the offset is applied
+	int64_t			frameCount;
+	int64_t			checkStart;		// Frames are numbered from 1, and only these count
+	int64_t			checkStop;
+	uint32_t		checksumV1;
+	uint32_t		checksumV2;
+};
+
+// Rounds towards negative infinity, unlike the / operator
+static int64_t
+FloorDivide(int64_t numerator, int64_t denominator)
+{
+	return (0 <= numerator ? numerator / denominator : -((-numerator + denominator - 1) / denominator));
+}
+
+@implementation AccurateRipChecksum
+
+- (id) initWithDrive:(Drive *)drive sectorRange:(SectorRange *)range driveOffset:(int)driveOffset
+{
+	NSUInteger					session;
+	NSUInteger					number;
+	NSUInteger					audioTrackCount;
+	NSUInteger					coveredSectors;
+	int64_t						firstRequiredSector;
+	int64_t						lastRequiredSector;
+	struct AccurateRipTrack		*track;
+	
+	NSParameterAssert(nil != drive);
+	NSParameterAssert(nil != range);
+	
+	if((self = [super init])) {
+		_sectorRange		= [range retain];
+		_driveOffset		= driveOffset;
+		
+		session				= [drive firstSession];
+		
+		_tracks				= calloc([drive lastTrackForSession:session] - [drive firstTrackForSession:session] + 1, sizeof(struct AccurateRipTrack));
+		NSAssert(NULL != _tracks, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		audioTrackCount		= 0;
+		coveredSectors		= 0;
+		for(number = [drive firstTrackForSession:session]; number <= [drive lastTrackForSession:session]; ++number) {
+			if([[drive trackNumber:number] dataTrack])
+				continue;
+			
+			++audioTrackCount;
+			
+			// Only whole tracks can be checked
+			if(NO == [range containsSector:[drive firstSectorForTrack:number]] || NO == [range containsSector:[drive lastSectorForTrack:number]])
+				continue;
+			
+			track				= _tracks + _trackCount++;
+			track->number		= audioTrackCount;
+			track->firstSector	= [drive firstSectorForTrack:number];
+			track->lastSector	= [drive lastSectorForTrack:number];
+			track->firstFrame	= ((int64_t)track->firstSector * FRAMES_PER_SECTOR) + driveOffset;
+			track->frameCount	= (int64_t)(track->lastSector - track->firstSector + 1) * FRAMES_PER_SECTOR;
+			track->checkStart	= (1 == audioTrackCount ? SKIPPED_FRAMES - 1 : 0);
+			track->checkStop	= track->frameCount;
+			
+			coveredSectors		+= track->lastSector - track->firstSector + 1;
+		}
+		
+		// The last audio track can only be identified once they have all been counted
+		for(number = 0; number < _trackCount; ++number) {
+			if(_tracks[number].number == audioTrackCount)
+				_tracks[number].checkStop = _tracks[number].frameCount - SKIPPED_FRAMES;
+		}
+		
+		_coversSectorRange	= (0 < _trackCount && [range length] == coveredSectors);
+		
+		// The offset shifts the audio needed into the neighbouring sectors, which may not exist
+		if(0 < _trackCount) {
+			firstRequiredSector		= FloorDivide(_tracks[0].firstFrame, FRAMES_PER_SECTOR);
+			lastRequiredSector		= FloorDivide(_tracks[_trackCount - 1].firstFrame + _tracks[_trackCount - 1].frameCount - 1, FRAMES_PER_SECTOR);
+			
+			firstRequiredSector		= MAX(firstRequiredSector, (int64_t)[drive firstSectorForSession:session]);
+			lastRequiredSector		= MIN(lastRequiredSector, (int64_t)[drive lastSectorForSession:session]);
+			
+			_requiredSectorRange	= [[SectorRange sectorRangeWithFirstSector:(NSUInteger)firstRequiredSector lastSector:(NSUInteger)lastRequiredSector] retain];
+		}
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	free(_tracks);						_tracks = NULL;
+	
+	[_requiredSectorRange release];		_requiredSectorRange = nil;
+	[_sectorRange release];				_sectorRange = nil;
+	
+	[super dealloc];
+}
+
+- (SectorRange *)	sectorRange								{ return [[_sectorRange retain] autorelease]; }
+- (int)				driveOffset								{ return _driveOffset; }
+- (SectorRange *)	requiredSectorRange						{ return [[_requiredSectorRange retain] autorelease]; }
+- (BOOL)			coversSectorRange						{ return _coversSectorRange; }
+
+- (SectorRange *) checkedSectorRange
+{
+	struct AccurateRipTrack		*first;
+	struct AccurateRipTrack		*last;
+	int64_t						firstFrame, lastFrame;
+	int64_t						firstSector, lastSector;
+	
+	if(0 == _trackCount) {
+		return nil;
+	}
+	
+	// The tracks are contiguous, so only the ends of the first and last are left unchecked
+	first		= _tracks;
+	last		= _tracks + (_trackCount - 1);
+	firstFrame	= first->firstFrame + MAX(first->checkStart, 1) - 1;
+	lastFrame	= last->firstFrame + last->checkStop - 1;
+	
+	firstSector	= MAX(FloorDivide(firstFrame + FRAMES_PER_SECTOR - 1, FRAMES_PER_SECTOR), (int64_t)[_sectorRange firstSector]);
+	lastSector	= MIN(FloorDivide(lastFrame + 1, FRAMES_PER_SECTOR) - 1, (int64_t)[_sectorRange lastSector]);
+	
+	if(firstSector > lastSector) {
+		return nil;
+	}
+	
+	return [SectorRange sectorRangeWithFirstSector:(NSUInteger)firstSector lastSector:(NSUInteger)lastSector];
+}
+
+- (void) addSector:(NSUInteger)sector bytes:(const void *)bytes
+{
+	struct AccurateRipTrack		*track;
+	const uint8_t				*frames			= bytes;
+	int64_t						sectorFrame		= (int64_t)sector * FRAMES_PER_SECTOR;
+	int64_t						first, last;
+	int64_t						frame;
+	uint64_t					multiplier;
+	uint64_t					product;
+	uint32_t					sample;
+	NSUInteger					i;
+	
+	NSParameterAssert(NULL != bytes);
+	
+	for(i = 0; i < _trackCount; ++i) {
+		track	= _tracks + i;
+		
+		// The part of this sector that lands in the track
+		first	= MAX(sectorFrame, track->firstFrame);
+		last	= MIN(sectorFrame + FRAMES_PER_SECTOR, track->firstFrame + track->frameCount);
+		
+		for(frame = first; frame < last; ++frame) {
+			multiplier = (uint64_t)(frame - track->firstFrame + 1);
+			if((int64_t)multiplier < track->checkStart || (int64_t)multiplier > track->checkStop)
+				continue;
+			
+			// Both channels at once, left in the low half
+			sample					= OSReadLittleInt32(frames, (frame - sectorFrame) * 4);
+			product					= sample * multiplier;
+			
+			track->checksumV1		+= (uint32_t)product;
+			track->checksumV2		+= (uint32_t)product + (uint32_t)(product >> 32);
+		}
+	}
+}
+
+- (NSUInteger)		countOfTracks							{ return _trackCount; }
+
+- (NSUInteger) trackNumberAtIndex:(NSUInteger)index
+{
+	NSParameterAssert(index < _trackCount);
+	return _tracks[index].number;
+}
+
+- (uint32_t) checksumV1AtIndex:(NSUInteger)index
+{
+	NSParameterAssert(index < _trackCount);
+	return _tracks[index].checksumV1;
+}
+
+- (uint32_t) checksumV2AtIndex:(NSUInteger)index
+{
+	NSParameterAssert(index < _trackCount);
+	return _tracks[index].checksumV2;
+}
+
+@end
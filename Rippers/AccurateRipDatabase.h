@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+@class Drive;
+
+// The AccurateRip results for one disc, as published in a dBAR file:
+//   - The file is found under a base URL, which may be the AccurateRip server, a local
+//     HTTP stand-in or a file: URL for a directory laid out the same way
+//   - Lookups are cached by URL, since a disc's tracks are usually ripped by separate tasks;
+//     a lookup that times out or fails is not cached, so a later track tries again
+//   - A disc missing from the database is not an error; it simply matches nothing
+@interface AccurateRipDatabase : NSObject
+{
+	NSUInteger		_trackCount;		// Audio tracks in the first session
+	uint32_t		_discID1;
+	uint32_t		_discID2;
+	uint32_t		_freeDBDiscID;
+	NSURL			*_URL;
+	NSData			*_data;
+}
+
++ (AccurateRipDatabase *) databaseForDrive:(Drive *)drive baseURL:(NSURL *)baseURL;
+
+- (instancetype)	initWithDrive:(Drive *)drive baseURL:(NSURL *)baseURL;
+
+- (NSURL *)			URL;
+- (BOOL)			discFound;
+
+// The highest confidence of the submissions agreeing with checksum, or 0 if there are none
+// track counts only the audio tracks in the first session, starting at 1
+- (NSUInteger)		confidenceForTrack:(NSUInteger)track checksum:(uint32_t)checksum;
+
+@end
@@ -0,0 +1,218 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AccurateRipDatabase.h"
+#import "Drive.h"
+
+#include <libkern/OSByteOrder.h>
+
+// Each dBAR entry is a header followed by one record per track
+#define DBAR_HEADER_SIZE		13
+#define DBAR_TRACK_SIZE			9
+
+// CD addresses count from the start of the lead-in for freedb's purposes
+#define LEAD_IN_SECTORS			150
+#define SECTORS_PER_SECOND		75
+
+// A rip waits on the lookup, so an unresponsive server must not stall it for long
+#define DBAR_FETCH_TIMEOUT		15.0
+
+static NSMutableDictionary *sDatabases = nil;
+
+static uint32_t
+DigitSum(NSUInteger n)
+{
+	uint32_t sum = 0;
+	
+	for(; 0 < n; n /= 10)
+		sum += n % 10;
+	
+	return sum;
+}
+
+@interface AccurateRipDatabase (Private)
+- (BOOL)		loadData;
+@end
+
+@implementation AccurateRipDatabase
+
++ (AccurateRipDatabase *) databaseForDrive:(Drive *)drive baseURL:(NSURL *)baseURL
+{
+	AccurateRipDatabase		*database		= [[AccurateRipDatabase alloc] initWithDrive:drive baseURL:baseURL];
+	AccurateRipDatabase		*cached			= nil;
+	
+	@synchronized(self) {
+		cached = [[sDatabases objectForKey:[[database URL] absoluteString]] retain];
+	}
+	
+	if(nil != cached) {
+		[database release];
+		return [cached autorelease];
+	}
+	
+	// Only a definite answer is cached; after a failed fetch the next track tries again
+	if([database loadData]) {
+		@synchronized(self) {
+			if(nil == sDatabases)
+				sDatabases = [[NSMutableDictionary alloc] init];
+			
+			[sDatabases setObject:database forKey:[[database URL] absoluteString]];
+		}
+	}
+	
+	return [database autorelease];
+}
+
+- (id) initWithDrive:(Drive *)drive baseURL:(NSURL *)baseURL
+{
+	NSUInteger		session;
+	NSUInteger		number;
+	NSUInteger		sector;
+	NSUInteger		leadOut;
+	uint32_t		digitSum;
+	
+	NSParameterAssert(nil != drive);
+	NSParameterAssert(nil != baseURL);
+	
+	if((self = [super init])) {
+		
+		// The AccurateRip IDs are calculated from the audio tracks in the first session
+		session			= [drive firstSession];
+		leadOut			= [drive leadOutForSession:session];
+		
+		for(number = [drive firstTrackForSession:session]; number <= [drive lastTrackForSession:session]; ++number) {
+			if([[drive trackNumber:number] dataTrack])
+				continue;
+			
+			sector			= [drive firstSectorForTrack:number];
+			
+			++_trackCount;
+			_discID1		+= (uint32_t)sector;
+			_discID2		+= (uint32_t)(0 == sector ? 1 : sector) * (uint32_t)_trackCount;
+		}
+		
+		_discID1		+= (uint32_t)leadOut;
+		_discID2		+= (uint32_t)leadOut * (uint32_t)(_trackCount + 1);
+		
+		// The freedb ID covers every track on the disc
+		digitSum		= 0;
+		for(session = [drive firstSession]; session <= [drive lastSession]; ++session) {
+			for(number = [drive firstTrackForSession:session]; number <= [drive lastTrackForSession:session]; ++number)
+				digitSum += DigitSum(([drive firstSectorForTrack:number] + LEAD_IN_SECTORS) / SECTORS_PER_SECOND);
+		}
+		
+		_freeDBDiscID	= ((digitSum % 0xFF) << 24)
+			| ((uint32_t)(([drive leadOutForSession:[drive lastSession]] + LEAD_IN_SECTORS) / SECTORS_PER_SECOND - ([drive firstSectorForTrack:[drive firstTrackForSession:[drive firstSession]]] + LEAD_IN_SECTORS) / SECTORS_PER_SECOND) << 8)
+			| (uint32_t)([drive lastTrackForSession:[drive lastSession]] - [drive firstTrackForSession:[drive firstSession]] + 1);
+		
+		// The file's path is relative to the base, which must name a directory
+		if(NO == [[baseURL absoluteString] hasSuffix:@"/"])
+			baseURL		= [NSURL URLWithString:[[baseURL absoluteString] stringByAppendingString:@"/"]];
+		
+		_URL			= [[NSURL alloc] initWithString:[NSString stringWithFormat:@"%x/%x/%x/dBAR-%03lu-%08x-%08x-%08x.bin",
+											 _discID1 & 0xF, (_discID1 >> 4) & 0xF, (_discID1 >> 8) & 0xF,
+											 (unsigned long)_trackCount, _discID1, _discID2, _freeDBDiscID]
+									relativeToURL:baseURL];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[_URL release];		_URL = nil;
+	[_data release];	_data = nil;
+	
+	[super dealloc];
+}
+
+- (NSURL *)			URL										{ return [[_URL retain] autorelease]; }
+- (BOOL)			discFound								{ return (0 != [_data length]); }
+
+- (NSUInteger) confidenceForTrack:(NSUInteger)track checksum:(uint32_t)checksum
+{
+	const uint8_t	*bytes			= [_data bytes];
+	NSUInteger		length			= [_data length];
+	NSUInteger		offset			= 0;
+	NSUInteger		entryTrackCount;
+	NSUInteger		confidence		= 0;
+	BOOL			sameDisc;
+	
+	NSParameterAssert(0 < track);
+	
+	// The file holds one entry for each pressing that was submitted
+	while(offset + DBAR_HEADER_SIZE <= length) {
+		entryTrackCount		= bytes[offset];
+		sameDisc			= (entryTrackCount == _trackCount
+							   && OSReadLittleInt32(bytes, offset + 1) == _discID1
+							   && OSReadLittleInt32(bytes, offset + 5) == _discID2
+							   && OSReadLittleInt32(bytes, offset + 9) == _freeDBDiscID);
+		
+		offset				+= DBAR_HEADER_SIZE;
+		
+		if(offset + (entryTrackCount * DBAR_TRACK_SIZE) > length)
+			break;
+		
+		if(sameDisc && track <= entryTrackCount) {
+			const uint8_t *record = bytes + offset + ((track - 1) * DBAR_TRACK_SIZE);
+			
+			if(OSReadLittleInt32(record, 1) == checksum && confidence < record[0])
+				confidence = record[0];
+		}
+		
+		offset				+= entryTrackCount * DBAR_TRACK_SIZE;
+	}
+	
+	return confidence;
+}
+
+@end
+
+@implementation AccurateRipDatabase (Private)
+
+- (BOOL) loadData
+{
+	NSURLRequest		*request		= [NSURLRequest requestWithURL:[self URL] cachePolicy:NSURLRequestUseProtocolCachePolicy timeoutInterval:DBAR_FETCH_TIMEOUT];
+	NSURLResponse		*response		= nil;
+	NSError				*error			= nil;
+	NSData				*data			= nil;
+	NSInteger			statusCode;
+	
+	data = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&error];
+	
+	if(nil != data && [response isKindOfClass:[NSHTTPURLResponse class]]) {
+		statusCode = [(NSHTTPURLResponse *)response statusCode];
+		
+		// The server answers 404 for a disc it has no submissions for
+		if(404 == statusCode)
+			data = [NSData data];
+		else if(200 != statusCode) {
+			data	= nil;
+			NSLog(@"AccurateRip results are not available from %@: HTTP status %ld", [self URL], (long)statusCode);
+		}
+	}
+	else if(nil == data)
+		NSLog(@"AccurateRip results are not available from %@: %@", [self URL], error);
+	
+	[_data release];
+	_data = [(nil == data ? [NSData data] : data) retain];
+	
+	return (nil != data);
+}
+
+@end
@@ -39,7 +39,7 @@
 - (id) initWithSectors:(NSArray *)sectors deviceName:(NSString *)deviceName
 {
 	if((self = [super initWithSectors:sectors deviceName:deviceName])) {
-		_drive				= [[Drive alloc] initWithDeviceName:deviceName];
+		_drive				= [[Drive driveWithDeviceName:deviceName] retain];
 		
 		// Determine the size of the track(s) we are ripping
 		[self setValue:[_sectors valueForKeyPath:@"@sum.length"] forKey:@"grandTotalSectors"];			
@@ -69,7 +69,7 @@
 	_startTime = [NSDate date];
 	[[self delegate] setStartTime:_startTime];
 	[[self delegate] setStarted:YES];
-	[[self delegate] setPhase:NSLocalizedStringFromTable(@"Ripping", @"General", @"")];
+	[_status beginPhase:kTaskPhaseRipping totalUnits:_grandTotalSectors];
 	
 	@try {
 		// Setup output file type (same)
@@ -147,12 +147,8 @@
 	NSUInteger			sectorsToRead		= grandTotalSectors - _sectorsRead;
 	SectorRange			*readRange			= nil;
 	OSStatus			err					= noErr;
-	NSUInteger			iterations			= 0;
 	AudioBufferList		bufferList;
 	UInt32				frameCount			= 0;
-	double				percentComplete;
-	NSTimeInterval		interval;
-	NSUInteger			secondsRemaining;
 	
 	@try {
 		// Allocate a buffer to hold the ripped data
@@ -195,25 +191,12 @@
 			sectorsRemaining	-= [readRange length];
 			sectorsToRead		-= [readRange length];
 			
-			// This loop is sufficiently slow that if the delegate is only polled every MAX_DO_POLL_FREQUENCY
-			// iterations the user will think the program is unresponsive
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % 2/*MAX_DO_POLL_FREQUENCY*/) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				percentComplete		= ((double)(grandTotalSectors - sectorsToRead)/(double) grandTotalSectors) * 100.0;
-				interval			= -1.0 * [_startTime timeIntervalSinceNow];
-				secondsRemaining	= interval / ((double)(grandTotalSectors - sectorsToRead)/(double) grandTotalSectors) - interval;
-				
-				[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
+			[_status setCompletedUnits:(grandTotalSectors - sectorsToRead)];
 			
-			++iterations;				
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop]) {
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+			}
 		}
 	}
 	
@@ -22,7 +22,8 @@
 {
 	NSUInteger		_bitCount;
 	NSUInteger		_length;
-	uint32_t		*_bits;
+	uint64_t		*_bits;
+	NSUInteger		_countOfOnes;
 }
 
 // Access the number of bits this object holds
@@ -33,6 +34,14 @@
 - (BOOL)			valueAtIndex:(NSUInteger)index;
 - (void)			setValue:(BOOL)value forIndex:(NSUInteger)index;
 
+// Access to runs of bits
+- (void)			setRange:(NSRange)range;
+- (void)			clearRange:(NSRange)range;
+
+// The index of the first bit at or after index with the given value, or NSNotFound
+- (NSUInteger)		nextZeroFromIndex:(NSUInteger)index;
+- (NSUInteger)		nextOneFromIndex:(NSUInteger)index;
+
 // Convenience methods
 - (BOOL)			allZeroes;
 - (NSUInteger)		countOfZeroes;
@@ -18,6 +18,18 @@
 
 #import "BitArray.h"
 
+#define BITS_PER_WORD		(8 * sizeof(uint64_t))
+
+// The bits of word wordIndex that lie in range
+static inline uint64_t
+MaskForWordInRange(NSUInteger wordIndex, NSRange range)
+{
+	NSUInteger	firstBit	= (wordIndex == range.location / BITS_PER_WORD ? range.location % BITS_PER_WORD : 0);
+	NSUInteger	lastBit		= (wordIndex == (NSMaxRange(range) - 1) / BITS_PER_WORD ? (NSMaxRange(range) - 1) % BITS_PER_WORD : BITS_PER_WORD - 1);
+	
+	return (UINT64_MAX << firstBit) & (UINT64_MAX >> (BITS_PER_WORD - 1 - lastBit));
+}
+
 @implementation BitArray
 
 - (void) dealloc
@@ -31,11 +43,13 @@
 - (NSUInteger)		bitCount									{ return _bitCount; }
 - (void)			setBitCount:(NSUInteger)bitCount
 {
-	_bitCount	= bitCount;
-	_length		= ([self bitCount] / (8 * sizeof(NSUInteger))) + 1;
+	_bitCount		= bitCount;
+	_length			= ([self bitCount] / BITS_PER_WORD) + 1;
+	_countOfOnes	= 0;
 	
+	// Bits past the end are always kept clear
 	free(_bits);
-	_bits = calloc(_length, sizeof(NSUInteger));
+	_bits = calloc(_length, sizeof(uint64_t));
 	NSAssert(NULL != _bits, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 }
 
@@ -43,191 +57,139 @@
 
 - (BOOL)				valueAtIndex:(NSUInteger)idx
 {
-	NSUInteger		arrayIndex;
-	NSUInteger		bitIndex;
-
-	arrayIndex	= idx / (8 * sizeof(NSUInteger));
-	bitIndex	= idx % (8 * sizeof(NSUInteger));
-	
-	return (_bits[arrayIndex] & (1 << bitIndex) ? YES : NO);
+	return ((_bits[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1 ? YES : NO);
 }
 
 - (void)				setValue:(BOOL)value forIndex:(NSUInteger)idx
 {
-	NSUInteger		arrayIndex;
-	NSUInteger		bitIndex;
-	NSUInteger		mask;
+	uint64_t		*word;
+	uint64_t		mask;
 	
-	arrayIndex	= idx / (8 * sizeof(NSUInteger));
-	bitIndex	= idx % (8 * sizeof(NSUInteger));
-	mask		= value << bitIndex;
+	NSParameterAssert(idx < [self bitCount]);
 	
-	if(value) {
-		_bits[arrayIndex] |= mask;
+	word	= _bits + (idx / BITS_PER_WORD);
+	mask	= (uint64_t)1 << (idx % BITS_PER_WORD);
+	
+	if(value && 0 == (*word & mask)) {
+		*word |= mask;
+		++_countOfOnes;
 	}
-	else {
-		_bits[arrayIndex] &= mask;
+	else if(NO == value && 0 != (*word & mask)) {
+		*word &= ~mask;
+		--_countOfOnes;
 	}
 }
 
-#pragma mark Zero methods
-
-- (BOOL)			allZeroes
+- (void)			setRange:(NSRange)range
 {
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
 	NSUInteger		i;
+	uint64_t		mask;
 	
-	lastArrayIndex	= [self bitCount] / (8 * sizeof(NSUInteger));
-	lastBitIndex	= [self bitCount] % (8 * sizeof(NSUInteger));
+	NSParameterAssert(NSMaxRange(range) <= [self bitCount]);
 	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		if(0x00000000 != _bits[i]) {
-			return NO;
-		}
+	if(0 == range.length) {
+		return;
 	}
 	
-	for(i = 0; i < lastBitIndex; ++i) {
-		if(0 != (_bits[lastArrayIndex] & (1 << i))) {
-			return NO;
-		}
+	for(i = range.location / BITS_PER_WORD; i <= (NSMaxRange(range) - 1) / BITS_PER_WORD; ++i) {
+		mask			= MaskForWordInRange(i, range);
+		_countOfOnes	+= __builtin_popcountll(mask & ~_bits[i]);
+		_bits[i]		|= mask;
 	}
-	
-	return YES;
 }
 
-- (NSUInteger)		countOfZeroes
+- (void)			clearRange:(NSRange)range
 {
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
-	NSUInteger		i, j;
-	NSUInteger		result;
-	
-	lastArrayIndex	= [self bitCount] / (8 * sizeof(NSUInteger));
-	lastBitIndex	= [self bitCount] % (8 * sizeof(NSUInteger));
-	result			= 0;
-	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		for(j = 0; j < (8 * sizeof(NSUInteger)); ++j) {
-			if(!(_bits[i] & (1 << j))) {
-				++result;
-			}
-		}
-	}
-	
-	for(i = 0; i < lastBitIndex; ++i) {
-		if(!(_bits[lastArrayIndex] & (1 << i))) {
-			++result;
-		}
-	}
-	
-	return result;
-}
-
-- (void)			setAllZeroes
-{
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
 	NSUInteger		i;
+	uint64_t		mask;
 	
-	lastArrayIndex	= [self bitCount] / (8 * sizeof(NSUInteger));
-	lastBitIndex	= [self bitCount] % (8 * sizeof(NSUInteger));
+	NSParameterAssert(NSMaxRange(range) <= [self bitCount]);
 	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		_bits[i] = 0x00000000;
+	if(0 == range.length) {
+		return;
 	}
 	
-	for(i = 0; i < lastBitIndex; ++i) {
-		_bits[lastArrayIndex] &= ~(1 << i);
+	for(i = range.location / BITS_PER_WORD; i <= (NSMaxRange(range) - 1) / BITS_PER_WORD; ++i) {
+		mask			= MaskForWordInRange(i, range);
+		_countOfOnes	-= __builtin_popcountll(mask & _bits[i]);
+		_bits[i]		&= ~mask;
 	}
 }
 
-#pragma mark One methods
+#pragma mark Run iteration
 
-- (BOOL)			allOnes
+- (NSUInteger)		nextZeroFromIndex:(NSUInteger)idx
 {
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
 	NSUInteger		i;
+	uint64_t		word;
 	
-	lastArrayIndex	= [self bitCount] / (8 * sizeof(NSUInteger));
-	lastBitIndex	= [self bitCount] % (8 * sizeof(NSUInteger));
-	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		if(0xFFFFFFFF != _bits[i]) {
-			return NO;
-		}
-	}
-	
-	for(i = 0; i < lastBitIndex; ++i) {
-		if(0 == (_bits[lastArrayIndex] & (1 << i))) {
-			return NO;
-		}
+	if(idx >= [self bitCount]) {
+		return NSNotFound;
 	}
 	
-	return YES;
-}
-
-- (NSUInteger)		countOfOnes
-{
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
-	NSUInteger		i, j;
-	NSUInteger		result;
-	
-	lastArrayIndex	= [self bitCount] / (8 * sizeof(NSUInteger));
-	lastBitIndex	= [self bitCount] % (8 * sizeof(NSUInteger));
-	result			= 0;
-	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		for(j = 0; j < (8 * sizeof(NSUInteger)); ++j) {
-			if(_bits[i] & (1 << j)) {
-				++result;
-			}
-		}
-	}
+	i		= idx / BITS_PER_WORD;
+	word	= ~_bits[i] & (UINT64_MAX << (idx % BITS_PER_WORD));
 	
-	for(i = 0; i < lastBitIndex; ++i) {
-		if(_bits[lastArrayIndex] & (1 << i)) {
-			++result;
+	while(0 == word) {
+		if(++i == _length) {
+			return NSNotFound;
 		}
+		word = ~_bits[i];
 	}
 	
-	return result;
+	// The clear bits past the end look like zeroes
+	idx = (i * BITS_PER_WORD) + __builtin_ctzll(word);
+	return (idx < [self bitCount] ? idx : NSNotFound);
 }
 
-- (void)			setAllOnes
+- (NSUInteger)		nextOneFromIndex:(NSUInteger)idx
 {
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
 	NSUInteger		i;
+	uint64_t		word;
 	
-	lastArrayIndex	= [self bitCount] / (8 * sizeof(NSUInteger));
-	lastBitIndex	= [self bitCount] % (8 * sizeof(NSUInteger));
-	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		_bits[i] = 0xFFFFFFFF;
+	if(idx >= [self bitCount]) {
+		return NSNotFound;
 	}
 	
-	for(i = 0; i < lastBitIndex; ++i) {
-		_bits[lastArrayIndex] |= 1 << i;
+	i		= idx / BITS_PER_WORD;
+	word	= _bits[i] & (UINT64_MAX << (idx % BITS_PER_WORD));
+	
+	while(0 == word) {
+		if(++i == _length) {
+			return NSNotFound;
+		}
+		word = _bits[i];
 	}
+	
+	return (i * BITS_PER_WORD) + __builtin_ctzll(word);
 }
 
+#pragma mark Zero methods
+
+- (BOOL)			allZeroes									{ return (0 == _countOfOnes); }
+- (NSUInteger)		countOfZeroes								{ return [self bitCount] - _countOfOnes; }
+- (void)			setAllZeroes								{ [self clearRange:NSMakeRange(0, [self bitCount])]; }
+
+#pragma mark One methods
+
+- (BOOL)			allOnes										{ return ([self bitCount] == _countOfOnes); }
+- (NSUInteger)		countOfOnes									{ return _countOfOnes; }
+- (void)			setAllOnes									{ [self setRange:NSMakeRange(0, [self bitCount])]; }
+
 - (NSString *)		description
 {
 	NSMutableString		*result;
 	NSUInteger			i;
 	
-	result = [NSMutableString stringWithCapacity:[self bitCount]];
+	result = [NSMutableString stringWithCapacity:[self bitCount] + ([self bitCount] / 8)];
 	for(i = 0; i < [self bitCount]; ++i) {
 		[result appendString:([self valueAtIndex:i] ? @"1" : @"0")];
-		if(0 == i % 8) {
-			[result appendString:@" "];
-		}
-		if(0 == i % 32) {
+		if(0 == (i + 1) % BITS_PER_WORD) {
 			[result appendString:@"\n"];
 		}
+		else if(0 == (i + 1) % 8) {
+			[result appendString:@" "];
+		}
 	}
 	
 	return result;
@@ -21,16 +21,28 @@
 #import "Ripper.h"
 #import "Drive.h"
 
+@class SectorStream;
+@class AdaptiveReadController;
+#include "SectorHash.h"
+
 @interface ComparisonRipper : Ripper
 {
 	Drive					*_drive;
+	SectorStream			*_stream;			// Receives each sector once verified, in place of the output file
+	AdaptiveReadController	*_readController;	// Sets the speed and read size for the range being ripped
 
 	int						_driveOffset;
 
 	NSUInteger				_requiredMatches;
 	NSUInteger				_maximumRetries;
 	BOOL					_useHashes;
+	SectorHashAlgorithm		_hashAlgorithm;
 	BOOL					_useC2;
+	BOOL					_useAdaptiveReads;
+	
+	BOOL					_useAccurateRip;
+	NSURL					*_accurateRipURL;
+	NSUInteger				_minimumAccurateRipConfidence;
 	
 	NSUInteger				_grandTotalSectors;
 	NSUInteger				_sectorsRead;
@@ -51,7 +63,24 @@
 - (BOOL)					useHashes;
 - (void)					setUseHashes:(BOOL)useHashes;
 
+- (SectorHashAlgorithm)		hashAlgorithm;
+- (void)					setHashAlgorithm:(SectorHashAlgorithm)hashAlgorithm;
+
 - (BOOL)					useC2;
 - (void)					setUseC2:(BOOL)useC2;
 
+// Slow down and shorten reads only where errors turn up, instead of reading everything at full speed
+- (BOOL)					useAdaptiveReads;
+- (void)					setUseAdaptiveReads:(BOOL)useAdaptiveReads;
+
+// Tracks matching the AccurateRip database after the first pass are not ripped again
+- (BOOL)					useAccurateRip;
+- (void)					setUseAccurateRip:(BOOL)useAccurateRip;
+
+- (NSURL *)					accurateRipURL;
+- (void)					setAccurateRipURL:(NSURL *)accurateRipURL;
+
+- (NSUInteger)				minimumAccurateRipConfidence;
+- (void)					setMinimumAccurateRipConfidence:(NSUInteger)confidence;
+
 @end
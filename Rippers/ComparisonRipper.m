@@ -20,9 +20,17 @@
 #import "Rip.h"
 #import "SectorRange.h"
 #import "BitArray.h"
+#import "SectorConsensus.h"
+#import "DriveReader.h"
+#import "ReRipPlanner.h"
+#import "AdaptiveReadController.h"
+#import "SectorStream.h"
+#import "AccurateRipChecksum.h"
+#import "AccurateRipDatabase.h"
 #import "LogController.h"
 #import "StopException.h"
 #import "UtilityFunctions.h"
+#import "C2ErrorScan.h"
 
 #include <IOKit/storage/IOCDTypes.h>
 
@@ -39,10 +47,17 @@
 #define TEMPFILE_SUFFIX		".rip"
 #define TEMPFILE_PATTERN	"MaxXXXXXXXX" TEMPFILE_SUFFIX
 
+// Reading through a gap of this many sectors is assumed to cost about as much as seeking over it
+#define RERIP_SEEK_COST		100
+
 @interface ComparisonRipper (Private)
 - (void)		logMessage:(NSString *)message;
 - (NSString *)	createTemporaryFile;
 - (void)		ripSectorRange:(SectorRange *)range toFile:(ExtAudioFileRef)file;
+- (void)		tallySectorRange:(SectorRange *)range ofRip:(Rip *)rip consensus:(SectorConsensus *)consensus masterRip:(Rip *)masterRip sectorStatus:(BitArray *)sectorStatus;
+- (void)		acceptSectorRange:(SectorRange *)range ofRip:(Rip *)rip consensus:(SectorConsensus *)consensus masterRip:(Rip *)masterRip sectorStatus:(BitArray *)sectorStatus;
+- (BOOL)		verifyChecksum:(AccurateRipChecksum *)checksum;
+- (void)		setC2ErrorsForSectorRange:(SectorRange *)range ofRip:(Rip *)rip fromChunk:(const int8_t *)chunk errorBuffer:(uint32_t *)errors;
 @end
 
 @implementation ComparisonRipper
@@ -73,12 +88,19 @@
 - (id) initWithSectors:(NSArray *)sectors deviceName:(NSString *)deviceName
 {
 	if((self = [super initWithSectors:sectors deviceName:deviceName])) {
-		_drive				= [[Drive alloc] initWithDeviceName:deviceName];
+		_drive				= [[Drive driveWithDeviceName:deviceName] retain];
 		
 		_requiredMatches	= [[NSUserDefaults standardUserDefaults] integerForKey:@"comparisonRipperRequiredMatches"];
 		_maximumRetries		= [[NSUserDefaults standardUserDefaults] integerForKey:@"comparisonRipperMaximumRetries"];
 		_useHashes			= [[NSUserDefaults standardUserDefaults] boolForKey:@"comparisonRipperUseHashes"];
+		_hashAlgorithm		= (SectorHashAlgorithm)[[NSUserDefaults standardUserDefaults] integerForKey:@"comparisonRipperHashAlgorithm"];
 		_useC2				= [[NSUserDefaults standardUserDefaults] boolForKey:@"comparisonRipperUseC2"];
+		_useAdaptiveReads	= [[NSUserDefaults standardUserDefaults] boolForKey:@"comparisonRipperUseAdaptiveReads"];
+		_driveOffset		= (int)[[NSUserDefaults standardUserDefaults] integerForKey:@"comparisonRipperDriveOffset"];
+		
+		_useAccurateRip					= [[NSUserDefaults standardUserDefaults] boolForKey:@"comparisonRipperUseAccurateRip"];
+		_accurateRipURL					= [[NSURL alloc] initWithString:[[NSUserDefaults standardUserDefaults] stringForKey:@"comparisonRipperAccurateRipURL"]];
+		_minimumAccurateRipConfidence	= [[NSUserDefaults standardUserDefaults] integerForKey:@"comparisonRipperAccurateRipMinimumConfidence"];
 
 		_sectorsRead		= 0;
 		
@@ -94,6 +116,8 @@
 - (void) dealloc
 {	
 	[_drive release];	_drive = nil;
+	[_stream release];	_stream = nil;
+	[_accurateRipURL release];	_accurateRipURL = nil;
 	
 	[super dealloc];
 }
@@ -112,9 +136,24 @@
 - (BOOL)				useHashes									{ return _useHashes; }
 - (void)				setUseHashes:(BOOL)useHashes				{ _useHashes = useHashes; }
 
+- (SectorHashAlgorithm)	hashAlgorithm								{ return _hashAlgorithm; }
+- (void)				setHashAlgorithm:(SectorHashAlgorithm)hashAlgorithm	{ _hashAlgorithm = hashAlgorithm; }
+
 - (BOOL)				useC2										{ return _useC2; }
 - (void)				setUseC2:(BOOL)useC2						{ _useC2 = useC2; }
 
+- (BOOL)				useAdaptiveReads							{ return _useAdaptiveReads; }
+- (void)				setUseAdaptiveReads:(BOOL)useAdaptiveReads	{ _useAdaptiveReads = useAdaptiveReads; }
+
+- (BOOL)				useAccurateRip								{ return _useAccurateRip; }
+- (void)				setUseAccurateRip:(BOOL)useAccurateRip		{ _useAccurateRip = useAccurateRip; }
+
+- (NSURL *)				accurateRipURL								{ return [[_accurateRipURL retain] autorelease]; }
+- (void)				setAccurateRipURL:(NSURL *)accurateRipURL	{ [_accurateRipURL release]; _accurateRipURL = [accurateRipURL retain]; }
+
+- (NSUInteger)			minimumAccurateRipConfidence				{ return _minimumAccurateRipConfidence; }
+- (void)				setMinimumAccurateRipConfidence:(NSUInteger)confidence	{ _minimumAccurateRipConfidence = confidence; }
+
 - (void)				logMessage:(NSString *)message
 {
 	if([self logActivity]) {
@@ -125,8 +164,8 @@
 - (oneway void) ripToFile:(NSString *)filename
 {
 	OSStatus						err;
-	AudioFileID						audioFile;
-	ExtAudioFileRef					extAudioFileRef;
+	AudioFileID						audioFile			= NULL;
+	ExtAudioFileRef					extAudioFileRef		= NULL;
 	AudioStreamBasicDescription		outputASBD;
 	SectorRange						*range;
 	uint16_t						driveSpeed;
@@ -150,11 +189,16 @@
 		outputASBD.mChannelsPerFrame	= 2;
 		outputASBD.mBitsPerChannel		= 16;
 		
-		err = AudioFileCreateWithURL((CFURLRef)[NSURL fileURLWithPath:filename], kAudioFileCAFType, &outputASBD, kAudioFileFlags_EraseFile, &audioFile);
-		NSAssert2(noErr == err, NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"AudioFileInitialize", UTCreateStringForOSType(err));
+		// The encoders may already be waiting for the audio
+		_stream = [[SectorStream streamWithIdentifier:filename] retain];
 		
-		err = ExtAudioFileWrapAudioFileID(audioFile, YES, &extAudioFileRef);
-		NSAssert2(noErr == err, NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"ExtAudioFileWrapAudioFileID", UTCreateStringForOSType(err));
+		if(nil == _stream) {
+			err = AudioFileCreateWithURL((CFURLRef)[NSURL fileURLWithPath:filename], kAudioFileCAFType, &outputASBD, kAudioFileFlags_EraseFile, &audioFile);
+			NSAssert2(noErr == err, NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"AudioFileInitialize", UTCreateStringForOSType(err));
+			
+			err = ExtAudioFileWrapAudioFileID(audioFile, YES, &extAudioFileRef);
+			NSAssert2(noErr == err, NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"ExtAudioFileWrapAudioFileID", UTCreateStringForOSType(err));
+		}
 		
 		// Save the drive speed
 		driveSpeed = [_drive speed];
@@ -167,13 +211,17 @@
 
 		// Restore drive speed
 		[_drive setSpeed:driveSpeed];
+		
+		[_stream finish];
 	}
 	
 	@catch(StopException *exception) {
+		[_stream abort];
 		[[self delegate] setStopped:YES];
 	}
 	
 	@catch(NSException *exception) {
+		[_stream abort];
 		[[self delegate] setException:exception];
 		[[self delegate] setStopped:YES];
 	}
@@ -182,7 +230,7 @@
 		NSException						*exception;
 		
 		// Close the output file
-		err = ExtAudioFileDispose(extAudioFileRef);
+		err = (NULL != extAudioFileRef ? ExtAudioFileDispose(extAudioFileRef) : noErr);
 		if(noErr != err) {
 			exception = [NSException exceptionWithName:@"CoreAudioException"
 												reason:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"ExtAudioFileDispose"]
@@ -191,7 +239,7 @@
 		}
 		
 		// Close the output file
-		err = AudioFileClose(audioFile);
+		err = (NULL != audioFile ? AudioFileClose(audioFile) : noErr);
 		if(noErr != err) {
 			exception = [NSException exceptionWithName:@"CoreAudioException"
 												 reason:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The call to %@ failed.", @"Exceptions", @""), @"AudioFileClose"]
@@ -213,10 +261,11 @@
 
 	int8_t				*buffer				= NULL;
 	int8_t				*audioBuffer		= NULL;
-	int8_t				*c2Buffer			= NULL;
-	int8_t				*sectorAlias		= NULL;
+	uint32_t			*c2Buffer			= NULL;
+	const int8_t		*sectorAlias		= NULL;
+	const int8_t		*chunk				= NULL;
+	DriveReader			*reader				= nil;
 	
-	int8_t				sectorBuffer		[ kCDSectorSizeCDDA ];
 	NSUInteger			bufferLen			= 0;
 	
 	NSUInteger			sectorsRead			= 0;
@@ -228,30 +277,18 @@
 	OSStatus			err					= noErr;
 	NSUInteger			totalSectors		= 0;
 	NSUInteger			sectorsToRead		= 0;
-	NSUInteger			iterations			= 0;
 	AudioBufferList		bufferList;
 	UInt32				frameCount			= 0;
 	NSMutableArray		*rips				= nil;
 	BitArray			*sectorStatus		= nil;
 	Rip					*masterRip			= nil;
 	Rip					*rip				= nil;
-	Rip					*master				= nil;
-	Rip					*comparator			= nil;
-	NSDate				*phaseStartTime		= nil;
-	BOOL				gotMatch;
-	NSUInteger			i, j, k;
-	NSUInteger			sector;
-	NSUInteger			sectorIndex;
-	NSUInteger			masterIndex;
-	NSUInteger			comparatorIndex;
-	NSUInteger			matchCount;
-	unsigned char		*masterHash;
-	NSUInteger			blockEnd;
+	SectorConsensus		*consensus			= nil;
+	AccurateRipChecksum	*checksum			= nil;
+	ReRipPlanner		*planner			= nil;
+	NSUInteger			i, j;
 	NSUInteger			retries;
-	NSUInteger			blockPadding;
-	double				percentComplete;
-	NSTimeInterval		interval;
-	NSUInteger			secondsRemaining;
+	NSUInteger			headSector;
 	
 	@try {
 		
@@ -259,19 +296,33 @@
 		masterRip = [[[Rip alloc] initWithSectorRange:range] autorelease];
 		[masterRip setFilename:[self createTemporaryFile]];
 		[masterRip setCalculateHashes:NO];
+		
+		// Sectors are verified as each rip lands, by counting identical readings
+		consensus = [[[SectorConsensus alloc] initWithSectorRange:range
+												  requiredMatches:[self requiredMatches]
+													   hashLength:([self useHashes] ? SectorHashLength([self hashAlgorithm]) : 0)] autorelease];
+
+		// A pristine track can be verified against the AccurateRip results after a single pass
+		if([self useAccurateRip] && nil != [self accurateRipURL]) {
+			checksum = [[[AccurateRipChecksum alloc] initWithDrive:_drive sectorRange:range driveOffset:[self driveOffset]] autorelease];
+		}
 
 		// Allocate the array that will hold the individual rips
 		rips = [[[NSMutableArray alloc] initWithCapacity:[self requiredMatches]] autorelease];
 		
-		// Allocate buffers to hold the ripped data
+		// Allocate buffers to hold the ripped data, reading no more at once than the drive accepts
 		bufferLen	= [range length] <  1024 ? [range length] : 1024;
+		if(0 < [_drive maximumReadSize] / (kCDSectorSizeCDDA + kCDSectorSizeErrorFlags)) {
+			bufferLen = MIN(bufferLen, [_drive maximumReadSize] / (kCDSectorSizeCDDA + kCDSectorSizeErrorFlags));
+		}
+		
 		buffer		= calloc(bufferLen, kCDSectorSizeCDDA + kCDSectorSizeErrorFlags);
 		audioBuffer	= calloc(bufferLen, kCDSectorSizeCDDA);
 		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 		NSAssert(NULL != audioBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 
 		if([self useC2]) {
-			c2Buffer	= calloc(bufferLen, kCDSectorSizeErrorFlags);
+			c2Buffer	= calloc((bufferLen + 31) / 32, sizeof(uint32_t));
 			NSAssert(NULL != c2Buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
 		}
 		
@@ -284,18 +335,19 @@
 		// ===============
 		// Rip the entire sector range the minimum number of times to achieve the required matches
 		
-		// Use maximum speed for the initial extraction
-		[self logMessage:NSLocalizedStringFromTable(@"Setting drive speed to maximum", @"Log", @"")];
-		[_drive setSpeed:kCDSpeedMax];
+		// Read at maximum speed, slowing down only where errors turn up
+		if([self useAdaptiveReads]) {
+			_readController = [[AdaptiveReadController alloc] initWithSectorRange:range maximumSectorsPerRead:bufferLen];
+			[_readController setLogDecisions:[self logActivity]];
+		}
 		
 		retries			= 0;
 		
 		// Update UI based on the current ripping phase only- too hard to predict otherwise
 		totalSectors	= [self requiredMatches] * [range length];
 		sectorsToRead	= [self requiredMatches] * [range length];
-		phaseStartTime	= [NSDate date];
 
-		[[self delegate] setPhase:NSLocalizedStringFromTable(@"Ripping", @"General", @"")];
+		[_status beginPhase:kTaskPhaseRipping totalUnits:totalSectors];
 		
 		for(i = 0; i < [self requiredMatches]; ++i) {
 			// Clear the drive's cache
@@ -307,219 +359,89 @@
 			// Associate it with the temporary file
 			[rip setFilename:[self createTemporaryFile]];
 			
-			// Don't calculate SHA-256 hashes unnecessarily
+			// Don't calculate hashes unnecessarily
 			[rip setCalculateHashes:[self useHashes]];
+			[rip setHashAlgorithm:[self hashAlgorithm]];
 			
 			// Place it in our array of objects
 			[rips addObject:[rip autorelease]];
 			
-			// Extract the audio
-			sectorsRemaining	= [range length];
+			// Extract the audio; the next chunk is read from the disc while this one is processed
+			reader = [[DriveReader alloc] initWithDrive:_drive sectorRange:range sectorsPerRead:bufferLen controller:_readController];
+			[reader start];
 			
-			while(0 < sectorsRemaining) {
+			while(NULL != (chunk = [reader nextChunk:&readRange sectorsRead:&sectorsRead])) {
 				
-				// Set up the parameters for this read
-				startSector		= [range firstSector] + [range length] - sectorsRemaining;
-				sectorCount		= sectorsRemaining > bufferLen ? bufferLen : sectorsRemaining;
-				readRange		= [SectorRange sectorRangeWithFirstSector:startSector sectorCount:sectorCount];
-
-				// Extract the audio from the disc
 				[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Ripping sectors %lu - %lu", @"Log", @""), (unsigned long)[readRange firstSector], (unsigned long)[readRange lastSector]]];
-				sectorsRead		= [_drive readAudioAndErrorFlags:buffer sectorRange:readRange];
 				
-				NSAssert(sectorCount == sectorsRead, NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Log", @""));
+				NSAssert([readRange length] == sectorsRead, NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Log", @""));
 				
-				// Copy audio and (optionally) C2 data to their respective buffers
+				// Copy audio to its buffer
 				for(j = 0; j < sectorsRead; ++j) {
-					sectorAlias = buffer + (j * (kCDSectorSizeCDDA + kCDSectorSizeErrorFlags));
+					sectorAlias = chunk + (j * (kCDSectorSizeCDDA + kCDSectorSizeErrorFlags));
 					memcpy(audioBuffer + (j * kCDSectorSizeCDDA), sectorAlias, kCDSectorSizeCDDA);
-
-					if([self useC2]) {
-						memcpy(c2Buffer + (j * kCDSectorSizeErrorFlags), sectorAlias + kCDSectorSizeCDDA, kCDSectorSizeErrorFlags);
-					}
 					
 					//memcpy(q + (j * kCDSectorSizeQSubchannel), sectorAlias + kCDSectorSizeCDDA + kCDSectorSizeErrorFlags, kCDSectorSizeQSubchannel);
 				}
 
-				// Check for C2 errors
-				if([self useC2]) {
-					for(j = 0; j < kCDSectorSizeErrorFlags * sectorsRead; ++j) {
-						if(c2Buffer[j]) {
-							for(k = 0; k < 8; ++k) {
-								if((1 << k) & c2Buffer[j]) {
-									[self logMessage:[NSString stringWithFormat:@"C2 error for sector %lu", [readRange firstSector] + (8 * j) + k]];
-								}
-							}					
-						}
-					}
-				}
-
 				// Place the data in the Rip object
 				[rip setBytes:audioBuffer forSectorRange:readRange];
+				
+				if(0 == i && nil != checksum) {
+					for(j = 0; j < sectorsRead; ++j) {
+						[checksum addSector:[readRange firstSector] + j bytes:audioBuffer + (j * kCDSectorSizeCDDA)];
+					}
+				}
 
 				// Store C2 errors
 				if([self useC2]) {
-					[rip setErrorFlags:c2Buffer forSectorRange:readRange];
+					[self setC2ErrorsForSectorRange:readRange ofRip:rip fromChunk:chunk errorBuffer:c2Buffer];
 				}
+
+				// Verify the new readings
+				[self tallySectorRange:readRange ofRip:rip consensus:consensus masterRip:masterRip sectorStatus:sectorStatus];
 				
 				// Housekeeping
-				sectorsRemaining	-= [readRange length];
 				sectorsToRead		-= [readRange length];
 				
-				// This loop is sufficiently slow that if the delegate is only polled every MAX_DO_POLL_FREQUENCY
-				// iterations the user will think the program is unresponsive
-				// Distributed Object calls are expensive, so only perform them every few iterations
-				if(0 == iterations % 2/*MAX_DO_POLL_FREQUENCY*/) {
-					
-					// Check if we should stop, and if so throw an exception
-					if([[self delegate] shouldStop]) {
-						@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-					}
-					
-					// Update UI
-					percentComplete		= ((double)(totalSectors - sectorsToRead)/(double) totalSectors) * 100.0;
-					interval			= -1.0 * [phaseStartTime timeIntervalSinceNow];
-					secondsRemaining	= interval / ((double)(totalSectors - sectorsToRead)/(double) totalSectors) - interval;
-					
-					[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-				}
+				[_status setCompletedUnits:(totalSectors - sectorsToRead)];
 				
-				++iterations;				
+				// Check if we should stop, and if so throw an exception
+				if([_status shouldStop]) {
+					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+				}
 			}
-		}
-		
-		// Main loop
-		for(;;) {
-			
-			// ===============
-			// COMPARISON LOOP
-			// ===============
-			// Iterate over each sector, checking each for the required number of matches
-			
-			// Update UI based on the current ripping phase only- too hard to predict otherwise
-			totalSectors	= [range length];
-			sectorsToRead	= [sectorStatus countOfZeroes];
-			phaseStartTime	= [NSDate date];
 			
-			[[self delegate] setPhase:NSLocalizedStringFromTable(@"Verifying", @"General", @"")];
-			[self logMessage:NSLocalizedStringFromTable(@"Verifying rip integrity", @"Log", @"")];
+			[reader release];
+			reader = nil;
 			
-			for(sector = [range firstSector]; sector <= [range lastSector]; ++sector) {
-				
-				// Initial conditions
-				matchCount		= 0;
-				sectorIndex		= [range indexForSector:sector];
-				
-				// If this sector has already been matched, skip it
-				if([sectorStatus valueAtIndex:sectorIndex]) {
-					continue;
-				}
-
-				// Use each rip as a "master", comparing the hash for the sector in question
-				// to every other rip we've generated that contains the sector
-				for(masterIndex = 0; masterIndex < [rips count] && NO == [sectorStatus valueAtIndex:sectorIndex]; ++masterIndex) {
-					
-					master = [rips objectAtIndex:masterIndex];
-					
-					// Skip this rip if it doesn't contain the sector of interest
-					if(NO == [master containsSector:sector]) {
-						continue;
-					}
-					
-					// Skip this rip if a C2 error was detected for the sector of interest
-					if([self useC2] && [master sectorHasError:sector]) {
-						continue;
-					}
-
-					// Determine whether to compare based on SHA-256 hash or the sector's data
-					if([self useHashes]) {
-						masterHash = [master hashForSector:sector];
-					}
-					else {
-						[master getBytes:sectorBuffer forSector:sector];
-					}
-					
-					for(comparatorIndex = 0; comparatorIndex < [rips count] && NO == [sectorStatus valueAtIndex:sectorIndex]; ++comparatorIndex) {
-												
-						comparator = [rips objectAtIndex:comparatorIndex];
-						
-						// Skip this rip if it doesn't contain the sector of interest
-						if(NO == [comparator containsSector:sector]) {
-							continue;
-						}
-						
-						// Skip this rip if a C2 error was detected for the sector of interest
-						if([self useC2] && [comparator sectorHasError:sector]) {
-							continue;
-						}
-						
-						// Determine if the two sectors are equal
-						gotMatch = NO;
-						if([self useHashes]) {
-							gotMatch = [comparator sector:sector hasHash:masterHash];
-						}
-						else {
-							gotMatch = [comparator sector:sector matchesSector:sectorBuffer];
-						}
-						
-						// If the sectors are equal (hashes or raw bytes), increment the match count
-						// (don't compare to ourselves but ensure a match)
-						if(masterIndex == comparatorIndex || gotMatch) {
-							++matchCount;
-							
-							//NSLog(@"Sector %i matches in rips %02i and %02i (%i)", sector, masterIndex, comparatorIndex, matchCount);
-							
-							// We've found the required number of matches- save this sector
-							if([self requiredMatches] == matchCount) {
-								
-								// We only need to grab the sector's raw bytes if are comparing by hash
-								if([self useHashes]) {
-									[master getBytes:sectorBuffer forSector:sector];
-								}
-								
-								[masterRip setBytes:sectorBuffer forSector:sector];
-								[sectorStatus setValue:YES forIndex:sectorIndex];
-							}
-						}
-					}
-				}
-				
-				// Distributed Object calls are expensive, so only perform them every few iterations
-				if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-					
-					// Check if we should stop, and if so throw an exception
-					if([[self delegate] shouldStop]) {
-						@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-					}
-					
-					// Update UI
-					 percentComplete	= ((double)(totalSectors - sectorsToRead)/(double) totalSectors) * 100.0;
-					 interval			= -1.0 * [phaseStartTime timeIntervalSinceNow];
-					 secondsRemaining	= interval / ((double)(totalSectors - sectorsToRead)/(double) totalSectors) - interval;
-					 
-					 [[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
+			// Skip the remaining passes if the first one matches AccurateRip; the checksums cover
+			// the audio shifted by the drive's offset, so the few sectors at the ends of the range they
+			// don't vouch for are left to the re-rips below
+			if(0 == i && nil != checksum && [self verifyChecksum:checksum]) {
+				if(nil != [checksum checkedSectorRange]) {
+					[self acceptSectorRange:[checksum checkedSectorRange] ofRip:rip consensus:consensus masterRip:masterRip sectorStatus:sectorStatus];
 				}
-				
-				++iterations;				
-				--sectorsToRead;				
+				break;
 			}
+		}
+		
+		// The initial passes leave the head at the end of the range
+		headSector	= [range lastSector];
+		planner		= [[[ReRipPlanner alloc] initWithSectorRange:range seekCost:RERIP_SEEK_COST cacheSectors:[_drive cacheSectorSize]] autorelease];
+		
+		// Main loop
+		for(;;) {
 			
 			// =====================
 			// TERMINATION CONDITION
 			// =====================
-			if([sectorStatus allOnes]) {
+			if([consensus allSectorsAccepted]) {
 				break;
 			}
 			else {
 				++retries;
 
-				// Slow drive down if we've had too many errors (too many is defined arbitrarily here as more retries
-				// than the number of sector matches required)
-				if([self requiredMatches] < retries) {
-					[_drive setSpeed:kCDSpeedMin];
-					[self logMessage:NSLocalizedStringFromTable(@"Setting drive speed to minimum", @"Log", @"")];
-				}
-				
 				// Abort rip if too many read errors have occurred
 				if([self maximumRetries] < retries) {
 					[self logMessage:NSLocalizedStringFromTable(@"Retry limit exceeded", @"Log", @"")];
@@ -534,48 +456,40 @@
 			// ===============
 			// For all sectors that don't have the required number of matches, generate a new rip
 
-			// Update UI based on the current ripping phase only- too hard to predict otherwise
-			totalSectors	= [sectorStatus countOfZeroes];
-			sectorsToRead	= [sectorStatus countOfZeroes];
-			phaseStartTime	= [NSDate date];
+			// Plan all the re-rips at once, so nearby runs share reads and cache clears
+			[planner planForSectorStatus:sectorStatus padding:([self requiredMatches] < retries ? 10 * retries : 0) headAtSector:headSector];
 			
-			[[self delegate] setPhase:NSLocalizedStringFromTable(@"Re-ripping", @"General", @"")];
-
-			for(i = 0; i < [range length]; ++i) {
-				
-				// If this sector has already been matched, skip it
-				if([sectorStatus valueAtIndex:i]) {
-					continue;
-				}
-				
-				// Determine if there are multiple mismatched sectors in a row, and if so, how many
-				blockEnd = i;
-				while(NO == [sectorStatus valueAtIndex:blockEnd + 1] && blockEnd + 1 < [range length]) {
-					++blockEnd;
-				}
-				
-				// Log this message here, instead of in the comparison loop, to avoid repetitive messages
-				if(blockEnd == i) {
-					[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Mismatch for sector %lu", @"Log", @""), (unsigned long)[range sectorForIndex:i]]];
+			// Log this message here, instead of in the comparison loop, to avoid repetitive messages
+			for(j = 0; j < [[planner unverifiedRuns] count]; ++j) {
+				blockRange = [[planner unverifiedRuns] objectAtIndex:j];
+				if(1 == [blockRange length]) {
+					[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Mismatch for sector %lu", @"Log", @""), (unsigned long)[blockRange firstSector]]];
 				}
 				else {
-					[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Mismatches for sectors %lu - %lu", @"Log", @""), (unsigned long)[range sectorForIndex:i], (unsigned long)[range sectorForIndex:blockEnd]]];
+					[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Mismatches for sectors %lu - %lu", @"Log", @""), (unsigned long)[blockRange firstSector], (unsigned long)[blockRange lastSector]]];
 				}
+			}
+			
+			[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Re-ripping %lu sectors in %lu reads with %lu cache clears and %lu seeks (unplanned: %lu sectors in %lu reads with %lu seeks)", @"Log", @""),
+				(unsigned long)[planner sectorCount], (unsigned long)[planner countOfReads], (unsigned long)[planner cacheClearCount], (unsigned long)[planner seekCount],
+				(unsigned long)[planner unplannedSectorCount], (unsigned long)[planner unplannedReadCount], (unsigned long)[planner unplannedSeekCount]]];
+			
+			// Update UI based on the current ripping phase only- too hard to predict otherwise
+			totalSectors	= [planner sectorCount];
+			sectorsToRead	= [planner sectorCount];
+			
+			[_status beginPhase:kTaskPhaseReRipping totalUnits:totalSectors];
+
+			for(i = 0; i < [planner countOfReads]; ++i) {
 				
-				// Adjust boundaries so drive is up to speed when it reaches the problem area if
-				// too many errors have occurred
+				// Padding brings the drive up to speed before it reaches the problem area if too many errors have occurred
 				// (I assume that a larger read will give better/more consistent results- may not be a correct assumption)
-				if([self requiredMatches] < retries) {
-					blockPadding	= 10 * retries;
-					i				= (i > blockPadding ? i - blockPadding : 0); 
-					blockEnd		= (blockEnd + blockPadding < [range length] ? blockEnd + blockPadding : [range length] - 1); 
-				}
+				blockRange = [planner readAtIndex:i];
 				
-				// Now just re-rip the block
-				blockRange = [SectorRange sectorRangeWithFirstSector:[range sectorForIndex:i] lastSector:[range sectorForIndex:blockEnd]];
-
-				// Clear the drive's cache
-				[_drive clearCache:blockRange];
+				// Clear the drive's cache, once for all the reads it could affect
+				if(nil != [planner cacheClearRangeBeforeReadAtIndex:i]) {
+					[_drive clearCache:[planner cacheClearRangeBeforeReadAtIndex:i]];
+				}
 				
 				// Allocate the rip object
 				rip = [[Rip alloc] initWithSectorRange:blockRange];
@@ -583,93 +497,62 @@
 				// Associate it with the temporary file
 				[rip setFilename:[self createTemporaryFile]];
 				
-				// Don't calculate SHA-256 hashes unnecessarily
+				// Don't calculate hashes unnecessarily
 				[rip setCalculateHashes:[self useHashes]];
+				[rip setHashAlgorithm:[self hashAlgorithm]];
 
 				// Place it in our array of objects
 				[rips addObject:[rip autorelease]];
 				
-				// Extract the audio
-				sectorsRemaining	= [blockRange length];
+				// Extract the audio; the next chunk is read from the disc while this one is processed
+				reader = [[DriveReader alloc] initWithDrive:_drive sectorRange:blockRange sectorsPerRead:bufferLen controller:_readController];
+				[reader start];
 
-				while(0 < sectorsRemaining) {
+				while(NULL != (chunk = [reader nextChunk:&readRange sectorsRead:&sectorsRead])) {
 					
-					// Set up the parameters for this read
-					startSector		= [blockRange firstSector] + [blockRange length] - sectorsRemaining;
-					sectorCount		= sectorsRemaining > bufferLen ? bufferLen : sectorsRemaining;
-					readRange		= [SectorRange sectorRangeWithFirstSector:startSector sectorCount:sectorCount];
-					
-					// Extract the audio from the disc
 					if(1 == [readRange length]) {
 						[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Re-ripping sector %lu", @"Log", @""), (unsigned long)[readRange firstSector]]];
 					}
 					else {
 						[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Re-ripping sectors %lu - %lu", @"Log", @""), (unsigned long)[readRange firstSector], (unsigned long)[readRange lastSector]]];
 					}
-					sectorsRead		= [_drive readAudioAndErrorFlags:buffer sectorRange:readRange];
 					
-					NSAssert(sectorCount == sectorsRead, NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Log", @""));
+					NSAssert([readRange length] == sectorsRead, NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Log", @""));
 					
-					// Copy audio and (optionally) C2 data to their respective buffers
+					// Copy audio to its buffer
 					for(j = 0; j < sectorsRead; ++j) {
-						sectorAlias = buffer + (j * (kCDSectorSizeCDDA + kCDSectorSizeErrorFlags));
+						sectorAlias = chunk + (j * (kCDSectorSizeCDDA + kCDSectorSizeErrorFlags));
 						memcpy(audioBuffer + (j * kCDSectorSizeCDDA), sectorAlias, kCDSectorSizeCDDA);
 						
-						if([self useC2]) {
-							memcpy(c2Buffer + (j * kCDSectorSizeErrorFlags), sectorAlias + kCDSectorSizeCDDA, kCDSectorSizeErrorFlags);
-						}
-						
 						//memcpy(q + (j * kCDSectorSizeQSubchannel), sectorAlias + kCDSectorSizeCDDA + kCDSectorSizeErrorFlags, kCDSectorSizeQSubchannel);
 					}
 					
-					// Check for C2 errors
-					if([self useC2]) {
-						for(j = 0; j < kCDSectorSizeErrorFlags * sectorsRead; ++j) {
-							if(c2Buffer[j]) {
-								for(k = 0; k < 8; ++k) {
-									if((1 << k) & c2Buffer[j]) {
-										[self logMessage:[NSString stringWithFormat:@"C2 error for sector %lu", [readRange firstSector] + (8 * j) + k]];
-									}
-								}					
-							}
-						}
-					}
-					
 					// Place the data in the Rip object
 					[rip setBytes:audioBuffer forSectorRange:readRange];
 					
 					// Store C2 errors
 					if([self useC2]) {
-						[rip setErrorFlags:c2Buffer forSectorRange:readRange];
+						[self setC2ErrorsForSectorRange:readRange ofRip:rip fromChunk:chunk errorBuffer:c2Buffer];
 					}
+
+					// Verify the new readings
+					[self tallySectorRange:readRange ofRip:rip consensus:consensus masterRip:masterRip sectorStatus:sectorStatus];
 					
 					// Housekeeping
-					sectorsRemaining -= [readRange length];
+					sectorsToRead		-= [readRange length];
 					
-					// This loop is sufficiently slow that if the delegate is only polled every MAX_DO_POLL_FREQUENCY
-					// iterations the user will think the program is unresponsive
-					// Distributed Object calls are expensive, so only perform them every few iterations
-					if(0 == iterations % 2/*MAX_DO_POLL_FREQUENCY*/) {
-						
-						// Check if we should stop, and if so throw an exception
-						if([[self delegate] shouldStop]) {
-							@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-						}
-						
-						// Update UI
-						percentComplete		= ((double)(totalSectors - sectorsToRead)/(double) totalSectors) * 100.0;
-						interval			= -1.0 * [phaseStartTime timeIntervalSinceNow];
-						secondsRemaining	= interval / ((double)(totalSectors - sectorsToRead)/(double) totalSectors) - interval;
-
-						[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-					}
+					[_status setCompletedUnits:(totalSectors - sectorsToRead)];
 					
-					++iterations;
-					sectorsToRead -= [readRange length];
+					// Check if we should stop, and if so throw an exception
+					if([_status shouldStop]) {
+						@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+					}
 				}
 				
-				// Adjust loop index
-				i = blockEnd;
+				[reader release];
+				reader = nil;
+				
+				headSector = [blockRange lastSector];
 			}
 									
 		}
@@ -678,15 +561,17 @@
 		// SAVE OUTPUT
 		// ===========
 		// Just place each chunk from the master rip into the CAF file
+		// When streaming, every sector has already gone to the encoders
 
-		sectorsRemaining	= [range length];
+		sectorsRemaining	= (NULL != file ? [range length] : 0);
 		
 		// Update UI based on the current ripping phase only- too hard to predict otherwise
 		totalSectors		= [range length];
-		phaseStartTime		= [NSDate date];
 		
-		[[self delegate] setPhase:NSLocalizedStringFromTable(@"Saving", @"General", @"")];
-		[self logMessage:NSLocalizedStringFromTable(@"Generating output", @"Log", @"")];
+		if(NULL != file) {
+			[_status beginPhase:kTaskPhaseSaving totalUnits:totalSectors];
+			[self logMessage:NSLocalizedStringFromTable(@"Generating output", @"Log", @"")];
+		}
 		
 		while(0 < sectorsRemaining) {
 			
@@ -695,11 +580,8 @@
 			sectorCount		= sectorsRemaining > bufferLen ? bufferLen : sectorsRemaining;
 			readRange		= [SectorRange sectorRangeWithFirstSector:startSector sectorCount:sectorCount];
 			
-			// Grab the master rip's data
-			[masterRip getBytes:buffer forSectorRange:readRange];
-			
-			// Convert to big endian byte ordering 
-			swab(buffer, buffer, [readRange byteSize]);
+			// Grab the master rip's data, converting to big endian byte ordering
+			swab([masterRip bytesForSectorRange:readRange], buffer, [readRange byteSize]);
 			
 			// Put the data in an AudioBufferList
 			bufferList.mNumberBuffers					= 1;
@@ -716,23 +598,12 @@
 			// Housekeeping
 			sectorsRemaining -= [readRange length];
 
-			// Distributed Object calls are expensive, so only perform them every few iterations
-			if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-				
-				// Check if we should stop, and if so throw an exception
-				if([[self delegate] shouldStop]) {
-					@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-				}
-				
-				// Update UI
-				 percentComplete	= ((double)(totalSectors - sectorsRemaining)/(double) totalSectors) * 100.0;
-				 interval			= -1.0 * [phaseStartTime timeIntervalSinceNow];
-				 secondsRemaining	= interval / ((double)(totalSectors - sectorsRemaining)/(double) totalSectors) - interval;
-				 
-				 [[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-			}
+			[_status setCompletedUnits:(totalSectors - sectorsRemaining)];
 			
-			++iterations;
+			// Check if we should stop, and if so throw an exception
+			if([_status shouldStop]) {
+				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+			}
 		}
 		
 	}
@@ -741,6 +612,13 @@
 		struct stat			sourceStat;
 		NSException			*exception;
 
+		// Stop reading ahead if the rip was interrupted
+		[reader stop];
+		[reader release];
+		
+		[_readController release];
+		_readController = nil;
+		
 		free(buffer);
 		free(audioBuffer);
 		free(c2Buffer);
@@ -767,6 +645,143 @@
 	}
 }
 
+- (void) tallySectorRange:(SectorRange *)range ofRip:(Rip *)rip consensus:(SectorConsensus *)consensus masterRip:(Rip *)masterRip sectorStatus:(BitArray *)sectorStatus
+{
+	NSUInteger		sector;
+	NSUInteger		readingCount;
+	
+	[_readController recordReadOfSectorRange:range];
+	
+	for(sector = [range firstSector]; sector <= [range lastSector]; ++sector) {
+		
+		// Readings with C2 errors don't get a vote
+		if([self useC2] && [rip sectorHasError:sector]) {
+			[_readController recordErrorForSector:sector];
+			continue;
+		}
+		
+		readingCount = [consensus readingCountForSector:sector];
+		
+		// Save the sector as soon as enough readings agree
+		if([consensus addReading:[rip bytesForSector:sector] hash:([self useHashes] ? [rip hashForSector:sector] : NULL) forSector:sector]) {
+			[masterRip setBytes:[consensus acceptedBytesForSector:sector] forSector:sector];
+			[_stream setBytes:[consensus acceptedBytesForSector:sector] forSector:sector];
+			[sectorStatus setValue:YES forIndex:(sector - [masterRip firstSector])];
+		}
+		// A reading unlike any before it means the drive is struggling here
+		else if(0 < readingCount && readingCount < [consensus readingCountForSector:sector]) {
+			[_readController recordMismatchForSector:sector];
+		}
+	}
+}
+
+- (void) acceptSectorRange:(SectorRange *)range ofRip:(Rip *)rip consensus:(SectorConsensus *)consensus masterRip:(Rip *)masterRip sectorStatus:(BitArray *)sectorStatus
+{
+	NSUInteger		sector;
+	
+	for(sector = [range firstSector]; sector <= [range lastSector]; ++sector) {
+		if([consensus acceptReading:[rip bytesForSector:sector] forSector:sector]) {
+			[masterRip setBytes:[rip bytesForSector:sector] forSector:sector];
+			[_stream setBytes:[rip bytesForSector:sector] forSector:sector];
+			[sectorStatus setValue:YES forIndex:(sector - [masterRip firstSector])];
+		}
+	}
+}
+
+- (BOOL) verifyChecksum:(AccurateRipChecksum *)checksum
+{
+	SectorRange				*range			= [checksum sectorRange];
+	SectorRange				*required		= [checksum requiredSectorRange];
+	AccurateRipDatabase		*database		= nil;
+	int8_t					*buffer			= NULL;
+	NSUInteger				sector;
+	NSUInteger				sectorsRead;
+	NSUInteger				track;
+	NSUInteger				confidence;
+	NSUInteger				i;
+	BOOL					verified		= YES;
+	
+	if(NO == [checksum coversSectorRange]) {
+		return NO;
+	}
+	
+	database = [AccurateRipDatabase databaseForDrive:_drive baseURL:[self accurateRipURL]];
+	if(NO == [database discFound]) {
+		[self logMessage:NSLocalizedStringFromTable(@"The disc is not in the AccurateRip database", @"Log", @"")];
+		return NO;
+	}
+	
+	// With the offset applied a few frames come from the neighbouring sectors
+	@try {
+		buffer = malloc(kCDSectorSizeCDDA);
+		NSAssert(NULL != buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		for(sector = [required firstSector]; sector <= [required lastSector]; ++sector) {
+			if([range containsSector:sector]) {
+				continue;
+			}
+			
+			sectorsRead = [_drive readAudio:buffer sector:sector];
+			NSAssert(1 == sectorsRead, NSLocalizedStringFromTable(@"Unable to read from the disc.", @"Log", @""));
+			[checksum addSector:sector bytes:buffer];
+		}
+	}
+	
+	@catch(NSException *exception) {
+		[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Unable to calculate the AccurateRip checksums: %@", @"Log", @""), [exception reason]]];
+		return NO;
+	}
+	
+	@finally {
+		free(buffer);
+	}
+	
+	for(i = 0; i < [checksum countOfTracks]; ++i) {
+		track		= [checksum trackNumberAtIndex:i];
+		confidence	= MAX([database confidenceForTrack:track checksum:[checksum checksumV1AtIndex:i]], [database confidenceForTrack:track checksum:[checksum checksumV2AtIndex:i]]);
+		
+		if(0 < confidence && [self minimumAccurateRipConfidence] <= confidence) {
+			[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Track %lu accurately ripped (confidence %lu)", @"Log", @""), (unsigned long)track, (unsigned long)confidence]];
+		}
+		else {
+			[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Track %lu does not match the AccurateRip database", @"Log", @""), (unsigned long)track]];
+			verified = NO;
+		}
+	}
+	
+	return verified;
+}
+
+- (void) setC2ErrorsForSectorRange:(SectorRange *)range ofRip:(Rip *)rip fromChunk:(const int8_t *)chunk errorBuffer:(uint32_t *)errors
+{
+	NSUInteger		i, runEnd;
+	
+	if(0 == C2ErrorScan((const uint8_t *)chunk + kCDSectorSizeCDDA, kCDSectorSizeCDDA + kCDSectorSizeErrorFlags, kCDSectorSizeErrorFlags, [range length], errors)) {
+		return;
+	}
+	
+	[rip setErrorFlags:errors forSectorRange:range];
+	
+	// A damaged area is logged once, not once per flagged bit
+	for(i = 0; i < [range length]; i = runEnd + 1) {
+		runEnd = i;
+		if(0 == (errors[i / 32] & (1U << (i % 32)))) {
+			continue;
+		}
+		
+		while(runEnd + 1 < [range length] && (errors[(runEnd + 1) / 32] & (1U << ((runEnd + 1) % 32)))) {
+			++runEnd;
+		}
+		
+		if(runEnd == i) {
+			[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"C2 error for sector %lu", @"Log", @""), (unsigned long)[range sectorForIndex:i]]];
+		}
+		else {
+			[self logMessage:[NSString stringWithFormat:NSLocalizedStringFromTable(@"C2 errors for sectors %lu - %lu", @"Log", @""), (unsigned long)[range sectorForIndex:i], (unsigned long)[range sectorForIndex:runEnd]]];
+		}
+	}
+}
+
 - (NSString *) createTemporaryFile
 {
 	int					fd				= -1;
@@ -170,7 +170,7 @@ callback(long inpos, int function, void *userdata)
 		_startTime = [NSDate date];
 		[[self delegate] setStartTime:_startTime];
 		[[self delegate] setStarted:YES];
-		[[self delegate] setPhase:NSLocalizedStringFromTable(@"Ripping", @"General", @"")];
+		[_status beginPhase:kTaskPhaseRipping totalUnits:[_grandTotalSectors unsignedLongValue]];
 
 		// Setup output file type (same)
 		bzero(&outputASBD, sizeof(AudioStreamBasicDescription));
@@ -243,13 +243,9 @@ callback(long inpos, int function, void *userdata)
 	unsigned long		grandTotalSectors	= [_grandTotalSectors unsignedLongValue];
 	unsigned long		sectorsToRead		= grandTotalSectors - [_sectorsRead unsignedLongValue];
 	long				where;
-	unsigned long		iterations			= 0;
 	OSStatus			err;
 	AudioBufferList		bufferList;
 	UInt32				frameCount;
-	double				percentComplete;
-	NSTimeInterval		interval;
-	unsigned			secondsRemaining;
 	
 	// Go to the range's first sector in preparation for reading
 	where = paranoia_seek(_paranoia, cursor, SEEK_SET);   	    
@@ -282,23 +278,12 @@ callback(long inpos, int function, void *userdata)
 		// Update status
 		sectorsToRead--;
 		
-		// Distributed Object calls are expensive, so only perform them every few iterations
-		if(0 == iterations % MAX_DO_POLL_FREQUENCY) {
-			
-			// Check if we should stop, and if so throw an exception
-			if([[self delegate] shouldStop]) {
-				@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
-			}
-			
-			// Update UI
-			percentComplete		= ((double)(grandTotalSectors - sectorsToRead)/(double) grandTotalSectors) * 100.0;
-			interval			= -1.0 * [_startTime timeIntervalSinceNow];
-			secondsRemaining	= interval / ((double)(grandTotalSectors - sectorsToRead)/(double) grandTotalSectors) - interval;
-			
-			[[self delegate] updateProgress:percentComplete secondsRemaining:secondsRemaining];
-		}
+		[_status setCompletedUnits:(grandTotalSectors - sectorsToRead)];
 		
-		++iterations;
+		// Check if we should stop, and if so throw an exception
+		if([_status shouldStop]) {
+			@throw [StopException exceptionWithReason:@"Stop requested by user" userInfo:nil];
+		}
 
 		// Advance cursor
 		++cursor;
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#import "SectorRange.h"
+#import "BitArray.h"
+
+// Plans the reads for one re-ripping pass over the unverified sectors of a range:
+//   - Each run of unverified sectors is padded, and runs separated by less than the cost of a
+//     seek are merged so the gap between them is read through
+//   - The reads sweep the range in one direction, starting from the end nearest the head
+//   - A cache clear is only planned where an earlier read since the last one may have left
+//     some of the sectors in the drive's cache, so one clear covers several reads
+//   - The plan is costed against reading each run separately after its own cache clear,
+//     as the ripper used to, so the two can be compared in the log
+@interface ReRipPlanner : NSObject
+{
+	SectorRange			*_sectorRange;
+	NSUInteger			_seekCost;			// In sectors
+	NSUInteger			_cacheSectors;		// How far past a read the drive may cache
+
+	NSMutableArray		*_unverifiedRuns;
+	NSMutableArray		*_reads;
+	NSMutableArray		*_cacheClearRanges;	// For each read, what a clear before it covers, or NSNull
+
+	NSUInteger			_seekCount;
+	NSUInteger			_sectorCount;
+	NSUInteger			_cacheClearCount;
+	NSUInteger			_unplannedReadCount;
+	NSUInteger			_unplannedSeekCount;
+	NSUInteger			_unplannedSectorCount;
+}
+
+- (instancetype)	initWithSectorRange:(SectorRange *)range seekCost:(NSUInteger)seekCost cacheSectors:(NSUInteger)cacheSectors;
+
+- (SectorRange *)	sectorRange;
+- (NSUInteger)		seekCost;
+- (NSUInteger)		cacheSectors;
+
+// sectorStatus has one bit per sector of the range, set for the verified sectors
+- (void)			planForSectorStatus:(BitArray *)sectorStatus padding:(NSUInteger)padding headAtSector:(NSUInteger)headSector;
+
+// The unverified sectors, in ascending order
+- (NSArray *)		unverifiedRuns;
+
+// The reads in the order they should be made
+- (NSUInteger)		countOfReads;
+- (SectorRange *)	readAtIndex:(NSUInteger)index;
+
+// The sectors a cache clear before the read must avoid, or nil if no clear is needed
+- (SectorRange *)	cacheClearRangeBeforeReadAtIndex:(NSUInteger)index;
+
+// The cost of the plan; a cache clear counts as one seek, but the sectors it reads are not counted
+- (NSUInteger)		seekCount;
+- (NSUInteger)		sectorCount;
+- (NSUInteger)		cacheClearCount;
+
+// The cost of reading each padded run separately, in order, after clearing the cache
+- (NSUInteger)		unplannedReadCount;
+- (NSUInteger)		unplannedSeekCount;
+- (NSUInteger)		unplannedSectorCount;
+
+@end
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ReRipPlanner.h"
+
+@interface ReRipPlanner (Private)
+- (void)			costUnplannedReadsForSectorStatus:(BitArray *)sectorStatus padding:(NSUInteger)padding headAtSector:(NSUInteger)headSector;
+- (void)			planCacheClears;
+- (void)			costReadsWithHeadAtSector:(NSUInteger)headSector;
+@end
+
+@implementation ReRipPlanner
+
+- (id) initWithSectorRange:(SectorRange *)range seekCost:(NSUInteger)seekCost cacheSectors:(NSUInteger)cacheSectors
+{
+	NSParameterAssert(nil != range);
+	
+	if((self = [super init])) {
+		_sectorRange		= [range retain];
+		_seekCost			= seekCost;
+		_cacheSectors		= cacheSectors;
+		
+		_unverifiedRuns		= [[NSMutableArray alloc] init];
+		_reads				= [[NSMutableArray alloc] init];
+		_cacheClearRanges	= [[NSMutableArray alloc] init];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[_sectorRange release];			_sectorRange = nil;
+	[_unverifiedRuns release];		_unverifiedRuns = nil;
+	[_reads release];				_reads = nil;
+	[_cacheClearRanges release];	_cacheClearRanges = nil;
+	
+	[super dealloc];
+}
+
+- (SectorRange *)	sectorRange								{ return [[_sectorRange retain] autorelease]; }
+- (NSUInteger)		seekCost								{ return _seekCost; }
+- (NSUInteger)		cacheSectors							{ return _cacheSectors; }
+
+- (void) planForSectorStatus:(BitArray *)sectorStatus padding:(NSUInteger)padding headAtSector:(NSUInteger)headSector
+{
+	NSUInteger		length		= [_sectorRange length];
+	NSUInteger		i, runEnd;
+	NSUInteger		first, last;
+	SectorRange		*read		= nil;
+	NSArray			*reversed	= nil;
+	
+	NSParameterAssert(nil != sectorStatus);
+	NSParameterAssert([sectorStatus bitCount] == length);
+	
+	[_unverifiedRuns removeAllObjects];
+	[_reads removeAllObjects];
+	[_cacheClearRanges removeAllObjects];
+	
+	for(i = [sectorStatus nextZeroFromIndex:0]; NSNotFound != i; i = [sectorStatus nextZeroFromIndex:runEnd + 1]) {
+		runEnd = [sectorStatus nextOneFromIndex:i];
+		runEnd = (NSNotFound == runEnd ? length - 1 : runEnd - 1);
+		
+		[_unverifiedRuns addObject:[SectorRange sectorRangeWithFirstSector:[_sectorRange sectorForIndex:i] lastSector:[_sectorRange sectorForIndex:runEnd]]];
+		
+		// Read through the gap to the previous run if that is cheaper than seeking over it
+		first	= [_sectorRange sectorForIndex:(i > padding ? i - padding : 0)];
+		last	= [_sectorRange sectorForIndex:MIN(runEnd + padding, length - 1)];
+		
+		if(nil != read && first <= [read lastSector] + 1 + _seekCost) {
+			[read setLastSector:MAX(last, [read lastSector])];
+		}
+		else {
+			read = [SectorRange sectorRangeWithFirstSector:first lastSector:last];
+			[_reads addObject:read];
+		}
+	}
+	
+	// Sweep away from whichever end of the plan is closer to the head
+	if(1 < [_reads count] && ([[_reads lastObject] lastSector] > headSector ? [[_reads lastObject] lastSector] - headSector : headSector - [[_reads lastObject] lastSector])
+	   < ([[_reads objectAtIndex:0] firstSector] > headSector ? [[_reads objectAtIndex:0] firstSector] - headSector : headSector - [[_reads objectAtIndex:0] firstSector])) {
+		reversed = [[_reads reverseObjectEnumerator] allObjects];
+		[_reads setArray:reversed];
+	}
+	
+	[self planCacheClears];
+	[self costReadsWithHeadAtSector:headSector];
+	[self costUnplannedReadsForSectorStatus:sectorStatus padding:padding headAtSector:headSector];
+}
+
+- (NSArray *)		unverifiedRuns							{ return [[_unverifiedRuns retain] autorelease]; }
+
+- (NSUInteger)		countOfReads							{ return [_reads count]; }
+- (SectorRange *)	readAtIndex:(NSUInteger)index			{ return [_reads objectAtIndex:index]; }
+
+- (SectorRange *) cacheClearRangeBeforeReadAtIndex:(NSUInteger)index
+{
+	id range = [_cacheClearRanges objectAtIndex:index];
+	return ([NSNull null] == range ? nil : range);
+}
+
+- (NSUInteger)		seekCount								{ return _seekCount; }
+- (NSUInteger)		sectorCount								{ return _sectorCount; }
+- (NSUInteger)		cacheClearCount							{ return _cacheClearCount; }
+
+- (NSUInteger)		unplannedReadCount						{ return _unplannedReadCount; }
+- (NSUInteger)		unplannedSeekCount						{ return _unplannedSeekCount; }
+- (NSUInteger)		unplannedSectorCount					{ return _unplannedSectorCount; }
+
+@end
+
+@implementation ReRipPlanner (Private)
+
+- (void) costUnplannedReadsForSectorStatus:(BitArray *)sectorStatus padding:(NSUInteger)padding headAtSector:(NSUInteger)headSector
+{
+	NSUInteger		length		= [_sectorRange length];
+	NSUInteger		i, blockEnd;
+	
+	_unplannedReadCount		= 0;
+	_unplannedSeekCount		= 0;
+	_unplannedSectorCount	= 0;
+	
+	// Each run is padded and read in turn after its own cache clear, so every read needs two seeks
+	for(i = [sectorStatus nextZeroFromIndex:0]; NSNotFound != i; i = [sectorStatus nextZeroFromIndex:blockEnd + 1]) {
+		blockEnd	= [sectorStatus nextOneFromIndex:i];
+		blockEnd	= (NSNotFound == blockEnd ? length - 1 : blockEnd - 1);
+		
+		i			= (i > padding ? i - padding : 0);
+		blockEnd	= MIN(blockEnd + padding, length - 1);
+		
+		++_unplannedReadCount;
+		_unplannedSeekCount		+= 2;
+		_unplannedSectorCount	+= blockEnd - i + 1;
+	}
+}
+
+- (void) planCacheClears
+{
+	NSUInteger		batchStart		= 0;
+	NSUInteger		i, j;
+	SectorRange		*read;
+	SectorRange		*earlier;
+	SectorRange		*batch			= nil;
+	BOOL			mayBeCached;
+	
+	_cacheClearCount = 0;
+	
+	for(i = 0; i < [_reads count]; ++i) {
+		read = [_reads objectAtIndex:i];
+		
+		// The drive may hold anything read since the last clear, and whatever it read ahead after that
+		mayBeCached = (0 == i);
+		for(j = batchStart; j < i && NO == mayBeCached; ++j) {
+			earlier		= [_reads objectAtIndex:j];
+			mayBeCached	= ([read firstSector] <= [earlier lastSector] + _cacheSectors && [earlier firstSector] <= [read lastSector]);
+		}
+		
+		if(mayBeCached) {
+			batchStart	= i;
+			batch		= [SectorRange sectorRangeWithFirstSector:[read firstSector] lastSector:[read lastSector]];
+			[_cacheClearRanges addObject:batch];
+			++_cacheClearCount;
+		}
+		else {
+			[_cacheClearRanges addObject:[NSNull null]];
+			
+			// The sectors read to clear the cache must stay clear of the whole batch
+			[batch setFirstSector:MIN([batch firstSector], [read firstSector])];
+			[batch setLastSector:MAX([batch lastSector], [read lastSector])];
+		}
+	}
+}
+
+- (void) costReadsWithHeadAtSector:(NSUInteger)headSector
+{
+	NSUInteger		nextSector		= headSector + 1;
+	NSUInteger		i;
+	SectorRange		*read;
+	
+	_seekCount		= 0;
+	_sectorCount	= 0;
+	
+	for(i = 0; i < [_reads count]; ++i) {
+		read = [_reads objectAtIndex:i];
+		
+		// Clearing the cache moves the head to one end of the session
+		if(nil != [self cacheClearRangeBeforeReadAtIndex:i]) {
+			++_seekCount;
+			nextSector = NSNotFound;
+		}
+		
+		if([read firstSector] != nextSector) {
+			++_seekCount;
+		}
+		
+		_sectorCount	+= [read length];
+		nextSector		= [read lastSector] + 1;
+	}
+}
+
+@end
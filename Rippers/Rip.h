@@ -19,14 +19,19 @@
 #import <Cocoa/Cocoa.h>
 #import "SectorRange.h"
 #import "BitArray.h"
+#include "SectorHash.h"
 
 @interface Rip : NSObject
 {
 	NSString			*_filename;			// The file containing the ripped CD-DA data
 	SectorRange			*_sectorRange;		// The range of sectors contained in the file
 	BitArray			*_errors;			// C2 error flags for the ripped sectors
-	BOOL				_calculateHashes;	// Whether to calculate the SHA-256 for each sector
-	unsigned char		**_hashes;			// The SHA-256 for each sector in the file
+	BOOL				_calculateHashes;	// Whether to calculate a hash for each sector
+	SectorHashAlgorithm	_hashAlgorithm;		// The hash used to compare sectors
+	uint8_t				*_hashes;			// The hash for each sector in the file, stored contiguously
+	BitArray			*_hashed;			// Which sectors have a valid hash
+	uint8_t				*_mapping;			// The backing file mapped into memory
+	size_t				_mappingSize;		// The size of the mapping, in bytes
 }
 
 - (instancetype)		initWithSectorRange:(SectorRange *)range;
@@ -42,20 +47,29 @@
 
 // Access to the filename
 // Note: A Rip neither creates nor destroys the file it is associated with
+// The file is sized to hold every sector in the range and kept mapped until the filename changes
 - (NSString *)			filename;
 - (void)				setFilename:(NSString *)filename;
 
-// Specify if the SHA-256 should be calculated for each sector
+// Specify if a hash should be calculated for each sector
 - (BOOL)				calculateHashes;
 - (void)				setCalculateHashes:(BOOL)calculateHashes;
 
-// Access to the hashes for each sector
+// The hash algorithm; changing it discards any hashes already calculated
+- (SectorHashAlgorithm)	hashAlgorithm;
+- (void)				setHashAlgorithm:(SectorHashAlgorithm)hashAlgorithm;
+
+// Access to the hashes for each sector; NULL if the sector has not been hashed
 - (NSUInteger)			hashLength;
 - (unsigned char *)		hashForSector:(NSUInteger)sector;
 
 // Sector equality testing
 - (BOOL)				sector:(NSUInteger)sector hasHash:(unsigned char *)hash;
-- (BOOL)				sector:(NSUInteger)sector matchesSector:(void *)data;
+- (BOOL)				sector:(NSUInteger)sector matchesSector:(const void *)data;
+
+// Direct access to the mapped CD-DA data; valid for the lifetime of the Rip or until the filename changes
+- (const void *)		bytesForSector:(NSUInteger)sector;
+- (const void *)		bytesForSectorRange:(SectorRange *)range;
 
 // Access the CD-DA data for a specific sector range
 - (NSData *)			dataForSector:(NSUInteger)sector;
@@ -74,6 +88,7 @@
 - (BOOL)				sectorHasError:(NSUInteger)sector;
 
 - (void)				setErrorFlag:(BOOL)errorFlag forSector:(NSUInteger)sector;
+// errorFlags holds one bit per sector of range, in 32-bit words, as produced by C2ErrorScan()
 - (void)				setErrorFlags:(const void *)errorFlags forSectorRange:(SectorRange *)range;
 
 @end
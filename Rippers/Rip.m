@@ -19,13 +19,14 @@
 #import "Rip.h"
 
 #include <IOKit/storage/IOCDTypes.h>
-
-/* sha-256 a block of memory */
-void sha_memory(unsigned char *buf, int len, unsigned char *hash);
+#include <sys/mman.h>
 
 @interface Rip (Private)
 - (void)				setFirstSector:(NSUInteger)sector;
 - (void)				setLastSector:(NSUInteger)sector;
+
+- (void)				mapFile;
+- (void)				unmapFile;
 @end
 
 @implementation Rip
@@ -42,8 +43,6 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 
 - (id) initWithFirstSector:(NSUInteger)firstSector lastSector:(NSUInteger)lastSector
 {
-	NSUInteger i;
-	
 	if((self = [super init])) {
 		
 		_sectorRange	= [[SectorRange alloc] init];
@@ -52,19 +51,15 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 		[self setLastSector:lastSector];
 
 		_calculateHashes	= YES;
+		_hashAlgorithm		= kSectorHashAlgorithmSHA256;
+		_hashes				= NULL;
 		
-		_hashes			= (unsigned char **)calloc([self length], sizeof(unsigned char *));
-
-		if(NULL == _hashes) {
-			[self release];
-			return nil;
-		}
-		
-		for(i = 0; i < [self length]; ++i) {
-			_hashes[i] = NULL;
-		}
+		_hashed			= [[BitArray alloc] init];
+		[_hashed setBitCount:[self length]];
 		
 		_filename		= nil;
+		_mapping		= NULL;
+		_mappingSize	= 0;
 		
 		_errors			= [[BitArray alloc] init];
 		[_errors setBitCount:[self length]];
@@ -78,16 +73,13 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 
 - (void) dealloc
 {
-	NSUInteger i;
-	
+	[self unmapFile];
+
 	[_sectorRange release];			_sectorRange	= nil;
 	[_filename release];			_filename		= nil;
 	
-	for(i = 0; i < [self length]; ++i) {
-		free(_hashes[i]);
-	}
-	
 	free(_hashes);					_hashes = NULL;
+	[_hashed release];				_hashed = nil;
 	
 	[_errors release];				_errors = nil;
 	
@@ -109,7 +101,18 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 #pragma mark -
 
 - (NSString *)		filename									{ return _filename; }
-- (void)			setFilename:(NSString *)filename			{ [_filename release]; _filename = [filename retain]; }
+
+- (void) setFilename:(NSString *)filename
+{
+	[self unmapFile];
+
+	[_filename release];
+	_filename = [filename retain];
+	
+	if(nil != _filename) {
+		[self mapFile];
+	}
+}
 
 #pragma mark -
 
@@ -118,29 +121,71 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 
 #pragma mark -
 
-- (NSUInteger)			hashLength								{ return 32; }
+- (SectorHashAlgorithm)	hashAlgorithm							{ return _hashAlgorithm; }
+
+- (void) setHashAlgorithm:(SectorHashAlgorithm)hashAlgorithm
+{
+	NSParameterAssert(0 != SectorHashLength(hashAlgorithm));
+	
+	if(hashAlgorithm == _hashAlgorithm) {
+		return;
+	}
+	
+	// Hashes computed with the previous algorithm are meaningless now
+	free(_hashes);					_hashes = NULL;
+	[_hashed setAllZeroes];
+	
+	_hashAlgorithm = hashAlgorithm;
+}
+
+- (NSUInteger)			hashLength								{ return SectorHashLength(_hashAlgorithm); }
 
 - (unsigned char *)		hashForSector:(NSUInteger)sector
 {
-/*	if(NO == [self containsSector:sector]) {
+	NSUInteger index;
+	
+	if(NO == [self containsSector:sector]) {
 		return NULL;
-	}*/
+	}
 	
-	return _hashes[[_sectorRange indexForSector:sector]];
+	index = [_sectorRange indexForSector:sector];
+	if(NO == [_hashed valueAtIndex:index]) {
+		return NULL;
+	}
+	
+	return _hashes + (index * [self hashLength]);
 }
 
 - (BOOL)				sector:(NSUInteger)sector hasHash:(unsigned char *)hash
 {
-	return (0 == memcmp(hash, [self hashForSector:sector], 32/*[self hashLength]*/));
+	unsigned char *sectorHash = [self hashForSector:sector];
+	
+	return (NULL != sectorHash && 0 == memcmp(hash, sectorHash, [self hashLength]));
+}
+
+- (BOOL)				sector:(NSUInteger)sector matchesSector:(const void *)data
+{
+	const void *bytes = [self bytesForSector:sector];
+	
+	return (NULL != bytes && 0 == memcmp(data, bytes, kCDSectorSizeCDDA));
 }
 
-- (BOOL)				sector:(NSUInteger)sector matchesSector:(void *)data
+- (const void *)		bytesForSector:(NSUInteger)sector
 {
-	int8_t		buffer [ kCDSectorSizeCDDA ];
+	if(NO == [self containsSector:sector] || NULL == _mapping) {
+		return NULL;
+	}
 	
-	[self getBytes:buffer forSector:sector];
+	return _mapping + (kCDSectorSizeCDDA * [_sectorRange indexForSector:sector]);
+}
+
+- (const void *)		bytesForSectorRange:(SectorRange *)range
+{
+	if(NO == [self containsSectorRange:range] || NULL == _mapping) {
+		return NULL;
+	}
 	
-	return (0 == memcmp(data, buffer, kCDSectorSizeCDDA));
+	return _mapping + (kCDSectorSizeCDDA * [_sectorRange indexForSector:[range firstSector]]);
 }
 
 - (NSData *)			dataForSector:(NSUInteger)sector
@@ -186,38 +231,13 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 
 - (void)				getBytes:(void *)buffer forSectorRange:(SectorRange *)range
 {
-	int			fd				= -1;
-	off_t		offset			= -1;
-	off_t		location		= -1;
-	ssize_t		bytesRead		= -1;
+	const void *bytes = [self bytesForSectorRange:range];
 	
-	if(NO == [self containsSectorRange:range] || nil == [self filename]) {
+	if(NULL == bytes) {
 		return;
 	}
 	
-	@try {
-		// Zero the buffer
-		bzero(buffer, [range byteSize]);
-		
-		// Open the file for reading
-		fd = open([_filename fileSystemRepresentation], O_RDONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-		NSAssert(-1 != fd, NSLocalizedStringFromTable(@"Unable to locate the input file.", @"Exceptions", @""));
-		
-		// Seek to the offset for the first sector
-		location	= kCDSectorSizeCDDA * [_sectorRange indexForSector:[range firstSector]];
-		offset		= lseek(fd, location, SEEK_SET);
-		NSAssert(-1 != offset, NSLocalizedStringFromTable(@"Unable to seek in the input file.", @"Exceptions", @""));
-		
-		// Read the sectors into the buffer
-		bytesRead = read(fd, buffer, [range byteSize]);
-		NSAssert(-1 != bytesRead && (NSUInteger)bytesRead == [range byteSize], NSLocalizedStringFromTable(@"Unable to read from the input file.", @"Exceptions", @""));
-	}
-	
-	@finally {
-		if(-1 != fd) {
-			close(fd);
-		}
-	}
+	memcpy(buffer, bytes, [range byteSize]);
 }
 
 - (void)				setData:(NSData *)data forSector:(NSUInteger)sector
@@ -241,61 +261,37 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 
 - (void)				setBytes:(const void *)buffer forSectorRange:(SectorRange *)range
 {
-	int				fd				= -1;
-	off_t			location		= -1;
-	off_t			offset			= -1;
-	ssize_t			bytesWritten	= -1;
+	uint8_t			*sector			= NULL;
 	NSUInteger		i				= 0;
 	NSUInteger		arrayIndex		= 0;
-	uint8_t			sector			[ kCDSectorSizeCDDA ];
-	unsigned char	hash			[ 32 ];
+	NSUInteger		hashLength		= 0;
 	
-	if(NO == [self containsSectorRange:range]  || nil == [self filename]) {
+	sector = (uint8_t *)[self bytesForSectorRange:range];
+	if(NULL == sector) {
 		return;
 	}
 	
-	@try {
-		
-		// Open the file for writing
-		fd = open([_filename fileSystemRepresentation], O_WRONLY | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-		NSAssert(-1 != fd, NSLocalizedStringFromTable(@"Unable to locate the output file.", @"Exceptions", @""));
-		
-		// Seek to the offset for the first sector
-		location	= kCDSectorSizeCDDA * [_sectorRange indexForSector:[range firstSector]];
-		offset		= lseek(fd, location, SEEK_SET);
-		NSAssert(-1 != offset, NSLocalizedStringFromTable(@"Unable to seek in the input file.", @"Exceptions", @""));
-		
-		// Write the sectors into the file
-		bytesWritten = write(fd, buffer, [range byteSize]);
-		NSAssert(-1 != bytesWritten && (NSUInteger)bytesWritten == [range byteSize], NSLocalizedStringFromTable(@"Unable to write to the output file.", @"Exceptions", @""));
-		
-		if(NO == [self calculateHashes]) {
-			return;
-		}
-		
-		// Compute the hash value for each sector and store them
-		for(i = 0; i < [range length]; ++i) {
-			arrayIndex = [_sectorRange indexForSector:[range firstSector] + i];
-			
-			// Extract the sector's bytes
-			memcpy(sector, buffer + (kCDSectorSizeCDDA * i), kCDSectorSizeCDDA);
-			
-			// Compute the SHA-256 for the sector
-			sha_memory(sector, kCDSectorSizeCDDA, hash);
-			
-			// Allocate space for the hash
-			_hashes[arrayIndex] = calloc(32, sizeof(unsigned char));
-			NSAssert(NULL != _hashes[arrayIndex], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
-			
-			// Copy the hash value
-			memcpy(_hashes[arrayIndex], hash, 32 * sizeof(unsigned char));
-		}
+	// Write the sectors directly into the mapping
+	memcpy(sector, buffer, [range byteSize]);
+	
+	if(NO == [self calculateHashes]) {
+		return;
 	}
 	
-	@finally {
-		if(-1 != fd) {
-			close(fd);
-		}
+	hashLength = [self hashLength];
+	
+	// One contiguous table holds the hashes for every sector in the rip
+	if(NULL == _hashes) {
+		_hashes = calloc([self length], hashLength);
+		NSAssert(NULL != _hashes, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	// Compute the hash value for each sector and store them
+	for(i = 0; i < [range length]; ++i, sector += kCDSectorSizeCDDA) {
+		arrayIndex = [_sectorRange indexForSector:[range firstSector] + i];
+		
+		SectorHash(_hashAlgorithm, sector, kCDSectorSizeCDDA, _hashes + (arrayIndex * hashLength));
+		[_hashed setValue:YES forIndex:arrayIndex];
 	}
 }
 
@@ -314,29 +310,65 @@ void sha_memory(unsigned char *buf, int len, unsigned char *hash);
 - (void)				setErrorFlags:(const void *)errorFlags forSectorRange:(SectorRange *)range
 {
 	const uint32_t	*flags;
-	NSUInteger		lastArrayIndex;
-	NSUInteger		lastBitIndex;
-	NSUInteger		i, j;
+	uint32_t		word;
+	NSUInteger		firstIndex;
+	NSUInteger		i;
 	
 	flags			= (const uint32_t *)errorFlags;
-	lastArrayIndex	= [range length] / (8 * sizeof(uint32_t));
-	lastBitIndex	= [range length] % (8 * sizeof(uint32_t));
-	
-	for(i = 0; i < lastArrayIndex; ++i) {
-		if(flags[i]) {
-			for(j = 0; j < 8; ++j) {
-				if(flags[i] & (1 << j)) {
-					[_errors setValue:YES forIndex:([range firstSector] + ((8 * sizeof(uint32_t) * i) + j) - [self firstSector])];
-				}
-			}
+	firstIndex		= [range firstSector] - [self firstSector];
+	
+	// Only visit the set bits; the last word's bits past the end of the range are clear
+	for(i = 0; i < ([range length] + 31) / 32; ++i) {
+		for(word = flags[i]; 0 != word; word &= word - 1) {
+			[_errors setValue:YES forIndex:(firstIndex + (32 * i) + __builtin_ctz(word))];
 		}
 	}
+}
+
+@end
+
+@implementation Rip (Private)
+
+- (void) mapFile
+{
+	int			fd;
+	int			result;
+	void		*mapping;
 	
-	for(i = 0; i < lastBitIndex; ++i) {
-		if(flags[lastArrayIndex] & (1 << i)) {
-			[_errors setValue:YES forIndex:([range firstSector] + ((8 * sizeof(uint32_t) * lastArrayIndex) + i) - [self firstSector])];
-		}
+	_mappingSize = kCDSectorSizeCDDA * [self length];
+	if(0 == _mappingSize) {
+		return;
 	}
+	
+	fd = open([_filename fileSystemRepresentation], O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	NSAssert(-1 != fd, NSLocalizedStringFromTable(@"Unable to locate the output file.", @"Exceptions", @""));
+
+	// Size the file to hold every sector up front, so writes may land anywhere in the range
+	result = ftruncate(fd, (off_t)_mappingSize);
+	if(-1 == result) {
+		close(fd);
+	}
+	NSAssert(-1 != result, NSLocalizedStringFromTable(@"Unable to write to the output file.", @"Exceptions", @""));
+	
+	// The mapping holds its own reference to the file, so the descriptor isn't needed past this;
+	// a damaged disc may need many rips, and each would otherwise keep one open
+	mapping = mmap(NULL, _mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	NSAssert(MAP_FAILED != mapping, NSLocalizedStringFromTable(@"Unable to read from the input file.", @"Exceptions", @""));
+	
+	// No madvise() hint: sectors are written in order but later compared in the scattered order
+	// of the re-rips, so the kernel's default read-ahead suits the mapping better than either hint
+	_mapping = mapping;
+}
+
+- (void) unmapFile
+{
+	if(NULL != _mapping) {
+		munmap(_mapping, _mappingSize);
+		_mapping = NULL;
+	}
+	
+	_mappingSize = 0;
 }
 
 @end
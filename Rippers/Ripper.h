@@ -20,10 +20,12 @@
 
 #import "RipperMethods.h"
 #import "RipperTaskMethods.h"
+#import "TaskStatus.h"
 
 @interface Ripper : NSObject <RipperMethods>
 {
 	id <RipperTaskMethods>	_delegate;
+	TaskStatus				*_status;
 	
 	NSArray					*_sectors;
 	NSString				*_deviceName;
@@ -34,6 +36,10 @@
 
 - (NSString *)				deviceName;
 
+// Progress and cancellation for the delegate, shared without messaging
+- (TaskStatus *)			status;
+- (void)					setStatus:(TaskStatus *)status;
+
 - (BOOL)					logActivity;
 - (void)					setLogActivity:(BOOL)logActivity;
 
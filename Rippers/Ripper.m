@@ -39,6 +39,7 @@
 		[ripper setLogActivity:[[NSUserDefaults standardUserDefaults] boolForKey:@"enableRipperLogging"]];
 			
 		[ripper setDelegate:owner];
+		[ripper setStatus:[portArray objectAtIndex:2]];
 		[owner ripperReady:ripper];
 	}	
 	
@@ -73,6 +74,7 @@
 {
 	[_sectors release];			_sectors = nil;
 	[_deviceName release];		_deviceName = nil;
+	[_status release];			_status = nil;
 	
 	[super dealloc];
 }
@@ -82,6 +84,9 @@
 
 - (NSString *)			deviceName									{ return [[_deviceName retain] autorelease]; }
 
+- (TaskStatus *)		status										{ return [[_status retain] autorelease]; }
+- (void)				setStatus:(TaskStatus *)status				{ [_status release]; _status = [status retain]; }
+
 - (void)					setDelegate:(id <RipperTaskMethods>)delegate	{ _delegate = delegate; }
 - (id <RipperTaskMethods>)	delegate										{ return _delegate; }
 
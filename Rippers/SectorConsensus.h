@@ -0,0 +1,58 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "SectorRange.h"
+
+struct SectorBallot;
+
+// Tallies the distinct readings seen for each sector of a range as rips land,
+// accepting a sector as soon as one reading has been seen requiredMatches times.
+// Readings are referenced, not copied, so the caller must keep the bytes (and hashes) alive
+@interface SectorConsensus : NSObject
+{
+	SectorRange				*_sectorRange;		// The sectors being voted on
+	NSUInteger				_requiredMatches;	// The number of identical readings needed to accept a sector
+	NSUInteger				_hashLength;		// The length of the hashes keying each reading, or 0 to compare bytes
+	NSUInteger				_acceptedCount;		// The number of sectors accepted so far
+	struct SectorBallot		*_ballots;			// The readings seen for each sector
+}
+
+- (instancetype)		initWithSectorRange:(SectorRange *)range requiredMatches:(NSUInteger)requiredMatches hashLength:(NSUInteger)hashLength;
+
+- (NSUInteger)			requiredMatches;
+- (NSUInteger)			hashLength;
+
+// Record one reading of sector; hash may be NULL when hashLength is 0
+// Returns YES if this reading caused the sector to be accepted
+- (BOOL)				addReading:(const void *)bytes hash:(const unsigned char *)hash forSector:(NSUInteger)sector;
+
+// Accept a reading verified by other means, such as a checksum of the whole track
+// Returns YES if the sector had not been accepted already
+- (BOOL)				acceptReading:(const void *)bytes forSector:(NSUInteger)sector;
+
+// The accepted reading for sector, or NULL if it has not been accepted
+- (const void *)		acceptedBytesForSector:(NSUInteger)sector;
+- (BOOL)				sectorIsAccepted:(NSUInteger)sector;
+- (BOOL)				allSectorsAccepted;
+
+// The number of distinct readings seen for sector, and the votes for the most common one
+- (NSUInteger)			readingCountForSector:(NSUInteger)sector;
+- (NSUInteger)			leadingVotesForSector:(NSUInteger)sector;
+
+@end
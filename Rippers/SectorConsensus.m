@@ -0,0 +1,248 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "SectorConsensus.h"
+
+#include <IOKit/storage/IOCDTypes.h>
+
+struct SectorReading {
+	const void				*bytes;
+	const unsigned char		*hash;
+	NSUInteger				votes;
+};
+
+// Almost every sector reads the same way every time, so the first reading is stored inline
+// and only sectors that have been read inconsistently allocate
+struct SectorBallot {
+	struct SectorReading	first;
+	struct SectorReading	*others;
+	uint32_t				otherCount;
+	uint32_t				otherCapacity;
+	const void				*accepted;
+};
+
+@interface SectorConsensus (Private)
+- (BOOL)			reading:(const struct SectorReading *)reading matchesBytes:(const void *)bytes hash:(const unsigned char *)hash;
+@end
+
+@implementation SectorConsensus
+
+- (id) initWithSectorRange:(SectorRange *)range requiredMatches:(NSUInteger)requiredMatches hashLength:(NSUInteger)hashLength
+{
+	NSParameterAssert(nil != range);
+	NSParameterAssert(0 < requiredMatches);
+	
+	if((self = [super init])) {
+		_sectorRange		= [range retain];
+		_requiredMatches	= requiredMatches;
+		_hashLength			= hashLength;
+		_acceptedCount		= 0;
+		
+		_ballots			= calloc([range length], sizeof(struct SectorBallot));
+		NSAssert(NULL != _ballots, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	NSUInteger i;
+	
+	if(NULL != _ballots) {
+		for(i = 0; i < [_sectorRange length]; ++i) {
+			free(_ballots[i].others);
+		}
+		free(_ballots);				_ballots = NULL;
+	}
+	
+	[_sectorRange release];			_sectorRange = nil;
+	
+	[super dealloc];
+}
+
+- (NSUInteger)		requiredMatches								{ return _requiredMatches; }
+- (NSUInteger)		hashLength									{ return _hashLength; }
+
+- (BOOL) addReading:(const void *)bytes hash:(const unsigned char *)hash forSector:(NSUInteger)sector
+{
+	struct SectorBallot		*ballot;
+	struct SectorReading	*reading;
+	struct SectorReading	*others;
+	uint32_t				i;
+	
+	NSParameterAssert(NULL != bytes);
+	NSParameterAssert(0 == _hashLength || NULL != hash);
+	
+	if(NO == [_sectorRange containsSector:sector]) {
+		return NO;
+	}
+	
+	ballot = _ballots + [_sectorRange indexForSector:sector];
+	
+	// Once a sector is accepted further readings are irrelevant
+	if(NULL != ballot->accepted) {
+		return NO;
+	}
+	
+	// Find an existing reading with the same value
+	reading = NULL;
+	if(0 == ballot->first.votes) {
+		reading = &ballot->first;
+	}
+	else if([self reading:&ballot->first matchesBytes:bytes hash:hash]) {
+		reading = &ballot->first;
+	}
+	else {
+		for(i = 0; i < ballot->otherCount; ++i) {
+			if([self reading:ballot->others + i matchesBytes:bytes hash:hash]) {
+				reading = ballot->others + i;
+				break;
+			}
+		}
+	}
+	
+	// Or start a new one
+	if(NULL == reading) {
+		if(ballot->otherCount == ballot->otherCapacity) {
+			others = realloc(ballot->others, (ballot->otherCapacity + 4) * sizeof(struct SectorReading));
+			NSAssert(NULL != others, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+			
+			ballot->others			= others;
+			ballot->otherCapacity	+= 4;
+		}
+		
+		reading = ballot->others + ballot->otherCount++;
+		reading->votes = 0;
+	}
+	
+	if(0 == reading->votes) {
+		reading->bytes	= bytes;
+		reading->hash	= hash;
+	}
+	
+	++reading->votes;
+	
+	if(_requiredMatches <= reading->votes) {
+		ballot->accepted = reading->bytes;
+		++_acceptedCount;
+		
+		// The losing readings will never be consulted again
+		free(ballot->others);
+		ballot->others			= NULL;
+		ballot->otherCount		= 0;
+		ballot->otherCapacity	= 0;
+		
+		return YES;
+	}
+	
+	return NO;
+}
+
+- (BOOL) acceptReading:(const void *)bytes forSector:(NSUInteger)sector
+{
+	struct SectorBallot		*ballot;
+	
+	NSParameterAssert(NULL != bytes);
+	
+	if(NO == [_sectorRange containsSector:sector]) {
+		return NO;
+	}
+	
+	ballot = _ballots + [_sectorRange indexForSector:sector];
+	
+	if(NULL != ballot->accepted) {
+		return NO;
+	}
+	
+	ballot->accepted = bytes;
+	++_acceptedCount;
+	
+	free(ballot->others);
+	ballot->others			= NULL;
+	ballot->otherCount		= 0;
+	ballot->otherCapacity	= 0;
+	
+	return YES;
+}
+
+- (const void *) acceptedBytesForSector:(NSUInteger)sector
+{
+	if(NO == [_sectorRange containsSector:sector]) {
+		return NULL;
+	}
+	
+	return _ballots[[_sectorRange indexForSector:sector]].accepted;
+}
+
+- (BOOL)			sectorIsAccepted:(NSUInteger)sector			{ return (NULL != [self acceptedBytesForSector:sector]); }
+- (BOOL)			allSectorsAccepted							{ return ([_sectorRange length] == _acceptedCount); }
+
+- (NSUInteger) readingCountForSector:(NSUInteger)sector
+{
+	struct SectorBallot *ballot;
+	
+	if(NO == [_sectorRange containsSector:sector]) {
+		return 0;
+	}
+	
+	ballot = _ballots + [_sectorRange indexForSector:sector];
+	
+	return (0 == ballot->first.votes ? 0 : 1 + ballot->otherCount);
+}
+
+- (NSUInteger) leadingVotesForSector:(NSUInteger)sector
+{
+	struct SectorBallot		*ballot;
+	NSUInteger				votes;
+	uint32_t				i;
+	
+	if(NO == [_sectorRange containsSector:sector]) {
+		return 0;
+	}
+	
+	ballot	= _ballots + [_sectorRange indexForSector:sector];
+	if(NULL != ballot->accepted) {
+		return _requiredMatches;
+	}
+	
+	votes	= ballot->first.votes;
+	
+	for(i = 0; i < ballot->otherCount; ++i) {
+		if(votes < ballot->others[i].votes) {
+			votes = ballot->others[i].votes;
+		}
+	}
+	
+	return votes;
+}
+
+@end
+
+@implementation SectorConsensus (Private)
+
+- (BOOL) reading:(const struct SectorReading *)reading matchesBytes:(const void *)bytes hash:(const unsigned char *)hash
+{
+	if(0 != _hashLength) {
+		return (0 == memcmp(reading->hash, hash, _hashLength));
+	}
+	
+	return (0 == memcmp(reading->bytes, bytes, kCDSectorSizeCDDA));
+}
+
+@end
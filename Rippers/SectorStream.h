@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// A SectorStream carries a rip's verified sectors straight to the encoders, in place of a temporary file:
+//   - The ripper stores each sector once it is final, in any order
+//   - Readers see the sectors as 16-bit little-endian CD-DA frames, and only up to the first
+//     sector that is not final yet, so an unverified sector holds back just the audio behind it
+//   - Audio the reader has copied out is handed back to the system, so memory is only held
+//     between the reader and the ripper rather than for the whole rip
+//   - Streams are registered by identifier, which stands in for the rip's output filename
+//
+// A stream has a single reader: with several output formats the encoders share it through a DecoderFanOut
+@interface SectorStream : NSObject
+{
+	NSString			*_identifier;
+	NSArray				*_sectorRanges;		// The sectors in stream order
+	NSUInteger			_sectorCount;
+	NSUInteger			_consumerCount;		// The readers that have not released the stream
+
+	uint8_t				*_storage;			// CD-DA for every sector in stream order
+	size_t				_storageSize;
+	uint8_t				*_sectorIsFinal;
+	NSUInteger			_finalSectorCount;	// Sectors before this one are all final
+	size_t				_discardedSize;		// Bytes at the start of _storage already given back
+
+	NSCondition			*_condition;
+	BOOL				_finished;
+	BOOL				_aborted;
+}
+
+// ========================================
+// Registration
+// ========================================
++ (BOOL) isStreamIdentifier:(NSString *)string;
+
++ (NSString *) registerStreamWithSectorRanges:(NSArray *)sectorRanges consumerCount:(NSUInteger)consumerCount;
++ (SectorStream *) streamWithIdentifier:(NSString *)identifier;
+
+// Called once by each consumer when it is done with the stream
++ (void) releaseStreamWithIdentifier:(NSString *)identifier;
+
+// ========================================
+// Properties
+// ========================================
+- (NSString *) identifier;
+- (NSUInteger) sectorCount;
+- (SInt64) totalFrames;
+
+// ========================================
+// Producer
+// ========================================
+// sector is a disc address from one of the stream's ranges
+- (void) setBytes:(const void *)bytes forSector:(NSUInteger)sector;
+
+// Wakes the readers once the rip is over, successfully or not
+- (void) finish;
+- (void) abort;
+
+// ========================================
+// Consumer
+// ========================================
+// Blocks until the frame is final, then returns the number of contiguous final frames starting there
+// Returns 0 at the end of the stream, and raises if the rip was aborted
+- (NSUInteger) waitForFramesAtFrame:(SInt64)frame;
+- (const void *) bytesAtFrame:(SInt64)frame;
+
+// The reader will not ask for the frames before frame again, so their memory may be reclaimed
+- (void) discardFramesBeforeFrame:(SInt64)frame;
+
+@end
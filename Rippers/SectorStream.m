@@ -0,0 +1,271 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "SectorStream.h"
+#import "SectorRange.h"
+
+#include <IOKit/storage/IOCDTypes.h>
+
+#include <sys/mman.h>		// mmap, munmap, madvise
+#include <unistd.h>			// getpagesize
+
+// CD-DA frames are four bytes
+#define FRAMES_PER_SECTOR		(kCDSectorSizeCDDA / 4)
+
+static NSMutableDictionary *sStreams = nil;
+
+@interface SectorStream (Private)
+- (id)				initWithIdentifier:(NSString *)identifier sectorRanges:(NSArray *)sectorRanges consumerCount:(NSUInteger)consumerCount;
+- (BOOL)			releaseConsumer;
+- (NSUInteger)		indexForSector:(NSUInteger)sector;
+@end
+
+@implementation SectorStream
+
+#pragma mark Registration
+
++ (BOOL) isStreamIdentifier:(NSString *)string
+{
+	return [[string pathExtension] isEqualToString:@"sectorstream"];
+}
+
++ (NSString *) registerStreamWithSectorRanges:(NSArray *)sectorRanges consumerCount:(NSUInteger)consumerCount
+{
+	NSString		*identifier		= [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"sectorstream"];
+	SectorStream	*stream			= [[SectorStream alloc] initWithIdentifier:identifier sectorRanges:sectorRanges consumerCount:consumerCount];
+	
+	@synchronized(self) {
+		if(nil == sStreams)
+			sStreams = [[NSMutableDictionary alloc] init];
+		
+		[sStreams setObject:stream forKey:identifier];
+	}
+	
+	[stream release];
+	
+	return identifier;
+}
+
++ (SectorStream *) streamWithIdentifier:(NSString *)identifier
+{
+	SectorStream	*stream		= nil;
+	
+	@synchronized(self) {
+		stream = [[sStreams objectForKey:identifier] retain];
+	}
+	
+	return [stream autorelease];
+}
+
++ (void) releaseStreamWithIdentifier:(NSString *)identifier
+{
+	// The audio is held until the last consumer is done with it
+	if([[self streamWithIdentifier:identifier] releaseConsumer]) {
+		@synchronized(self) {
+			[sStreams removeObjectForKey:identifier];
+		}
+	}
+}
+
+- (void) dealloc
+{
+	if(NULL != _storage) {
+		munmap(_storage, _storageSize);
+		_storage = NULL;
+	}
+	
+	free(_sectorIsFinal);			_sectorIsFinal = NULL;
+	
+	[_condition release];			_condition = nil;
+	[_sectorRanges release];		_sectorRanges = nil;
+	[_identifier release];			_identifier = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+- (NSString *)			identifier						{ return [[_identifier retain] autorelease]; }
+- (NSUInteger)			sectorCount						{ return _sectorCount; }
+- (SInt64)				totalFrames						{ return (SInt64)_sectorCount * FRAMES_PER_SECTOR; }
+
+#pragma mark Producer
+
+- (void) setBytes:(const void *)bytes forSector:(NSUInteger)sector
+{
+	NSUInteger		index		= [self indexForSector:sector];
+	
+	NSParameterAssert(NULL != bytes);
+	
+	[_condition lock];
+	
+	// Readers may already be using a final sector, so it is never stored twice
+	if(NO == _sectorIsFinal[index]) {
+		memcpy(_storage + (index * kCDSectorSizeCDDA), bytes, kCDSectorSizeCDDA);
+		_sectorIsFinal[index] = YES;
+		
+		if(index == _finalSectorCount) {
+			while(_finalSectorCount < _sectorCount && _sectorIsFinal[_finalSectorCount])
+				++_finalSectorCount;
+			
+			[_condition broadcast];
+		}
+	}
+	
+	[_condition unlock];
+}
+
+- (void) finish
+{
+	[_condition lock];
+	_finished = YES;
+	[_condition broadcast];
+	[_condition unlock];
+}
+
+- (void) abort
+{
+	[_condition lock];
+	_aborted = YES;
+	[_condition broadcast];
+	[_condition unlock];
+}
+
+#pragma mark Consumer
+
+- (NSUInteger) waitForFramesAtFrame:(SInt64)frame
+{
+	NSUInteger		frameCount		= 0;
+	
+	NSParameterAssert(0 <= frame);
+	
+	if([self totalFrames] <= frame)
+		return 0;
+	
+	[_condition lock];
+	
+	@try {
+		if(frame * 4 < (SInt64)_discardedSize)
+			@throw [NSException exceptionWithName:NSRangeException reason:@"The frame has already been discarded." userInfo:nil];
+		
+		while((SInt64)_finalSectorCount * FRAMES_PER_SECTOR <= frame && NO == _aborted && NO == _finished)
+			[_condition wait];
+		
+		if(_aborted)
+			@throw [NSException exceptionWithName:@"IOException" reason:NSLocalizedStringFromTable(@"The rip did not complete.", @"Exceptions", @"") userInfo:nil];
+		
+		// A finished rip has stored every sector, so anything short of that is the end
+		if((SInt64)_finalSectorCount * FRAMES_PER_SECTOR > frame)
+			frameCount = (NSUInteger)(((SInt64)_finalSectorCount * FRAMES_PER_SECTOR) - frame);
+	}
+	
+	@finally {
+		[_condition unlock];
+	}
+	
+	return frameCount;
+}
+
+- (const void *) bytesAtFrame:(SInt64)frame
+{
+	NSParameterAssert(0 <= frame && frame < [self totalFrames]);
+	return _storage + (frame * 4);
+}
+
+- (void) discardFramesBeforeFrame:(SInt64)frame
+{
+	size_t		pageSize		= (size_t)getpagesize();
+	size_t		discardSize;
+	
+	NSParameterAssert(0 <= frame && frame <= [self totalFrames]);
+	
+	// Only whole pages can be given back; every sector in them is final, so the ripper won't touch them again
+	discardSize = ((size_t)frame * 4) / pageSize * pageSize;
+	
+	[_condition lock];
+	
+	if(discardSize > _discardedSize) {
+		madvise(_storage + _discardedSize, discardSize - _discardedSize, MADV_FREE);
+		_discardedSize = discardSize;
+	}
+	
+	[_condition unlock];
+}
+
+@end
+
+@implementation SectorStream (Private)
+
+- (id) initWithIdentifier:(NSString *)identifier sectorRanges:(NSArray *)sectorRanges consumerCount:(NSUInteger)consumerCount
+{
+	NSParameterAssert(nil != identifier);
+	NSParameterAssert(nil != sectorRanges);
+	NSParameterAssert(0 < consumerCount);
+	
+	if((self = [super init])) {
+		_identifier			= [identifier retain];
+		_sectorRanges		= [sectorRanges copy];
+		_sectorCount		= [[_sectorRanges valueForKeyPath:@"@sum.length"] unsignedIntegerValue];
+		_consumerCount		= consumerCount;
+		_condition			= [[NSCondition alloc] init];
+		
+		NSAssert(0 < _sectorCount, @"The stream has no sectors.");
+		
+		// Anonymous memory is only committed as sectors arrive
+		_storageSize		= _sectorCount * kCDSectorSizeCDDA;
+		_discardedSize		= 0;
+		_storage			= mmap(NULL, _storageSize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+		if(MAP_FAILED == _storage)
+			_storage = NULL;
+		NSAssert(NULL != _storage, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		_sectorIsFinal		= calloc(_sectorCount, sizeof(uint8_t));
+		NSAssert(NULL != _sectorIsFinal, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+	}
+	
+	return self;
+}
+
+- (BOOL) releaseConsumer
+{
+	BOOL	released	= NO;
+	
+	[_condition lock];
+	if(0 < _consumerCount)
+		--_consumerCount;
+	released = (0 == _consumerCount);
+	[_condition unlock];
+	
+	return released;
+}
+
+- (NSUInteger) indexForSector:(NSUInteger)sector
+{
+	SectorRange		*range;
+	NSUInteger		offset		= 0;
+	
+	for(range in _sectorRanges) {
+		if([range containsSector:sector])
+			return offset + [range indexForSector:sector];
+		offset += [range length];
+	}
+	
+	@throw [NSException exceptionWithName:NSRangeException reason:@"The sector is not part of the stream." userInfo:nil];
+}
+
+@end
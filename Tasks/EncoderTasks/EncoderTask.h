@@ -29,6 +29,9 @@
 	id <EncoderMethods>		_encoder;
 	NSDictionary			*_encoderSettings;
 	NSString				*_encoderSettingsString;
+	NSString				*_decoderFanOutIdentifier;
+	NSUInteger				_decoderFanOutSinkIndex;
+	double					_estimatedCost;
 }
 
 - (NSString *)		outputFormatName;
@@ -37,6 +40,13 @@
 - (void)			encoderReady:(id)anObject;
 
 - (NSString *)		encoderSettingsString;
+
+- (void)			setDecoderFanOutIdentifier:(NSString *)identifier sinkIndex:(NSUInteger)sinkIndex;
+
+// Scheduling weight: the number of frames to encode times the cost of encoding one frame,
+// relative to MP3 at the standard quality setting
+- (double)			costPerFrame;
+- (double)			estimatedCost;
 @end
 
 @interface EncoderTask (CueSheetAdditions)
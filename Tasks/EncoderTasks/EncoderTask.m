@@ -20,6 +20,9 @@
 
 #import "EncoderMethods.h"
 #import "EncoderController.h"
+#import "DecoderFanOut.h"
+#import "SectorStream.h"
+#import "TaskScheduler.h"
 #import "LogController.h"
 #import "Track.h"
 
@@ -30,6 +33,11 @@
 
 - (void)			touchOutputFile;
 
+- (void)			detachFromDecoderFanOut;
+- (void)			releaseSectorStream;
+
+- (SInt64)			estimatedFrameCount;
+
 - (NSString *)		generateStandardBasenameUsingMetadata:(AudioMetadata *)metadata;
 - (NSString *)		generateCustomBasenameUsingMetadata:(AudioMetadata *)metadata settings:(NSDictionary *)settings substitutions:(NSDictionary *)substitutions;
 @end
@@ -79,9 +87,13 @@ enum {
 		}
 	}
 	
+	[self detachFromDecoderFanOut];
+	[self releaseSectorStream];
+
 	[_connection release];				_connection = nil;
 	[_encoderSettings release];			_encoderSettings = nil;
 	[_encoderSettingsString release];	_encoderSettingsString = nil;
+	[_decoderFanOutIdentifier release];	_decoderFanOutIdentifier = nil;
 
 	[super dealloc];
 }
@@ -103,6 +115,26 @@ enum {
 
 - (NSString *)		encoderSettingsString				{ return _encoderSettingsString; }
 
+- (NSString *)		decoderFanOutIdentifier				{ return [[_decoderFanOutIdentifier retain] autorelease]; }
+- (NSUInteger)		decoderFanOutSinkIndex				{ return _decoderFanOutSinkIndex; }
+
+- (void) setDecoderFanOutIdentifier:(NSString *)identifier sinkIndex:(NSUInteger)sinkIndex
+{
+	[_decoderFanOutIdentifier release];
+	_decoderFanOutIdentifier	= [identifier retain];
+	_decoderFanOutSinkIndex		= sinkIndex;
+}
+
+- (double)			costPerFrame						{ return 1.0; }
+
+- (double) estimatedCost
+{
+	if(0 == _estimatedCost)
+		_estimatedCost = [self estimatedFrameCount] * [self costPerFrame];
+	
+	return _estimatedCost;
+}
+
 - (void)			encoderReady:(id)anObject
 {
 	_encoder = [(NSObject<EncoderMethods>*) anObject retain];
@@ -183,6 +215,7 @@ enum {
 					break;
 
 				case NSAlertThirdButtonReturn:
+					[self detachFromDecoderFanOut];
 					[[EncoderController sharedController] encoderTaskDidStop:self notify:NO];
 					return; //break;
 			}		
@@ -232,10 +265,10 @@ enum {
 	_connection = [[NSConnection alloc] initWithReceivePort:port1 sendPort:port2];
 	[_connection setRootObject:self];
 
-	portArray = [NSArray arrayWithObjects:port2, port1, nil];
+	portArray = [NSArray arrayWithObjects:port2, port1, [self status], nil];
 	
 	[super setStarted:YES];
-	[NSThread detachNewThreadSelector:@selector(connectWithPorts:) toTarget:_encoderClass withObject:portArray];
+	[[[EncoderController sharedController] scheduler] detachJobSelector:@selector(connectWithPorts:) toTarget:_encoderClass withObject:portArray cost:[self estimatedCost] group:[self decoderFanOutIdentifier]];
 }
 
 - (void) setTaskInfo:(TaskInfo *)taskInfo
@@ -279,6 +312,9 @@ enum {
 	_encoder = nil;
 	[_connection invalidate];
 
+	// Don't hold up the other formats sharing our input
+	[self detachFromDecoderFanOut];
+
 	// Mark tracks as complete
 	if(nil != [[self taskInfo] inputTracks]) {
 		NSArray			*tracks		= [[self taskInfo] inputTracks];
@@ -308,6 +344,8 @@ enum {
 	[(NSObject *)_encoder release];
 	_encoder = nil;
 	[_connection invalidate];
+
+	[self detachFromDecoderFanOut];
 	
 /*
 	// This file is finished
@@ -576,6 +614,77 @@ enum {
 	NSAssert(YES == result, NSLocalizedStringFromTable(@"Unable to create the output file.", @"Exceptions", @""));	
 }
 
+- (void) detachFromDecoderFanOut
+{
+	if(nil == _decoderFanOutIdentifier)
+		return;
+	
+	[DecoderFanOut detachSink:_decoderFanOutSinkIndex fromFanOutWithIdentifier:_decoderFanOutIdentifier];
+}
+
+- (void) releaseSectorStream
+{
+	NSString	*inputFilename		= [[self taskInfo] inputFilenameAtInputFileIndex];
+	
+	if([SectorStream isStreamIdentifier:inputFilename])
+		[SectorStream releaseStreamWithIdentifier:inputFilename];
+}
+
+- (SInt64) estimatedFrameCount
+{
+	NSDictionary	*framesToConvert	= [[[self taskInfo] settings] valueForKey:@"framesToConvert"];
+	NSArray			*tracks				= [[self taskInfo] inputTracks];
+	NSString		*filename			= [[self taskInfo] inputFilenameAtInputFileIndex];
+	SInt64			frameCount			= 0;
+	unsigned		i;
+	
+	// Regions and ripped tracks know their length up front
+	if(nil != framesToConvert)
+		frameCount = [[framesToConvert valueForKey:@"frameCount"] unsignedIntValue];
+	else if(nil != tracks) {
+		// CD-DA frames are four bytes
+		for(i = 0; i < [tracks count]; ++i)
+			frameCount += [[tracks objectAtIndex:i] byteSize] / 4;
+	}
+	// Otherwise estimate the length without opening a decoder, since the scheduler
+	// asks for it on the main thread and some decoders scan the whole file when opened
+	else {
+		NSString		*extension			= [[filename pathExtension] lowercaseString];
+		NSFileHandle	*file				= [NSFileHandle fileHandleForReadingAtPath:filename];
+		NSData			*header				= nil;
+		const uint8_t	*bytes				= NULL;
+		SInt64			fileSize			= [[[[NSFileManager defaultManager] attributesOfItemAtPath:filename error:nil] objectForKey:NSFileSize] longLongValue];
+		
+		@try {
+			header = [file readDataOfLength:26];
+		}
+		
+		@catch(NSException *exception) {
+			header = nil;
+		}
+		
+		[file closeFile];
+		
+		// FLAC's STREAMINFO block immediately follows the stream marker and holds the
+		// 36-bit total sample count at bytes 21 - 25
+		bytes = [header bytes];
+		if(26 == [header length] && 0 == memcmp(bytes, "fLaC", 4) && 0 == (bytes[4] & 0x7f))
+			frameCount = ((SInt64)(bytes[21] & 0x0f) << 32) | ((SInt64)bytes[22] << 24) | (bytes[23] << 16) | (bytes[24] << 8) | bytes[25];
+		
+		// The ratios only need to order the tasks, so assume 16-bit stereo at typical bitrates
+		if(0 >= frameCount) {
+			if([[NSArray arrayWithObjects:@"mp3", @"mp2", @"ogg", @"spx", @"mpc", @"m4a", @"aac", nil] containsObject:extension])
+				frameCount = fileSize * 2;
+			else if([[NSArray arrayWithObjects:@"flac", @"oggflac", @"ape", @"wv", @"shn", nil] containsObject:extension])
+				frameCount = fileSize / 2;
+			else
+				frameCount = fileSize / 4;
+		}
+	}
+	
+	return (0 < frameCount ? frameCount : 1);
+}
+
 - (NSString *) generateCustomBasenameUsingMetadata:(AudioMetadata *)metadata settings:(NSDictionary *)settings substitutions:(NSDictionary *)substitutions
 {
 	NSString			*basename			= nil;
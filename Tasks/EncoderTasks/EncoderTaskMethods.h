@@ -24,4 +24,8 @@
 - (NSDictionary *)	encoderSettings;
 - (void)			setEncoderSettings:(NSDictionary *)encoderSettings;
 
+// The DecoderFanOut shared with the other output formats for this input, if any
+- (bycopy NSString *)	decoderFanOutIdentifier;
+- (NSUInteger)			decoderFanOutSinkIndex;
+
 @end
@@ -307,6 +307,16 @@
 - (NSString *)		fileExtension					{ return @"flac"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"FLAC", @"General", @""); }
 
+- (double) costPerFrame
+{
+	double cost = 0.3;
+	
+	if([[[self encoderSettings] objectForKey:@"exhaustiveModelSearch"] boolValue])
+		cost *= 3;
+	
+	return cost;
+}
+
 @end
 
 @implementation FLACEncoderTask (CueSheetAdditions)
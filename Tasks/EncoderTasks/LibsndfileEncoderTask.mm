@@ -75,6 +75,9 @@
 	return [NSString stringWithCString:formatInfo.name encoding:NSASCIIStringEncoding];
 }
 
+// Writing PCM is bound by I/O, not the CPU
+- (double)			costPerFrame					{ return 0.1; }
+
 @end
 
 @implementation LibsndfileEncoderTask (CueSheetAdditions)
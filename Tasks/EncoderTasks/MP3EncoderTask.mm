@@ -343,6 +343,15 @@
 - (NSString *)		fileExtension					{ return @"mp3"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"MP3", @"General", @""); }
 
+- (double) costPerFrame
+{
+	switch([[[self encoderSettings] objectForKey:@"encodingEngineQuality"] intValue]) {
+		case LAME_ENCODING_ENGINE_QUALITY_FAST:			return 0.6;
+		case LAME_ENCODING_ENGINE_QUALITY_HIGH:			return 1.8;
+		default:										return 1.0;
+	}
+}
+
 @end
 
 @implementation MP3EncoderTask (CueSheetExtensions)
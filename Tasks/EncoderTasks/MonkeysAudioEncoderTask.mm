@@ -222,6 +222,17 @@
 - (NSString *)		fileExtension					{ return @"ape"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"Monkey's Audio", @"General", @""); }
 
+- (double) costPerFrame
+{
+	switch([[[self encoderSettings] objectForKey:@"compressionLevel"] intValue]) {
+		case MAC_COMPRESSION_LEVEL_FAST:				return 0.3;
+		case MAC_COMPRESSION_LEVEL_HIGH:				return 0.8;
+		case MAC_COMPRESSION_LEVEL_EXTRA_HIGH:			return 2.0;
+		case MAC_COMPRESSION_LEVEL_INSANE:				return 4.0;
+		default:										return 0.5;
+	}
+}
+
 @end
 
 @implementation MonkeysAudioEncoderTask (CueSheetAdditions)
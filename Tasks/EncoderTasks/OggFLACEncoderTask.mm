@@ -187,4 +187,14 @@
 - (NSString *)		fileExtension					{ return @"oga"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"Ogg FLAC", @"General", @""); }
 
+- (double) costPerFrame
+{
+	double cost = 0.3;
+	
+	if([[[self encoderSettings] objectForKey:@"exhaustiveModelSearch"] boolValue])
+		cost *= 3;
+	
+	return cost;
+}
+
 @end
@@ -183,4 +183,6 @@
 - (NSString *)		fileExtension					{ return @"spx"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"Speex", @"General", @""); }
 
+- (double)			costPerFrame					{ return 0.2 + 0.1 * [[[self encoderSettings] objectForKey:@"complexity"] intValue]; }
+
 @end
@@ -187,4 +187,6 @@
 - (NSString *)		fileExtension					{ return @"ogg"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"Ogg Vorbis", @"General", @""); }
 
+- (double)			costPerFrame					{ return 1.5; }
+
 @end
@@ -163,6 +163,16 @@
 - (NSString *)		fileExtension					{ return @"wv"; }
 - (NSString *)		outputFormatName				{ return NSLocalizedStringFromTable(@"WavPack", @"General", @""); }
 
+- (double) costPerFrame
+{
+	switch([[[self encoderSettings] objectForKey:@"compressionMode"] intValue]) {
+		case WAVPACK_COMPRESSION_MODE_FAST:				return 0.3;
+		case WAVPACK_COMPRESSION_MODE_HIGH:				return 0.6;
+		case WAVPACK_COMPRESSION_MODE_VERY_HIGH:		return 1.0;
+		default:										return 0.4;
+	}
+}
+
 @end
 
 @implementation WavPackEncoderTask (CueSheetAdditions)
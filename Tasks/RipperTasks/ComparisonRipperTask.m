@@ -32,4 +32,9 @@
 	return nil;
 }
 
+- (BOOL) canStreamToEncoders
+{
+	return [[NSUserDefaults standardUserDefaults] boolForKey:@"comparisonRipperStreamToEncoders"];
+}
+
 @end
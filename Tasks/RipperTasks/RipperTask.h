@@ -30,6 +30,7 @@
 	NSArray					*_tracks;
 	NSMutableArray			*_sectors;
 	NSString				*_deviceName;
+	BOOL					_streaming;
 }
 
 - (instancetype)	initWithTracks:(NSArray *)tracks;
@@ -42,4 +43,10 @@
 
 - (void)			ripperReady:(id)anObject;
 
+// Subclasses whose ripper can feed the encoders as it goes override this
+- (BOOL)			canStreamToEncoders;
+
+// YES if the encoders were started with the rip, reading from a SectorStream in place of the output file
+- (BOOL)			streaming;
+
 @end
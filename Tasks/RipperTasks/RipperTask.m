@@ -20,6 +20,8 @@
 #import "RipperMethods.h"
 #import "RipperController.h"
 #import "SectorRange.h"
+#import "SectorStream.h"
+#import "EncoderController.h"
 #import "CompactDiscDocument.h"
 #import "UtilityFunctions.h"
 #import "StopException.h"
@@ -79,6 +81,8 @@
 
 - (NSArray *)			sectors									{ return [[_sectors retain] autorelease]; }
 - (NSString *)			deviceName								{ return [[_deviceName retain] autorelease]; }
+- (BOOL)				canStreamToEncoders						{ return NO; }
+- (BOOL)				streaming								{ return _streaming; }
 - (NSUInteger)			countOfTracks							{ return [_tracks count]; }
 - (Track *)				objectInTracksAtIndex:(unsigned)index	{ return [_tracks objectAtIndex:index]; }
 
@@ -94,18 +98,49 @@
 	_connection = [[NSConnection alloc] initWithReceivePort:port1 sendPort:port2];
 	[_connection setRootObject:self];
 	
-	portArray = [NSArray arrayWithObjects:port2, port1, nil];
+	portArray = [NSArray arrayWithObjects:port2, port1, [self status], nil];
 	
 	[super setStarted:YES];
 	
 	[NSThread detachNewThreadSelector:@selector(connectWithPorts:) toTarget:_ripperClass withObject:portArray];
 }
 
+- (void) sampleStatus
+{
+	NSString	*phase		= nil;
+	
+	[super sampleStatus];
+	
+	switch([[self status] phase]) {
+		case kTaskPhaseRipping:			phase = NSLocalizedStringFromTable(@"Ripping", @"General", @"");		break;
+		case kTaskPhaseVerifying:		phase = NSLocalizedStringFromTable(@"Verifying", @"General", @"");		break;
+		case kTaskPhaseReRipping:		phase = NSLocalizedStringFromTable(@"Re-ripping", @"General", @"");		break;
+		case kTaskPhaseSaving:			phase = NSLocalizedStringFromTable(@"Saving", @"General", @"");			break;
+	}
+	
+	if(nil != phase && NO == [phase isEqualToString:[self phase]])
+		[self setPhase:phase];
+}
+
 - (void) ripperReady:(id)anObject
 {
+	NSDictionary	*settings			= [[self taskInfo] settings];
+	NSUInteger		encoderCount		= [[settings objectForKey:@"encoders"] count];
+	
     [anObject setProtocolForProxy:@protocol(RipperMethods)];
-	[self setOutputFilename:GenerateTemporaryFilename([[[self taskInfo] settings] objectForKey:@"temporaryDirectory"], @"caf")];
-	[self touchOutputFile];
+	
+	// Start the encoders now and hand them each sector as it is verified, or rip to a file and encode it afterwards
+	if([self canStreamToEncoders] && 0 < encoderCount) {
+		[self setOutputFilename:[SectorStream registerStreamWithSectorRanges:[self sectors] consumerCount:encoderCount]];
+		_streaming = YES;
+		
+		[[EncoderController sharedController] encodeFile:[self outputFilename] metadata:[[self taskInfo] metadata] settings:settings inputTracks:[[self taskInfo] inputTracks]];
+	}
+	else {
+		[self setOutputFilename:GenerateTemporaryFilename([settings objectForKey:@"temporaryDirectory"], @"caf")];
+		[self touchOutputFile];
+	}
+	
 	[anObject ripToFile:[self outputFilename]];
 }
 
@@ -123,6 +158,10 @@
 	
 	// Once we're stopped, invalidate the connection
 	[_connection invalidate];
+	
+	// Encoders reading the rip as it happens can't wait for the rest of it
+	if(_streaming)
+		[[SectorStream streamWithIdentifier:[self outputFilename]] abort];
 
 	for(track in _tracks) {
 		[track setRipInProgress:NO];
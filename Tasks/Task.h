@@ -19,6 +19,7 @@
 #import <Cocoa/Cocoa.h>
 
 #import "TaskMethods.h"
+#import "TaskStatus.h"
 
 @interface Task : NSObject <TaskMethods>
 {
@@ -35,7 +36,7 @@
 	
 	NSString			*_phase;
 	
-	BOOL				_shouldStop;
+	TaskStatus			*_status;
 	
 	NSUInteger			_secondsRemaining;
 		
@@ -48,6 +49,12 @@
 - (void)			run;
 - (void)			stop;
 
+// Shared with the worker thread, which reports progress and checks for cancellation through it
+- (TaskStatus *)	status;
+
+// Called periodically by the owning controller to publish the worker's progress
+- (void)			sampleStatus;
+
 - (NSString *)		outputFilename;
 - (void)			setOutputFilename:(NSString *)outputFilename;
 
@@ -35,7 +35,8 @@
 - (id) init
 {
 	if((self = [super init])) {
-		_secondsRemaining = UINT_MAX;
+		_secondsRemaining	= UINT_MAX;
+		_status				= [[TaskStatus alloc] init];
 		return self;
 	}
 	
@@ -52,6 +53,7 @@
 	[_startTime release];		_startTime = nil;
 	[_endTime release];			_endTime = nil;
 	[_phase release];			_phase = nil;
+	[_status release];			_status = nil;
 	[_exception release];		_exception = nil;
 	[_outputFilename release];	_outputFilename = nil;
 	
@@ -81,8 +83,8 @@
 - (float)			percentComplete								{ return _percentComplete; }
 - (void)			setPercentComplete:(float)percentComplete	{ _percentComplete = percentComplete; }
 
-- (BOOL)			shouldStop									{ return _shouldStop; }
-- (void)			setShouldStop:(BOOL)shouldStop				{ _shouldStop = shouldStop; }
+- (BOOL)			shouldStop									{ return [_status shouldStop]; }
+- (void)			setShouldStop:(BOOL)shouldStop				{ [_status setShouldStop:shouldStop]; }
 
 - (NSUInteger)		secondsRemaining							{ return _secondsRemaining; }
 - (void)			setSecondsRemaining:(NSUInteger)secondsRemaining { _secondsRemaining = secondsRemaining; }
@@ -101,6 +103,20 @@
 - (void)			run											{}
 - (void)			stop										{}
 
+- (TaskStatus *)	status										{ return [[_status retain] autorelease]; }
+
+- (void) sampleStatus
+{
+	double				fraction		= [_status fractionComplete];
+	NSTimeInterval		interval;
+	
+	if(0 == fraction)
+		return;
+	
+	interval = [_status secondsInPhase];
+	[self updateProgress:(float)(fraction * 100.0) secondsRemaining:(NSUInteger)(interval / fraction - interval)];
+}
+
 - (NSString *)		outputFilename								{ return [[_outputFilename retain] autorelease];}
 - (void)			setOutputFilename:(NSString *)outputFilename { [_outputFilename release]; _outputFilename = [outputFilename retain]; }
 
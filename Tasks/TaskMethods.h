@@ -19,9 +19,6 @@
 #import <Cocoa/Cocoa.h>
 #import "TaskInfo.h"
 
-// The number of iterations a task should run between calls to its delegate
-#define MAX_DO_POLL_FREQUENCY 300
-
 // The protocol exposed to Encoders/Rippers running in separate threads
 @protocol TaskMethods
 
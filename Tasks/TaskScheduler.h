@@ -0,0 +1,78 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#include <pthread.h>
+
+struct TaskSchedulerDeque;
+
+// A fixed pool of worker threads for long-running jobs, such as an entire encode:
+//   - Each worker owns a deque ordered by descending estimated cost; new jobs are placed on the
+//     least loaded worker, which takes them longest first from the front
+//   - A worker whose deque is empty steals the longest job from the deque with the most queued
+//     cost, so the stragglers at the end of a batch are spread over whichever workers are free
+//   - Jobs submitted with the same group should run concurrently (see DecoderFanOut): only the first
+//     is queued, and the rest start on threads of their own as soon as it is taken by a worker
+//   - There are never more of those group threads than workers; members past that wait, in the order
+//     they were submitted, for a group thread to finish its job
+// Workers run for the lifetime of the process, so a scheduler is never deallocated
+@interface TaskScheduler : NSObject
+{
+	NSUInteger					_workerCount;
+	struct TaskSchedulerDeque	*_deques;
+
+	NSCondition					*_condition;		// Parks idle workers
+	NSUInteger					_queuedJobs;
+
+	pthread_mutex_t				_groupMutex;
+	NSMutableDictionary			*_groupLeaders;
+	NSMutableArray				*_heldFollowers;	// Group members waiting for a group thread
+
+	// Statistics
+	int64_t						_statisticsStartTime;
+	int64_t						_busyMicroseconds;
+	uint32_t					_busyWorkers;
+	uint32_t					_groupThreads;
+	uint64_t					_completedJobs;
+	uint64_t					_stolenJobs;
+}
+
+// Zero workers means one for each active processor
+- (id)				initWithWorkerCount:(NSUInteger)workerCount;
+
+// The job runs as [target performSelector:selector withObject:argument] inside its own autorelease pool
+- (void)			detachJobSelector:(SEL)selector toTarget:(id)target withObject:(id)argument cost:(double)cost group:(NSString *)group;
+
+- (NSUInteger)		workerCount;
+
+// Jobs waiting for a worker
+- (NSUInteger)		queueDepth;
+
+// Workers running a job, not counting jobs started alongside their group
+- (NSUInteger)		busyWorkers;
+- (NSUInteger)		groupThreads;
+
+// The fraction of the pool's capacity spent running jobs since the statistics were last reset
+- (double)			utilization;
+- (uint64_t)		completedJobs;
+- (uint64_t)		stolenJobs;
+
+- (void)			resetStatistics;
+
+@end
@@ -0,0 +1,453 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "TaskScheduler.h"
+
+#include <float.h>
+
+struct TaskSchedulerDeque {
+	pthread_mutex_t		mutex;
+	NSMutableArray		*jobs;				// Descending cost
+	double				queuedCost;
+	double				load;				// Cost of the queued jobs plus the running one
+	int64_t				jobStartTime;		// In microseconds, or 0 while idle
+};
+
+static int64_t
+CurrentMicroseconds()
+{
+	return (int64_t)(CFAbsoluteTimeGetCurrent() * 1000000.0);
+}
+
+@interface TaskSchedulerJob : NSObject
+{
+@public
+	id					_target;
+	SEL					_selector;
+	id					_argument;
+	double				_cost;
+	NSString			*_group;
+	NSMutableArray		*_followers;		// Members of the group waiting for this job to be taken
+	NSUInteger			_dequeIndex;
+	BOOL				_taken;
+}
+@end
+
+@implementation TaskSchedulerJob
+
+- (void) dealloc
+{
+	[_target release];			_target = nil;
+	[_argument release];		_argument = nil;
+	[_group release];			_group = nil;
+	[_followers release];		_followers = nil;
+	
+	[super dealloc];
+}
+
+@end
+
+@interface TaskScheduler (Private)
+- (void)				workerMain:(NSNumber *)workerIndex;
+- (void)				groupThreadMain:(TaskSchedulerJob *)job;
+
+- (void)				enqueueJob:(TaskSchedulerJob *)job;
+- (void)				insertJob:(TaskSchedulerJob *)job intoDeque:(struct TaskSchedulerDeque *)deque;
+- (void)				addFollower:(TaskSchedulerJob *)job toLeader:(TaskSchedulerJob *)leader;
+- (void)				startFollower:(TaskSchedulerJob *)job;
+- (TaskSchedulerJob *)	takeJobForWorker:(NSUInteger)workerIndex;
+
+- (void)				startFollowersOfJob:(TaskSchedulerJob *)job;
+- (void)				runJob:(TaskSchedulerJob *)job;
+- (void)				finishJob:(TaskSchedulerJob *)job;
+@end
+
+@implementation TaskScheduler
+
+- (id) initWithWorkerCount:(NSUInteger)workerCount
+{
+	if((self = [super init])) {
+		NSUInteger i;
+		
+		_workerCount	= (0 == workerCount ? [[NSProcessInfo processInfo] activeProcessorCount] : workerCount);
+		_deques			= calloc(_workerCount, sizeof(struct TaskSchedulerDeque));
+		NSAssert(NULL != _deques, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Exceptions", @""));
+		
+		for(i = 0; i < _workerCount; ++i) {
+			pthread_mutex_init(&_deques[i].mutex, NULL);
+			_deques[i].jobs = [[NSMutableArray alloc] init];
+		}
+		
+		_condition		= [[NSCondition alloc] init];
+		_groupLeaders	= [[NSMutableDictionary alloc] init];
+		_heldFollowers	= [[NSMutableArray alloc] init];
+		pthread_mutex_init(&_groupMutex, NULL);
+		
+		[self resetStatistics];
+		
+		for(i = 0; i < _workerCount; ++i)
+			[NSThread detachNewThreadSelector:@selector(workerMain:) toTarget:self withObject:[NSNumber numberWithUnsignedInteger:i]];
+		
+		return self;
+	}
+	return nil;
+}
+
+- (void) detachJobSelector:(SEL)selector toTarget:(id)target withObject:(id)argument cost:(double)cost group:(NSString *)group
+{
+	TaskSchedulerJob	*job		= [[TaskSchedulerJob alloc] init];
+	TaskSchedulerJob	*leader		= nil;
+	BOOL				startNow	= NO;
+	
+	job->_target		= [target retain];
+	job->_selector		= selector;
+	job->_argument		= [argument retain];
+	job->_cost			= cost;
+	job->_group			= [group copy];
+	job->_followers		= [[NSMutableArray alloc] init];
+	
+	if(nil != group) {
+		pthread_mutex_lock(&_groupMutex);
+		
+		leader = [_groupLeaders objectForKey:group];
+		if(nil == leader)
+			[_groupLeaders setObject:job forKey:group];
+		else if(leader->_taken)
+			startNow = YES;
+		else
+			[self addFollower:job toLeader:leader];
+		
+		pthread_mutex_unlock(&_groupMutex);
+	}
+	
+	if(startNow)
+		[self startFollower:job];
+	else if(nil == leader)
+		[self enqueueJob:job];
+	
+	[job release];
+}
+
+- (NSUInteger) workerCount							{ return _workerCount; }
+
+- (NSUInteger) queueDepth
+{
+	NSUInteger queueDepth;
+	
+	[_condition lock];
+	queueDepth = _queuedJobs;
+	[_condition unlock];
+	
+	return queueDepth;
+}
+
+- (NSUInteger)	busyWorkers							{ return __atomic_load_n(&_busyWorkers, __ATOMIC_RELAXED); }
+- (NSUInteger)	groupThreads						{ return __atomic_load_n(&_groupThreads, __ATOMIC_RELAXED); }
+- (uint64_t)	completedJobs						{ return __atomic_load_n(&_completedJobs, __ATOMIC_RELAXED); }
+- (uint64_t)	stolenJobs							{ return __atomic_load_n(&_stolenJobs, __ATOMIC_RELAXED); }
+
+- (double) utilization
+{
+	int64_t		now				= CurrentMicroseconds();
+	int64_t		startTime		= __atomic_load_n(&_statisticsStartTime, __ATOMIC_RELAXED);
+	int64_t		busy			= __atomic_load_n(&_busyMicroseconds, __ATOMIC_RELAXED);
+	int64_t		jobStartTime;
+	NSUInteger	i;
+	
+	// Include the time spent so far on the jobs still running
+	for(i = 0; i < _workerCount; ++i) {
+		jobStartTime = __atomic_load_n(&_deques[i].jobStartTime, __ATOMIC_RELAXED);
+		if(0 != jobStartTime)
+			busy += now - (jobStartTime > startTime ? jobStartTime : startTime);
+	}
+	
+	if(now <= startTime)
+		return 0;
+	
+	return MIN(1.0, (double)busy / ((double)(now - startTime) * _workerCount));
+}
+
+- (void) resetStatistics
+{
+	__atomic_store_n(&_statisticsStartTime, CurrentMicroseconds(), __ATOMIC_RELAXED);
+	__atomic_store_n(&_busyMicroseconds, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&_completedJobs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&_stolenJobs, 0, __ATOMIC_RELAXED);
+}
+
+@end
+
+@implementation TaskScheduler (Private)
+
+- (void) workerMain:(NSNumber *)workerIndex
+{
+	NSUInteger					index			= [workerIndex unsignedIntegerValue];
+	struct TaskSchedulerDeque	*deque			= &_deques[index];
+	NSAutoreleasePool			*pool			= nil;
+	TaskSchedulerJob			*job			= nil;
+	int64_t						jobStartTime;
+	int64_t						startTime;
+	
+	for(;;) {
+		pool	= [[NSAutoreleasePool alloc] init];
+		job		= [self takeJobForWorker:index];
+		
+		if(nil == job) {
+			[_condition lock];
+			while(0 == _queuedJobs)
+				[_condition wait];
+			[_condition unlock];
+		}
+		else {
+			[self startFollowersOfJob:job];
+			
+			jobStartTime = CurrentMicroseconds();
+			__atomic_store_n(&deque->jobStartTime, jobStartTime, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&_busyWorkers, 1, __ATOMIC_RELAXED);
+			
+			[self runJob:job];
+			
+			__atomic_sub_fetch(&_busyWorkers, 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&deque->jobStartTime, 0, __ATOMIC_RELAXED);
+			
+			startTime = __atomic_load_n(&_statisticsStartTime, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&_busyMicroseconds, CurrentMicroseconds() - (jobStartTime > startTime ? jobStartTime : startTime), __ATOMIC_RELAXED);
+			
+			pthread_mutex_lock(&deque->mutex);
+			deque->load -= job->_cost;
+			pthread_mutex_unlock(&deque->mutex);
+			
+			[self finishJob:job];
+			[job release];
+		}
+		
+		[pool release];
+	}
+}
+
+- (void) groupThreadMain:(TaskSchedulerJob *)job
+{
+	NSAutoreleasePool *pool = nil;
+	
+	[job retain];
+	
+	// The thread takes over the members held back while it was busy, and exits once there are none
+	while(nil != job) {
+		pool = [[NSAutoreleasePool alloc] init];
+		
+		[self runJob:job];
+		[job release];
+		job = nil;
+		
+		pthread_mutex_lock(&_groupMutex);
+		if(0 != [_heldFollowers count]) {
+			job = [[_heldFollowers objectAtIndex:0] retain];
+			[_heldFollowers removeObjectAtIndex:0];
+		}
+		else
+			__atomic_sub_fetch(&_groupThreads, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&_groupMutex);
+		
+		[pool release];
+	}
+}
+
+- (void) enqueueJob:(TaskSchedulerJob *)job
+{
+	struct TaskSchedulerDeque	*deque			= NULL;
+	double						minimumLoad		= DBL_MAX;
+	NSUInteger					i;
+	
+	// Greedy longest-processing-time placement: the job goes to the least loaded worker
+	for(i = 0; i < _workerCount; ++i) {
+		pthread_mutex_lock(&_deques[i].mutex);
+		if(_deques[i].load < minimumLoad) {
+			minimumLoad			= _deques[i].load;
+			deque				= &_deques[i];
+			job->_dequeIndex	= i;
+		}
+		pthread_mutex_unlock(&_deques[i].mutex);
+	}
+	
+	pthread_mutex_lock(&deque->mutex);
+	[self insertJob:job intoDeque:deque];
+	deque->queuedCost	+= job->_cost;
+	deque->load			+= job->_cost;
+	pthread_mutex_unlock(&deque->mutex);
+	
+	// Wake every idle worker, since the owner of the deque may be busy
+	[_condition lock];
+	++_queuedJobs;
+	[_condition broadcast];
+	[_condition unlock];
+}
+
+- (void) insertJob:(TaskSchedulerJob *)job intoDeque:(struct TaskSchedulerDeque *)deque
+{
+	NSUInteger i;
+	
+	for(i = 0; i < [deque->jobs count]; ++i) {
+		if(((TaskSchedulerJob *)[deque->jobs objectAtIndex:i])->_cost < job->_cost)
+			break;
+	}
+	
+	[deque->jobs insertObject:job atIndex:i];
+}
+
+- (void) addFollower:(TaskSchedulerJob *)job toLeader:(TaskSchedulerJob *)leader
+{
+	struct TaskSchedulerDeque *deque = &_deques[leader->_dequeIndex];
+	
+	pthread_mutex_lock(&deque->mutex);
+	
+	[leader->_followers addObject:job];
+	
+	// The group runs as a unit, so it is ordered by its combined cost
+	if(NSNotFound != [deque->jobs indexOfObjectIdenticalTo:leader]) {
+		[deque->jobs removeObjectIdenticalTo:leader];
+		leader->_cost		+= job->_cost;
+		deque->queuedCost	+= job->_cost;
+		deque->load			+= job->_cost;
+		[self insertJob:leader intoDeque:deque];
+	}
+	
+	pthread_mutex_unlock(&deque->mutex);
+}
+
+- (void) startFollower:(TaskSchedulerJob *)job
+{
+	BOOL startThread = NO;
+	
+	// A group as large as a cue sheet's every track in every format would otherwise start hundreds of threads;
+	// a member held back is started late, and DecoderFanOut gives it a private decoder if the window has moved on
+	pthread_mutex_lock(&_groupMutex);
+	if(__atomic_load_n(&_groupThreads, __ATOMIC_RELAXED) < _workerCount) {
+		__atomic_add_fetch(&_groupThreads, 1, __ATOMIC_RELAXED);
+		startThread = YES;
+	}
+	else
+		[_heldFollowers addObject:job];
+	pthread_mutex_unlock(&_groupMutex);
+	
+	if(startThread)
+		[NSThread detachNewThreadSelector:@selector(groupThreadMain:) toTarget:self withObject:job];
+}
+
+- (TaskSchedulerJob *) takeJobForWorker:(NSUInteger)workerIndex
+{
+	struct TaskSchedulerDeque	*deque			= &_deques[workerIndex];
+	struct TaskSchedulerDeque	*victim			= NULL;
+	TaskSchedulerJob			*job			= nil;
+	double						maximumCost		= 0;
+	NSUInteger					i;
+	
+	pthread_mutex_lock(&deque->mutex);
+	if(0 != [deque->jobs count]) {
+		job = [[deque->jobs objectAtIndex:0] retain];
+		[deque->jobs removeObjectAtIndex:0];
+		deque->queuedCost -= job->_cost;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	
+	// Steal the longest job queued behind the busiest worker
+	if(nil == job) {
+		for(i = 0; i < _workerCount; ++i) {
+			if(i == workerIndex)
+				continue;
+			
+			pthread_mutex_lock(&_deques[i].mutex);
+			if(0 != [_deques[i].jobs count] && _deques[i].queuedCost >= maximumCost) {
+				maximumCost		= _deques[i].queuedCost;
+				victim			= &_deques[i];
+			}
+			pthread_mutex_unlock(&_deques[i].mutex);
+		}
+		
+		if(NULL != victim) {
+			pthread_mutex_lock(&victim->mutex);
+			if(0 != [victim->jobs count]) {
+				job = [[victim->jobs objectAtIndex:0] retain];
+				[victim->jobs removeObjectAtIndex:0];
+				victim->queuedCost	-= job->_cost;
+				victim->load		-= job->_cost;
+			}
+			pthread_mutex_unlock(&victim->mutex);
+		}
+		
+		if(nil != job) {
+			pthread_mutex_lock(&deque->mutex);
+			deque->load			+= job->_cost;
+			job->_dequeIndex	= workerIndex;
+			pthread_mutex_unlock(&deque->mutex);
+			
+			__atomic_add_fetch(&_stolenJobs, 1, __ATOMIC_RELAXED);
+		}
+	}
+	
+	if(nil != job) {
+		[_condition lock];
+		--_queuedJobs;
+		[_condition unlock];
+	}
+	
+	return job;
+}
+
+- (void) startFollowersOfJob:(TaskSchedulerJob *)job
+{
+	NSArray				*followers		= nil;
+	TaskSchedulerJob	*follower		= nil;
+	
+	if(nil == job->_group)
+		return;
+	
+	pthread_mutex_lock(&_groupMutex);
+	job->_taken		= YES;
+	followers		= [[job->_followers copy] autorelease];
+	[job->_followers removeAllObjects];
+	pthread_mutex_unlock(&_groupMutex);
+	
+	for(follower in followers)
+		[self startFollower:follower];
+}
+
+- (void) runJob:(TaskSchedulerJob *)job
+{
+	@try {
+		[job->_target performSelector:job->_selector withObject:job->_argument];
+	}
+	
+	@catch(NSException *exception) {
+		NSLog(@"%@", exception);
+	}
+	
+	__atomic_add_fetch(&_completedJobs, 1, __ATOMIC_RELAXED);
+}
+
+- (void) finishJob:(TaskSchedulerJob *)job
+{
+	if(nil == job->_group)
+		return;
+	
+	pthread_mutex_lock(&_groupMutex);
+	if(job == [_groupLeaders objectForKey:job->_group])
+		[_groupLeaders removeObjectForKey:job->_group];
+	pthread_mutex_unlock(&_groupMutex);
+}
+
+@end
@@ -0,0 +1,59 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// The phases a task can report
+enum {
+	kTaskPhaseNone					= 0,
+	kTaskPhaseRipping				= 1,
+	kTaskPhaseVerifying				= 2,
+	kTaskPhaseReRipping				= 3,
+	kTaskPhaseSaving				= 4
+};
+
+// Progress and cancellation state shared between a Task and the thread doing its work
+// Every method is lock-free, so workers can update it and check for cancellation on each chunk;
+// the owning controller samples it on a timer instead of being messaged
+@interface TaskStatus : NSObject
+{
+	int64_t			_completedUnits;
+	int64_t			_totalUnits;
+	int64_t			_phaseStartTime;
+	uint32_t		_phase;
+	uint32_t		_shouldStop;
+}
+
+// Called by the worker
+- (void)			beginPhase:(unsigned)phase totalUnits:(int64_t)totalUnits;
+- (void)			setCompletedUnits:(int64_t)completedUnits;
+
+- (BOOL)			shouldStop;
+
+// Called by the task
+- (void)			setShouldStop:(BOOL)shouldStop;
+
+- (unsigned)		phase;
+
+// Measured from the most recent call to beginPhase:totalUnits:
+- (NSTimeInterval)	secondsInPhase;
+
+// In the range [0, 1]
+- (double)			fractionComplete;
+
+@end
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "TaskStatus.h"
+
+@implementation TaskStatus
+
+- (void) beginPhase:(unsigned)phase totalUnits:(int64_t)totalUnits
+{
+	__atomic_store_n(&_completedUnits, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&_totalUnits, totalUnits, __ATOMIC_RELAXED);
+	__atomic_store_n(&_phaseStartTime, (int64_t)(CFAbsoluteTimeGetCurrent() * 1000000.0), __ATOMIC_RELAXED);
+	__atomic_store_n(&_phase, phase, __ATOMIC_RELEASE);
+}
+
+- (void)		setCompletedUnits:(int64_t)completedUnits		{ __atomic_store_n(&_completedUnits, completedUnits, __ATOMIC_RELAXED); }
+
+- (BOOL)		shouldStop										{ return 0 != __atomic_load_n(&_shouldStop, __ATOMIC_RELAXED); }
+- (void)		setShouldStop:(BOOL)shouldStop					{ __atomic_store_n(&_shouldStop, (shouldStop ? 1 : 0), __ATOMIC_RELAXED); }
+
+- (unsigned)	phase											{ return __atomic_load_n(&_phase, __ATOMIC_ACQUIRE); }
+
+- (NSTimeInterval) secondsInPhase
+{
+	int64_t phaseStartTime = __atomic_load_n(&_phaseStartTime, __ATOMIC_RELAXED);
+	return CFAbsoluteTimeGetCurrent() - (phaseStartTime / 1000000.0);
+}
+
+- (double) fractionComplete
+{
+	int64_t		completedUnits		= __atomic_load_n(&_completedUnits, __ATOMIC_RELAXED);
+	int64_t		totalUnits			= __atomic_load_n(&_totalUnits, __ATOMIC_RELAXED);
+	
+	// The two values are not read together, so a sample taken across a phase change may be inconsistent
+	if(0 >= totalUnits || 0 >= completedUnits)
+		return 0;
+	else if(completedUnits >= totalUnits)
+		return 1;
+	
+	return (double)completedUnits / (double)totalUnits;
+}
+
+@end
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "C2ErrorScan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define C2_USE_SSE2	1
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  define C2_USE_NEON	1
+#  include <arm_neon.h>
+#endif
+
+// Nonzero if any of the len bytes at p is nonzero
+static inline int
+AnyFlagRaised(const uint8_t *p, size_t len)
+{
+	size_t		i		= 0;
+	uint64_t	word;
+	uint64_t	acc		= 0;
+	
+#if C2_USE_SSE2
+	__m128i		vacc	= _mm_setzero_si128();
+	for(; i + 16 <= len; i += 16)
+		vacc = _mm_or_si128(vacc, _mm_loadu_si128((const __m128i *)(p + i)));
+	if(0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(vacc, _mm_setzero_si128())))
+		return 1;
+#elif C2_USE_NEON
+	uint8x16_t	vacc	= vdupq_n_u8(0);
+	for(; i + 16 <= len; i += 16)
+		vacc = vorrq_u8(vacc, vld1q_u8(p + i));
+	if(0 != vmaxvq_u8(vacc))
+		return 1;
+#endif
+	
+	for(; i + sizeof(word) <= len; i += sizeof(word)) {
+		memcpy(&word, p + i, sizeof(word));
+		acc |= word;
+	}
+	for(; i < len; ++i)
+		acc |= p[i];
+	
+	return (0 != acc);
+}
+
+size_t
+C2ErrorScan(const uint8_t *flags, size_t stride, size_t flagLength, size_t sectorCount, uint32_t *errors)
+{
+	size_t		i;
+	size_t		errorCount	= 0;
+	
+	memset(errors, 0, ((sectorCount + 31) / 32) * sizeof(uint32_t));
+	
+	for(i = 0; i < sectorCount; ++i, flags += stride) {
+		if(AnyFlagRaised(flags, flagLength)) {
+			errors[i / 32] |= (uint32_t)1 << (i % 32);
+			++errorCount;
+		}
+	}
+	
+	return errorCount;
+}
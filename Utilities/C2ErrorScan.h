@@ -0,0 +1,36 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reduce the C2 error pointers of sectorCount sectors to one bit per sector
+//   flags		the first sector's error pointers; each following sector's are stride bytes further on
+//   flagLength	the number of error pointer bytes per sector
+//   errors		receives bit (i % 32) of word (i / 32) set if any pointer of sector i is raised;
+//				it must hold (sectorCount + 31) / 32 words
+// Returns the number of sectors with errors
+size_t	C2ErrorScan(const uint8_t *flags, size_t stride, size_t flagLength, size_t sectorCount, uint32_t *errors);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#include <sys/types.h>
+
+// A MappedFile maps a whole file read-only, for decoders that read their input through it:
+//   - Libraries that accept a buffer are handed pointers into the mapping
+//   - Libraries that pull their input through callbacks read from a cursor, copying
+//     straight from the mapping instead of through a stdio buffer
+//   - The kernel is told the file will be read sequentially, so it reads ahead aggressively
+@interface MappedFile : NSObject
+{
+	NSString		*_filename;
+	const uint8_t	*_bytes;
+	size_t			_length;
+	time_t			_modificationTime;
+	size_t			_offset;
+}
+
+// Returns nil if the file could not be opened or mapped
++ (id)				mappedFileWithFilename:(NSString *)filename;
+- (id)				initWithFilename:(NSString *)filename;
+
+- (NSString *)		filename;
+- (time_t)			modificationTime;
+
+// The file's contents; NULL for an empty file
+- (const uint8_t *)	bytes;
+- (size_t)			length;
+
+// The cursor
+- (size_t)			offset;
+- (BOOL)			seekToOffset:(off_t)offset;
+- (BOOL)			seekToOffset:(off_t)offset whence:(int)whence;
+- (BOOL)			atEnd;
+
+// Copies up to length bytes from the cursor and advances it; returns the number of bytes copied
+- (size_t)			readBytes:(void *)buffer length:(size_t)length;
+
+@end
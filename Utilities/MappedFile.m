@@ -0,0 +1,131 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "MappedFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+@implementation MappedFile
+
++ (id) mappedFileWithFilename:(NSString *)filename
+{
+	return [[[MappedFile alloc] initWithFilename:filename] autorelease];
+}
+
+- (id) initWithFilename:(NSString *)filename
+{
+	NSParameterAssert(nil != filename);
+	
+	if((self = [super init])) {
+		struct stat		sourceStat;
+		void			*bytes;
+		int				fd;
+		
+		_filename = [filename retain];
+		
+		fd = open([filename fileSystemRepresentation], O_RDONLY);
+		if(-1 == fd) {
+			[self release];
+			return nil;
+		}
+		
+		if(-1 == fstat(fd, &sourceStat)) {
+			close(fd);
+			[self release];
+			return nil;
+		}
+		
+		// mmap() refuses empty files, but there is nothing to read from them anyway
+		_length = (size_t)sourceStat.st_size;
+		_modificationTime = sourceStat.st_mtime;
+		if(0 < _length) {
+			bytes = mmap(NULL, _length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(MAP_FAILED == bytes) {
+				close(fd);
+				[self release];
+				return nil;
+			}
+			
+			_bytes = bytes;
+			madvise(bytes, _length, MADV_SEQUENTIAL);
+		}
+		
+		// The mapping stays valid once the descriptor is closed
+		close(fd);
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(NULL != _bytes) {
+		munmap((void *)_bytes, _length);
+		_bytes = NULL;
+	}
+	
+	[_filename release];		_filename = nil;
+	
+	[super dealloc];
+}
+
+- (NSString *)		filename						{ return [[_filename retain] autorelease]; }
+- (time_t)			modificationTime				{ return _modificationTime; }
+
+- (const uint8_t *)	bytes							{ return _bytes; }
+- (size_t)			length							{ return _length; }
+
+- (size_t)			offset							{ return _offset; }
+- (BOOL)			seekToOffset:(off_t)offset		{ return [self seekToOffset:offset whence:SEEK_SET]; }
+- (BOOL)			atEnd							{ return (_offset >= _length); }
+
+- (BOOL) seekToOffset:(off_t)offset whence:(int)whence
+{
+	off_t		base;
+	
+	switch(whence) {
+		case SEEK_SET:		base = 0;					break;
+		case SEEK_CUR:		base = (off_t)_offset;		break;
+		case SEEK_END:		base = (off_t)_length;		break;
+		default:			return NO;
+	}
+	
+	// As with lseek(), the cursor may move past the end but not before the start
+	if(0 > base + offset)
+		return NO;
+	
+	_offset = (size_t)(base + offset);
+	return YES;
+}
+
+- (size_t) readBytes:(void *)buffer length:(size_t)length
+{
+	size_t		available		= (_offset < _length ? _length - _offset : 0);
+	size_t		count			= (length < available ? length : available);
+	
+	if(0 < count) {
+		memcpy(buffer, _bytes + _offset, count);
+		_offset += count;
+	}
+	
+	return count;
+}
+
+@end
@@ -0,0 +1,810 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "PCMConversion.h"
+
+#include <libkern/OSByteOrder.h>
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define PCM_USE_X86	1
+#  include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  define PCM_USE_NEON	1
+#  include <arm_neon.h>
+#endif
+
+// The vector kernels load and store host-order words, so only enable them on little-endian hosts
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#  undef PCM_USE_X86
+#  undef PCM_USE_NEON
+#endif
+
+// The number of samples converted at a time when a conversion needs an intermediate buffer
+#define PCM_CHUNK_SAMPLES		1024
+
+#pragma mark Kernels
+
+typedef struct {
+	const char	*name;
+	
+	void		(*unpackBigEndian16)(const uint8_t *src, int32_t *dst, size_t count);
+	void		(*unpackBigEndian24)(const uint8_t *src, int32_t *dst, size_t count);
+	void		(*unpackBigEndian32)(const uint8_t *src, int32_t *dst, size_t count);
+	
+	void		(*packBigEndian16)(const int32_t *src, uint8_t *dst, size_t count);
+	void		(*packBigEndian24)(const int32_t *src, uint8_t *dst, size_t count);
+	void		(*packBigEndian32)(const int32_t *src, uint8_t *dst, size_t count);
+	
+	void		(*deinterleaveStereo)(const int32_t *src, int32_t *left, int32_t *right, size_t frameCount);
+	void		(*interleaveStereo)(const int32_t *left, const int32_t *right, int32_t *dst, size_t frameCount);
+	
+	void		(*toFloat)(const int32_t *src, float *dst, size_t count, float scale);
+	void		(*shiftLeft)(int32_t *samples, size_t count, unsigned shift);
+} PCMKernels;
+
+#pragma mark Scalar
+
+static void
+ScalarUnpackBigEndian16(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i, src += 2)
+		dst[i] = (int16_t)OSReadBigInt16(src, 0);
+}
+
+static void
+ScalarUnpackBigEndian24(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i, src += 3)
+		dst[i] = (int32_t)(((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8)) >> 8;
+}
+
+static void
+ScalarUnpackBigEndian32(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i, src += 4)
+		dst[i] = (int32_t)OSReadBigInt32(src, 0);
+}
+
+static void
+ScalarPackBigEndian16(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i, dst += 2)
+		OSWriteBigInt16(dst, 0, (uint16_t)src[i]);
+}
+
+static void
+ScalarPackBigEndian24(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i) {
+		*dst++	= (uint8_t)(src[i] >> 16);
+		*dst++	= (uint8_t)(src[i] >> 8);
+		*dst++	= (uint8_t)src[i];
+	}
+}
+
+static void
+ScalarPackBigEndian32(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i, dst += 4)
+		OSWriteBigInt32(dst, 0, (uint32_t)src[i]);
+}
+
+static void
+ScalarDeinterleaveStereo(const int32_t *src, int32_t *left, int32_t *right, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i < frameCount; ++i, src += 2) {
+		left[i]		= src[0];
+		right[i]	= src[1];
+	}
+}
+
+static void
+ScalarInterleaveStereo(const int32_t *left, const int32_t *right, int32_t *dst, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i < frameCount; ++i, dst += 2) {
+		dst[0]	= left[i];
+		dst[1]	= right[i];
+	}
+}
+
+static void
+ScalarToFloat(const int32_t *src, float *dst, size_t count, float scale)
+{
+	int32_t		sample;
+	size_t		i;
+	
+	// Load through memcpy since the conversion may be done in place
+	for(i = 0; i < count; ++i) {
+		memcpy(&sample, src + i, sizeof(sample));
+		dst[i] = sample * scale;
+	}
+}
+
+static void
+ScalarShiftLeft(int32_t *samples, size_t count, unsigned shift)
+{
+	size_t i;
+	for(i = 0; i < count; ++i)
+		samples[i] = (int32_t)((uint32_t)samples[i] << shift);
+}
+
+static const PCMKernels sScalarKernels = {
+	"scalar",
+	ScalarUnpackBigEndian16, ScalarUnpackBigEndian24, ScalarUnpackBigEndian32,
+	ScalarPackBigEndian16, ScalarPackBigEndian24, ScalarPackBigEndian32,
+	ScalarDeinterleaveStereo, ScalarInterleaveStereo,
+	ScalarToFloat, ScalarShiftLeft
+};
+
+#if PCM_USE_X86
+
+#pragma mark SSE2
+
+static inline __m128i
+SSE2ByteSwap16(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i
+SSE2ByteSwap32(__m128i v)
+{
+	v = SSE2ByteSwap16(v);
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static void
+SSE2UnpackBigEndian16(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 8 <= count; i += 8) {
+		__m128i v = SSE2ByteSwap16(_mm_loadu_si128((const __m128i *)(src + 2 * i)));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+		_mm_storeu_si128((__m128i *)(dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+	}
+	ScalarUnpackBigEndian16(src + 2 * i, dst + i, count - i);
+}
+
+static void
+SSE2UnpackBigEndian32(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + i), SSE2ByteSwap32(_mm_loadu_si128((const __m128i *)(src + 4 * i))));
+	ScalarUnpackBigEndian32(src + 4 * i, dst + i, count - i);
+}
+
+static void
+SSE2PackBigEndian16(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	
+	// Sign extend the low half of each word first, so the saturating pack truncates like the scalar path
+	for(i = 0; i + 8 <= count; i += 8) {
+		__m128i a = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 16), 16);
+		__m128i b = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), 16), 16);
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), SSE2ByteSwap16(_mm_packs_epi32(a, b)));
+	}
+	ScalarPackBigEndian16(src + i, dst + 2 * i, count - i);
+}
+
+static void
+SSE2PackBigEndian32(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + 4 * i), SSE2ByteSwap32(_mm_loadu_si128((const __m128i *)(src + i))));
+	ScalarPackBigEndian32(src + i, dst + 4 * i, count - i);
+}
+
+static void
+SSE2DeinterleaveStereo(const int32_t *src, int32_t *left, int32_t *right, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i + 4 <= frameCount; i += 4) {
+		__m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 2 * i)));
+		__m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 2 * i + 4)));
+		_mm_storeu_si128((__m128i *)(left + i), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+		_mm_storeu_si128((__m128i *)(right + i), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+	}
+	ScalarDeinterleaveStereo(src + 2 * i, left + i, right + i, frameCount - i);
+}
+
+static void
+SSE2InterleaveStereo(const int32_t *left, const int32_t *right, int32_t *dst, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i + 4 <= frameCount; i += 4) {
+		__m128i l = _mm_loadu_si128((const __m128i *)(left + i));
+		__m128i r = _mm_loadu_si128((const __m128i *)(right + i));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi32(l, r));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 4), _mm_unpackhi_epi32(l, r));
+	}
+	ScalarInterleaveStereo(left + i, right + i, dst + 2 * i, frameCount - i);
+}
+
+static void
+SSE2ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+{
+	__m128	s	= _mm_set1_ps(scale);
+	size_t	i;
+	for(i = 0; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i))), s));
+	ScalarToFloat(src + i, dst + i, count - i, scale);
+}
+
+static void
+SSE2ShiftLeft(int32_t *samples, size_t count, unsigned shift)
+{
+	__m128i	s	= _mm_cvtsi32_si128((int)shift);
+	size_t	i;
+	for(i = 0; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(samples + i), _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(samples + i)), s));
+	ScalarShiftLeft(samples + i, count - i, shift);
+}
+
+// SSE2 has no byte shuffle, so 24-bit samples stay scalar
+static const PCMKernels sSSE2Kernels = {
+	"SSE2",
+	SSE2UnpackBigEndian16, ScalarUnpackBigEndian24, SSE2UnpackBigEndian32,
+	SSE2PackBigEndian16, ScalarPackBigEndian24, SSE2PackBigEndian32,
+	SSE2DeinterleaveStereo, SSE2InterleaveStereo,
+	SSE2ToFloat, SSE2ShiftLeft
+};
+
+#pragma mark AVX2
+
+#define PCM_AVX2	__attribute__((target("avx2")))
+
+PCM_AVX2 static void
+AVX2UnpackBigEndian16(const uint8_t *src, int32_t *dst, size_t count)
+{
+	const __m128i	swap	= _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	size_t			i;
+	for(i = 0; i + 8 <= count; i += 8) {
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2 * i)), swap);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtepi16_epi32(v));
+	}
+	ScalarUnpackBigEndian16(src + 2 * i, dst + i, count - i);
+}
+
+PCM_AVX2 static void
+AVX2UnpackBigEndian24(const uint8_t *src, int32_t *dst, size_t count)
+{
+	// Move each sample's bytes to the top of a word, then shift down to sign extend
+	const __m128i	spread	= _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+	size_t			i;
+	
+	// Each step reads 16 bytes but consumes only 12, so stop while a full load is still in bounds
+	for(i = 0; i + 6 <= count; i += 4) {
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 3 * i)), spread);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(v, 8));
+	}
+	ScalarUnpackBigEndian24(src + 3 * i, dst + i, count - i);
+}
+
+PCM_AVX2 static void
+AVX2UnpackBigEndian32(const uint8_t *src, int32_t *dst, size_t count)
+{
+	const __m256i	swap	= _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+											   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t			i;
+	for(i = 0; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 4 * i)), swap));
+	ScalarUnpackBigEndian32(src + 4 * i, dst + i, count - i);
+}
+
+PCM_AVX2 static void
+AVX2PackBigEndian16(const int32_t *src, uint8_t *dst, size_t count)
+{
+	// Keep the low half of each word, byte swapped, then gather both lanes' results
+	const __m256i	narrow	= _mm256_setr_epi8(1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1,
+											   1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1);
+	size_t			i;
+	for(i = 0; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i)), narrow);
+		v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), _mm256_castsi256_si128(v));
+	}
+	ScalarPackBigEndian16(src + i, dst + 2 * i, count - i);
+}
+
+PCM_AVX2 static void
+AVX2PackBigEndian24(const int32_t *src, uint8_t *dst, size_t count)
+{
+	const __m128i	gather	= _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t			i;
+	for(i = 0; i + 4 <= count; i += 4) {
+		__m128i		v		= _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), gather);
+		int32_t		tail	= _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		
+		_mm_storel_epi64((__m128i *)(dst + 3 * i), v);
+		memcpy(dst + 3 * i + 8, &tail, sizeof(tail));
+	}
+	ScalarPackBigEndian24(src + i, dst + 3 * i, count - i);
+}
+
+PCM_AVX2 static void
+AVX2PackBigEndian32(const int32_t *src, uint8_t *dst, size_t count)
+{
+	const __m256i	swap	= _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+											   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t			i;
+	for(i = 0; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i)), swap));
+	ScalarPackBigEndian32(src + i, dst + 4 * i, count - i);
+}
+
+PCM_AVX2 static void
+AVX2DeinterleaveStereo(const int32_t *src, int32_t *left, int32_t *right, size_t frameCount)
+{
+	const __m256i	split	= _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	size_t			i;
+	for(i = 0; i + 8 <= frameCount; i += 8) {
+		__m256i a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(src + 2 * i)), split);
+		__m256i b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(src + 2 * i + 8)), split);
+		_mm256_storeu_si256((__m256i *)(left + i), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(right + i), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	SSE2DeinterleaveStereo(src + 2 * i, left + i, right + i, frameCount - i);
+}
+
+PCM_AVX2 static void
+AVX2InterleaveStereo(const int32_t *left, const int32_t *right, int32_t *dst, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i + 8 <= frameCount; i += 8) {
+		__m256i l	= _mm256_loadu_si256((const __m256i *)(left + i));
+		__m256i r	= _mm256_loadu_si256((const __m256i *)(right + i));
+		__m256i lo	= _mm256_unpacklo_epi32(l, r);
+		__m256i hi	= _mm256_unpackhi_epi32(l, r);
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	SSE2InterleaveStereo(left + i, right + i, dst + 2 * i, frameCount - i);
+}
+
+PCM_AVX2 static void
+AVX2ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+{
+	__m256	s	= _mm256_set1_ps(scale);
+	size_t	i;
+	for(i = 0; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i))), s));
+	ScalarToFloat(src + i, dst + i, count - i, scale);
+}
+
+PCM_AVX2 static void
+AVX2ShiftLeft(int32_t *samples, size_t count, unsigned shift)
+{
+	__m128i	s	= _mm_cvtsi32_si128((int)shift);
+	size_t	i;
+	for(i = 0; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(samples + i), _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)(samples + i)), s));
+	ScalarShiftLeft(samples + i, count - i, shift);
+}
+
+static const PCMKernels sAVX2Kernels = {
+	"AVX2",
+	AVX2UnpackBigEndian16, AVX2UnpackBigEndian24, AVX2UnpackBigEndian32,
+	AVX2PackBigEndian16, AVX2PackBigEndian24, AVX2PackBigEndian32,
+	AVX2DeinterleaveStereo, AVX2InterleaveStereo,
+	AVX2ToFloat, AVX2ShiftLeft
+};
+
+#endif /* PCM_USE_X86 */
+
+#if PCM_USE_NEON
+
+#pragma mark NEON
+
+static void
+NEONUnpackBigEndian16(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 8 <= count; i += 8) {
+		int16x8_t v = vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(src + 2 * i)));
+		vst1q_s32(dst + i, vmovl_s16(vget_low_s16(v)));
+		vst1q_s32(dst + i + 4, vmovl_s16(vget_high_s16(v)));
+	}
+	ScalarUnpackBigEndian16(src + 2 * i, dst + i, count - i);
+}
+
+static void
+NEONUnpackBigEndian24(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	
+	// Build each word as (MSB << 24) | (middle << 16) | (LSB << 8), then shift down to sign extend
+	for(i = 0; i + 16 <= count; i += 16) {
+		uint8x16x3_t	bytes	= vld3q_u8(src + 3 * i);
+		uint8x16_t		zero	= vdupq_n_u8(0);
+		uint16x8_t		lowLo	= vreinterpretq_u16_u8(vzip1q_u8(zero, bytes.val[2]));
+		uint16x8_t		lowHi	= vreinterpretq_u16_u8(vzip2q_u8(zero, bytes.val[2]));
+		uint16x8_t		highLo	= vreinterpretq_u16_u8(vzip1q_u8(bytes.val[1], bytes.val[0]));
+		uint16x8_t		highHi	= vreinterpretq_u16_u8(vzip2q_u8(bytes.val[1], bytes.val[0]));
+		
+		vst1q_s32(dst + i,		vshrq_n_s32(vreinterpretq_s32_u16(vzip1q_u16(lowLo, highLo)), 8));
+		vst1q_s32(dst + i + 4,	vshrq_n_s32(vreinterpretq_s32_u16(vzip2q_u16(lowLo, highLo)), 8));
+		vst1q_s32(dst + i + 8,	vshrq_n_s32(vreinterpretq_s32_u16(vzip1q_u16(lowHi, highHi)), 8));
+		vst1q_s32(dst + i + 12,	vshrq_n_s32(vreinterpretq_s32_u16(vzip2q_u16(lowHi, highHi)), 8));
+	}
+	ScalarUnpackBigEndian24(src + 3 * i, dst + i, count - i);
+}
+
+static void
+NEONUnpackBigEndian32(const uint8_t *src, int32_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 4 <= count; i += 4)
+		vst1q_s32(dst + i, vreinterpretq_s32_u8(vrev32q_u8(vld1q_u8(src + 4 * i))));
+	ScalarUnpackBigEndian32(src + 4 * i, dst + i, count - i);
+}
+
+static void
+NEONPackBigEndian16(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 8 <= count; i += 8) {
+		int16x8_t v = vcombine_s16(vmovn_s32(vld1q_s32(src + i)), vmovn_s32(vld1q_s32(src + i + 4)));
+		vst1q_u8(dst + 2 * i, vrev16q_u8(vreinterpretq_u8_s16(v)));
+	}
+	ScalarPackBigEndian16(src + i, dst + 2 * i, count - i);
+}
+
+static inline uint8x16_t
+NEONNarrowBytes(int32x4_t a, int32x4_t b, int32x4_t c, int32x4_t d)
+{
+	uint16x8_t lo = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(a)), vmovn_u32(vreinterpretq_u32_s32(b)));
+	uint16x8_t hi = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(c)), vmovn_u32(vreinterpretq_u32_s32(d)));
+	return vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+}
+
+static void
+NEONPackBigEndian24(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 16 <= count; i += 16) {
+		int32x4_t		a		= vld1q_s32(src + i);
+		int32x4_t		b		= vld1q_s32(src + i + 4);
+		int32x4_t		c		= vld1q_s32(src + i + 8);
+		int32x4_t		d		= vld1q_s32(src + i + 12);
+		uint8x16x3_t	bytes;
+		
+		bytes.val[0]	= NEONNarrowBytes(vshrq_n_s32(a, 16), vshrq_n_s32(b, 16), vshrq_n_s32(c, 16), vshrq_n_s32(d, 16));
+		bytes.val[1]	= NEONNarrowBytes(vshrq_n_s32(a, 8), vshrq_n_s32(b, 8), vshrq_n_s32(c, 8), vshrq_n_s32(d, 8));
+		bytes.val[2]	= NEONNarrowBytes(a, b, c, d);
+		
+		vst3q_u8(dst + 3 * i, bytes);
+	}
+	ScalarPackBigEndian24(src + i, dst + 3 * i, count - i);
+}
+
+static void
+NEONPackBigEndian32(const int32_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for(i = 0; i + 4 <= count; i += 4)
+		vst1q_u8(dst + 4 * i, vrev32q_u8(vreinterpretq_u8_s32(vld1q_s32(src + i))));
+	ScalarPackBigEndian32(src + i, dst + 4 * i, count - i);
+}
+
+static void
+NEONDeinterleaveStereo(const int32_t *src, int32_t *left, int32_t *right, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i + 4 <= frameCount; i += 4) {
+		int32x4x2_t v = vld2q_s32(src + 2 * i);
+		vst1q_s32(left + i, v.val[0]);
+		vst1q_s32(right + i, v.val[1]);
+	}
+	ScalarDeinterleaveStereo(src + 2 * i, left + i, right + i, frameCount - i);
+}
+
+static void
+NEONInterleaveStereo(const int32_t *left, const int32_t *right, int32_t *dst, size_t frameCount)
+{
+	size_t i;
+	for(i = 0; i + 4 <= frameCount; i += 4) {
+		int32x4x2_t v;
+		v.val[0] = vld1q_s32(left + i);
+		v.val[1] = vld1q_s32(right + i);
+		vst2q_s32(dst + 2 * i, v);
+	}
+	ScalarInterleaveStereo(left + i, right + i, dst + 2 * i, frameCount - i);
+}
+
+static void
+NEONToFloat(const int32_t *src, float *dst, size_t count, float scale)
+{
+	size_t i;
+	for(i = 0; i + 4 <= count; i += 4)
+		vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), scale));
+	ScalarToFloat(src + i, dst + i, count - i, scale);
+}
+
+static void
+NEONShiftLeft(int32_t *samples, size_t count, unsigned shift)
+{
+	int32x4_t	s	= vdupq_n_s32((int32_t)shift);
+	size_t		i;
+	for(i = 0; i + 4 <= count; i += 4)
+		vst1q_s32(samples + i, vshlq_s32(vld1q_s32(samples + i), s));
+	ScalarShiftLeft(samples + i, count - i, shift);
+}
+
+static const PCMKernels sNEONKernels = {
+	"NEON",
+	NEONUnpackBigEndian16, NEONUnpackBigEndian24, NEONUnpackBigEndian32,
+	NEONPackBigEndian16, NEONPackBigEndian24, NEONPackBigEndian32,
+	NEONDeinterleaveStereo, NEONInterleaveStereo,
+	NEONToFloat, NEONShiftLeft
+};
+
+#endif /* PCM_USE_NEON */
+
+#pragma mark Dispatch
+
+static const PCMKernels		*sKernels				= &sScalarKernels;
+static const PCMKernels		*sAvailableKernels		[4];
+static size_t				sAvailableKernelCount	= 0;
+static pthread_once_t		sKernelsOnce			= PTHREAD_ONCE_INIT;
+
+static void
+SelectKernels(void)
+{
+	sAvailableKernels[sAvailableKernelCount++] = &sScalarKernels;
+	
+#if PCM_USE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+		sAvailableKernels[sAvailableKernelCount++] = &sSSE2Kernels;
+	if(__builtin_cpu_supports("avx2"))
+		sAvailableKernels[sAvailableKernelCount++] = &sAVX2Kernels;
+#elif PCM_USE_NEON
+	sAvailableKernels[sAvailableKernelCount++] = &sNEONKernels;
+#endif
+	
+	// The fastest is the last one found
+	sKernels = sAvailableKernels[sAvailableKernelCount - 1];
+}
+
+static inline const PCMKernels *
+Kernels(void)
+{
+	pthread_once(&sKernelsOnce, SelectKernels);
+	return sKernels;
+}
+
+const char *
+PCMConversionKernelName(void)
+{
+	return Kernels()->name;
+}
+
+size_t
+PCMConversionKernelCount(void)
+{
+	pthread_once(&sKernelsOnce, SelectKernels);
+	return sAvailableKernelCount;
+}
+
+const char *
+PCMConversionKernelNameAtIndex(size_t index)
+{
+	return (index < PCMConversionKernelCount() ? sAvailableKernels[index]->name : NULL);
+}
+
+// Not synchronized with conversions in progress, so only for use while nothing else is converting
+bool
+PCMConversionUseKernels(const char *name)
+{
+	size_t i;
+	
+	for(i = 0; i < PCMConversionKernelCount(); ++i) {
+		if(0 == strcmp(name, sAvailableKernels[i]->name)) {
+			sKernels = sAvailableKernels[i];
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+#pragma mark Conversions
+
+static bool
+UnpackBigEndian(const PCMKernels *kernels, const void *src, int32_t *dst, size_t count, unsigned bitsPerChannel)
+{
+	const int8_t	*src8	= (const int8_t *)src;
+	size_t			i;
+	
+	switch(bitsPerChannel) {
+		case 8:
+			for(i = 0; i < count; ++i)
+				dst[i] = src8[i];
+			break;
+		case 16:	kernels->unpackBigEndian16(src, dst, count);		break;
+		case 24:	kernels->unpackBigEndian24(src, dst, count);		break;
+		case 32:	kernels->unpackBigEndian32(src, dst, count);		break;
+		default:	return false;
+	}
+	
+	return true;
+}
+
+static bool
+PackBigEndian(const PCMKernels *kernels, const int32_t *src, void *dst, size_t count, unsigned bitsPerChannel)
+{
+	int8_t			*dst8	= (int8_t *)dst;
+	size_t			i;
+	
+	switch(bitsPerChannel) {
+		case 8:
+			for(i = 0; i < count; ++i)
+				dst8[i] = (int8_t)src[i];
+			break;
+		case 16:	kernels->packBigEndian16(src, dst, count);			break;
+		case 24:	kernels->packBigEndian24(src, dst, count);			break;
+		case 32:	kernels->packBigEndian32(src, dst, count);			break;
+		default:	return false;
+	}
+	
+	return true;
+}
+
+static void
+Deinterleave(const PCMKernels *kernels, const int32_t *src, int32_t * const *dst, size_t offset, unsigned channels, size_t frameCount)
+{
+	size_t			frame;
+	unsigned		channel;
+	
+	if(1 == channels)
+		memcpy(dst[0] + offset, src, frameCount * sizeof(int32_t));
+	else if(2 == channels)
+		kernels->deinterleaveStereo(src, dst[0] + offset, dst[1] + offset, frameCount);
+	else {
+		for(frame = offset; frame < offset + frameCount; ++frame) {
+			for(channel = 0; channel < channels; ++channel)
+				dst[channel][frame] = *src++;
+		}
+	}
+}
+
+static void
+Interleave(const PCMKernels *kernels, const int32_t * const *src, size_t offset, int32_t *dst, unsigned channels, size_t frameCount)
+{
+	size_t			frame;
+	unsigned		channel;
+	
+	if(1 == channels)
+		memcpy(dst, src[0] + offset, frameCount * sizeof(int32_t));
+	else if(2 == channels)
+		kernels->interleaveStereo(src[0] + offset, src[1] + offset, dst, frameCount);
+	else {
+		for(frame = offset; frame < offset + frameCount; ++frame) {
+			for(channel = 0; channel < channels; ++channel)
+				*dst++ = src[channel][frame];
+		}
+	}
+}
+
+bool
+PCMDeinterleaveBigEndianToInt32(const void *src, int32_t * const *dst, unsigned channels, unsigned bitsPerChannel, size_t frameCount)
+{
+	const PCMKernels	*kernels		= Kernels();
+	const uint8_t		*srcBytes		= (const uint8_t *)src;
+	size_t				bytesPerFrame	= channels * (bitsPerChannel / 8);
+	size_t				chunkFrames		= PCM_CHUNK_SAMPLES / channels;
+	size_t				frame, framesToConvert;
+	int32_t				chunk			[PCM_CHUNK_SAMPLES];
+	
+	if(1 == channels)
+		return UnpackBigEndian(kernels, src, dst[0], frameCount, bitsPerChannel);
+	
+	// Convert in cache-sized pieces, then split the channels
+	for(frame = 0; frame < frameCount; frame += framesToConvert) {
+		framesToConvert = (frameCount - frame < chunkFrames ? frameCount - frame : chunkFrames);
+		
+		if(false == UnpackBigEndian(kernels, srcBytes + frame * bytesPerFrame, chunk, framesToConvert * channels, bitsPerChannel))
+			return false;
+		
+		Deinterleave(kernels, chunk, dst, frame, channels, framesToConvert);
+	}
+	
+	return true;
+}
+
+bool
+PCMBigEndianToInt32(const void *src, int32_t *dst, size_t sampleCount, unsigned bitsPerChannel)
+{
+	return UnpackBigEndian(Kernels(), src, dst, sampleCount, bitsPerChannel);
+}
+
+void
+PCMDeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frameCount)
+{
+	Deinterleave(Kernels(), src, dst, 0, channels, frameCount);
+}
+
+void
+PCMInterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frameCount)
+{
+	Interleave(Kernels(), src, 0, dst, channels, frameCount);
+}
+
+bool
+PCMInterleaveInt32ToBigEndian(const int32_t * const *src, void *dst, unsigned channels, unsigned bitsPerChannel, size_t frameCount)
+{
+	const PCMKernels	*kernels		= Kernels();
+	uint8_t				*dstBytes		= (uint8_t *)dst;
+	size_t				bytesPerFrame	= channels * (bitsPerChannel / 8);
+	size_t				chunkFrames		= PCM_CHUNK_SAMPLES / channels;
+	size_t				frame, framesToConvert;
+	int32_t				chunk			[PCM_CHUNK_SAMPLES];
+	
+	if(1 == channels)
+		return PackBigEndian(kernels, src[0], dst, frameCount, bitsPerChannel);
+	
+	for(frame = 0; frame < frameCount; frame += framesToConvert) {
+		framesToConvert = (frameCount - frame < chunkFrames ? frameCount - frame : chunkFrames);
+		
+		Interleave(kernels, src, frame, chunk, channels, framesToConvert);
+		
+		if(false == PackBigEndian(kernels, chunk, dstBytes + frame * bytesPerFrame, framesToConvert * channels, bitsPerChannel))
+			return false;
+	}
+	
+	return true;
+}
+
+bool
+PCMInt32ToBigEndian(const int32_t *src, void *dst, size_t sampleCount, unsigned bitsPerChannel)
+{
+	return PackBigEndian(Kernels(), src, dst, sampleCount, bitsPerChannel);
+}
+
+void
+PCMInt32ToFloat(const int32_t *src, float *dst, size_t sampleCount, unsigned bitsPerChannel)
+{
+	Kernels()->toFloat(src, dst, sampleCount, 1.f / (float)(1UL << (bitsPerChannel - 1)));
+}
+
+void
+PCMInt32ToFloatWithScale(const int32_t *src, float *dst, size_t sampleCount, float scale)
+{
+	Kernels()->toFloat(src, dst, sampleCount, scale);
+}
+
+void
+PCMInt32ToFullScale(int32_t *samples, size_t sampleCount, unsigned bitsPerChannel)
+{
+	if(32 > bitsPerChannel)
+		Kernels()->shiftLeft(samples, sampleCount, 32 - bitsPerChannel);
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Conversions between big-endian interleaved PCM, as provided by -readAudio:frameCount:,
+// and the host-endian int32 samples used by the planar read methods.
+// Integer samples are right-justified, so a 16-bit sample lies in [-32768, 32767];
+// sample sizes other than 8, 16, 24 and 32 bits are not supported and return false.
+// The fastest implementation for the processor (SSE2, AVX2 or NEON) is chosen on first use.
+
+// The name of the implementation in use, for logging
+const char *	PCMConversionKernelName(void);
+
+// The implementations this processor can run, scalar first, and a way to switch between them for benchmarking
+size_t			PCMConversionKernelCount(void);
+const char *	PCMConversionKernelNameAtIndex(size_t index);
+bool			PCMConversionUseKernels(const char *name);
+
+// Convert big-endian samples to int32 with the same layout
+bool	PCMBigEndianToInt32(const void *src, int32_t *dst, size_t sampleCount, unsigned bitsPerChannel);
+
+// Split big-endian interleaved samples into one int32 buffer per channel
+bool	PCMDeinterleaveBigEndianToInt32(const void *src, int32_t * const *dst, unsigned channels, unsigned bitsPerChannel, size_t frameCount);
+
+// Split interleaved int32 samples into one buffer per channel
+void	PCMDeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frameCount);
+
+// Interleave one int32 buffer per channel
+void	PCMInterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frameCount);
+
+// Interleave one int32 buffer per channel into big-endian samples
+bool	PCMInterleaveInt32ToBigEndian(const int32_t * const *src, void *dst, unsigned channels, unsigned bitsPerChannel, size_t frameCount);
+
+// Convert interleaved int32 samples to big-endian samples with the same layout
+bool	PCMInt32ToBigEndian(const int32_t *src, void *dst, size_t sampleCount, unsigned bitsPerChannel);
+
+// Scale int32 samples to floats in [-1, 1); src and dst may be the same buffer
+void	PCMInt32ToFloat(const int32_t *src, float *dst, size_t sampleCount, unsigned bitsPerChannel);
+
+// Multiply int32 samples by scale and convert them to floats; src and dst may be the same buffer
+void	PCMInt32ToFloatWithScale(const int32_t *src, float *dst, size_t sampleCount, float scale);
+
+// Shift right-justified samples in place so they span the full range of int32
+void	PCMInt32ToFullScale(int32_t *samples, size_t sampleCount, unsigned bitsPerChannel);
+
+#ifdef __cplusplus
+}
+#endif
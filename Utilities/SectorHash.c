@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SectorHash.h"
+
+#include <CommonCrypto/CommonDigest.h>
+
+// The reference implementation, compiled into this file
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+size_t
+SectorHashLength(SectorHashAlgorithm algorithm)
+{
+	switch(algorithm) {
+		case kSectorHashAlgorithmSHA256:		return CC_SHA256_DIGEST_LENGTH;
+		case kSectorHashAlgorithmXXH3_128:		return sizeof(XXH128_canonical_t);
+		default:								return 0;
+	}
+}
+
+void
+SectorHash(SectorHashAlgorithm algorithm, const void *data, size_t len, uint8_t *hash)
+{
+	switch(algorithm) {
+		case kSectorHashAlgorithmSHA256:
+			CC_SHA256(data, (CC_LONG)len, hash);
+			break;
+			
+		case kSectorHashAlgorithmXXH3_128:
+			// The canonical form is big-endian, matching the reference tools' output
+			XXH128_canonicalFromHash((XXH128_canonical_t *)hash, XXH3_128bits(data, len));
+			break;
+	}
+}
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2005 - 2020 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hashes used to compare ripped sectors; they need only detect differing reads,
+// so a non-cryptographic hash is sufficient and considerably faster
+enum {
+	kSectorHashAlgorithmSHA256		= 0,		// SHA-256 via CommonCrypto, which uses the processor's SHA instructions when present
+	kSectorHashAlgorithmXXH3_128	= 1			// XXH3-128 from the reference xxHash (xxhash.h)
+};
+
+typedef unsigned SectorHashAlgorithm;
+
+// The longest hash produced by any algorithm, in bytes
+#define kSectorHashMaximumLength	32
+
+// The length of the hash produced by algorithm, or 0 if the algorithm is unknown
+size_t	SectorHashLength(SectorHashAlgorithm algorithm);
+
+// Hash len bytes of data into hash, which must hold SectorHashLength(algorithm) bytes
+void	SectorHash(SectorHashAlgorithm algorithm, const void *data, size_t len, uint8_t *hash);
+
+#ifdef __cplusplus
+}
+#endif